@@ -16,6 +16,7 @@ const char kNameKey[] = "name";
 const char kPlatformAppBackgroundKey[] = "app.background";
 const char kVersionKey[] = "version";
 const char kWebURLsKey[] = "app.urls";
+const char kXWalkExtensionsKey[] = "xwalk_extensions";
 }  // namespace application_manifest_keys
 
 namespace application_manifest_errors {
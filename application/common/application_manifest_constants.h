@@ -22,6 +22,7 @@ namespace application_manifest_keys {
   extern const char kPlatformAppBackgroundKey[];
   extern const char kVersionKey[];
   extern const char kWebURLsKey[];
+  extern const char kXWalkExtensionsKey[];
 }  // namespace application_manifest_keys
 
 namespace application_manifest_errors {
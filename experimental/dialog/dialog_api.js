@@ -8,9 +8,9 @@ var internal = extension._internal;
 // FIXME(tmpsantos): Simple methods like this should be automatically
 // created from the JSON Schema generated by the IDL file.
 exports.showOpenDialog = function(arg1, arg2, arg3, arg4, arg5, callback) {
-  internal.postMessage('showOpenDialog', [arg1, arg2, arg3, arg4, arg5], callback);
+  internal.postMessage(functionIds.showOpenDialog, [arg1, arg2, arg3, arg4, arg5], callback);
 };
 
 exports.showSaveDialog = function(arg1, arg2, arg3, callback) {
-  internal.postMessage('showSaveDialog', [arg1, arg2, arg3], callback);
+  internal.postMessage(functionIds.showSaveDialog, [arg1, arg2, arg3], callback);
 };
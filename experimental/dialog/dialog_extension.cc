@@ -7,7 +7,7 @@
 #include <utility>
 #include "base/strings/utf_string_conversions.h"
 #include "content/public/browser/browser_thread.h"
-#include "xwalk/jsapi/dialog.h"
+#include "xwalk/jsapi/dialog_functions.h"
 
 using content::BrowserThread;
 
@@ -24,6 +24,7 @@ DialogExtension::DialogExtension(RuntimeRegistry* runtime_registry)
     runtime_registry_(runtime_registry),
     owning_window_(NULL) {
   set_name("xwalk.experimental.dialog");
+  SetJavaScriptAPI(kFunctionIdsSource, kSource_dialog_api);
   runtime_registry_->AddObserver(this);
 }
 
@@ -31,10 +32,6 @@ DialogExtension::~DialogExtension() {
   runtime_registry_->RemoveObserver(this);
 }
 
-const char* DialogExtension::GetJavaScriptAPI() {
-  return kSource_dialog_api;
-}
-
 XWalkExtensionInstance* DialogExtension::CreateInstance(
   const XWalkExtension::PostMessageCallback& post_message) {
   return new DialogInstance(this, post_message);
@@ -52,8 +49,8 @@ DialogInstance::DialogInstance(DialogExtension* extension,
   : XWalkInternalExtensionInstance(post_message),
     extension_(extension),
     dialog_(NULL) {
-  RegisterFunction("showOpenDialog", &DialogInstance::OnShowOpenDialog);
-  RegisterFunction("showSaveDialog", &DialogInstance::OnShowSaveDialog);
+  RegisterFunction(kShowOpenDialog, &DialogInstance::OnShowOpenDialog);
+  RegisterFunction(kShowSaveDialog, &DialogInstance::OnShowSaveDialog);
 }
 
 DialogInstance::~DialogInstance() {
@@ -71,19 +68,11 @@ void DialogInstance::HandleMessage(scoped_ptr<base::Value> msg) {
   XWalkInternalExtensionInstance::HandleMessage(msg.Pass());
 }
 
-void DialogInstance::OnShowOpenDialog(const std::string& function_name,
-                                     const std::string& callback_id,
-                                     base::ListValue* args) {
+void DialogInstance::OnShowOpenDialog(
+    int callback_id,
+    scoped_ptr<ShowOpenDialog::Params> params) {
   CHECK(BrowserThread::CurrentlyOn(BrowserThread::UI));
 
-  scoped_ptr<ShowOpenDialog::Params>
-      params(ShowOpenDialog::Params::Create(*args));
-
-  if (!params) {
-    LOG(WARNING) << "Malformed parameters passed to " << function_name;
-    return;
-  }
-
   SelectFileDialog::Type dialog_type = SelectFileDialog::SELECT_OPEN_FILE;
   if (params->choose_directories)
     dialog_type = SelectFileDialog::SELECT_FOLDER;
@@ -96,8 +85,8 @@ void DialogInstance::OnShowOpenDialog(const std::string& function_name,
   // FIXME(jeez): implement file_type and file_extension support.
   base::FilePath::StringType file_extension;
 
-  std::pair<std::string, std::string>* data =
-      new std::pair<std::string, std::string>(function_name, callback_id);
+  std::pair<FunctionId, int>* data =
+      new std::pair<FunctionId, int>(kShowOpenDialog, callback_id);
 
   if (!dialog_)
     dialog_ = ui::SelectFileDialog::Create(this, 0 /* policy */);
@@ -108,19 +97,11 @@ void DialogInstance::OnShowOpenDialog(const std::string& function_name,
                       extension_->owning_window_, data);
 }
 
-void DialogInstance::OnShowSaveDialog(const std::string& function_name,
-                                     const std::string& callback_id,
-                                     base::ListValue* args) {
+void DialogInstance::OnShowSaveDialog(
+    int callback_id,
+    scoped_ptr<ShowSaveDialog::Params> params) {
   CHECK(BrowserThread::CurrentlyOn(BrowserThread::UI));
 
-  scoped_ptr<ShowSaveDialog::Params>
-      params(ShowSaveDialog::Params::Create(*args));
-
-  if (!params) {
-    LOG(WARNING) << "Malformed parameters passed to " << function_name;
-    return;
-  }
-
   string16 title16;
   UTF8ToUTF16(params->title.c_str(), params->title.length(), &title16);
 
@@ -130,8 +111,8 @@ void DialogInstance::OnShowSaveDialog(const std::string& function_name,
   if (!dialog_)
     dialog_ = ui::SelectFileDialog::Create(this, 0 /* policy */);
 
-  std::pair<std::string, std::string>* data =
-      new std::pair<std::string, std::string>(function_name, callback_id);
+  std::pair<FunctionId, int>* data =
+      new std::pair<FunctionId, int>(kShowSaveDialog, callback_id);
 
   base::FilePath filePath =
       base::FilePath::FromUTF8Unsafe(params->initial_path);
@@ -145,11 +126,11 @@ void DialogInstance::OnShowSaveDialog(const std::string& function_name,
 
 void DialogInstance::FileSelected(const base::FilePath& path, int,
                                  void* params) {
-  scoped_ptr<std::pair<std::string, std::string> >
-      data(static_cast<std::pair<std::string, std::string>*>(params));
+  scoped_ptr<std::pair<FunctionId, int> >
+      data(static_cast<std::pair<FunctionId, int>*>(params));
 
   std::string strPath = path.AsUTF8Unsafe();
-  if (data->first == "showOpenDialog") {
+  if (data->first == kShowOpenDialog) {
     std::vector<std::string> filesList;
     filesList.push_back(strPath);
     PostResult(data->second,
@@ -162,8 +143,8 @@ void DialogInstance::FileSelected(const base::FilePath& path, int,
 
 void DialogInstance::MultiFilesSelected(
     const std::vector<base::FilePath>& files, void* params) {
-  scoped_ptr<std::pair<std::string, std::string> >
-      data(static_cast<std::pair<std::string, std::string>*>(params));
+  scoped_ptr<std::pair<FunctionId, int> >
+      data(static_cast<std::pair<FunctionId, int>*>(params));
 
   std::vector<std::string> filesList;
   std::vector<base::FilePath>::const_iterator it;
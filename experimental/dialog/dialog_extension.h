@@ -11,6 +11,7 @@
 #include "base/values.h"
 #include "ui/shell_dialogs/select_file_dialog.h"
 #include "xwalk/extensions/browser/xwalk_extension_internal.h"
+#include "xwalk/jsapi/dialog.h"
 #include "xwalk/runtime/browser/runtime.h"
 #include "xwalk/runtime/browser/runtime_registry.h"
 
@@ -31,7 +32,6 @@ class DialogExtension : public XWalkInternalExtension,
   virtual ~DialogExtension();
 
   // XWalkExtension implementation.
-  virtual const char* GetJavaScriptAPI() OVERRIDE;
   virtual XWalkExtensionInstance* CreateInstance(
     const PostMessageCallback& post_message) OVERRIDE;
 
@@ -64,10 +64,12 @@ class DialogInstance : public XWalkInternalExtensionInstance,
     const std::vector<base::FilePath>& files, void* params) OVERRIDE;
 
  private:
-  void OnShowOpenDialog(const std::string& function_name,
-                        const std::string& callback_id, base::ListValue* args);
-  void OnShowSaveDialog(const std::string& function_name,
-                        const std::string& callback_id, base::ListValue* args);
+  void OnShowOpenDialog(
+      int callback_id,
+      scoped_ptr<jsapi::dialog::ShowOpenDialog::Params> params);
+  void OnShowSaveDialog(
+      int callback_id,
+      scoped_ptr<jsapi::dialog::ShowSaveDialog::Params> params);
 
   DialogExtension* extension_;
   scoped_refptr<SelectFileDialog> dialog_;
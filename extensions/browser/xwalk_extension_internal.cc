@@ -6,16 +6,44 @@
 
 #include "base/logging.h"
 #include "base/strings/string_number_conversions.h"
-#include "base/strings/string_split.h"
 
 namespace xwalk {
 namespace extensions {
 
+namespace {
+
+// Function id used by xwalk_api.js to tell whether the JavaScript context
+// has listeners for an event. The arguments are the event id and a boolean.
+// The ids generated from the IDL are never negative.
+const int kEventListenersChangedFunctionId = -1;
+
+// Bounds the listeners table, whatever the renderer sends. Way more events
+// than any IDL declares.
+const int kMaxEventCount = 1024;
+
+// Messages to JavaScript with this callback id are events, see
+// CreateEventMessage().
+const int kEventCallbackId = 0;
+
+}  // namespace
+
+const char* XWalkInternalExtension::GetJavaScriptAPI() {
+  return javascript_api_.c_str();
+}
+
 XWalkExtensionInstance* XWalkInternalExtension::CreateInstance(
     const XWalkExtension::PostMessageCallback& post_message) {
   return new XWalkInternalExtensionInstance(post_message);
 }
 
+void XWalkInternalExtension::SetJavaScriptAPI(const char* function_ids,
+                                              const char* api) {
+  // The table goes in the first line, so the line numbers of errors in |api|
+  // don't change.
+  javascript_api_ = function_ids;
+  javascript_api_ += api;
+}
+
 XWalkInternalExtensionInstance::XWalkInternalExtensionInstance(
     const XWalkExtension::PostMessageCallback& post_message) {
   SetPostMessageCallback(post_message);
@@ -24,20 +52,28 @@ XWalkInternalExtensionInstance::XWalkInternalExtensionInstance(
 XWalkInternalExtensionInstance::~XWalkInternalExtensionInstance() {
 }
 
-XWalkInternalExtensionInstance::FunctionHandler*
-    XWalkInternalExtensionInstance::GetHandlerForFunction(
-    const std::string& function) {
-  FunctionHandlerMap::iterator iter = handlers_.find(function);
-  if (iter == handlers_.end())
-    return NULL;
+void XWalkInternalExtensionInstance::SetFunctionHandler(
+    int function_id, const FunctionHandler& handler) {
+  DCHECK_GE(function_id, 0);
+  if (static_cast<size_t>(function_id) >= handlers_.size())
+    handlers_.resize(function_id + 1);
+  handlers_[function_id] = handler;
+}
 
-  return &iter->second;
+// static
+void XWalkInternalExtensionInstance::RunWithoutParams(
+    const base::Callback<void(int)>& handler, int callback_id,
+    const base::ListValue& args) {
+  handler.Run(callback_id);
 }
 
 void XWalkInternalExtensionInstance::HandleMessage(
     scoped_ptr<base::Value> msg) {
-  base::ListValue* args;
-  if (!msg->GetAsList(&args) || args->GetSize() < 2) {
+  // Messages have the layout of extension_obj._internal.postMessage() in
+  // xwalk_api.js: the function id, the callback id and the list of
+  // arguments, which is handed as is to the handler.
+  base::ListValue* message;
+  if (!msg->GetAsList(&message) || message->GetSize() != 3) {
     // FIXME(tmpsantos): This warning could be better if the Context had a
     // pointer to the Extension. We could tell what extension sent the
     // invalid message.
@@ -45,49 +81,110 @@ void XWalkInternalExtensionInstance::HandleMessage(
     return;
   }
 
-  // The first parameter stands for the function signature.
-  std::string function_name;
-  if (!args->GetString(0, &function_name)) {
-    LOG(WARNING) << "The function name is not a string.";
+  int function_id;
+  if (!message->GetInteger(0, &function_id)) {
+    LOG(WARNING) << "The function id is not an integer.";
+    return;
+  }
+
+  int callback_id;
+  if (!message->GetInteger(1, &callback_id)) {
+    LOG(WARNING) << "The callback id is not an integer.";
+    return;
+  }
+
+  base::ListValue* args;
+  if (!message->GetList(2, &args)) {
+    LOG(WARNING) << "The function arguments are not a list.";
     return;
   }
 
-  // The second parameter stands for callback id, the remaining
-  // ones are the function arguments.
-  std::string callback_id;
-  if (!args->GetString(1, &callback_id)) {
-    LOG(WARNING) << "The callback id is not a string.";
+  if (function_id == kEventListenersChangedFunctionId) {
+    HandleEventListenersChanged(*args);
     return;
   }
 
-  FunctionHandler* handler = GetHandlerForFunction(function_name);
-  if (!handler) {
-    DLOG(WARNING) << "Function not registered: " << function_name;
+  if (function_id < 0 ||
+      static_cast<size_t>(function_id) >= handlers_.size() ||
+      handlers_[function_id].is_null()) {
+    DLOG(WARNING) << "Function not registered: " << function_id;
     return;
   }
 
-  // We reuse args to pass the extra arguments to the handler, so remove
-  // function_name and callback_id from it.
-  args->Remove(0, NULL);
-  args->Remove(0, NULL);
-  handler->Run(function_name, callback_id, args);
+  handlers_[function_id].Run(callback_id, *args);
 }
 
 void XWalkInternalExtensionInstance::PostResult(
-    const std::string& callback_id, scoped_ptr<base::ListValue> result) {
+    int callback_id, scoped_ptr<base::ListValue> result) {
   DCHECK(result);
 
-  if (callback_id.empty()) {
-    DLOG(WARNING) << "Sending a reply with an empty callback id has no"
+  if (!callback_id) {
+    DLOG(WARNING) << "Sending a reply without a callback id has no "
         "practical effect. This code can be optimized by not creating "
         "and not posting the result.";
     return;
   }
 
-  // Prepend the callback id to the list, so the handlers
-  // on the JavaScript side know which callback should be evoked.
-  result->Insert(0, new base::StringValue(callback_id));
-  PostMessageToJS(scoped_ptr<base::Value>(result.release()));
+  // The callback id goes next to the results, so the handler on the
+  // JavaScript side knows which callback should be evoked and passes the
+  // results list to it as is.
+  scoped_ptr<base::ListValue> reply(new base::ListValue);
+  reply->AppendInteger(callback_id);
+  reply->Append(result.release());
+  PostMessageToJS(reply.PassAs<base::Value>());
+}
+
+void XWalkInternalExtensionInstance::DispatchEvent(
+    int event_id, scoped_ptr<base::ListValue> args) {
+  DCHECK(args);
+  if (!HasEventListeners(event_id))
+    return;
+  PostMessageToJS(CreateEventMessage(event_id, args.Pass()));
+}
+
+void XWalkInternalExtensionInstance::DispatchLatestEvent(
+    int event_id, scoped_ptr<base::ListValue> args) {
+  DCHECK(args);
+  if (!HasEventListeners(event_id))
+    return;
+  PostCoalescedMessageToJS("event" + base::IntToString(event_id),
+                           CreateEventMessage(event_id, args.Pass()));
+}
+
+bool XWalkInternalExtensionInstance::HasEventListeners(int event_id) const {
+  return event_id >= 0 &&
+      static_cast<size_t>(event_id) < event_listeners_.size() &&
+      event_listeners_[event_id];
+}
+
+void XWalkInternalExtensionInstance::HandleEventListenersChanged(
+    const base::ListValue& args) {
+  int event_id;
+  bool has_listeners;
+  if (args.GetSize() != 2 || !args.GetInteger(0, &event_id) ||
+      !args.GetBoolean(1, &has_listeners) || event_id < 0 ||
+      event_id >= kMaxEventCount) {
+    LOG(WARNING) << "Malformed event listeners message.";
+    return;
+  }
+
+  if (HasEventListeners(event_id) == has_listeners)
+    return;
+  if (static_cast<size_t>(event_id) >= event_listeners_.size())
+    event_listeners_.resize(event_id + 1);
+  event_listeners_[event_id] = has_listeners;
+  OnEventListenersChanged(event_id, has_listeners);
+}
+
+// Events are [kEventCallbackId, event_id, [args]], so they share the message
+// listener of xwalk_api.js with the replies.
+scoped_ptr<base::Value> XWalkInternalExtensionInstance::CreateEventMessage(
+    int event_id, scoped_ptr<base::ListValue> args) {
+  scoped_ptr<base::ListValue> msg(new base::ListValue);
+  msg->AppendInteger(kEventCallbackId);
+  msg->AppendInteger(event_id);
+  msg->Append(args.release());
+  return msg.PassAs<base::Value>();
 }
 
 }  // namespace extensions
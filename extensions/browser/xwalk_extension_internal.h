@@ -5,10 +5,12 @@
 #ifndef XWALK_EXTENSIONS_BROWSER_XWALK_EXTENSION_INTERNAL_H_
 #define XWALK_EXTENSIONS_BROWSER_XWALK_EXTENSION_INTERNAL_H_
 
-#include <map>
 #include <string>
+#include <vector>
 #include "base/bind.h"
+#include "base/logging.h"
 #include "base/memory/scoped_ptr.h"
+#include "base/values.h"
 #include "xwalk/extensions/common/xwalk_extension.h"
 
 namespace xwalk {
@@ -18,14 +20,33 @@ namespace extensions {
 // extensions shipped by default with Crosswalk and thus, have access to
 // internal Chromium data types. This allow the extensions to use message
 // serializers generated from IDLs and/or JSON Schema.
+//
+// Internal extensions only do short work in their handlers, or post it to the
+// relevant browser thread, so their instances run in pooled threads. Those
+// that have to block in their handlers should switch back to
+// DEDICATED_THREAD in their constructor.
 class XWalkInternalExtension : public XWalkExtension {
  public:
-  XWalkInternalExtension() {}
+  XWalkInternalExtension() { set_runner_mode(POOLED_THREAD); }
+
+  virtual const char* GetJavaScriptAPI() OVERRIDE;
 
   virtual XWalkExtensionInstance* CreateInstance(
       const XWalkExtension::PostMessageCallback& post_message) OVERRIDE;
 
+ protected:
+  // The JS API code is |function_ids|, the kFunctionIdsSource generated
+  // from the IDL of the extension by generate_function_ids.py, followed by
+  // |api|. The JS API code calls the functions and listens to the events by
+  // their id:
+  //
+  //   internal.postMessage(functionIds.showBar, [arg1, arg2], callback);
+  //   internal.addListener(eventIds.onBarShown, listener);
+  void SetJavaScriptAPI(const char* function_ids, const char* api);
+
  private:
+  std::string javascript_api_;
+
   DISALLOW_COPY_AND_ASSIGN(XWalkInternalExtension);
 };
 
@@ -43,54 +64,110 @@ class XWalkInternalExtensionInstance : public XWalkExtensionInstance {
   virtual void HandleMessage(scoped_ptr<base::Value> msg) OVERRIDE;
 
  protected:
-  // This method will register a function to handle a message tagged as
-  // |function_name|. When invoked, the handler will get as first parameter
-  // the |function_name| (which can be used in case a handler is in charge of
-  // more than one function). The |callback_id| is a unique identifier that
-  // should be returned on the PostResult() in case the function triggers a
-  // callback (empty string otherwise). Finally, |args| contains the list of
-  // parameters ready to be used as input for Params::Create() generated from
-  // the IDL description of the API.
+  // This method will register a function to handle the messages calling
+  // |function_id|, one of the FunctionId values generated from the IDL
+  // description of the API by generate_function_ids.py. The arguments are
+  // decoded with the Params::Create() generated from the IDL before the
+  // handler is called, calls with malformed arguments are dropped. The
+  // |callback_id| is a unique identifier that should be returned on the
+  // PostResult() in case the function triggers a callback (0 otherwise).
   //
   // The signature of a function handler shall like the following:
   //
-  //   void FooContext::OnShowBar(const std::string& function_name,
-  //                              const std::string& callback_id,
-  //                              base::ListValue* args)
+  //   void FooContext::OnShowBar(int callback_id,
+  //                              scoped_ptr<ShowBar::Params> params)
+  //
+  // Or, for functions without arguments:
+  //
+  //   void FooContext::OnGetStuff(int callback_id)
   //
   // And register them like this, preferable at the FooContext constructor:
   //
-  //   RegisterFunction("showBar", &FooContext::OnShowBar);
-  //   RegisterFunction("getStuff", &FooContext::OnGetStuff);
+  //   RegisterFunction(kShowBar, &FooContext::OnShowBar);
+  //   RegisterFunction(kGetStuff, &FooContext::OnGetStuff);
   //   ...
+  template <class T, class Params>
+  void RegisterFunction(int function_id,
+      void (T::*handler)(int callback_id, scoped_ptr<Params> params)) {
+    SetFunctionHandler(function_id, base::Bind(&DecodeParamsAndRun<Params>,
+        base::Bind(handler, base::Unretained(static_cast<T*>(this)))));
+  }
+
   template <class T>
-  void RegisterFunction(const std::string& function_name,
-      void (T::*handler)(const std::string& function_name,
-      const std::string& callback_id, base::ListValue* args)) {
-    handlers_[function_name] = base::Bind(handler,
-        base::Unretained(static_cast<T*>(this)));
+  void RegisterFunction(int function_id,
+      void (T::*handler)(int callback_id)) {
+    SetFunctionHandler(function_id, base::Bind(&RunWithoutParams,
+        base::Bind(handler, base::Unretained(static_cast<T*>(this)))));
   }
 
   // Send the result back and invokes a callback on the renderer. The
   // |callback_id| must be the same as the one got on the function handler.
   // The |result| should be created using the output from Results::Create(),
   // function generated from the IDL describing the JavaScript API. It is a
-  // valid optimization not post a result in case the |callback_id| is an
-  // empty string, because it won't have any practical effect other than noise
-  // at the IPC channel. This can be the case when the user of the JavaScript
-  // API omits the callback. If the JavaScript function doesn't take a
-  // callback at all, you won't need to call this method.
-  void PostResult(const std::string& callback_id,
-                  scoped_ptr<base::ListValue> result);
+  // valid optimization not post a result in case the |callback_id| is 0,
+  // because it won't have any practical effect other than noise at the IPC
+  // channel. This can be the case when the user of the JavaScript API omits
+  // the callback. If the JavaScript function doesn't take a callback at all,
+  // you won't need to call this method.
+  //
+  // Callbacks passed to extension_obj._internal.subscribe() can get results
+  // posted any number of times, until the JavaScript code unsubscribes.
+  void PostResult(int callback_id, scoped_ptr<base::ListValue> result);
+
+  // Runs the listeners added with extension_obj._internal.addListener() for
+  // |event_id|, one of the EventId values generated from the IDL, with
+  // |args|, created by the Create() generated for the event. Events nobody
+  // listens to in the JavaScript context are dropped here, without reaching
+  // the IPC channel; check HasEventListeners() to skip creating |args| too.
+  // All the listeners of the context are run by a single message, and events
+  // dispatched in a row reach the renderer in a single batch.
+  void DispatchEvent(int event_id, scoped_ptr<base::ListValue> args);
+
+  // Same as DispatchEvent(), but replaces the previous event with |event_id|
+  // if it wasn't delivered yet. Useful for events streaming updates, like
+  // sensor readings, where the listeners only care about the latest one.
+  void DispatchLatestEvent(int event_id, scoped_ptr<base::ListValue> args);
+
+  bool HasEventListeners(int event_id) const;
+
+  // Called when the JavaScript context gets its first listener for
+  // |event_id|, or loses its last one. Extensions can start or stop whatever
+  // produces the event here.
+  virtual void OnEventListenersChanged(int event_id, bool has_listeners) {}
 
  private:
-  typedef base::Callback<void(const std::string&, const std::string&,
-                              base::ListValue*)> FunctionHandler;
-  typedef std::map<std::string, FunctionHandler> FunctionHandlerMap;
+  typedef base::Callback<void(int callback_id,
+                              const base::ListValue& args)> FunctionHandler;
+
+  template <class Params>
+  static void DecodeParamsAndRun(
+      const base::Callback<void(int, scoped_ptr<Params>)>& handler,
+      int callback_id, const base::ListValue& args) {
+    scoped_ptr<Params> params(Params::Create(args));
+    if (!params) {
+      LOG(WARNING) << "Malformed parameters passed to internal extension "
+                   << "function.";
+      return;
+    }
+    handler.Run(callback_id, params.Pass());
+  }
+
+  static void RunWithoutParams(
+      const base::Callback<void(int)>& handler, int callback_id,
+      const base::ListValue& args);
+
+  void SetFunctionHandler(int function_id, const FunctionHandler& handler);
+
+  void HandleEventListenersChanged(const base::ListValue& args);
+  scoped_ptr<base::Value> CreateEventMessage(int event_id,
+                                             scoped_ptr<base::ListValue> args);
 
-  FunctionHandler* GetHandlerForFunction(const std::string& function);
+  // Indexed by function id. The ids generated from an IDL are dense, so this
+  // is only as big as the API.
+  std::vector<FunctionHandler> handlers_;
 
-  FunctionHandlerMap handlers_;
+  // Indexed by event id, whether the JavaScript context has listeners.
+  std::vector<bool> event_listeners_;
 
   DISALLOW_COPY_AND_ASSIGN(XWalkInternalExtensionInstance);
 };
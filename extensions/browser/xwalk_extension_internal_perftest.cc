@@ -0,0 +1,186 @@
+// Copyright (c) 2013 Intel Corporation. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "xwalk/extensions/browser/xwalk_extension_internal.h"
+
+#include <stdio.h>
+#include <map>
+#include <string>
+#include <vector>
+#include "base/bind.h"
+#include "base/strings/stringprintf.h"
+#include "base/time/time.h"
+#include "base/values.h"
+#include "testing/gtest/include/gtest/gtest.h"
+
+using xwalk::extensions::XWalkExtensionInstance;
+using xwalk::extensions::XWalkInternalExtensionInstance;
+
+namespace {
+
+// Functions of the API, calls are spread over all of them.
+const int kFunctionCount = 20;
+const int kCalls = 200000;
+
+void IgnoreMessage(scoped_ptr<base::Value> msg) {}
+
+// What the IDL compiler would generate for 'static void setPerson(DOMString
+// name, long age)'.
+struct SetPersonParams {
+  static scoped_ptr<SetPersonParams> Create(const base::ListValue& args) {
+    scoped_ptr<SetPersonParams> params(new SetPersonParams);
+    if (args.GetSize() != 2 || !args.GetString(0, &params->name) ||
+        !args.GetInteger(1, &params->age))
+      return scoped_ptr<SetPersonParams>();
+    return params.Pass();
+  }
+
+  std::string name;
+  int age;
+};
+
+std::string GetFunctionName(int function_id) {
+  return base::StringPrintf("function%d", function_id);
+}
+
+// Dispatches like XWalkInternalExtensionInstance did before function ids:
+// handlers looked up by name, the function name and callback id removed from
+// the front of the message, and the arguments decoded by each handler.
+class NamedDispatchInstance : public XWalkExtensionInstance {
+ public:
+  NamedDispatchInstance() : calls_(0) {
+    for (int i = 0; i < kFunctionCount; ++i) {
+      handlers_[GetFunctionName(i)] = i % 2 ?
+          base::Bind(&NamedDispatchInstance::OnSetPerson,
+                     base::Unretained(this)) :
+          base::Bind(&NamedDispatchInstance::OnPing, base::Unretained(this));
+    }
+  }
+
+  virtual void HandleMessage(scoped_ptr<base::Value> msg) OVERRIDE {
+    base::ListValue* args;
+    std::string function_name;
+    std::string callback_id;
+    if (!msg->GetAsList(&args) || args->GetSize() < 2 ||
+        !args->GetString(0, &function_name) ||
+        !args->GetString(1, &callback_id))
+      return;
+
+    HandlerMap::iterator it = handlers_.find(function_name);
+    if (it == handlers_.end())
+      return;
+
+    args->Remove(0, NULL);
+    args->Remove(0, NULL);
+    it->second.Run(function_name, callback_id, args);
+  }
+
+  int calls() const { return calls_; }
+
+ private:
+  typedef base::Callback<void(const std::string&, const std::string&,
+                              base::ListValue*)> Handler;
+  typedef std::map<std::string, Handler> HandlerMap;
+
+  void OnPing(const std::string& function_name,
+              const std::string& callback_id, base::ListValue* args) {
+    calls_++;
+  }
+
+  void OnSetPerson(const std::string& function_name,
+                   const std::string& callback_id, base::ListValue* args) {
+    scoped_ptr<SetPersonParams> params(SetPersonParams::Create(*args));
+    if (params)
+      calls_++;
+  }
+
+  HandlerMap handlers_;
+  int calls_;
+};
+
+class TypedDispatchInstance : public XWalkInternalExtensionInstance {
+ public:
+  TypedDispatchInstance()
+      : XWalkInternalExtensionInstance(base::Bind(&IgnoreMessage)),
+        calls_(0) {
+    for (int i = 0; i < kFunctionCount; ++i) {
+      if (i % 2)
+        RegisterFunction(i, &TypedDispatchInstance::OnSetPerson);
+      else
+        RegisterFunction(i, &TypedDispatchInstance::OnPing);
+    }
+  }
+
+  int calls() const { return calls_; }
+
+ private:
+  void OnPing(int callback_id) {
+    calls_++;
+  }
+
+  void OnSetPerson(int callback_id, scoped_ptr<SetPersonParams> params) {
+    calls_++;
+  }
+
+  int calls_;
+};
+
+// Messages as posted by extension_obj._internal.postMessage(), before and
+// after the function ids.
+base::Value* CreateNamedMessage(int function_id) {
+  base::ListValue* msg = new base::ListValue;
+  msg->AppendString(GetFunctionName(function_id));
+  msg->AppendString("");
+  if (function_id % 2) {
+    msg->AppendString("Alice");
+    msg->AppendInteger(30);
+  }
+  return msg;
+}
+
+base::Value* CreateTypedMessage(int function_id) {
+  base::ListValue* msg = new base::ListValue;
+  msg->AppendInteger(function_id);
+  msg->AppendInteger(0);
+  base::ListValue* args = new base::ListValue;
+  if (function_id % 2) {
+    args->AppendString("Alice");
+    args->AppendInteger(30);
+  }
+  msg->Append(args);
+  return msg;
+}
+
+// The messages are built beforehand, only their dispatch and destruction are
+// timed.
+template <class Instance>
+base::TimeDelta TimeDispatch(Instance* instance,
+                             base::Value* (*create_message)(int)) {
+  std::vector<base::Value*> messages;
+  for (int i = 0; i < kCalls; ++i)
+    messages.push_back(create_message(i % kFunctionCount));
+
+  base::TimeTicks start = base::TimeTicks::HighResNow();
+  for (int i = 0; i < kCalls; ++i)
+    instance->HandleMessage(make_scoped_ptr(messages[i]));
+  base::TimeDelta elapsed = base::TimeTicks::HighResNow() - start;
+
+  EXPECT_EQ(kCalls, instance->calls());
+  return elapsed;
+}
+
+void PrintTime(const std::string& trace, base::TimeDelta elapsed) {
+  printf("RESULT internal_extension_dispatch: %s= %.3f us/call\n",
+         trace.c_str(), elapsed.InMicrosecondsF() / kCalls);
+}
+
+}  // namespace
+
+TEST(XWalkInternalExtensionPerfTest, DispatchSmallCalls) {
+  NamedDispatchInstance named;
+  PrintTime("by_name", TimeDispatch(&named, &CreateNamedMessage));
+
+  TypedDispatchInstance typed;
+  PrintTime("by_id", TimeDispatch(&typed, &CreateTypedMessage));
+}
@@ -0,0 +1,310 @@
+// Copyright (c) 2013 Intel Corporation. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "xwalk/extensions/browser/xwalk_extension_process_host.h"
+
+#include "base/bind.h"
+#include "base/command_line.h"
+#include "content/public/browser/browser_child_process_host.h"
+#include "content/public/browser/browser_child_process_host_delegate.h"
+#include "content/public/browser/browser_thread.h"
+#include "content/public/common/child_process_host.h"
+#include "content/public/common/content_switches.h"
+#include "xwalk/extensions/common/xwalk_extension_messages.h"
+#include "xwalk/extensions/common/xwalk_extension_process_type.h"
+#include "xwalk/extensions/common/xwalk_extension_set.h"
+#include "xwalk/extensions/common/xwalk_extension_switches.h"
+
+#if defined(OS_WIN)
+#include "content/public/common/sandboxed_process_launcher_delegate.h"
+#elif defined(OS_POSIX)
+#include <unistd.h>
+#include "base/posix/eintr_wrapper.h"
+#endif
+
+using content::BrowserThread;
+
+namespace xwalk {
+namespace extensions {
+
+namespace {
+
+// An extension process dying more than this is not launched again, and the
+// extensions it hosts stop working for the render process.
+const int kMaxRestartCount = 3;
+
+#if defined(OS_WIN)
+// Native extensions are trusted as much as they are in the browser process.
+class ExtensionSandboxedProcessLauncherDelegate
+    : public content::SandboxedProcessLauncherDelegate {
+ public:
+  virtual void ShouldSandbox(bool* in_sandbox) OVERRIDE {
+    *in_sandbox = false;
+  }
+};
+#endif
+
+}  // namespace
+
+// Launches and talks to the extension process. The BrowserChildProcessHost
+// deletes its delegate when the process goes away, so this object is owned by
+// it, and tells the XWalkExtensionProcessHost about it when deleted.
+class XWalkExtensionProcessHost::ExtensionProcess
+    : public content::BrowserChildProcessHostDelegate {
+ public:
+  explicit ExtensionProcess(
+      const base::WeakPtr<XWalkExtensionProcessHost>& host)
+      : host_(host),
+        crashed_(false) {}
+
+  virtual ~ExtensionProcess() {
+    if (host_)
+      host_->OnProcessGone(crashed_);
+  }
+
+  bool Launch(const base::FilePath& extensions_path);
+
+  bool Send(IPC::Message* message) {
+    return process_->Send(message);
+  }
+
+  // content::BrowserChildProcessHostDelegate implementation.
+  virtual bool OnMessageReceived(const IPC::Message& message) OVERRIDE {
+    if (host_)
+      host_->OnProcessMessageReceived(message);
+    return true;
+  }
+
+  virtual void OnProcessCrashed(int exit_code) OVERRIDE {
+    crashed_ = true;
+  }
+
+ private:
+  base::WeakPtr<XWalkExtensionProcessHost> host_;
+  scoped_ptr<content::BrowserChildProcessHost> process_;
+  bool crashed_;
+
+  DISALLOW_COPY_AND_ASSIGN(ExtensionProcess);
+};
+
+bool XWalkExtensionProcessHost::ExtensionProcess::Launch(
+    const base::FilePath& extensions_path) {
+  process_.reset(content::BrowserChildProcessHost::Create(
+      PROCESS_TYPE_EXTENSION, this));
+
+  std::string channel_id = process_->GetHost()->CreateChannel();
+  if (channel_id.empty())
+    return false;
+
+#if defined(OS_LINUX)
+  int flags = content::ChildProcessHost::CHILD_ALLOW_SELF;
+#else
+  int flags = content::ChildProcessHost::CHILD_NORMAL;
+#endif
+  base::FilePath exe_path = content::ChildProcessHost::GetChildPath(flags);
+  if (exe_path.empty())
+    return false;
+
+  CommandLine* cmd_line = new CommandLine(exe_path);
+  cmd_line->AppendSwitchASCII(switches::kProcessType,
+                              switches::kXWalkExtensionProcess);
+  cmd_line->AppendSwitchASCII(switches::kProcessChannelID, channel_id);
+
+  process_->Launch(
+#if defined(OS_WIN)
+      new ExtensionSandboxedProcessLauncherDelegate,
+#elif defined(OS_POSIX)
+      false, base::EnvironmentVector(),
+#endif
+      cmd_line);
+
+  // Kept in the channel until the process connects to it.
+  return process_->Send(
+      new XWalkExtensionProcessMsg_RegisterExtensions(extensions_path));
+}
+
+XWalkExtensionProcessHost::XWalkExtensionProcessHost(
+    IPC::Sender* render_process_sender,
+    const scoped_refptr<XWalkExtensionSet>& in_process_extensions,
+    const base::FilePath& external_extensions_path)
+    : render_process_sender_(render_process_sender),
+      in_process_extensions_(in_process_extensions),
+      external_extensions_path_(external_extensions_path),
+      process_(NULL),
+      restart_count_(0),
+      extensions_registered_(false),
+      channel_requested_(false),
+      render_process_connected_(false),
+      weak_ptr_factory_(this) {
+  // The host is deleted in the IO-thread, after this task runs.
+  BrowserThread::PostTask(BrowserThread::IO, FROM_HERE,
+      base::Bind(&XWalkExtensionProcessHost::StartProcess,
+                 base::Unretained(this)));
+}
+
+XWalkExtensionProcessHost::~XWalkExtensionProcessHost() {
+  DCHECK(BrowserThread::CurrentlyOn(BrowserThread::IO));
+
+  // Terminates the extension process, without trying to launch it again.
+  weak_ptr_factory_.InvalidateWeakPtrs();
+  delete process_;
+  ResetChannelHandle();
+}
+
+void XWalkExtensionProcessHost::StartProcess() {
+  DCHECK(BrowserThread::CurrentlyOn(BrowserThread::IO));
+  DCHECK(!process_);
+
+  if (external_extensions_path_.empty()) {
+    extensions_registered_ = true;
+    SendChannelToRenderProcess();
+    return;
+  }
+
+  ExtensionProcess* process =
+      new ExtensionProcess(weak_ptr_factory_.GetWeakPtr());
+  process_ = process;
+  if (!process->Launch(external_extensions_path_)) {
+    LOG(ERROR) << "Couldn't launch the extension process.";
+    // Handled by OnProcessGone() like any other failure.
+    delete process;
+  }
+}
+
+void XWalkExtensionProcessHost::OnProcessGone(bool crashed) {
+  if (crashed)
+    LOG(ERROR) << "The extension process crashed.";
+  else
+    LOG(WARNING) << "The extension process is gone.";
+
+  process_ = NULL;
+  // Nobody can connect to the channel of a dead process.
+  ResetChannelHandle();
+
+  if (restart_count_ >= kMaxRestartCount) {
+    LOG(ERROR) << "The extension process died " << restart_count_
+               << " times, its extensions won't be available anymore.";
+    if (!extensions_registered_) {
+      extensions_registered_ = true;
+      SendChannelToRenderProcess();
+    }
+    return;
+  }
+
+  // Posted since we are called while the old process is being torn down.
+  ++restart_count_;
+  BrowserThread::PostTask(BrowserThread::IO, FROM_HERE,
+      base::Bind(&XWalkExtensionProcessHost::StartProcess,
+                 weak_ptr_factory_.GetWeakPtr()));
+}
+
+void XWalkExtensionProcessHost::ResetChannelHandle() {
+#if defined(OS_POSIX)
+  // Received with auto_close set, the descriptor is ours until the message
+  // carrying it to the render process is written.
+  if (channel_handle_.socket.fd != -1 && channel_handle_.socket.auto_close) {
+    if (HANDLE_EINTR(close(channel_handle_.socket.fd)) < 0)
+      PLOG(ERROR) << "close";
+  }
+#endif
+  channel_handle_ = IPC::ChannelHandle();
+}
+
+bool XWalkExtensionProcessHost::SendToRenderProcess(IPC::Message* message) {
+  if (sender_cancellation_flag_.IsSet()) {
+    delete message;
+    return false;
+  }
+
+  return render_process_sender_->Send(message);
+}
+
+void XWalkExtensionProcessHost::Invalidate() {
+  sender_cancellation_flag_.Set();
+}
+
+bool XWalkExtensionProcessHost::OnRendererMessageReceived(
+    const IPC::Message& message) {
+  DCHECK(BrowserThread::CurrentlyOn(BrowserThread::IO));
+
+  bool handled = true;
+  IPC_BEGIN_MESSAGE_MAP(XWalkExtensionProcessHost, message)
+    IPC_MESSAGE_HANDLER(XWalkExtensionServerMsg_ConnectToExtensionProcess,
+        OnConnectToExtensionProcess)
+    IPC_MESSAGE_UNHANDLED(handled = false)
+  IPC_END_MESSAGE_MAP()
+
+  return handled;
+}
+
+void XWalkExtensionProcessHost::OnConnectToExtensionProcess() {
+  channel_requested_ = true;
+  if (extensions_registered_)
+    SendChannelToRenderProcess();
+}
+
+void XWalkExtensionProcessHost::SendChannelToRenderProcess() {
+  if (!channel_requested_)
+    return;
+  channel_requested_ = false;
+
+  SendToRenderProcess(
+      new XWalkExtensionClientMsg_ExtensionProcessChannelCreated(
+          channel_handle_, extension_names_, extension_apis_));
+
+  // A channel can't be used twice. The message owns the socket now.
+  if (!channel_handle_.name.empty()) {
+    render_process_connected_ = true;
+    channel_handle_ = IPC::ChannelHandle();
+  }
+}
+
+void XWalkExtensionProcessHost::OnProcessMessageReceived(
+    const IPC::Message& message) {
+  IPC_BEGIN_MESSAGE_MAP(XWalkExtensionProcessHost, message)
+    IPC_MESSAGE_HANDLER(XWalkExtensionClientMsg_RegisterExtension,
+        OnRegisterExtension)
+    IPC_MESSAGE_HANDLER(
+        XWalkExtensionProcessHostMsg_RenderProcessChannelCreated,
+        OnRenderProcessChannelCreated)
+  IPC_END_MESSAGE_MAP()
+}
+
+void XWalkExtensionProcessHost::OnRegisterExtension(const std::string& name,
+    const std::string& api) {
+  // A relaunched process loads the same extensions, which the render process
+  // already knows about.
+  if (extensions_registered_)
+    return;
+
+  if (in_process_extensions_->Get(name)) {
+    LOG(WARNING) << "Ignoring external extension with name already registered"
+                 << " in the browser process: " << name;
+    return;
+  }
+
+  extension_names_.push_back(name);
+  extension_apis_.push_back(api);
+}
+
+void XWalkExtensionProcessHost::OnRenderProcessChannelCreated(
+    const IPC::ChannelHandle& handle) {
+  extensions_registered_ = true;
+
+  // The render process connected to a previous extension process, which
+  // died. It creates its instances again on the new channel.
+  if (render_process_connected_) {
+    SendToRenderProcess(
+        new XWalkExtensionClientMsg_ExtensionProcessChannelCreated(
+            handle, extension_names_, extension_apis_));
+    return;
+  }
+
+  ResetChannelHandle();
+  channel_handle_ = handle;
+  SendChannelToRenderProcess();
+}
+
+}  // namespace extensions
+}  // namespace xwalk
@@ -0,0 +1,110 @@
+// Copyright (c) 2013 Intel Corporation. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef XWALK_EXTENSIONS_BROWSER_XWALK_EXTENSION_PROCESS_HOST_H_
+#define XWALK_EXTENSIONS_BROWSER_XWALK_EXTENSION_PROCESS_HOST_H_
+
+#include <string>
+#include <vector>
+#include "base/files/file_path.h"
+#include "base/memory/ref_counted.h"
+#include "base/memory/weak_ptr.h"
+#include "base/synchronization/cancellation_flag.h"
+#include "ipc/ipc_channel_handle.h"
+
+namespace IPC {
+class Message;
+class Sender;
+}
+
+namespace xwalk {
+namespace extensions {
+
+class XWalkExtensionSet;
+
+// Runs the external extensions of one render process in a separate extension
+// process, so a misbehaving native extension can't take the browser down
+// with it.
+//
+// The browser only brokers the connection: the extension process creates an
+// IPC channel for the render process, and the host hands it over together
+// with the list of extensions. After that, the messages of the instances go
+// straight between both processes.
+//
+// If the extension process dies, it is launched again and the render process
+// gets a new channel, on which it creates its instances again.
+//
+// Created in the UI-thread, but lives in the IO-thread like the
+// XWalkExtensionServer of the render process.
+class XWalkExtensionProcessHost {
+ public:
+  // Extensions in |in_process_extensions| stay in the browser process, the
+  // ones from |external_extensions_path| are loaded in the extension process.
+  XWalkExtensionProcessHost(
+      IPC::Sender* render_process_sender,
+      const scoped_refptr<XWalkExtensionSet>& in_process_extensions,
+      const base::FilePath& external_extensions_path);
+  ~XWalkExtensionProcessHost();
+
+  // Handles the messages from the render process about the extension
+  // process. Returns false for the other ones.
+  bool OnRendererMessageReceived(const IPC::Message& message);
+
+  // Stops sending messages to the render process, which is going away. Can be
+  // called from the UI-thread.
+  void Invalidate();
+
+ private:
+  class ExtensionProcess;
+
+  void StartProcess();
+  void OnProcessMessageReceived(const IPC::Message& message);
+  void OnProcessGone(bool crashed);
+
+  bool SendToRenderProcess(IPC::Message* message);
+
+  // Message from the render process.
+  void OnConnectToExtensionProcess();
+
+  // Messages from the extension process.
+  void OnRegisterExtension(const std::string& name, const std::string& api);
+  void OnRenderProcessChannelCreated(const IPC::ChannelHandle& handle);
+
+  // Sends the channel to the render process if it asked for it.
+  void SendChannelToRenderProcess();
+
+  // Forgets |channel_handle_|, closing its socket if nobody took it.
+  void ResetChannelHandle();
+
+  IPC::Sender* render_process_sender_;
+  base::CancellationFlag sender_cancellation_flag_;
+
+  scoped_refptr<XWalkExtensionSet> in_process_extensions_;
+  base::FilePath external_extensions_path_;
+
+  // Owned by the BrowserChildProcessHost machinery, which deletes it when
+  // the process goes away. NULL while there's no extension process.
+  ExtensionProcess* process_;
+  int restart_count_;
+
+  // Set once the extensions of the first launch are known.
+  bool extensions_registered_;
+  std::vector<std::string> extension_names_;
+  std::vector<std::string> extension_apis_;
+
+  // The render process asks for the channel once, the channels of later
+  // launches are sent to it as they are created.
+  bool channel_requested_;
+  IPC::ChannelHandle channel_handle_;
+  bool render_process_connected_;
+
+  base::WeakPtrFactory<XWalkExtensionProcessHost> weak_ptr_factory_;
+
+  DISALLOW_COPY_AND_ASSIGN(XWalkExtensionProcessHost);
+};
+
+}  // namespace extensions
+}  // namespace xwalk
+
+#endif  // XWALK_EXTENSIONS_BROWSER_XWALK_EXTENSION_PROCESS_HOST_H_
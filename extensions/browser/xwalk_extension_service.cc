@@ -4,14 +4,21 @@
 
 #include "xwalk/extensions/browser/xwalk_extension_service.h"
 
+#include "base/bind.h"
 #include "base/callback.h"
 #include "base/command_line.h"
 #include "base/scoped_native_library.h"
+#include "base/threading/sequenced_worker_pool.h"
 #include "content/public/browser/browser_thread.h"
 #include "content/public/browser/notification_types.h"
 #include "content/public/browser/notification_service.h"
 #include "content/public/browser/render_process_host.h"
+#include "content/public/common/content_switches.h"
+#include "xwalk/extensions/browser/xwalk_extension_process_host.h"
 #include "xwalk/extensions/common/xwalk_extension.h"
+#include "xwalk/extensions/common/xwalk_extension_code_cache_store.h"
+#include "xwalk/extensions/common/xwalk_extension_frame_policy.h"
+#include "xwalk/extensions/common/xwalk_extension_messages.h"
 #include "xwalk/extensions/common/xwalk_extension_server.h"
 #include "xwalk/extensions/common/xwalk_extension_switches.h"
 
@@ -32,81 +39,177 @@ g_register_extensions_callback;
 // in_process ExtensionServer.
 class ExtensionServerMessageFilter : public IPC::ChannelProxy::MessageFilter {
  public:
-  explicit ExtensionServerMessageFilter(XWalkExtensionServer* server);
+  // |process_host| can be NULL if there's no extension process.
+  ExtensionServerMessageFilter(XWalkExtensionServer* server,
+                               XWalkExtensionProcessHost* process_host);
 
   // IPC::ChannelProxy::MessageFilter Implementation.
   virtual bool OnMessageReceived(const IPC::Message& message) OVERRIDE;
+  virtual void OnChannelConnected(int32 peer_pid) OVERRIDE;
 
  private:
   friend class IPC::ChannelProxy::MessageFilter;
   virtual ~ExtensionServerMessageFilter() {}
   XWalkExtensionServer* server_;
+  XWalkExtensionProcessHost* process_host_;
 };
 
 ExtensionServerMessageFilter::ExtensionServerMessageFilter(
-    XWalkExtensionServer* server)
-    : server_(server) {
+    XWalkExtensionServer* server, XWalkExtensionProcessHost* process_host)
+    : server_(server),
+      process_host_(process_host) {
 }
 
 bool ExtensionServerMessageFilter::OnMessageReceived(const IPC::Message& msg) {
+  if (process_host_ && process_host_->OnRendererMessageReceived(msg))
+    return true;
   return server_->OnMessageReceived(msg);
 }
 
+void ExtensionServerMessageFilter::OnChannelConnected(int32 peer_pid) {
+  server_->OnChannelConnected(peer_pid);
+}
+
 
 XWalkExtensionService::XWalkExtensionService()
-    : render_process_host_(NULL),
-      in_process_server_message_filter_(NULL) {
+    : extensions_(new XWalkExtensionSet),
+      use_extension_process_(false) {
   CommandLine* cmd_line = CommandLine::ForCurrentProcess();
   if (cmd_line->HasSwitch(switches::kXWalkEnableExtensionProcess)) {
-    VLOG(1) << "Extension process enabled.";
+    if (cmd_line->HasSwitch(switches::kSingleProcess)) {
+      LOG(WARNING) << "Extension process can't be used in single process"
+                   << " mode, external extensions will run in the browser.";
+    } else {
+      VLOG(1) << "Extension process enabled.";
+      use_extension_process_ = true;
+    }
   }
 
   registrar_.Add(this, content::NOTIFICATION_RENDERER_PROCESS_TERMINATED,
                  content::NotificationService::AllBrowserContextsAndSources());
-
-  // This object is created on the UI-thread but it will live on the IO-thread.
-  // Its deletion will happen on the IO-thread.
-  in_process_extensions_server_.reset(new XWalkExtensionServer());
+  registrar_.Add(this, content::NOTIFICATION_RENDERER_PROCESS_CLOSED,
+                 content::NotificationService::AllBrowserContextsAndSources());
 
   if (!g_register_extensions_callback.is_null())
     g_register_extensions_callback.Run(this);
 }
 
 XWalkExtensionService::~XWalkExtensionService() {
+  while (!render_process_servers_.empty())
+    DestroyServer(render_process_servers_.begin());
 }
 
 bool XWalkExtensionService::RegisterExtension(
     scoped_ptr<XWalkExtension> extension) {
-  // Note: for now we only support registering new extensions before
-  // render process hosts were created.
-  CHECK(!render_process_host_);
-  return in_process_extensions_server_->RegisterExtension(extension.Pass());
+  // Copied before handing the extension over, it could be removed from the
+  // set by another thread right after.
+  std::string name = extension->name();
+  std::string api = extension->GetJavaScriptAPI();
+  if (!extensions_->Add(extension.Pass()))
+    return false;
+
+  RenderProcessServerMap::iterator it = render_process_servers_.begin();
+  for (; it != render_process_servers_.end(); ++it)
+    it->second.server->RegisterExtensionInRenderProcess(name, api);
+  return true;
+}
+
+bool XWalkExtensionService::UnregisterExtension(const std::string& name) {
+  if (!extensions_->Remove(name))
+    return false;
+
+  RenderProcessServerMap::iterator it = render_process_servers_.begin();
+  for (; it != render_process_servers_.end(); ++it)
+    it->second.server->UnregisterExtensionInRenderProcess(name);
+  return true;
 }
 
 void XWalkExtensionService::RegisterExternalExtensionsForPath(
     const base::FilePath& path) {
-  RegisterExternalExtensionsInDirectory(
-      in_process_extensions_server_.get(), path);
+  CHECK(render_process_servers_.empty());
+
+  // Each extension process loads them by itself.
+  if (use_extension_process_) {
+    external_extensions_path_ = path;
+    return;
+  }
+
+  RegisterExternalExtensionsInDirectory(extensions_.get(), path);
+}
+
+void XWalkExtensionService::SetCodeCacheDirectory(
+    const base::FilePath& path) {
+  CHECK(render_process_servers_.empty());
+
+  base::SequencedWorkerPool* pool = BrowserThread::GetBlockingPool();
+  scoped_refptr<base::SequencedTaskRunner> task_runner =
+      pool->GetSequencedTaskRunnerWithShutdownBehavior(
+          pool->GetSequenceToken(),
+          base::SequencedWorkerPool::SKIP_ON_SHUTDOWN);
+
+  code_cache_store_ = new XWalkExtensionCodeCacheStore(path, task_runner);
+}
+
+bool XWalkExtensionService::SetFramePolicy(
+    const base::DictionaryValue& policy) {
+  // Parsed here too, so a bad manifest is reported once instead of by every
+  // render process.
+  XWalkExtensionFramePolicy parsed_policy;
+  std::string error;
+  if (!parsed_policy.InitFromValue(policy, &error)) {
+    LOG(WARNING) << "Ignoring extensions frame policy: " << error;
+    frame_policy_.reset();
+    return false;
+  }
+  frame_policy_.reset(policy.DeepCopy());
+  return true;
 }
 
 void XWalkExtensionService::OnRenderProcessHostCreated(
     content::RenderProcessHost* host) {
-  // FIXME(cmarcelo): For now we support only one render process host.
-  if (render_process_host_)
+  // A host that was already plugged is being reused for a new render process,
+  // the old server was destroyed when the previous process went away.
+  if (render_process_servers_.find(host->GetID()) !=
+      render_process_servers_.end())
     return;
 
-  render_process_host_ = host;
+  // This object is created on the UI-thread but it will live on the IO-thread.
+  // Its deletion will happen on the IO-thread.
+  XWalkExtensionServer* server = new XWalkExtensionServer(extensions_);
+  server->SetCodeCacheStore(code_cache_store_);
+
+  IPC::ChannelProxy* channel = host->GetChannel();
 
-  IPC::ChannelProxy* channel = render_process_host_->GetChannel();
+  // Goes before anything that could create frames in the render process.
+  if (frame_policy_)
+    channel->Send(new XWalkExtensionClientMsg_SetFramePolicy(*frame_policy_));
+
+  // Also lives on the IO-thread, and is deleted after the server.
+  XWalkExtensionProcessHost* process_host = NULL;
+  if (use_extension_process_) {
+    process_host = new XWalkExtensionProcessHost(
+        channel, extensions_, external_extensions_path_);
+  }
 
   // The filter is owned by the IPC channel but we keep a reference to remove
   // it from the Channel later during a RenderProcess shutdown.
-  in_process_server_message_filter_ =
-      new ExtensionServerMessageFilter(in_process_extensions_server_.get());
-  channel->AddFilter(in_process_server_message_filter_);
-  in_process_extensions_server_->Initialize(channel);
+  ExtensionServerMessageFilter* filter =
+      new ExtensionServerMessageFilter(server, process_host);
+  channel->AddFilter(filter);
+  server->Initialize(channel);
+
+  server->RegisterExtensionsInRenderProcess();
+
+  // The server is deleted in the IO-thread, after this task runs, see
+  // Observe().
+  BrowserThread::PostTask(BrowserThread::IO, FROM_HERE,
+      base::Bind(&XWalkExtensionServer::SendCodeCacheToClient,
+                 base::Unretained(server)));
 
-  in_process_extensions_server_->RegisterExtensionsInRenderProcess();
+  RenderProcessServer& entry = render_process_servers_[host->GetID()];
+  entry.server = server;
+  entry.process_host = process_host;
+  entry.filter = filter;
 }
 
 // static
@@ -115,6 +218,29 @@ void XWalkExtensionService::SetRegisterExtensionsCallbackForTesting(
   g_register_extensions_callback = callback;
 }
 
+void XWalkExtensionService::DestroyServer(
+    RenderProcessServerMap::iterator it) {
+  // Only the instances created by this render process are destroyed, the
+  // extensions are still used by the other processes.
+  XWalkExtensionServer* server = it->second.server;
+  server->Invalidate();
+  if (it->second.process_host)
+    it->second.process_host->Invalidate();
+  // The filter goes away with the channel if the host was already deleted.
+  content::RenderProcessHost* host =
+      content::RenderProcessHost::FromID(it->first);
+  IPC::ChannelProxy* channel = host ? host->GetChannel() : NULL;
+  if (channel)
+    channel->RemoveFilter(it->second.filter);
+  BrowserThread::DeleteSoon(BrowserThread::IO, FROM_HERE, server);
+  if (it->second.process_host) {
+    BrowserThread::DeleteSoon(BrowserThread::IO, FROM_HERE,
+                              it->second.process_host);
+  }
+
+  render_process_servers_.erase(it);
+}
+
 // We use this to keep track of the RenderProcess shutdown events.
 // This is _very_ important so we can clean up all we need gracefully,
 // avoiding invalid IPC steps after the IPC channel is gonne.
@@ -126,15 +252,10 @@ void XWalkExtensionService::Observe(int type,
     case content::NOTIFICATION_RENDERER_PROCESS_CLOSED: {
       content::RenderProcessHost* rph =
           content::Source<content::RenderProcessHost>(source).ptr();
-      if (rph == render_process_host_) {
-        in_process_extensions_server_->Invalidate();
-        render_process_host_->GetChannel()->RemoveFilter(
-            in_process_server_message_filter_);
-        BrowserThread::DeleteSoon(BrowserThread::IO, FROM_HERE,
-            in_process_extensions_server_.release());
-
-        in_process_server_message_filter_ = NULL;
-      }
+      RenderProcessServerMap::iterator it =
+          render_process_servers_.find(rph->GetID());
+      if (it != render_process_servers_.end())
+        DestroyServer(it);
     }
   }
 }
@@ -6,16 +6,16 @@
 #define XWALK_EXTENSIONS_BROWSER_XWALK_EXTENSION_SERVICE_H_
 
 #include <stdint.h>
+#include <map>
 #include <string>
 #include "base/callback_forward.h"
+#include "base/files/file_path.h"
+#include "base/memory/ref_counted.h"
 #include "base/memory/scoped_ptr.h"
+#include "base/values.h"
 #include "content/public/browser/notification_observer.h"
 #include "content/public/browser/notification_registrar.h"
 
-namespace base {
-class FilePath;
-}
-
 namespace content {
 class RenderProcessHost;
 class WebContents;
@@ -26,22 +26,45 @@ namespace extensions {
 
 class ExtensionServerMessageFilter;
 class XWalkExtension;
+class XWalkExtensionCodeCacheStore;
+class XWalkExtensionProcessHost;
 class XWalkExtensionServer;
+class XWalkExtensionSet;
 
 // This is the entry point for Crosswalk extensions. Its responsible for keeping
 // track of the extensions, and enable them on WebContents once they are
 // created. It's life time follows the Browser process itself.
+//
+// Every render process gets its own XWalkExtensionServer, all of them sharing
+// the same set of extensions. With --enable-extension-process, the external
+// extensions of each render process run in a separate process instead, see
+// XWalkExtensionProcessHost.
 class XWalkExtensionService : public content::NotificationObserver {
  public:
   XWalkExtensionService();
   virtual ~XWalkExtensionService();
 
   // Returns false if it couldn't be registered because another one with the
-  // same name exists, otherwise returns true.
+  // same name exists, otherwise returns true. Extensions registered after
+  // render processes were created are sent to them, and show up in the frames
+  // they already have.
   bool RegisterExtension(scoped_ptr<XWalkExtension> extension);
 
+  // Returns false if there's no extension called |name|. Frames that already
+  // loaded the JS API of the extension keep using it until they go away.
+  bool UnregisterExtension(const std::string& name);
+
   void RegisterExternalExtensionsForPath(const base::FilePath& path);
 
+  // Compiled JS API code of the extensions will be kept in |path|, so later
+  // launches don't need to parse it again.
+  void SetCodeCacheDirectory(const base::FilePath& path);
+
+  // Decides which frames of the render processes created from now on get the
+  // extensions, see XWalkExtensionFramePolicy. Returns false if |policy| is
+  // malformed, in which case all the frames get them.
+  bool SetFramePolicy(const base::DictionaryValue& policy);
+
   // To be called when a new RenderProcessHost is created, will plug the
   // extension system to that render process. See
   // XWalkContentBrowserClient::RenderProcessHostCreated().
@@ -57,12 +80,32 @@ class XWalkExtensionService : public content::NotificationObserver {
   virtual void Observe(int type, const content::NotificationSource& source,
                        const content::NotificationDetails& details) OVERRIDE;
 
-  // FIXME(cmarcelo): For now we support only one render process host.
-  content::RenderProcessHost* render_process_host_;
-
-  // This object lives on the IO-thread.
-  scoped_ptr<XWalkExtensionServer> in_process_extensions_server_;
-  ExtensionServerMessageFilter* in_process_server_message_filter_;
+  // Server for the extensions running in the browser process, and the filter
+  // feeding it with the messages of the render process. The server and the
+  // extension process host live on the IO-thread, the filter is owned by the
+  // IPC channel.
+  struct RenderProcessServer {
+    XWalkExtensionServer* server;
+    XWalkExtensionProcessHost* process_host;
+    ExtensionServerMessageFilter* filter;
+  };
+  // Keyed by the id of the RenderProcessHost, which can already be gone when
+  // the service is destroyed during shutdown.
+  typedef std::map<int, RenderProcessServer> RenderProcessServerMap;
+  RenderProcessServerMap render_process_servers_;
+
+  void DestroyServer(RenderProcessServerMap::iterator it);
+
+  scoped_refptr<XWalkExtensionSet> extensions_;
+  scoped_refptr<XWalkExtensionCodeCacheStore> code_cache_store_;
+
+  // Sent as is to the render processes, NULL for the default policy.
+  scoped_ptr<base::DictionaryValue> frame_policy_;
+
+  // Where the extension processes load external extensions from. Only used
+  // if |use_extension_process_| is set.
+  bool use_extension_process_;
+  base::FilePath external_extensions_path_;
 
   content::NotificationRegistrar registrar_;
 
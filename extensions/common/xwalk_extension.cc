@@ -9,7 +9,11 @@
 namespace xwalk {
 namespace extensions {
 
-XWalkExtension::XWalkExtension() {}
+XWalkExtension::XWalkExtension()
+    : runner_mode_(DEDICATED_THREAD),
+      instance_mode_(INSTANCE_PER_CONTEXT),
+      message_queue_limit_(0),
+      queue_full_policy_(BLOCK_SENDER) {}
 
 XWalkExtension::~XWalkExtension() {}
 
@@ -20,8 +24,109 @@ void XWalkExtensionInstance::SetPostMessageCallback(const
   post_message_ = post_message;
 }
 
+void XWalkExtensionInstance::SetPostBinaryMessageCallback(const
+    XWalkExtension::PostBinaryMessageCallback& post_binary_message) {
+  post_binary_message_ = post_binary_message;
+}
+
+void XWalkExtensionInstance::SetPostCoalescedMessageCallback(const
+    XWalkExtension::PostCoalescedMessageCallback& post_coalesced_message) {
+  post_coalesced_message_ = post_coalesced_message;
+}
+
+void XWalkExtensionInstance::SetPostReplyCallback(const
+    XWalkExtension::PostReplyCallback& post_reply) {
+  post_reply_ = post_reply;
+}
+
+void XWalkExtensionInstance::SetPostSyncReplyCallback(const
+    XWalkExtension::PostSyncReplyCallback& post_sync_reply) {
+  post_sync_reply_ = post_sync_reply;
+}
+
+void XWalkExtensionInstance::SetPostContextMessageCallback(const
+    XWalkExtension::PostContextMessageCallback& post_context_message) {
+  post_context_message_ = post_context_message;
+}
+
 XWalkExtensionInstance::~XWalkExtensionInstance() {}
 
+void XWalkExtensionInstance::HandleBinaryMessage(
+    const scoped_refptr<base::RefCountedMemory>& data) {
+  HandleMessage(scoped_ptr<base::Value>(
+      base::BinaryValue::CreateWithCopiedBuffer(
+          reinterpret_cast<const char*>(data->front()), data->size())));
+}
+
+void XWalkExtensionInstance::PostBinaryMessageToJS(
+    const scoped_refptr<base::RefCountedMemory>& data) {
+  if (post_binary_message_.is_null()) {
+    LOG(WARNING) << "Can't post binary message, instance is not attached "
+                 << "to a runner.";
+    return;
+  }
+  post_binary_message_.Run(data);
+}
+
+void XWalkExtensionInstance::PostCoalescedMessageToJS(const std::string& key,
+    scoped_ptr<base::Value> msg) {
+  // Runners that don't batch messages have nothing to coalesce.
+  if (post_coalesced_message_.is_null()) {
+    PostMessageToJS(msg.Pass());
+    return;
+  }
+  post_coalesced_message_.Run(key, msg.Pass());
+}
+
+void XWalkExtensionInstance::HandleRequest(int request_id,
+    scoped_ptr<base::Value> msg) {
+  LOG(WARNING) << "Sending request to extension which doesn't support it!";
+  PostReplyToJS(request_id, scoped_ptr<base::Value>());
+}
+
+void XWalkExtensionInstance::PostReplyToJS(int request_id,
+    scoped_ptr<base::Value> reply) {
+  if (post_reply_.is_null()) {
+    LOG(WARNING) << "Can't reply request, instance is not attached "
+                 << "to a runner.";
+    return;
+  }
+  if (!reply)
+    reply.reset(base::Value::CreateNullValue());
+  post_reply_.Run(request_id, reply.Pass());
+}
+
+void XWalkExtensionInstance::HandleDeferrableSyncMessage(int reply_id,
+    scoped_ptr<base::Value> msg) {
+  PostSyncReplyToJS(reply_id, HandleSyncMessage(msg.Pass()));
+}
+
+void XWalkExtensionInstance::PostSyncReplyToJS(int reply_id,
+    scoped_ptr<base::Value> reply) {
+  if (post_sync_reply_.is_null()) {
+    LOG(WARNING) << "Can't reply sync message, instance is not attached "
+                 << "to a runner.";
+    return;
+  }
+  if (!reply)
+    reply.reset(base::Value::CreateNullValue());
+  post_sync_reply_.Run(reply_id, reply.Pass());
+}
+
+void XWalkExtensionInstance::HandleContextMessage(int64_t context_id,
+    scoped_ptr<base::Value> msg) {
+  HandleMessage(msg.Pass());
+}
+
+void XWalkExtensionInstance::PostMessageToContext(int64_t context_id,
+    scoped_ptr<base::Value> msg) {
+  if (post_context_message_.is_null()) {
+    PostMessageToJS(msg.Pass());
+    return;
+  }
+  post_context_message_.Run(context_id, msg.Pass());
+}
+
 scoped_ptr<base::Value> XWalkExtensionInstance::HandleSyncMessage(
     scoped_ptr<base::Value> msg) {
   LOG(FATAL) << "Sending sync message to extension which doesn't support it!";
@@ -9,6 +9,7 @@
 #include <string>
 #include "base/callback_forward.h"
 #include "base/callback.h"
+#include "base/memory/ref_counted_memory.h"
 #include "base/values.h"
 
 namespace xwalk {
@@ -35,10 +36,97 @@ class XWalkExtension {
   // XWalkExtensionInstance. Callback will take the ownership of the message.
   typedef base::Callback<void(scoped_ptr<base::Value> msg)> PostMessageCallback;
 
+  // Callback type used by Instances to send binary messages. The payload is
+  // sent as raw bytes and exposed as an ArrayBuffer in the renderer, without
+  // being converted to a base::Value tree. It is still copied on the way: into
+  // the IPC message or a shared memory segment, and into the ArrayBuffer.
+  typedef base::Callback<void(const scoped_refptr<base::RefCountedMemory>&)>
+      PostBinaryMessageCallback;
+
+  // Callback type used by Instances to send messages that can be coalesced:
+  // a message that wasn't delivered yet is dropped when a newer one with the
+  // same key is posted.
+  typedef base::Callback<void(const std::string& key,
+                              scoped_ptr<base::Value> msg)>
+      PostCoalescedMessageCallback;
+
+  // Callback type used by Instances to answer a request, see
+  // XWalkExtensionInstance::HandleRequest(). Can be run from any thread.
+  typedef base::Callback<void(int request_id, scoped_ptr<base::Value> reply)>
+      PostReplyCallback;
+
+  // Callback type used by Instances to answer a synchronous message, see
+  // XWalkExtensionInstance::HandleDeferrableSyncMessage(). Can be run from
+  // any thread.
+  typedef base::Callback<void(int reply_id, scoped_ptr<base::Value> reply)>
+      PostSyncReplyCallback;
+
+  // Callback type used by Instances shared by many contexts to send messages
+  // to one of them, see XWalkExtension::InstanceMode.
+  typedef base::Callback<void(int64_t context_id,
+                              scoped_ptr<base::Value> msg)>
+      PostContextMessageCallback;
+
   // Create an XWalkExtensionInstance with the given |post_message| callback.
   virtual XWalkExtensionInstance* CreateInstance(
       const PostMessageCallback& post_message) = 0;
 
+  // Instances run either in a thread of their own or in a thread borrowed
+  // from a pool shared by all the extensions. Pooled instances still get
+  // their messages in order, but must not block nor rely on having a
+  // MessageLoop in their thread: waiting or doing IO in their handlers fails
+  // the base::ThreadRestrictions checks. Instances that block should keep a
+  // dedicated thread.
+  enum RunnerMode {
+    DEDICATED_THREAD,
+    POOLED_THREAD
+  };
+
+  RunnerMode runner_mode() const { return runner_mode_; }
+  void set_runner_mode(RunnerMode mode) { runner_mode_ = mode; }
+
+  // By default each JavaScript context, i.e. each frame, gets an instance of
+  // its own. Extensions that keep no state per context, or whose state is
+  // a singleton anyway, can have a single instance serving all the contexts
+  // of a render process instead, so pages with many frames don't multiply
+  // instances and threads. Such an instance gets the messages of each
+  // context through HandleContextMessage(), and its PostMessageToJS() goes
+  // to all the contexts. External extensions choose it with
+  // XW_Internal_InstanceModeInterface, see XW_Extension_InstanceMode.h.
+  enum InstanceMode {
+    INSTANCE_PER_CONTEXT,
+    INSTANCE_PER_PROCESS
+  };
+
+  InstanceMode instance_mode() const { return instance_mode_; }
+  void set_instance_mode(InstanceMode mode) { instance_mode_ = mode; }
+
+  // What happens when JavaScript posts messages to an instance faster than
+  // it handles them, and the limit of messages waiting in its queue is
+  // reached:
+  //   BLOCK_SENDER: postMessage() blocks until the instance catches up.
+  //   DROP_OLDEST: the oldest message still waiting is dropped. Sync
+  //       messages and requests are never dropped.
+  //   FAIL_MESSAGE: postMessage() and request() fail until the instance
+  //       catches up.
+  // The renderer learns the queue is full asynchronously, so the messages
+  // already on their way are still queued. By default there's no limit, so
+  // none of these apply until the extension sets one.
+  enum QueueFullPolicy {
+    BLOCK_SENDER,
+    DROP_OLDEST,
+    FAIL_MESSAGE
+  };
+
+  // Zero means no limit.
+  size_t message_queue_limit() const { return message_queue_limit_; }
+  void set_message_queue_limit(size_t limit) { message_queue_limit_ = limit; }
+
+  QueueFullPolicy queue_full_policy() const { return queue_full_policy_; }
+  void set_queue_full_policy(QueueFullPolicy policy) {
+    queue_full_policy_ = policy;
+  }
+
   std::string name() const { return name_; }
 
  protected:
@@ -51,6 +139,11 @@ class XWalkExtension {
   // Name of extension, used for dispatching messages.
   std::string name_;
 
+  RunnerMode runner_mode_;
+  InstanceMode instance_mode_;
+  size_t message_queue_limit_;
+  QueueFullPolicy queue_full_policy_;
+
   DISALLOW_COPY_AND_ASSIGN(XWalkExtension);
 };
 
@@ -70,8 +163,54 @@ class XWalkExtensionInstance {
   virtual scoped_ptr<base::Value> HandleSyncMessage(
       scoped_ptr<base::Value> msg);
 
+  // Allow to handle binary messages, i.e. ArrayBuffers posted from JavaScript
+  // code. The default implementation wraps the data in a base::BinaryValue
+  // and forwards it to HandleMessage(), so extensions that don't care about
+  // binary data keep working as before.
+  virtual void HandleBinaryMessage(
+      const scoped_refptr<base::RefCountedMemory>& data);
+
+  // Allow to handle requests, sent from JavaScript code with
+  // 'extension.request()'. Unlike synchronous messages, the renderer doesn't
+  // block: the reply is given later with PostReplyToJS(), possibly from
+  // another thread, and many requests can be waiting for a reply at the same
+  // time. The default implementation replies with a null value, extensions
+  // supporting requests must override it.
+  virtual void HandleRequest(int request_id, scoped_ptr<base::Value> msg);
+
+  // Same as HandleSyncMessage(), but the reply can be given later with
+  // PostSyncReplyToJS(), possibly from another thread. The renderer stays
+  // blocked until the reply. The default implementation replies with
+  // HandleSyncMessage().
+  virtual void HandleDeferrableSyncMessage(int reply_id,
+                                           scoped_ptr<base::Value> msg);
+
+  // Only called on instances of INSTANCE_PER_PROCESS extensions. Messages
+  // posted with 'extension.postMessage()' arrive here, with the id of the
+  // context that posted them. The default implementation calls
+  // HandleMessage(). Binary and sync messages, and requests, don't tell
+  // their context: their replies go to the right one anyway.
+  virtual void HandleContextMessage(int64_t context_id,
+                                    scoped_ptr<base::Value> msg);
+
+  // Only called on instances of INSTANCE_PER_PROCESS extensions, when a
+  // context starts or stops using the instance.
+  virtual void DidCreateContext(int64_t context_id) {}
+  virtual void WillDestroyContext(int64_t context_id) {}
+
   void SetPostMessageCallback(
       const XWalkExtension::PostMessageCallback& post_message);
+  void SetPostBinaryMessageCallback(
+      const XWalkExtension::PostBinaryMessageCallback& post_binary_message);
+  void SetPostCoalescedMessageCallback(
+      const XWalkExtension::PostCoalescedMessageCallback&
+          post_coalesced_message);
+  void SetPostReplyCallback(
+      const XWalkExtension::PostReplyCallback& post_reply);
+  void SetPostSyncReplyCallback(
+      const XWalkExtension::PostSyncReplyCallback& post_sync_reply);
+  void SetPostContextMessageCallback(
+      const XWalkExtension::PostContextMessageCallback& post_context_message);
 
  protected:
   explicit XWalkExtensionInstance();
@@ -83,8 +222,41 @@ class XWalkExtensionInstance {
     post_message_.Run(msg.Pass());
   }
 
+  // Similar to PostMessageToJS(), but the message will arrive as an
+  // ArrayBuffer in the JavaScript side.
+  void PostBinaryMessageToJS(
+      const scoped_refptr<base::RefCountedMemory>& data);
+
+  // Similar to PostMessageToJS(), but if a previous message with the same
+  // |key| is still waiting to be delivered, it is replaced by |msg|. Useful
+  // for extensions that stream state updates, where only the latest one
+  // matters for JavaScript.
+  void PostCoalescedMessageToJS(const std::string& key,
+                                scoped_ptr<base::Value> msg);
+
+  // Resolves the promise returned by 'extension.request()' with |reply|. Each
+  // request should be replied once. It is safe to call from any thread, as
+  // long as it happens before the instance is destroyed.
+  void PostReplyToJS(int request_id, scoped_ptr<base::Value> reply);
+
+  // Answers the synchronous message given to HandleDeferrableSyncMessage()
+  // with |reply_id|, unblocking the renderer. Each one must be answered
+  // once, from any thread. The ones still unanswered when the instance is
+  // destroyed get a null value.
+  void PostSyncReplyToJS(int reply_id, scoped_ptr<base::Value> reply);
+
+  // Posts |msg| to the context |context_id| only, for instances of
+  // INSTANCE_PER_PROCESS extensions. Other instances have a single context,
+  // and this is the same as PostMessageToJS().
+  void PostMessageToContext(int64_t context_id, scoped_ptr<base::Value> msg);
+
  private:
   XWalkExtension::PostMessageCallback post_message_;
+  XWalkExtension::PostBinaryMessageCallback post_binary_message_;
+  XWalkExtension::PostCoalescedMessageCallback post_coalesced_message_;
+  XWalkExtension::PostReplyCallback post_reply_;
+  XWalkExtension::PostSyncReplyCallback post_sync_reply_;
+  XWalkExtension::PostContextMessageCallback post_context_message_;
 
   DISALLOW_COPY_AND_ASSIGN(XWalkExtensionInstance);
 };
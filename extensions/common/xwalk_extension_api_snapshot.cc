@@ -0,0 +1,188 @@
+// Copyright (c) 2013 Intel Corporation. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "xwalk/extensions/common/xwalk_extension_api_snapshot.h"
+
+#include <string.h>
+#include <algorithm>
+#include "base/hash.h"
+#include "base/logging.h"
+
+#if defined(OS_LINUX)
+#include <fcntl.h>
+#include <unistd.h>
+#include "base/posix/eintr_wrapper.h"
+#include "base/strings/stringprintf.h"
+#endif
+
+namespace xwalk {
+namespace extensions {
+
+namespace {
+
+// The code of all the extensions together, way more than any real set of
+// extensions needs.
+const size_t kMaxSnapshotSize = 64 * 1024 * 1024;
+
+// Keeps the region mapped for as long as the code of any extension in it is
+// referenced.
+class MappedSnapshot : public base::RefCountedThreadSafe<MappedSnapshot> {
+ public:
+  MappedSnapshot(base::SharedMemoryHandle handle, size_t size)
+      : memory_(handle, true /* read_only */),
+        size_(size) {}
+
+  bool Map() { return memory_.Map(size_); }
+
+  const unsigned char* memory() const {
+    return static_cast<const unsigned char*>(memory_.memory());
+  }
+
+ private:
+  friend class base::RefCountedThreadSafe<MappedSnapshot>;
+  ~MappedSnapshot() {}
+
+  base::SharedMemory memory_;
+  size_t size_;
+};
+
+// The code of one extension, inside the mapped region.
+class SnapshotBytes : public base::RefCountedMemory {
+ public:
+  SnapshotBytes(const scoped_refptr<MappedSnapshot>& snapshot, size_t offset,
+                size_t size)
+      : snapshot_(snapshot),
+        offset_(offset),
+        size_(size) {}
+
+  virtual const unsigned char* front() const OVERRIDE {
+    return snapshot_->memory() + offset_;
+  }
+
+  virtual size_t size() const OVERRIDE { return size_; }
+
+ private:
+  virtual ~SnapshotBytes() {}
+
+  scoped_refptr<MappedSnapshot> snapshot_;
+  size_t offset_;
+  size_t size_;
+};
+
+}  // namespace
+
+XWalkExtensionAPISnapshot::XWalkExtensionAPISnapshot()
+    : region_size_(0)
+#if defined(OS_LINUX)
+    , read_only_fd_(-1)
+#endif
+{}
+
+XWalkExtensionAPISnapshot::~XWalkExtensionAPISnapshot() {
+#if defined(OS_LINUX)
+  if (read_only_fd_ >= 0 && HANDLE_EINTR(close(read_only_fd_)) < 0)
+    PLOG(ERROR) << "close";
+#endif
+}
+
+// static
+scoped_refptr<XWalkExtensionAPISnapshot> XWalkExtensionAPISnapshot::Create(
+    const std::vector<std::string>& names,
+    const std::vector<std::string>& apis) {
+  DCHECK_EQ(names.size(), apis.size());
+
+  size_t total_size = 0;
+  for (size_t i = 0; i < apis.size(); ++i) {
+    total_size += apis[i].size();
+    if (total_size > kMaxSnapshotSize) {
+      LOG(WARNING) << "JavaScript API code of the extensions is too big for "
+                   << "a snapshot.";
+      return NULL;
+    }
+  }
+
+  scoped_refptr<XWalkExtensionAPISnapshot> snapshot(
+      new XWalkExtensionAPISnapshot);
+
+  // Empty regions can't be created.
+  const size_t region_size = std::max(total_size, static_cast<size_t>(1));
+  if (!snapshot->memory_.CreateAnonymous(region_size) ||
+      !snapshot->memory_.Map(region_size)) {
+    LOG(WARNING) << "Couldn't allocate shared memory of size " << region_size
+                 << " for the JavaScript API code of the extensions.";
+    return NULL;
+  }
+
+  char* memory = static_cast<char*>(snapshot->memory_.memory());
+  size_t offset = 0;
+  for (size_t i = 0; i < apis.size(); ++i) {
+    memcpy(memory + offset, apis[i].data(), apis[i].size());
+    offset += apis[i].size();
+    snapshot->hashes_.push_back(base::Hash(apis[i]));
+    snapshot->sizes_.push_back(static_cast<uint32_t>(apis[i].size()));
+  }
+  snapshot->names_ = names;
+  snapshot->region_size_ = static_cast<uint32_t>(region_size);
+
+#if defined(OS_LINUX)
+  // Opening the region through /proc gives a new file description, with its
+  // own access mode, while duplicating our descriptor would keep it writable.
+  std::string path = base::StringPrintf(
+      "/proc/self/fd/%d", snapshot->memory_.handle().fd);
+  snapshot->read_only_fd_ = HANDLE_EINTR(open(path.c_str(), O_RDONLY));
+  if (snapshot->read_only_fd_ < 0)
+    PLOG(WARNING) << "Couldn't reopen the JavaScript API snapshot read-only";
+#endif
+
+  return snapshot;
+}
+
+bool XWalkExtensionAPISnapshot::ShareToProcess(
+    base::ProcessHandle process, base::SharedMemoryHandle* handle) {
+#if defined(OS_LINUX)
+  if (read_only_fd_ < 0)
+    return false;
+  int fd = HANDLE_EINTR(dup(read_only_fd_));
+  if (fd < 0)
+    return false;
+  *handle = base::FileDescriptor(fd, true);
+  return true;
+#else
+  return false;
+#endif
+}
+
+bool MapExtensionAPISnapshot(
+    base::SharedMemoryHandle handle, uint32_t region_size,
+    const std::vector<uint32_t>& sizes,
+    std::vector<scoped_refptr<base::RefCountedMemory> >* apis) {
+  scoped_refptr<MappedSnapshot> snapshot(
+      new MappedSnapshot(handle, region_size));
+
+  // The handle is closed with |snapshot| if we give up.
+  uint64_t total_size = 0;
+  for (size_t i = 0; i < sizes.size(); ++i)
+    total_size += sizes[i];
+  if (total_size > region_size) {
+    LOG(WARNING) << "Invalid JavaScript API snapshot, the code of the "
+                 << "extensions doesn't fit in the region.";
+    return false;
+  }
+
+  if (!snapshot->Map()) {
+    LOG(WARNING) << "Couldn't map the JavaScript API snapshot of size "
+                 << region_size;
+    return false;
+  }
+
+  size_t offset = 0;
+  for (size_t i = 0; i < sizes.size(); ++i) {
+    apis->push_back(new SnapshotBytes(snapshot, offset, sizes[i]));
+    offset += sizes[i];
+  }
+  return true;
+}
+
+}  // namespace extensions
+}  // namespace xwalk
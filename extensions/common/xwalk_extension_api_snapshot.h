@@ -0,0 +1,82 @@
+// Copyright (c) 2013 Intel Corporation. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef XWALK_EXTENSIONS_COMMON_XWALK_EXTENSION_API_SNAPSHOT_H_
+#define XWALK_EXTENSIONS_COMMON_XWALK_EXTENSION_API_SNAPSHOT_H_
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include "base/memory/ref_counted.h"
+#include "base/memory/ref_counted_memory.h"
+#include "base/memory/scoped_ptr.h"
+#include "base/memory/shared_memory.h"
+#include "base/process_util.h"
+
+namespace xwalk {
+namespace extensions {
+
+// The JavaScript API code of a set of extensions, laid out one after the
+// other in a single shared memory region. Render processes map the region
+// read-only and get the code of each extension from it, so only the names,
+// the hashes and the sizes of the code go through the IPC channel. The same
+// region is shared with all the render processes, so they only get a
+// descriptor opened read-only, which can't be mapped writable.
+//
+// Only Linux can reopen the region read-only, elsewhere the snapshot can't be
+// shared and the code has to be sent in the messages.
+class XWalkExtensionAPISnapshot
+    : public base::RefCountedThreadSafe<XWalkExtensionAPISnapshot> {
+ public:
+  // |names| and |apis| have one entry per extension. Returns NULL if the
+  // shared memory couldn't be created.
+  static scoped_refptr<XWalkExtensionAPISnapshot> Create(
+      const std::vector<std::string>& names,
+      const std::vector<std::string>& apis);
+
+  // Gives a read-only handle of the region for |process|. Returns false if
+  // the region couldn't be shared. Can be called from any thread.
+  bool ShareToProcess(base::ProcessHandle process,
+                      base::SharedMemoryHandle* handle);
+
+  const std::vector<std::string>& names() const { return names_; }
+  const std::vector<uint32_t>& hashes() const { return hashes_; }
+  const std::vector<uint32_t>& sizes() const { return sizes_; }
+
+  // Size of the region, at least the sum of |sizes|.
+  uint32_t region_size() const { return region_size_; }
+
+ private:
+  friend class base::RefCountedThreadSafe<XWalkExtensionAPISnapshot>;
+  XWalkExtensionAPISnapshot();
+  ~XWalkExtensionAPISnapshot();
+
+  std::vector<std::string> names_;
+  std::vector<uint32_t> hashes_;
+  std::vector<uint32_t> sizes_;
+
+  base::SharedMemory memory_;
+  uint32_t region_size_;
+
+#if defined(OS_LINUX)
+  // The region opened again read-only, duplicated for each render process.
+  int read_only_fd_;
+#endif
+
+  DISALLOW_COPY_AND_ASSIGN(XWalkExtensionAPISnapshot);
+};
+
+// Maps the region of a snapshot read-only, and fills |apis| with the code of
+// each extension, in the order of |sizes|. The code is read directly from the
+// mapped region, which stays mapped while any of |apis| is referenced.
+// Returns false if the region couldn't be mapped or |sizes| doesn't fit in it.
+bool MapExtensionAPISnapshot(
+    base::SharedMemoryHandle handle, uint32_t region_size,
+    const std::vector<uint32_t>& sizes,
+    std::vector<scoped_refptr<base::RefCountedMemory> >* apis);
+
+}  // namespace extensions
+}  // namespace xwalk
+
+#endif  // XWALK_EXTENSIONS_COMMON_XWALK_EXTENSION_API_SNAPSHOT_H_
@@ -0,0 +1,162 @@
+// Copyright (c) 2013 Intel Corporation. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "xwalk/extensions/common/xwalk_extension_api_snapshot.h"
+
+#include <string>
+#include <vector>
+#include "base/hash.h"
+
+#if defined(OS_LINUX)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include "base/posix/eintr_wrapper.h"
+#endif
+
+#include "testing/gtest/include/gtest/gtest.h"
+#include "xwalk/extensions/common/xwalk_extension.h"
+#include "xwalk/extensions/common/xwalk_extension_set.h"
+
+using xwalk::extensions::MapExtensionAPISnapshot;
+using xwalk::extensions::XWalkExtension;
+using xwalk::extensions::XWalkExtensionAPISnapshot;
+using xwalk::extensions::XWalkExtensionInstance;
+using xwalk::extensions::XWalkExtensionSet;
+
+namespace {
+
+typedef std::vector<scoped_refptr<base::RefCountedMemory> > APIList;
+
+std::string ToString(const scoped_refptr<base::RefCountedMemory>& data) {
+  return std::string(reinterpret_cast<const char*>(data->front()),
+                     data->size());
+}
+
+class TestExtension : public XWalkExtension {
+ public:
+  TestExtension(const std::string& name, const std::string& api)
+      : api_(api) {
+    set_name(name);
+  }
+  virtual const char* GetJavaScriptAPI() OVERRIDE { return api_.c_str(); }
+  virtual XWalkExtensionInstance* CreateInstance(
+      const PostMessageCallback& post_message) OVERRIDE {
+    return NULL;
+  }
+
+ private:
+  std::string api_;
+};
+
+}  // namespace
+
+// The snapshot can only be shared on Linux.
+#if defined(OS_LINUX)
+TEST(XWalkExtensionAPISnapshotTest, CodeIsReadFromTheSharedRegion) {
+  std::vector<std::string> names;
+  std::vector<std::string> apis;
+  names.push_back("first");
+  apis.push_back("exports.first = 1;");
+  names.push_back("empty");
+  apis.push_back("");
+  names.push_back("big");
+  apis.push_back(std::string(256 * 1024, 'x'));
+
+  scoped_refptr<XWalkExtensionAPISnapshot> snapshot =
+      XWalkExtensionAPISnapshot::Create(names, apis);
+  ASSERT_TRUE(snapshot);
+  EXPECT_EQ(names, snapshot->names());
+  ASSERT_EQ(apis.size(), snapshot->hashes().size());
+  for (size_t i = 0; i < apis.size(); ++i)
+    EXPECT_EQ(base::Hash(apis[i]), snapshot->hashes()[i]);
+
+  base::SharedMemoryHandle handle;
+  ASSERT_TRUE(snapshot->ShareToProcess(base::GetCurrentProcessHandle(),
+                                       &handle));
+
+  APIList mapped;
+  ASSERT_TRUE(MapExtensionAPISnapshot(handle, snapshot->region_size(),
+                                      snapshot->sizes(), &mapped));
+  ASSERT_EQ(apis.size(), mapped.size());
+  for (size_t i = 0; i < apis.size(); ++i)
+    EXPECT_EQ(apis[i], ToString(mapped[i]));
+
+  // The mapping outlives the snapshot it came from.
+  snapshot = NULL;
+  EXPECT_EQ(apis[0], ToString(mapped[0]));
+}
+
+TEST(XWalkExtensionAPISnapshotTest, SizesNotFittingTheRegionAreRejected) {
+  std::vector<std::string> names(1, "ext");
+  std::vector<std::string> apis(1, "exports.x = 1;");
+  scoped_refptr<XWalkExtensionAPISnapshot> snapshot =
+      XWalkExtensionAPISnapshot::Create(names, apis);
+  ASSERT_TRUE(snapshot);
+
+  base::SharedMemoryHandle handle;
+  ASSERT_TRUE(snapshot->ShareToProcess(base::GetCurrentProcessHandle(),
+                                       &handle));
+
+  std::vector<uint32_t> sizes(snapshot->sizes());
+  sizes.push_back(snapshot->region_size());
+  APIList mapped;
+  EXPECT_FALSE(MapExtensionAPISnapshot(handle, snapshot->region_size(),
+                                       sizes, &mapped));
+  EXPECT_TRUE(mapped.empty());
+}
+
+TEST(XWalkExtensionAPISnapshotTest, SharedHandleCantBeMappedWritable) {
+  std::vector<std::string> names(1, "ext");
+  std::vector<std::string> apis(1, "exports.x = 1;");
+  scoped_refptr<XWalkExtensionAPISnapshot> snapshot =
+      XWalkExtensionAPISnapshot::Create(names, apis);
+  ASSERT_TRUE(snapshot);
+
+  base::SharedMemoryHandle handle;
+  ASSERT_TRUE(snapshot->ShareToProcess(base::GetCurrentProcessHandle(),
+                                       &handle));
+  EXPECT_EQ(O_RDONLY, fcntl(handle.fd, F_GETFL) & O_ACCMODE);
+
+  void* memory = mmap(NULL, snapshot->region_size(), PROT_READ | PROT_WRITE,
+                      MAP_SHARED, handle.fd, 0);
+  EXPECT_EQ(MAP_FAILED, memory);
+  if (memory != MAP_FAILED)
+    munmap(memory, snapshot->region_size());
+
+  // Reading is still fine.
+  APIList mapped;
+  ASSERT_TRUE(MapExtensionAPISnapshot(handle, snapshot->region_size(),
+                                      snapshot->sizes(), &mapped));
+  EXPECT_EQ(apis[0], ToString(mapped[0]));
+}
+#endif  // defined(OS_LINUX)
+
+TEST(XWalkExtensionAPISnapshotTest, SetSharesSnapshotUntilChanged) {
+  scoped_refptr<XWalkExtensionSet> extensions(new XWalkExtensionSet);
+  extensions->Add(scoped_ptr<XWalkExtension>(
+      new TestExtension("first", "exports.first = 1;")));
+
+  scoped_refptr<XWalkExtensionAPISnapshot> snapshot =
+      extensions->GetAPISnapshot();
+  ASSERT_TRUE(snapshot);
+  EXPECT_EQ(snapshot, extensions->GetAPISnapshot());
+  EXPECT_EQ(1u, snapshot->names().size());
+
+  extensions->Add(scoped_ptr<XWalkExtension>(
+      new TestExtension("second", "exports.second = 2;")));
+  scoped_refptr<XWalkExtensionAPISnapshot> added =
+      extensions->GetAPISnapshot();
+  ASSERT_TRUE(added);
+  EXPECT_NE(snapshot, added);
+  EXPECT_EQ(2u, added->names().size());
+
+  extensions->Remove("first");
+  scoped_refptr<XWalkExtensionAPISnapshot> removed =
+      extensions->GetAPISnapshot();
+  ASSERT_TRUE(removed);
+  EXPECT_NE(added, removed);
+  ASSERT_EQ(1u, removed->names().size());
+  EXPECT_EQ("second", removed->names()[0]);
+}
@@ -0,0 +1,153 @@
+// Copyright (c) 2013 Intel Corporation. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "xwalk/extensions/common/xwalk_extension_code_cache_store.h"
+
+#include <string.h>
+#include "base/bind.h"
+#include "base/file_util.h"
+#include "base/logging.h"
+#include "base/strings/stringprintf.h"
+
+namespace xwalk {
+namespace extensions {
+
+namespace {
+
+// Preparse data of the JS API of an extension is a few KB, so this is plenty.
+const size_t kMaxDataSize = 1024 * 1024;
+
+// Files also hold the header line.
+const int64 kMaxEntrySize = kMaxDataSize + 1024;
+
+// Header of V8 preparse data, see PreparseDataConstants in
+// v8/src/preparse-data-format.h. The data is a sequence of unsigned words.
+// Data from another V8 version never reaches V8, since the version is part of
+// the key of the code.
+const unsigned kPreparseMagicNumber = 0xBadDead;
+const size_t kPreparseMagicOffset = 0;
+const size_t kPreparseHasErrorOffset = 2;
+const size_t kPreparseFunctionsSizeOffset = 3;
+const size_t kPreparseHeaderSize = 6;
+
+// The header line is the hash of the JS API code and the key of the wrapped
+// code the data was produced for.
+std::string CreateHeader(uint32_t api_hash, const std::string& key) {
+  return base::StringPrintf("%08x %s", api_hash, key.c_str());
+}
+
+}  // namespace
+
+XWalkExtensionCodeCacheStore::XWalkExtensionCodeCacheStore(
+    const base::FilePath& directory,
+    const scoped_refptr<base::SequencedTaskRunner>& task_runner)
+    : directory_(directory),
+      task_runner_(task_runner) {
+}
+
+XWalkExtensionCodeCacheStore::~XWalkExtensionCodeCacheStore() {}
+
+void XWalkExtensionCodeCacheStore::Load(
+    const std::vector<std::string>& names,
+    const std::vector<uint32_t>& api_hashes,
+    const LoadCallback& callback) {
+  DCHECK_EQ(names.size(), api_hashes.size());
+  EntryList* entries = new EntryList;
+  task_runner_->PostTaskAndReply(FROM_HERE,
+      base::Bind(&XWalkExtensionCodeCacheStore::LoadOnTaskRunner, this,
+                 names, api_hashes, entries),
+      base::Bind(callback, base::Owned(entries)));
+}
+
+void XWalkExtensionCodeCacheStore::Store(const std::string& name,
+                                         uint32_t api_hash,
+                                         const std::string& key,
+                                         const std::string& data) {
+  if (!IsValidData(data)) {
+    LOG(WARNING) << "Ignoring invalid code cache for extension " << name;
+    return;
+  }
+
+  task_runner_->PostTask(FROM_HERE,
+      base::Bind(&XWalkExtensionCodeCacheStore::StoreOnTaskRunner, this,
+                 name, api_hash, key, data));
+}
+
+// static
+bool XWalkExtensionCodeCacheStore::IsValidData(const std::string& data) {
+  const size_t word_size = sizeof(unsigned);
+  if (data.size() > kMaxDataSize || data.size() % word_size != 0 ||
+      data.size() < kPreparseHeaderSize * word_size) {
+    return false;
+  }
+
+  unsigned header[kPreparseHeaderSize];
+  memcpy(header, data.data(), sizeof(header));
+  const size_t words = data.size() / word_size;
+  return header[kPreparseMagicOffset] == kPreparseMagicNumber &&
+         header[kPreparseHasErrorOffset] == 0 &&
+         header[kPreparseFunctionsSizeOffset] <= words - kPreparseHeaderSize;
+}
+
+base::FilePath XWalkExtensionCodeCacheStore::GetPath(
+    const std::string& name) const {
+  return directory_.AppendASCII(name + ".cache");
+}
+
+void XWalkExtensionCodeCacheStore::LoadOnTaskRunner(
+    const std::vector<std::string>& names,
+    const std::vector<uint32_t>& api_hashes, EntryList* entries) {
+  for (size_t i = 0; i < names.size(); ++i) {
+    base::FilePath path = GetPath(names[i]);
+    int64 size;
+    if (!file_util::GetFileSize(path, &size) || size > kMaxEntrySize)
+      continue;
+
+    std::string contents;
+    if (!file_util::ReadFileToString(path, &contents))
+      continue;
+
+    // The file is the header in the first line, followed by the data.
+    size_t pos = contents.find('\n');
+    if (pos == std::string::npos)
+      continue;
+
+    std::string header = contents.substr(0, pos);
+    const std::string expected_prefix = CreateHeader(api_hashes[i], "");
+    if (header.compare(0, expected_prefix.size(), expected_prefix) != 0 ||
+        header.size() == expected_prefix.size())
+      continue;
+
+    Entry entry;
+    entry.name = names[i];
+    entry.key = header.substr(expected_prefix.size());
+    entry.data = contents.substr(pos + 1);
+    if (!IsValidData(entry.data))
+      continue;
+    entries->push_back(entry);
+  }
+}
+
+void XWalkExtensionCodeCacheStore::StoreOnTaskRunner(const std::string& name,
+                                                     uint32_t api_hash,
+                                                     const std::string& key,
+                                                     const std::string& data) {
+  if (key.empty() || key.find('\n') != std::string::npos)
+    return;
+
+  if (!file_util::CreateDirectory(directory_)) {
+    LOG(WARNING) << "Couldn't create extension code cache directory "
+                 << directory_.AsUTF8Unsafe();
+    return;
+  }
+
+  std::string contents = CreateHeader(api_hash, key) + '\n' + data;
+  int written = file_util::WriteFile(GetPath(name), contents.data(),
+                                     contents.size());
+  if (written != static_cast<int>(contents.size()))
+    LOG(WARNING) << "Couldn't write code cache for extension " << name;
+}
+
+}  // namespace extensions
+}  // namespace xwalk
@@ -0,0 +1,81 @@
+// Copyright (c) 2013 Intel Corporation. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef XWALK_EXTENSIONS_COMMON_XWALK_EXTENSION_CODE_CACHE_STORE_H_
+#define XWALK_EXTENSIONS_COMMON_XWALK_EXTENSION_CODE_CACHE_STORE_H_
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include "base/callback.h"
+#include "base/files/file_path.h"
+#include "base/memory/ref_counted.h"
+#include "base/sequenced_task_runner.h"
+
+namespace xwalk {
+namespace extensions {
+
+// Keeps on disk the preparse data the renderers produce for the JS API code
+// of extensions, see XWalkExtensionCodeCache. There's one file per extension
+// in |directory|, holding the key of the code and the data. All the file
+// operations run in |task_runner|.
+//
+// The data comes from renderers, so it isn't trusted: it is only stored and
+// loaded if it looks like V8 preparse data of a sane size, and each entry is
+// bound to the hash of the JS API code the browser knows, so data produced
+// for another version of the code is never given back.
+class XWalkExtensionCodeCacheStore
+    : public base::RefCountedThreadSafe<XWalkExtensionCodeCacheStore> {
+ public:
+  struct Entry {
+    std::string name;
+    std::string key;
+    std::string data;
+  };
+  typedef std::vector<Entry> EntryList;
+
+  // Called in the thread Load() was called from.
+  typedef base::Callback<void(EntryList* entries)> LoadCallback;
+
+  XWalkExtensionCodeCacheStore(
+      const base::FilePath& directory,
+      const scoped_refptr<base::SequencedTaskRunner>& task_runner);
+
+  // Reads the entries for the extensions in |names|, whose JS API code has
+  // the hashes in |api_hashes|. The ones missing, unreadable or stored for
+  // another code are skipped.
+  void Load(const std::vector<std::string>& names,
+            const std::vector<uint32_t>& api_hashes,
+            const LoadCallback& callback);
+
+  // Replaces the entry of extension |name|, whose JS API code has the hash
+  // |api_hash|. The name must have been validated by the caller, it is used
+  // as the file name. Invalid data is ignored.
+  void Store(const std::string& name, uint32_t api_hash,
+             const std::string& key, const std::string& data);
+
+  // Whether |data| could be V8 preparse data, checking its size and header.
+  static bool IsValidData(const std::string& data);
+
+ private:
+  friend class base::RefCountedThreadSafe<XWalkExtensionCodeCacheStore>;
+  ~XWalkExtensionCodeCacheStore();
+
+  base::FilePath GetPath(const std::string& name) const;
+  void LoadOnTaskRunner(const std::vector<std::string>& names,
+                        const std::vector<uint32_t>& api_hashes,
+                        EntryList* entries);
+  void StoreOnTaskRunner(const std::string& name, uint32_t api_hash,
+                         const std::string& key, const std::string& data);
+
+  const base::FilePath directory_;
+  scoped_refptr<base::SequencedTaskRunner> task_runner_;
+
+  DISALLOW_COPY_AND_ASSIGN(XWalkExtensionCodeCacheStore);
+};
+
+}  // namespace extensions
+}  // namespace xwalk
+
+#endif  // XWALK_EXTENSIONS_COMMON_XWALK_EXTENSION_CODE_CACHE_STORE_H_
@@ -0,0 +1,154 @@
+// Copyright (c) 2013 Intel Corporation. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "xwalk/extensions/common/xwalk_extension_code_cache_store.h"
+
+#include <string>
+#include <vector>
+#include "base/bind.h"
+#include "base/file_util.h"
+#include "base/files/scoped_temp_dir.h"
+#include "base/message_loop/message_loop.h"
+#include "base/message_loop/message_loop_proxy.h"
+#include "base/run_loop.h"
+#include "testing/gtest/include/gtest/gtest.h"
+
+using xwalk::extensions::XWalkExtensionCodeCacheStore;
+
+namespace {
+
+void SaveEntries(XWalkExtensionCodeCacheStore::EntryList* result,
+                 XWalkExtensionCodeCacheStore::EntryList* entries) {
+  *result = *entries;
+}
+
+// Something shaped like V8 preparse data: a header with the magic number and
+// no error, followed by |words| words of function data.
+std::string CreateData(unsigned words, unsigned fill) {
+  std::vector<unsigned> data(6 + words, fill);
+  data[0] = 0xBadDead;
+  data[1] = 7;
+  data[2] = 0;
+  data[3] = words;
+  data[4] = 0;
+  data[5] = 0;
+  return std::string(reinterpret_cast<const char*>(&data[0]),
+                     data.size() * sizeof(unsigned));
+}
+
+}  // namespace
+
+TEST(XWalkExtensionCodeCacheStoreTest, StoredEntriesAreLoaded) {
+  base::MessageLoop message_loop;
+  base::ScopedTempDir temp_dir;
+  ASSERT_TRUE(temp_dir.CreateUniqueTempDir());
+
+  scoped_refptr<XWalkExtensionCodeCacheStore> store(
+      new XWalkExtensionCodeCacheStore(
+          temp_dir.path().AppendASCII("cache"),
+          base::MessageLoopProxy::current()));
+
+  // The newline is part of the data, not a separator.
+  const std::string data = CreateData(4, '\n');
+  store->Store("a.b", 1, "key1", data);
+  store->Store("c", 2, "key2", CreateData(1, 2));
+  store->Store("c", 2, "key3", CreateData(1, 3));
+
+  std::vector<std::string> names;
+  std::vector<uint32_t> api_hashes;
+  names.push_back("a.b");
+  api_hashes.push_back(1);
+  names.push_back("c");
+  api_hashes.push_back(2);
+  names.push_back("not_stored");
+  api_hashes.push_back(3);
+
+  XWalkExtensionCodeCacheStore::EntryList entries;
+  store->Load(names, api_hashes, base::Bind(&SaveEntries, &entries));
+  base::RunLoop().RunUntilIdle();
+
+  ASSERT_EQ(2U, entries.size());
+  EXPECT_EQ("a.b", entries[0].name);
+  EXPECT_EQ("key1", entries[0].key);
+  EXPECT_EQ(data, entries[0].data);
+  EXPECT_EQ("c", entries[1].name);
+  EXPECT_EQ("key3", entries[1].key);
+  EXPECT_EQ(CreateData(1, 3), entries[1].data);
+}
+
+// Entries are only given back for the JS API code they were stored for.
+TEST(XWalkExtensionCodeCacheStoreTest, EntriesOfOtherCodeAreSkipped) {
+  base::MessageLoop message_loop;
+  base::ScopedTempDir temp_dir;
+  ASSERT_TRUE(temp_dir.CreateUniqueTempDir());
+
+  scoped_refptr<XWalkExtensionCodeCacheStore> store(
+      new XWalkExtensionCodeCacheStore(temp_dir.path(),
+                                       base::MessageLoopProxy::current()));
+  store->Store("a", 1, "key", CreateData(1, 0));
+
+  std::vector<std::string> names(1, "a");
+  std::vector<uint32_t> api_hashes(1, 2);
+  XWalkExtensionCodeCacheStore::EntryList entries;
+  store->Load(names, api_hashes, base::Bind(&SaveEntries, &entries));
+  base::RunLoop().RunUntilIdle();
+
+  EXPECT_TRUE(entries.empty());
+}
+
+// Data from renderers is checked before it reaches the disk.
+TEST(XWalkExtensionCodeCacheStoreTest, InvalidDataIsRejected) {
+  EXPECT_TRUE(XWalkExtensionCodeCacheStore::IsValidData(CreateData(0, 0)));
+  EXPECT_TRUE(XWalkExtensionCodeCacheStore::IsValidData(CreateData(10, 0)));
+
+  EXPECT_FALSE(XWalkExtensionCodeCacheStore::IsValidData(""));
+  EXPECT_FALSE(XWalkExtensionCodeCacheStore::IsValidData("not preparse data"));
+
+  std::string bad_magic = CreateData(1, 0);
+  bad_magic[0] ^= 1;
+  EXPECT_FALSE(XWalkExtensionCodeCacheStore::IsValidData(bad_magic));
+
+  std::string truncated = CreateData(4, 0);
+  truncated.resize(truncated.size() - sizeof(unsigned));
+  EXPECT_FALSE(XWalkExtensionCodeCacheStore::IsValidData(truncated));
+
+  std::string odd_size = CreateData(1, 0) + "x";
+  EXPECT_FALSE(XWalkExtensionCodeCacheStore::IsValidData(odd_size));
+
+  EXPECT_FALSE(XWalkExtensionCodeCacheStore::IsValidData(
+      CreateData(2 * 1024 * 1024 / sizeof(unsigned), 0)));
+
+  base::MessageLoop message_loop;
+  base::ScopedTempDir temp_dir;
+  ASSERT_TRUE(temp_dir.CreateUniqueTempDir());
+  scoped_refptr<XWalkExtensionCodeCacheStore> store(
+      new XWalkExtensionCodeCacheStore(temp_dir.path(),
+                                       base::MessageLoopProxy::current()));
+  store->Store("a", 1, "key", bad_magic);
+  base::RunLoop().RunUntilIdle();
+  EXPECT_FALSE(file_util::PathExists(temp_dir.path().AppendASCII("a.cache")));
+}
+
+TEST(XWalkExtensionCodeCacheStoreTest, InvalidFilesAreSkipped) {
+  base::MessageLoop message_loop;
+  base::ScopedTempDir temp_dir;
+  ASSERT_TRUE(temp_dir.CreateUniqueTempDir());
+
+  const std::string contents("no key separator");
+  ASSERT_EQ(static_cast<int>(contents.size()),
+            file_util::WriteFile(temp_dir.path().AppendASCII("bad.cache"),
+                                 contents.data(), contents.size()));
+
+  scoped_refptr<XWalkExtensionCodeCacheStore> store(
+      new XWalkExtensionCodeCacheStore(temp_dir.path(),
+                                       base::MessageLoopProxy::current()));
+
+  std::vector<std::string> names(1, "bad");
+  std::vector<uint32_t> api_hashes(1, 0);
+  XWalkExtensionCodeCacheStore::EntryList entries;
+  store->Load(names, api_hashes, base::Bind(&SaveEntries, &entries));
+  base::RunLoop().RunUntilIdle();
+
+  EXPECT_TRUE(entries.empty());
+}
@@ -0,0 +1,113 @@
+// Copyright (c) 2013 Intel Corporation. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "xwalk/extensions/common/xwalk_extension_frame_policy.h"
+
+#include "base/values.h"
+
+namespace xwalk {
+namespace extensions {
+
+namespace {
+
+const char kSubframesKey[] = "subframes";
+const char kOriginsKey[] = "origins";
+
+const char kSubframesAll[] = "all";
+const char kSubframesSameOrigin[] = "same-origin";
+const char kSubframesNone[] = "none";
+
+const char kAboutBlankURL[] = "about:blank";
+const char kDataScheme[] = "data";
+
+// GURL only knows the origin of URLs with standard schemes, the others are
+// compared by scheme.
+std::string OriginOf(const GURL& url) {
+  if (url.IsStandard())
+    return url.GetOrigin().spec();
+  return url.scheme() + ":";
+}
+
+}  // namespace
+
+XWalkExtensionFramePolicy::XWalkExtensionFramePolicy()
+    : subframe_mode_(SUBFRAMES_ALL) {}
+
+XWalkExtensionFramePolicy::~XWalkExtensionFramePolicy() {}
+
+bool XWalkExtensionFramePolicy::InitFromValue(
+    const base::DictionaryValue& value, std::string* error) {
+  SubframeMode subframe_mode = SUBFRAMES_ALL;
+  std::string subframes;
+  if (value.HasKey(kSubframesKey)) {
+    if (!value.GetString(kSubframesKey, &subframes)) {
+      *error = "'subframes' must be a string.";
+      return false;
+    }
+    if (subframes == kSubframesSameOrigin) {
+      subframe_mode = SUBFRAMES_SAME_ORIGIN;
+    } else if (subframes == kSubframesNone) {
+      subframe_mode = SUBFRAMES_NONE;
+    } else if (subframes != kSubframesAll) {
+      *error = "Invalid value for 'subframes': " + subframes;
+      return false;
+    }
+  }
+
+  std::vector<std::string> origins;
+  if (value.HasKey(kOriginsKey)) {
+    const base::ListValue* list;
+    if (!value.GetList(kOriginsKey, &list)) {
+      *error = "'origins' must be a list.";
+      return false;
+    }
+    for (size_t i = 0; i < list->GetSize(); ++i) {
+      std::string origin;
+      GURL url;
+      if (list->GetString(i, &origin))
+        url = GURL(origin);
+      if (!url.is_valid()) {
+        *error = "Invalid origin in 'origins': " + origin;
+        return false;
+      }
+      origins.push_back(OriginOf(url));
+    }
+  }
+
+  subframe_mode_ = subframe_mode;
+  origins_.swap(origins);
+  return true;
+}
+
+bool XWalkExtensionFramePolicy::ShouldSetUpFrame(
+    const GURL& url, const GURL& top_url, bool is_main_frame) const {
+  if (url == GURL(kAboutBlankURL))
+    return false;
+
+  // Usually ads or widgets built by script. A data: main frame was navigated
+  // to on purpose, so it keeps extensions, within the rules below.
+  if (!is_main_frame && url.SchemeIs(kDataScheme))
+    return false;
+
+  if (!is_main_frame) {
+    if (subframe_mode_ == SUBFRAMES_NONE)
+      return false;
+    if (subframe_mode_ == SUBFRAMES_SAME_ORIGIN &&
+        OriginOf(url) != OriginOf(top_url))
+      return false;
+  }
+
+  if (origins_.empty())
+    return true;
+
+  std::string origin = OriginOf(url);
+  for (size_t i = 0; i < origins_.size(); ++i) {
+    if (origins_[i] == origin)
+      return true;
+  }
+  return false;
+}
+
+}  // namespace extensions
+}  // namespace xwalk
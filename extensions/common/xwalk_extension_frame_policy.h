@@ -0,0 +1,68 @@
+// Copyright (c) 2013 Intel Corporation. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef XWALK_EXTENSIONS_COMMON_XWALK_EXTENSION_FRAME_POLICY_H_
+#define XWALK_EXTENSIONS_COMMON_XWALK_EXTENSION_FRAME_POLICY_H_
+
+#include <string>
+#include <vector>
+#include "googleurl/src/gurl.h"
+
+namespace base {
+class DictionaryValue;
+}
+
+namespace xwalk {
+namespace extensions {
+
+// Decides which frames get the extension machinery, i.e. a module system and
+// instances of the extensions they use. Frames that can't use extensions
+// anyway, about:blank ones and subframes with data: URLs, never get it. By
+// default every other frame does; applications can restrict it in their
+// manifest:
+//
+//   "xwalk_extensions": {
+//     "subframes": "same-origin",
+//     "origins": ["app://myapp", "https://example.com"]
+//   }
+//
+// "subframes" is "all" (the default), "same-origin", for the subframes with
+// the origin of their main frame, or "none". When "origins" is given, only
+// the frames with one of them get extensions. app: is registered as a
+// standard scheme by the runtime, so app://myapp is an origin of its own. URLs
+// with non-standard schemes have no origin and are told apart by their scheme
+// only.
+class XWalkExtensionFramePolicy {
+ public:
+  enum SubframeMode {
+    SUBFRAMES_ALL,
+    SUBFRAMES_SAME_ORIGIN,
+    SUBFRAMES_NONE
+  };
+
+  XWalkExtensionFramePolicy();
+  ~XWalkExtensionFramePolicy();
+
+  // Reads the policy from the "xwalk_extensions" section of a manifest.
+  // Returns false and sets |error| if it's malformed, leaving the policy
+  // unchanged.
+  bool InitFromValue(const base::DictionaryValue& value, std::string* error);
+
+  // |top_url| is the URL of the main frame, same as |url| for main frames.
+  bool ShouldSetUpFrame(const GURL& url, const GURL& top_url,
+                        bool is_main_frame) const;
+
+  SubframeMode subframe_mode() const { return subframe_mode_; }
+
+ private:
+  SubframeMode subframe_mode_;
+
+  // Empty when every origin gets extensions.
+  std::vector<std::string> origins_;
+};
+
+}  // namespace extensions
+}  // namespace xwalk
+
+#endif  // XWALK_EXTENSIONS_COMMON_XWALK_EXTENSION_FRAME_POLICY_H_
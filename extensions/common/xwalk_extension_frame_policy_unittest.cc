@@ -0,0 +1,137 @@
+// Copyright (c) 2013 Intel Corporation. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "xwalk/extensions/common/xwalk_extension_frame_policy.h"
+
+#include "base/basictypes.h"
+#include "base/json/json_reader.h"
+#include "base/memory/scoped_ptr.h"
+#include "base/values.h"
+#include "googleurl/src/url_util.h"
+#include "testing/gtest/include/gtest/gtest.h"
+
+using xwalk::extensions::XWalkExtensionFramePolicy;
+
+namespace {
+
+const GURL kTopURL("https://example.com/index.html");
+
+bool InitFromJSON(XWalkExtensionFramePolicy* policy, const std::string& json,
+                  std::string* error) {
+  scoped_ptr<base::Value> value(base::JSONReader::Read(json));
+  base::DictionaryValue* dict;
+  if (!value || !value->GetAsDictionary(&dict))
+    return false;
+  return policy->InitFromValue(*dict, error);
+}
+
+// The runtime registers app: as a standard scheme, see XWalkContentClient.
+void RegisterAppScheme() {
+  static bool registered = false;
+  if (registered)
+    return;
+  url_util::AddStandardScheme("app");
+  registered = true;
+}
+
+}  // namespace
+
+TEST(XWalkExtensionFramePolicyTest, DefaultPolicy) {
+  XWalkExtensionFramePolicy policy;
+  EXPECT_TRUE(policy.ShouldSetUpFrame(kTopURL, kTopURL, true));
+  EXPECT_TRUE(policy.ShouldSetUpFrame(GURL("https://ads.example.org/"),
+                                      kTopURL, false));
+
+  // Frames that can't use extensions anyway.
+  EXPECT_FALSE(policy.ShouldSetUpFrame(GURL("about:blank"), kTopURL, false));
+  EXPECT_FALSE(policy.ShouldSetUpFrame(GURL("data:text/html,<p>ad</p>"),
+                                       kTopURL, false));
+  EXPECT_FALSE(policy.ShouldSetUpFrame(GURL("about:blank"),
+                                       GURL("about:blank"), true));
+
+  // Only data: subframes are left out.
+  const GURL data_url("data:text/html,<p>app</p>");
+  EXPECT_TRUE(policy.ShouldSetUpFrame(data_url, data_url, true));
+}
+
+TEST(XWalkExtensionFramePolicyTest, SameOriginSubframes) {
+  XWalkExtensionFramePolicy policy;
+  std::string error;
+  ASSERT_TRUE(InitFromJSON(&policy, "{\"subframes\": \"same-origin\"}",
+                           &error)) << error;
+
+  EXPECT_TRUE(policy.ShouldSetUpFrame(kTopURL, kTopURL, true));
+  EXPECT_TRUE(policy.ShouldSetUpFrame(GURL("https://example.com/frame.html"),
+                                      kTopURL, false));
+  EXPECT_FALSE(policy.ShouldSetUpFrame(GURL("https://ads.example.org/"),
+                                       kTopURL, false));
+  EXPECT_FALSE(policy.ShouldSetUpFrame(GURL("http://example.com/frame.html"),
+                                       kTopURL, false));
+}
+
+TEST(XWalkExtensionFramePolicyTest, NoSubframes) {
+  XWalkExtensionFramePolicy policy;
+  std::string error;
+  ASSERT_TRUE(InitFromJSON(&policy, "{\"subframes\": \"none\"}", &error))
+      << error;
+
+  EXPECT_TRUE(policy.ShouldSetUpFrame(kTopURL, kTopURL, true));
+  EXPECT_FALSE(policy.ShouldSetUpFrame(kTopURL, kTopURL, false));
+}
+
+TEST(XWalkExtensionFramePolicyTest, AllowedOrigins) {
+  RegisterAppScheme();
+  XWalkExtensionFramePolicy policy;
+  std::string error;
+  ASSERT_TRUE(InitFromJSON(&policy,
+      "{\"origins\": [\"https://example.com\", \"app://myapp\"]}", &error))
+      << error;
+
+  EXPECT_TRUE(policy.ShouldSetUpFrame(kTopURL, kTopURL, true));
+  EXPECT_TRUE(policy.ShouldSetUpFrame(GURL("app://myapp/index.html"),
+                                      GURL("app://myapp/index.html"), true));
+  EXPECT_FALSE(policy.ShouldSetUpFrame(GURL("app://otherapp/index.html"),
+                                       GURL("app://otherapp/index.html"),
+                                       true));
+  EXPECT_FALSE(policy.ShouldSetUpFrame(GURL("https://example.org/"),
+                                       GURL("https://example.org/"), true));
+  EXPECT_FALSE(policy.ShouldSetUpFrame(GURL("https://ads.example.org/"),
+                                       kTopURL, false));
+}
+
+// Without an origin, all the URLs of a non-standard scheme are alike.
+TEST(XWalkExtensionFramePolicyTest, NonStandardSchemes) {
+  XWalkExtensionFramePolicy policy;
+  std::string error;
+  ASSERT_TRUE(InitFromJSON(&policy, "{\"origins\": [\"widget:main\"]}",
+                           &error)) << error;
+
+  const GURL url("widget:other");
+  ASSERT_FALSE(url.IsStandard());
+  EXPECT_TRUE(policy.ShouldSetUpFrame(url, url, true));
+  EXPECT_FALSE(policy.ShouldSetUpFrame(kTopURL, kTopURL, true));
+}
+
+TEST(XWalkExtensionFramePolicyTest, MalformedPolicyIsRejected) {
+  const char* malformed[] = {
+    "{\"subframes\": 1}",
+    "{\"subframes\": \"some\"}",
+    "{\"origins\": \"https://example.com\"}",
+    "{\"origins\": [\"not an url\"]}",
+    "{\"origins\": [1]}",
+  };
+
+  for (size_t i = 0; i < arraysize(malformed); ++i) {
+    XWalkExtensionFramePolicy policy;
+    std::string error;
+    EXPECT_FALSE(InitFromJSON(&policy, malformed[i], &error)) << malformed[i];
+    EXPECT_FALSE(error.empty()) << malformed[i];
+
+    // The previous policy is kept.
+    EXPECT_EQ(XWalkExtensionFramePolicy::SUBFRAMES_ALL,
+              policy.subframe_mode());
+    EXPECT_TRUE(policy.ShouldSetUpFrame(GURL("https://ads.example.org/"),
+                                        kTopURL, false));
+  }
+}
@@ -4,3 +4,39 @@
 
 #define IPC_MESSAGE_IMPL
 #include "xwalk/extensions/common/xwalk_extension_messages.h"
+
+#include "base/strings/stringprintf.h"
+
+namespace IPC {
+
+void ParamTraits<scoped_refptr<base::RefCountedMemory> >::Write(
+    Message* m, const param_type& p) {
+  if (!p) {
+    m->WriteData(NULL, 0);
+    return;
+  }
+  m->WriteData(reinterpret_cast<const char*>(p->front()),
+               static_cast<int>(p->size()));
+}
+
+bool ParamTraits<scoped_refptr<base::RefCountedMemory> >::Read(
+    const Message* m, PickleIterator* iter, param_type* r) {
+  const char* data;
+  int length;
+  if (!m->ReadData(iter, &data, &length) || length < 0)
+    return false;
+
+  // This is the only copy the payload goes through on the receiving side, the
+  // pickle buffer is released as soon as the message is dispatched.
+  std::string bytes(data, length);
+  *r = base::RefCountedString::TakeString(&bytes);
+  return true;
+}
+
+void ParamTraits<scoped_refptr<base::RefCountedMemory> >::Log(
+    const param_type& p, std::string* l) {
+  l->append(base::StringPrintf("<binary: %d bytes>",
+                               p ? static_cast<int>(p->size()) : 0));
+}
+
+}  // namespace IPC
@@ -4,9 +4,34 @@
 
 #include <stdint.h>
 #include <string>
+#include <vector>
+#include "base/files/file_path.h"
+#include "base/memory/ref_counted_memory.h"
+#include "base/memory/shared_memory.h"
 #include "base/values.h"
+#include "ipc/ipc_channel_handle.h"
 #include "ipc/ipc_message_macros.h"
 
+#ifndef XWALK_EXTENSIONS_COMMON_XWALK_EXTENSION_MESSAGES_H_
+#define XWALK_EXTENSIONS_COMMON_XWALK_EXTENSION_MESSAGES_H_
+
+namespace IPC {
+
+// Binary messages are written as a single blob of data in the pickle, instead
+// of being wrapped in a base::ListValue. This skips building and walking a
+// tree of base::Value on both ends of the channel.
+template <>
+struct ParamTraits<scoped_refptr<base::RefCountedMemory> > {
+  typedef scoped_refptr<base::RefCountedMemory> param_type;
+  static void Write(Message* m, const param_type& p);
+  static bool Read(const Message* m, PickleIterator* iter, param_type* r);
+  static void Log(const param_type& p, std::string* l);
+};
+
+}  // namespace IPC
+
+#endif  // XWALK_EXTENSIONS_COMMON_XWALK_EXTENSION_MESSAGES_H_
+
 // Note: it is safe to use numbers after LastIPCMsgStart since that limit
 // is not relevant for embedders. It is used only by a tool inside chrome/
 // that we currently don't use.
@@ -19,6 +44,34 @@ IPC_MESSAGE_CONTROL2(XWalkExtensionClientMsg_RegisterExtension,  // NOLINT(*)
                     std::string /* extension */,
                     std::string /* JS API code for extension */)
 
+// Registers the extensions available when the render process starts. Their
+// JS API code is laid out one after the other in a read-only shared memory
+// region, shared by all the render processes, see XWalkExtensionAPISnapshot.
+IPC_MESSAGE_CONTROL5(XWalkExtensionClientMsg_RegisterExtensions,  // NOLINT(*)
+                    base::SharedMemoryHandle /* JS API code region */,
+                    uint32_t /* region size */,
+                    std::vector<std::string> /* extension names */,
+                    std::vector<uint32_t> /* hashes of the JS API code */,
+                    std::vector<uint32_t> /* sizes of the JS API code */)
+
+// The extension can't be used by new frames anymore. Frames that already
+// loaded its JS API keep their instances.
+IPC_MESSAGE_CONTROL1(XWalkExtensionClientMsg_UnregisterExtension,  // NOLINT(*)
+                    std::string /* extension */)
+
+
+// Preparse data of the JS API code of an extension, the key identifies the
+// code it was produced from. The client sends it when compiling the code for
+// the first time, and the server sends it back in later launches.
+IPC_MESSAGE_CONTROL3(XWalkExtensionClientMsg_SetCodeCacheData,  // NOLINT(*)
+                    std::string /* extension name */,
+                    std::string /* key */,
+                    std::string /* data */)
+
+IPC_MESSAGE_CONTROL3(XWalkExtensionServerMsg_StoreCodeCacheData,  // NOLINT(*)
+                    std::string /* extension name */,
+                    std::string /* key */,
+                    std::string /* data */)
 
 IPC_MESSAGE_CONTROL2(XWalkExtensionServerMsg_CreateInstance,  // NOLINT(*)
                     int64_t /* instance id */,
@@ -28,17 +81,106 @@ IPC_MESSAGE_CONTROL2(XWalkExtensionServerMsg_PostMessageToNative,  // NOLINT(*)
                     int64_t /* instance id */,
                     base::ListValue /* contents */)
 
+// Messages posted in a burst by the instance are sent together, each item of
+// the list is a message.
 IPC_MESSAGE_CONTROL2(XWalkExtensionClientMsg_PostMessageToJS,  // NOLINT(*)
                     int64_t /* instance id */,
-                    base::ListValue /* contents */)
+                    base::ListValue /* messages */)
+
+IPC_MESSAGE_CONTROL2(XWalkExtensionServerMsg_PostBinaryMessageToNative,  // NOLINT(*)
+                    int64_t /* instance id */,
+                    scoped_refptr<base::RefCountedMemory> /* contents */)
+
+IPC_MESSAGE_CONTROL2(XWalkExtensionClientMsg_PostBinaryMessageToJS,  // NOLINT(*)
+                    int64_t /* instance id */,
+                    scoped_refptr<base::RefCountedMemory> /* contents */)
+
+// Big binary messages are copied into a shared memory segment owned by the
+// sender, only the segment id goes through the channel. The handle is valid
+// only the first time a segment is sent. Once the receiver is done with the
+// message, it tells the sender the segment can be reused.
+IPC_MESSAGE_CONTROL5(XWalkExtensionServerMsg_PostSharedMemoryMessageToNative,  // NOLINT(*)
+                    int64_t /* instance id */,
+                    int /* segment id */,
+                    base::SharedMemoryHandle /* segment handle */,
+                    uint32_t /* segment size */,
+                    uint32_t /* message size */)
+
+IPC_MESSAGE_CONTROL5(XWalkExtensionClientMsg_PostSharedMemoryMessageToJS,  // NOLINT(*)
+                    int64_t /* instance id */,
+                    int /* segment id */,
+                    base::SharedMemoryHandle /* segment handle */,
+                    uint32_t /* segment size */,
+                    uint32_t /* message size */)
+
+IPC_MESSAGE_CONTROL1(XWalkExtensionServerMsg_ReleaseSharedMemorySegment,  // NOLINT(*)
+                    int /* segment id */)
+
+IPC_MESSAGE_CONTROL1(XWalkExtensionClientMsg_ReleaseSharedMemorySegment,  // NOLINT(*)
+                    int /* segment id */)
 
 IPC_SYNC_MESSAGE_CONTROL2_1(XWalkExtensionServerMsg_SendSyncMessageToNative,  // NOLINT(*)
                    int64_t /* instance id */,
                    base::ListValue /* input contents */,
                    base::ListValue /* output contents */)
 
+// Asynchronous alternative to SendSyncMessageToNative: the renderer doesn't
+// block, and the reply comes later with the same request id.
+IPC_MESSAGE_CONTROL3(XWalkExtensionServerMsg_PostRequestToNative,  // NOLINT(*)
+                    int64_t /* instance id */,
+                    int /* request id */,
+                    base::ListValue /* contents */)
+
+IPC_MESSAGE_CONTROL3(XWalkExtensionClientMsg_PostRequestReplyToJS,  // NOLINT(*)
+                    int64_t /* instance id */,
+                    int /* request id */,
+                    base::ListValue /* reply */)
+
 IPC_MESSAGE_CONTROL1(XWalkExtensionServerMsg_DestroyInstance,  // NOLINT(*)
                    int64_t /* instance id */)
 
 IPC_MESSAGE_CONTROL1(XWalkExtensionClientMsg_InstanceDestroyed,  // NOLINT(*)
                    int64_t /* instance id */)
+
+// The queue of messages waiting for the instance reached its limit, or went
+// back under it. Depending on the policy of the extension, the renderer waits
+// for room before posting again or fails the messages posted meanwhile.
+IPC_MESSAGE_CONTROL3(XWalkExtensionClientMsg_MessageQueueFull,  // NOLINT(*)
+                   int64_t /* instance id */,
+                   bool /* full */,
+                   bool /* block sender */)
+
+// Replied once the queue of the instance has room again, or the instance is
+// gone.
+IPC_SYNC_MESSAGE_CONTROL1_0(XWalkExtensionServerMsg_WaitForMessageQueue,  // NOLINT(*)
+                   int64_t /* instance id */)
+
+// Sent by the renderer when it starts, to get the channel to its extension
+// process. The browser answers with ExtensionProcessChannelCreated once the
+// process has loaded the extensions, the renderer doesn't wait for it.
+IPC_MESSAGE_CONTROL0(XWalkExtensionServerMsg_ConnectToExtensionProcess)  // NOLINT(*)
+
+// Channel to the extension process of the render process, and the extensions
+// it hosts. The handle is empty if there's no extension process. Sent again
+// when the extension process was launched again after dying, then the
+// renderer connects to it and creates its instances again.
+IPC_MESSAGE_CONTROL3(XWalkExtensionClientMsg_ExtensionProcessChannelCreated,  // NOLINT(*)
+                   IPC::ChannelHandle /* channel to the extension process */,
+                   std::vector<std::string> /* extension names */,
+                   std::vector<std::string> /* JS API code */)
+
+// Sent by the browser before any frame is created, with the
+// "xwalk_extensions" section of the application manifest, see
+// XWalkExtensionFramePolicy.
+IPC_MESSAGE_CONTROL1(XWalkExtensionClientMsg_SetFramePolicy,  // NOLINT(*)
+                   base::DictionaryValue /* policy */)
+
+// Asks the extension process to load the external extensions in a directory.
+IPC_MESSAGE_CONTROL1(XWalkExtensionProcessMsg_RegisterExtensions,  // NOLINT(*)
+                   base::FilePath /* external extensions path */)
+
+// Sent by the extension process after the XWalkExtensionClientMsg_-
+// RegisterExtension messages of the extensions it loaded, with the channel
+// the render process should connect to.
+IPC_MESSAGE_CONTROL1(XWalkExtensionProcessHostMsg_RenderProcessChannelCreated,  // NOLINT(*)
+                   IPC::ChannelHandle /* channel for the render process */)
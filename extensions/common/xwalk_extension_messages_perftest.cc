@@ -0,0 +1,139 @@
+// Copyright (c) 2013 Intel Corporation. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include "base/memory/ref_counted_memory.h"
+#include "base/memory/scoped_ptr.h"
+#include "base/time/time.h"
+#include "base/values.h"
+#include "testing/gtest/include/gtest/gtest.h"
+#include "v8/include/v8.h"
+#include "xwalk/extensions/common/xwalk_extension_messages.h"
+
+namespace {
+
+const size_t kPayloadSizes[] = {
+  1024,             // 1 KB
+  64 * 1024,        // 64 KB
+  4 * 1024 * 1024,  // 4 MB
+};
+
+// Total amount of data pushed through each path for every payload size, so
+// the small payloads run enough iterations to be measurable.
+const size_t kBytesPerRun = 256 * 1024 * 1024;
+
+size_t IterationsForSize(size_t size) {
+  return std::max<size_t>(kBytesPerRun / size, 16);
+}
+
+// Results are printed in the format understood by Chromium perf dashboards:
+// RESULT <graph>: <trace>= <value> <units>
+void PrintThroughput(const std::string& graph, size_t size,
+                     size_t iterations, base::TimeDelta elapsed) {
+  double megabytes = static_cast<double>(size) * iterations / (1024 * 1024);
+  printf("RESULT %s: %uB= %.2f MB/s\n", graph.c_str(),
+         static_cast<unsigned>(size), megabytes / elapsed.InSecondsF());
+}
+
+// Copies the contents of |buffer| out of V8, as XWalkExtensionModule does with
+// the ArrayBuffers posted from JavaScript. |buffer| is an external ArrayBuffer
+// over |backing_store|, which is where its contents are read from.
+std::vector<unsigned char> CopyFromArrayBuffer(
+    v8::Handle<v8::Value> buffer, const std::string& backing_store) {
+  CHECK(buffer->IsArrayBuffer());
+  const unsigned char* data =
+      reinterpret_cast<const unsigned char*>(backing_store.data());
+  return std::vector<unsigned char>(data, data + backing_store.size());
+}
+
+// Creates a new ArrayBuffer holding a copy of |data|, as XWalkExtensionModule
+// does with the binary messages it receives. The backing store is owned by
+// |storage| so it outlives the ArrayBuffer in this benchmark.
+v8::Handle<v8::Value> CopyToArrayBuffer(const unsigned char* data, size_t size,
+                                        std::vector<unsigned char>* storage) {
+  storage->resize(size);
+  memcpy(&storage->front(), data, size);
+  return v8::ArrayBuffer::New(&storage->front(), size);
+}
+
+// Mimics what happens when an ArrayBuffer is posted from JS without the
+// binary path: its bytes are copied out of V8 into a base::BinaryValue,
+// wrapped in a base::ListValue, serialized in the IPC message, deserialized
+// again and turned back into an ArrayBuffer on the other side.
+base::TimeDelta MeasureValuePath(v8::Handle<v8::Value> buffer,
+                                 const std::string& payload,
+                                 size_t iterations) {
+  std::vector<unsigned char> storage;
+  base::TimeTicks start = base::TimeTicks::HighResNow();
+  for (size_t i = 0; i < iterations; ++i) {
+    v8::HandleScope handle_scope(v8::Isolate::GetCurrent());
+    std::vector<unsigned char> bytes = CopyFromArrayBuffer(buffer, payload);
+    base::ListValue list;
+    list.Append(base::BinaryValue::CreateWithCopiedBuffer(
+        reinterpret_cast<const char*>(&bytes.front()), bytes.size()));
+    scoped_ptr<IPC::Message> msg(
+        new XWalkExtensionServerMsg_PostMessageToNative(i, list));
+
+    XWalkExtensionServerMsg_PostMessageToNative::Schema::Param param;
+    CHECK(XWalkExtensionServerMsg_PostMessageToNative::Read(msg.get(),
+                                                            &param));
+    base::Value* value;
+    param.b.Remove(0, &value);
+    base::BinaryValue* binary = static_cast<base::BinaryValue*>(value);
+    CopyToArrayBuffer(reinterpret_cast<const unsigned char*>(
+        binary->GetBuffer()), binary->GetSize(), &storage);
+    delete value;
+  }
+  return base::TimeTicks::HighResNow() - start;
+}
+
+// Same as above, through the binary path: the bytes skip base::Value but are
+// still copied out of V8, into the IPC message, and into a new ArrayBuffer.
+base::TimeDelta MeasureBinaryPath(v8::Handle<v8::Value> buffer,
+                                  const std::string& payload,
+                                  size_t iterations) {
+  std::vector<unsigned char> storage;
+  base::TimeTicks start = base::TimeTicks::HighResNow();
+  for (size_t i = 0; i < iterations; ++i) {
+    v8::HandleScope handle_scope(v8::Isolate::GetCurrent());
+    std::vector<unsigned char> bytes = CopyFromArrayBuffer(buffer, payload);
+    scoped_refptr<base::RefCountedMemory> data(
+        base::RefCountedBytes::TakeVector(&bytes));
+    scoped_ptr<IPC::Message> msg(
+        new XWalkExtensionServerMsg_PostBinaryMessageToNative(i, data));
+
+    XWalkExtensionServerMsg_PostBinaryMessageToNative::Schema::Param param;
+    CHECK(XWalkExtensionServerMsg_PostBinaryMessageToNative::Read(msg.get(),
+                                                                  &param));
+    CHECK_EQ(payload.size(), param.b->size());
+    CopyToArrayBuffer(param.b->front(), param.b->size(), &storage);
+  }
+  return base::TimeTicks::HighResNow() - start;
+}
+
+}  // namespace
+
+TEST(XWalkExtensionMessagesPerfTest, BinaryMessageThroughput) {
+  v8::Isolate* isolate = v8::Isolate::GetCurrent();
+  v8::HandleScope handle_scope(isolate);
+  v8::Handle<v8::Context> context = v8::Context::New(isolate);
+  v8::Context::Scope context_scope(context);
+
+  for (size_t i = 0; i < arraysize(kPayloadSizes); ++i) {
+    const size_t size = kPayloadSizes[i];
+    const size_t iterations = IterationsForSize(size);
+    std::string payload(size, 'x');
+    v8::Handle<v8::Value> buffer =
+        v8::ArrayBuffer::New(&payload[0], payload.size());
+
+    PrintThroughput("extension_message_value_path", size, iterations,
+                    MeasureValuePath(buffer, payload, iterations));
+    PrintThroughput("extension_message_binary_path", size, iterations,
+                    MeasureBinaryPath(buffer, payload, iterations));
+  }
+}
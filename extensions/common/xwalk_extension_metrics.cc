@@ -0,0 +1,122 @@
+// Copyright (c) 2013 Intel Corporation. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "xwalk/extensions/common/xwalk_extension_metrics.h"
+
+#include <algorithm>
+#include "base/lazy_instance.h"
+#include "base/metrics/histogram.h"
+
+namespace xwalk {
+namespace extensions {
+
+namespace {
+
+base::LazyInstance<XWalkExtensionMetrics>::Leaky g_metrics =
+    LAZY_INSTANCE_INITIALIZER;
+
+}  // namespace
+
+XWalkExtensionMetrics::Counters::Counters()
+    : messages_in(0),
+      bytes_in(0),
+      messages_out(0),
+      bytes_out(0),
+      sync_messages(0),
+      dropped_messages(0),
+      queue_depth(0),
+      max_queue_depth(0) {}
+
+XWalkExtensionMetrics::XWalkExtensionMetrics() {}
+
+XWalkExtensionMetrics::~XWalkExtensionMetrics() {}
+
+// static
+XWalkExtensionMetrics* XWalkExtensionMetrics::GetInstance() {
+  return g_metrics.Pointer();
+}
+
+void XWalkExtensionMetrics::RecordMessageIn(const std::string& extension,
+                                            size_t bytes) {
+  UMA_HISTOGRAM_COUNTS("XWalk.Extensions.MessageSizeIn", bytes);
+
+  base::AutoLock lock(lock_);
+  Counters& counters = counters_[extension];
+  counters.messages_in++;
+  counters.bytes_in += bytes;
+}
+
+void XWalkExtensionMetrics::RecordMessagesOut(const std::string& extension,
+                                              size_t count, size_t bytes) {
+  UMA_HISTOGRAM_COUNTS("XWalk.Extensions.MessageSizeOut", bytes);
+
+  base::AutoLock lock(lock_);
+  Counters& counters = counters_[extension];
+  counters.messages_out += count;
+  counters.bytes_out += bytes;
+}
+
+void XWalkExtensionMetrics::RecordSyncReply(const std::string& extension,
+                                            base::TimeDelta latency) {
+  UMA_HISTOGRAM_TIMES("XWalk.Extensions.SyncReplyLatency", latency);
+
+  base::AutoLock lock(lock_);
+  Counters& counters = counters_[extension];
+  counters.sync_messages++;
+  counters.sync_reply_time += latency;
+  counters.max_sync_reply_time =
+      std::max(counters.max_sync_reply_time, latency);
+}
+
+void XWalkExtensionMetrics::RecordHandlerTime(const std::string& extension,
+                                              base::TimeDelta time) {
+  UMA_HISTOGRAM_TIMES("XWalk.Extensions.HandlerTime", time);
+
+  base::AutoLock lock(lock_);
+  Counters& counters = counters_[extension];
+  counters.handler_time += time;
+  counters.max_handler_time = std::max(counters.max_handler_time, time);
+}
+
+int XWalkExtensionMetrics::RecordTaskQueued(const std::string& extension) {
+  int depth;
+  {
+    base::AutoLock lock(lock_);
+    Counters& counters = counters_[extension];
+    depth = ++counters.queue_depth;
+    counters.max_queue_depth = std::max(counters.max_queue_depth, depth);
+  }
+
+  UMA_HISTOGRAM_COUNTS_100("XWalk.Extensions.QueueDepth", depth);
+  return depth;
+}
+
+int XWalkExtensionMetrics::RecordTaskDone(const std::string& extension) {
+  base::AutoLock lock(lock_);
+  return --counters_[extension].queue_depth;
+}
+
+void XWalkExtensionMetrics::RecordMessageDropped(
+    const std::string& extension) {
+  base::AutoLock lock(lock_);
+  Counters& counters = counters_[extension];
+  counters.dropped_messages++;
+  counters.queue_depth--;
+}
+
+void XWalkExtensionMetrics::RecordTasksDiscarded(const std::string& extension,
+                                                 size_t count) {
+  if (!count)
+    return;
+  base::AutoLock lock(lock_);
+  counters_[extension].queue_depth -= static_cast<int>(count);
+}
+
+void XWalkExtensionMetrics::GetCounters(CountersMap* counters) const {
+  base::AutoLock lock(lock_);
+  *counters = counters_;
+}
+
+}  // namespace extensions
+}  // namespace xwalk
@@ -0,0 +1,91 @@
+// Copyright (c) 2013 Intel Corporation. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef XWALK_EXTENSIONS_COMMON_XWALK_EXTENSION_METRICS_H_
+#define XWALK_EXTENSIONS_COMMON_XWALK_EXTENSION_METRICS_H_
+
+#include <stdint.h>
+#include <map>
+#include <string>
+#include "base/basictypes.h"
+#include "base/lazy_instance.h"
+#include "base/synchronization/lock.h"
+#include "base/time/time.h"
+
+namespace xwalk {
+namespace extensions {
+
+// Counters about the messages exchanged by the instances of each extension
+// running in this process, so it is possible to tell which extensions are
+// hot or slow. They are updated by the XWalkExtensionServer and by the
+// extension threads, and also reported as UMA histograms aggregated for all
+// the extensions.
+//
+// Sizes are the ones of the IPC messages, which is what the channel carries.
+class XWalkExtensionMetrics {
+ public:
+  struct Counters {
+    Counters();
+
+    int64_t messages_in;
+    int64_t bytes_in;
+    int64_t messages_out;
+    int64_t bytes_out;
+    int64_t sync_messages;
+
+    // Dropped because the queue of the instance was full, see
+    // XWalkExtension::QueueFullPolicy.
+    int64_t dropped_messages;
+
+    // Tasks posted to the threads of the instances but not handled yet.
+    int queue_depth;
+    int max_queue_depth;
+
+    base::TimeDelta handler_time;
+    base::TimeDelta max_handler_time;
+
+    // From the arrival of a sync message to its reply being sent back.
+    base::TimeDelta sync_reply_time;
+    base::TimeDelta max_sync_reply_time;
+  };
+
+  typedef std::map<std::string, Counters> CountersMap;
+
+  static XWalkExtensionMetrics* GetInstance();
+
+  void RecordMessageIn(const std::string& extension, size_t bytes);
+  void RecordMessagesOut(const std::string& extension, size_t count,
+                         size_t bytes);
+  void RecordSyncReply(const std::string& extension,
+                       base::TimeDelta latency);
+  void RecordHandlerTime(const std::string& extension, base::TimeDelta time);
+
+  // Called when a message is posted to the thread of an instance, and once
+  // it was handled there. Returns the resulting queue depth.
+  int RecordTaskQueued(const std::string& extension);
+  int RecordTaskDone(const std::string& extension);
+  void RecordMessageDropped(const std::string& extension);
+
+  // Called for the messages still queued when an instance goes away, which
+  // are never handled.
+  void RecordTasksDiscarded(const std::string& extension, size_t count);
+
+  // Copies the current counters, keyed by extension name.
+  void GetCounters(CountersMap* counters) const;
+
+ private:
+  XWalkExtensionMetrics();
+  ~XWalkExtensionMetrics();
+  friend struct base::DefaultLazyInstanceTraits<XWalkExtensionMetrics>;
+
+  mutable base::Lock lock_;
+  CountersMap counters_;
+
+  DISALLOW_COPY_AND_ASSIGN(XWalkExtensionMetrics);
+};
+
+}  // namespace extensions
+}  // namespace xwalk
+
+#endif  // XWALK_EXTENSIONS_COMMON_XWALK_EXTENSION_METRICS_H_
@@ -0,0 +1,93 @@
+// Copyright (c) 2013 Intel Corporation. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "xwalk/extensions/common/xwalk_extension_metrics.h"
+
+#include "testing/gtest/include/gtest/gtest.h"
+
+using xwalk::extensions::XWalkExtensionMetrics;
+
+namespace {
+
+// The metrics are shared by the whole process, so each test uses an
+// extension name of its own.
+XWalkExtensionMetrics::Counters GetCounters(const std::string& extension) {
+  XWalkExtensionMetrics::CountersMap counters;
+  XWalkExtensionMetrics::GetInstance()->GetCounters(&counters);
+  return counters[extension];
+}
+
+}  // namespace
+
+TEST(XWalkExtensionMetricsTest, MessagesAreCountedPerExtension) {
+  XWalkExtensionMetrics* metrics = XWalkExtensionMetrics::GetInstance();
+  metrics->RecordMessageIn("metrics.a", 10);
+  metrics->RecordMessageIn("metrics.a", 20);
+  metrics->RecordMessagesOut("metrics.a", 3, 100);
+  metrics->RecordMessageIn("metrics.b", 5);
+
+  XWalkExtensionMetrics::Counters a = GetCounters("metrics.a");
+  EXPECT_EQ(2, a.messages_in);
+  EXPECT_EQ(30, a.bytes_in);
+  EXPECT_EQ(3, a.messages_out);
+  EXPECT_EQ(100, a.bytes_out);
+
+  XWalkExtensionMetrics::Counters b = GetCounters("metrics.b");
+  EXPECT_EQ(1, b.messages_in);
+  EXPECT_EQ(5, b.bytes_in);
+  EXPECT_EQ(0, b.messages_out);
+}
+
+TEST(XWalkExtensionMetricsTest, QueueDepthKeepsMaximum) {
+  XWalkExtensionMetrics* metrics = XWalkExtensionMetrics::GetInstance();
+  EXPECT_EQ(1, metrics->RecordTaskQueued("metrics.queue"));
+  EXPECT_EQ(2, metrics->RecordTaskQueued("metrics.queue"));
+  EXPECT_EQ(1, metrics->RecordTaskDone("metrics.queue"));
+  EXPECT_EQ(0, metrics->RecordTaskDone("metrics.queue"));
+
+  XWalkExtensionMetrics::Counters counters = GetCounters("metrics.queue");
+  EXPECT_EQ(0, counters.queue_depth);
+  EXPECT_EQ(2, counters.max_queue_depth);
+}
+
+TEST(XWalkExtensionMetricsTest, DroppedMessagesLeaveTheQueue) {
+  XWalkExtensionMetrics* metrics = XWalkExtensionMetrics::GetInstance();
+  metrics->RecordTaskQueued("metrics.dropped");
+  metrics->RecordTaskQueued("metrics.dropped");
+  metrics->RecordMessageDropped("metrics.dropped");
+
+  XWalkExtensionMetrics::Counters counters = GetCounters("metrics.dropped");
+  EXPECT_EQ(1, counters.dropped_messages);
+  EXPECT_EQ(1, counters.queue_depth);
+}
+
+TEST(XWalkExtensionMetricsTest, DiscardedMessagesLeaveTheQueue) {
+  XWalkExtensionMetrics* metrics = XWalkExtensionMetrics::GetInstance();
+  metrics->RecordTaskQueued("metrics.discarded");
+  metrics->RecordTaskQueued("metrics.discarded");
+  metrics->RecordTaskQueued("metrics.discarded");
+  metrics->RecordTasksDiscarded("metrics.discarded", 2);
+
+  XWalkExtensionMetrics::Counters counters = GetCounters("metrics.discarded");
+  EXPECT_EQ(0, counters.dropped_messages);
+  EXPECT_EQ(1, counters.queue_depth);
+  EXPECT_EQ(3, counters.max_queue_depth);
+}
+
+TEST(XWalkExtensionMetricsTest, TimesAreAccumulated) {
+  XWalkExtensionMetrics* metrics = XWalkExtensionMetrics::GetInstance();
+  metrics->RecordHandlerTime("metrics.time",
+                             base::TimeDelta::FromMilliseconds(2));
+  metrics->RecordHandlerTime("metrics.time",
+                             base::TimeDelta::FromMilliseconds(5));
+  metrics->RecordSyncReply("metrics.time",
+                           base::TimeDelta::FromMilliseconds(7));
+
+  XWalkExtensionMetrics::Counters counters = GetCounters("metrics.time");
+  EXPECT_EQ(7, counters.handler_time.InMilliseconds());
+  EXPECT_EQ(5, counters.max_handler_time.InMilliseconds());
+  EXPECT_EQ(1, counters.sync_messages);
+  EXPECT_EQ(7, counters.sync_reply_time.InMilliseconds());
+  EXPECT_EQ(7, counters.max_sync_reply_time.InMilliseconds());
+}
@@ -0,0 +1,23 @@
+// Copyright (c) 2013 Intel Corporation. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef XWALK_EXTENSIONS_COMMON_XWALK_EXTENSION_PROCESS_TYPE_H_
+#define XWALK_EXTENSIONS_COMMON_XWALK_EXTENSION_PROCESS_TYPE_H_
+
+#include "content/public/common/process_type.h"
+
+namespace xwalk {
+namespace extensions {
+
+// Child process types defined by Crosswalk, numbered after the ones of
+// content as the embedder is expected to do.
+enum ProcessType {
+  PROCESS_TYPE_EXTENSION = content::PROCESS_TYPE_CONTENT_END,
+  PROCESS_TYPE_XWALK_END
+};
+
+}  // namespace extensions
+}  // namespace xwalk
+
+#endif  // XWALK_EXTENSIONS_COMMON_XWALK_EXTENSION_PROCESS_TYPE_H_
@@ -19,18 +19,44 @@ void XWalkExtensionRunner::PostMessageToNative(scoped_ptr<base::Value> msg) {
   HandleMessageFromClient(msg.Pass());
 }
 
+void XWalkExtensionRunner::PostBinaryMessageToNative(
+    const scoped_refptr<base::RefCountedMemory>& data) {
+  HandleBinaryMessageFromClient(data);
+}
+
 void XWalkExtensionRunner::SendSyncMessageToNative(
     scoped_ptr<IPC::Message> ipc_reply, scoped_ptr<base::Value> msg) {
   return HandleSyncMessageFromClient(ipc_reply.Pass(), msg.Pass());
 }
 
-void XWalkExtensionRunner::PostMessageToClient(scoped_ptr<base::Value> msg) {
-  client_->HandleMessageFromNative(this, msg.Pass());
+void XWalkExtensionRunner::PostRequestToNative(int request_id,
+    scoped_ptr<base::Value> msg) {
+  HandleRequestFromClient(request_id, msg.Pass());
+}
+
+void XWalkExtensionRunner::PostMessagesToClient(int64_t instance_id,
+    scoped_ptr<base::ListValue> msgs) {
+  client_->HandleMessagesFromNative(this, instance_id, msgs.Pass());
+}
+
+void XWalkExtensionRunner::PostBinaryMessageToClient(
+    const scoped_refptr<base::RefCountedMemory>& data) {
+  client_->HandleBinaryMessageFromNative(this, data);
 }
 
 void XWalkExtensionRunner::PostReplyMessageToClient(
     scoped_ptr<IPC::Message> ipc_reply, scoped_ptr<base::Value> msg) {
-  client_->HandleReplyMessageFromNative(ipc_reply.Pass(), msg.Pass());
+  client_->HandleReplyMessageFromNative(this, ipc_reply.Pass(), msg.Pass());
+}
+
+void XWalkExtensionRunner::PostRequestReplyToClient(int request_id,
+    scoped_ptr<base::Value> reply) {
+  client_->HandleRequestReplyFromNative(this, request_id, reply.Pass());
+}
+
+void XWalkExtensionRunner::PostMessageQueueFullToClient(bool full,
+                                                        bool block_sender) {
+  client_->HandleMessageQueueFullFromNative(this, full, block_sender);
 }
 
 }  // namespace extensions
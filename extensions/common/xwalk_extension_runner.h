@@ -8,6 +8,7 @@
 #include <stdint.h>
 #include <string>
 #include "base/basictypes.h"
+#include "base/memory/ref_counted_memory.h"
 #include "base/memory/scoped_ptr.h"
 #include "base/values.h"
 #include "ipc/ipc_message.h"
@@ -20,7 +21,7 @@ namespace extensions {
 // directly, in a thread environment or even in a separated process.
 //
 // Subclasses of runner should implement HandleMessageFromClient() and also call
-// PostMessageToClient when appropriate. See the concrete subclasses for
+// PostMessagesToClient when appropriate. See the concrete subclasses for
 // examples.
 //
 // To use a context runner, the object should implement its Client interface to
@@ -30,10 +31,29 @@ class XWalkExtensionRunner {
  public:
   class Client {
    public:
-    virtual void HandleMessageFromNative(
-        const XWalkExtensionRunner* runner, scoped_ptr<base::Value> msg) = 0;
+    // Messages posted in a burst by the extension context are delivered
+    // together, in the order they were posted. They go to |instance_id|,
+    // the instance id of the runner unless a context shared by many
+    // instances posted them to one of those, see
+    // XWalkExtension::InstanceMode.
+    virtual void HandleMessagesFromNative(
+        const XWalkExtensionRunner* runner, int64_t instance_id,
+        scoped_ptr<base::ListValue> msgs) = 0;
+    virtual void HandleBinaryMessageFromNative(
+        const XWalkExtensionRunner* runner,
+        const scoped_refptr<base::RefCountedMemory>& data) = 0;
     virtual void HandleReplyMessageFromNative(
+        const XWalkExtensionRunner* runner,
         scoped_ptr<IPC::Message> ipc_reply, scoped_ptr<base::Value> msg) = 0;
+    virtual void HandleRequestReplyFromNative(
+        const XWalkExtensionRunner* runner, int request_id,
+        scoped_ptr<base::Value> reply) = 0;
+    // The messages waiting for the extension context reached the limit of
+    // its queue, or went back well under it. Only reported for the
+    // QueueFullPolicy values relying on the sender to slow down,
+    // |block_sender| tells whether it is BLOCK_SENDER.
+    virtual void HandleMessageQueueFullFromNative(
+        const XWalkExtensionRunner* runner, bool full, bool block_sender) = 0;
    protected:
     virtual ~Client() {}
   };
@@ -43,20 +63,32 @@ class XWalkExtensionRunner {
   virtual ~XWalkExtensionRunner();
 
   void PostMessageToNative(scoped_ptr<base::Value> msg);
+  void PostBinaryMessageToNative(
+      const scoped_refptr<base::RefCountedMemory>& data);
   void SendSyncMessageToNative(scoped_ptr<IPC::Message> ipc_reply,
                                 scoped_ptr<base::Value> msg);
+  void PostRequestToNative(int request_id, scoped_ptr<base::Value> msg);
 
   std::string extension_name() const { return extension_name_; }
   int64_t instance_id() const { return instance_id_; }
 
  protected:
-  void PostMessageToClient(scoped_ptr<base::Value> msg);
+  void PostMessagesToClient(int64_t instance_id,
+                            scoped_ptr<base::ListValue> msgs);
+  void PostBinaryMessageToClient(
+      const scoped_refptr<base::RefCountedMemory>& data);
   void PostReplyMessageToClient(scoped_ptr<IPC::Message> ipc_reply,
                                 scoped_ptr<base::Value> msg);
+  void PostRequestReplyToClient(int request_id, scoped_ptr<base::Value> reply);
+  void PostMessageQueueFullToClient(bool full, bool block_sender);
 
   virtual void HandleMessageFromClient(scoped_ptr<base::Value> msg) = 0;
+  virtual void HandleBinaryMessageFromClient(
+      const scoped_refptr<base::RefCountedMemory>& data) = 0;
   virtual void HandleSyncMessageFromClient(scoped_ptr<IPC::Message> ipc_reply,
                                            scoped_ptr<base::Value> msg) = 0;
+  virtual void HandleRequestFromClient(int request_id,
+                                       scoped_ptr<base::Value> msg) = 0;
 
   Client* client_;
 
@@ -4,22 +4,59 @@
 
 #include "xwalk/extensions/common/xwalk_extension_server.h"
 
+#include <algorithm>
+#include <limits>
+#include <vector>
+#include "base/bind.h"
+#include "base/debug/trace_event.h"
 #include "base/file_util.h"
 #include "base/files/file_enumerator.h"
 #include "base/files/file_path.h"
+#include "base/hash.h"
+#include "base/memory/scoped_vector.h"
+#include "base/platform_file.h"
+#include "base/scoped_native_library.h"
+#include "base/stl_util.h"
+#include "base/synchronization/waitable_event.h"
+#include "base/threading/worker_pool.h"
 #include "content/public/browser/render_process_host.h"
 #include "ipc/ipc_sender.h"
 #include "xwalk/extensions/common/xwalk_extension.h"
 #include "xwalk/extensions/common/xwalk_extension_external.h"
 #include "xwalk/extensions/common/xwalk_extension_messages.h"
+#include "xwalk/extensions/common/xwalk_extension_metrics.h"
 #include "xwalk/extensions/common/xwalk_extension_threaded_runner.h"
 #include "xwalk/extensions/common/xwalk_external_extension.h"
+#include "xwalk/extensions/common/xwalk_external_extension_index.h"
 
 namespace xwalk {
 namespace extensions {
 
+namespace {
+
+// Instance id of the runners shared by many instances. The ids given by the
+// client are never negative.
+const int64_t kSharedRunnerInstanceId = -1;
+
+}  // namespace
+
 XWalkExtensionServer::XWalkExtensionServer()
-    : sender_(0) {
+    : sender_(0),
+      incoming_message_size_(0),
+      extensions_(new XWalkExtensionSet),
+      next_shared_request_id_(0),
+      peer_handle_(base::kNullProcessHandle),
+      weak_ptr_factory_(this) {
+}
+
+XWalkExtensionServer::XWalkExtensionServer(
+    const scoped_refptr<XWalkExtensionSet>& extensions)
+    : sender_(0),
+      incoming_message_size_(0),
+      extensions_(extensions),
+      next_shared_request_id_(0),
+      peer_handle_(base::kNullProcessHandle),
+      weak_ptr_factory_(this) {
 }
 
 XWalkExtensionServer::~XWalkExtensionServer() {
@@ -27,15 +64,26 @@ XWalkExtensionServer::~XWalkExtensionServer() {
     LOG(WARNING) << "XWalkExtensionServer DTOR: RunnerMap is not empty!";
 
   RunnerMap::iterator it_runner = runners_.begin();
-  for (; it_runner != runners_.end(); ++it_runner)
-    delete it_runner->second;
+  for (; it_runner != runners_.end(); ++it_runner) {
+    if (!IsSharedRunner(it_runner->second))
+      delete it_runner->second;
+  }
+  SharedRunnerMap::iterator it_shared = shared_runners_.begin();
+  for (; it_shared != shared_runners_.end(); ++it_shared)
+    delete it_shared->second.runner;
+
+  // The renderer is gone, nobody waits for these replies anymore.
+  STLDeleteValues(&queue_waiters_);
+
+  // The extensions are deleted with the last reference to |extensions_|.
 
-  ExtensionMap::iterator it = extensions_.begin();
-  for (; it != extensions_.end(); ++it)
-    delete it->second;
+  if (peer_handle_ != base::kNullProcessHandle)
+    base::CloseProcessHandle(peer_handle_);
 }
 
 bool XWalkExtensionServer::OnMessageReceived(const IPC::Message& message) {
+  incoming_message_size_ = message.size();
+
   bool handled = true;
   IPC_BEGIN_MESSAGE_MAP(XWalkExtensionServer, message)
     IPC_MESSAGE_HANDLER(XWalkExtensionServerMsg_CreateInstance,
@@ -44,33 +92,103 @@ bool XWalkExtensionServer::OnMessageReceived(const IPC::Message& message) {
         OnDestroyInstance)
     IPC_MESSAGE_HANDLER(XWalkExtensionServerMsg_PostMessageToNative,
         OnPostMessageToNative)
+    IPC_MESSAGE_HANDLER(XWalkExtensionServerMsg_PostBinaryMessageToNative,
+        OnPostBinaryMessageToNative)
+    IPC_MESSAGE_HANDLER(XWalkExtensionServerMsg_PostSharedMemoryMessageToNative,
+        OnPostSharedMemoryMessageToNative)
+    IPC_MESSAGE_HANDLER(XWalkExtensionServerMsg_ReleaseSharedMemorySegment,
+        OnReleaseSharedMemorySegment)
+    IPC_MESSAGE_HANDLER(XWalkExtensionServerMsg_StoreCodeCacheData,
+        OnStoreCodeCacheData)
+    IPC_MESSAGE_HANDLER(XWalkExtensionServerMsg_PostRequestToNative,
+        OnPostRequestToNative)
     IPC_MESSAGE_HANDLER_DELAY_REPLY(
         XWalkExtensionServerMsg_SendSyncMessageToNative,
         OnSendSyncMessageToNative)
+    IPC_MESSAGE_HANDLER_DELAY_REPLY(
+        XWalkExtensionServerMsg_WaitForMessageQueue,
+        OnWaitForMessageQueue)
     IPC_MESSAGE_UNHANDLED(handled = false)
   IPC_END_MESSAGE_MAP()
 
   return handled;
 }
 
+void XWalkExtensionServer::OnChannelConnected(int32 peer_pid) {
+  if (peer_handle_ != base::kNullProcessHandle)
+    base::CloseProcessHandle(peer_handle_);
+  if (!base::OpenProcessHandle(peer_pid, &peer_handle_))
+    peer_handle_ = base::kNullProcessHandle;
+}
+
 void XWalkExtensionServer::OnCreateInstance(int64_t instance_id,
     std::string name) {
-  ExtensionMap::const_iterator it = extensions_.find(name);
+  // The extension stays alive until the context created from it is gone.
+  base::Closure instance_destroyed;
+  XWalkExtension* extension =
+      extensions_->GetForInstance(name, &instance_destroyed);
 
-  if (it == extensions_.end()) {
+  if (!extension) {
     LOG(WARNING) << "Can't create instance of extension: " << name
         << ". Extension is not registered.";
     return;
   }
 
+  if (extension->instance_mode() == XWalkExtension::INSTANCE_PER_PROCESS) {
+    SharedRunner& shared = shared_runners_[name];
+    if (!shared.runner) {
+      shared.runner = new XWalkExtensionThreadedRunner(
+          extension, this, base::MessageLoopProxy::current(),
+          kSharedRunnerInstanceId, instance_destroyed);
+    } else {
+      // Only the shared context counts as an instance.
+      instance_destroyed.Run();
+    }
+    shared.runner->AddContext(instance_id);
+    shared.instance_ids.insert(instance_id);
+    runners_[instance_id] = shared.runner;
+    return;
+  }
+
   XWalkExtensionRunner* runner = new XWalkExtensionThreadedRunner(
-      it->second, this, base::MessageLoopProxy::current(), instance_id);
+      extension, this, base::MessageLoopProxy::current(), instance_id,
+      instance_destroyed);
 
   runners_[instance_id] = runner;
 }
 
+bool XWalkExtensionServer::IsSharedRunner(
+    const XWalkExtensionRunner* runner) const {
+  return runner->instance_id() == kSharedRunnerInstanceId;
+}
+
+void XWalkExtensionServer::GetMessageDestinations(
+    const XWalkExtensionRunner* runner, int64_t instance_id,
+    std::vector<int64_t>* instance_ids) const {
+  if (!IsSharedRunner(runner)) {
+    instance_ids->push_back(instance_id);
+    return;
+  }
+
+  SharedRunnerMap::const_iterator it =
+      shared_runners_.find(runner->extension_name());
+  if (it == shared_runners_.end())
+    return;
+  const std::set<int64_t>& shared_ids = it->second.instance_ids;
+  if (instance_id == kSharedRunnerInstanceId) {
+    instance_ids->assign(shared_ids.begin(), shared_ids.end());
+    return;
+  }
+
+  // The instance may be gone while the message was on its way.
+  if (shared_ids.count(instance_id))
+    instance_ids->push_back(instance_id);
+}
+
 void XWalkExtensionServer::OnPostMessageToNative(int64_t instance_id,
     const base::ListValue& msg) {
+  TRACE_EVENT1("xwalk", "XWalkExtensionServer::OnPostMessageToNative",
+               "instance_id", instance_id);
   RunnerMap::const_iterator it = runners_.find(instance_id);
   if (it == runners_.end()) {
     LOG(WARNING) << "Can't PostMessage to invalid Extension instance id: "
@@ -78,6 +196,9 @@ void XWalkExtensionServer::OnPostMessageToNative(int64_t instance_id,
     return;
   }
 
+  XWalkExtensionMetrics::GetInstance()->RecordMessageIn(
+      it->second->extension_name(), incoming_message_size_);
+
   // The const_cast is needed to remove the only Value contained by the
   // ListValue (which is solely used as wrapper, since Value doesn't
   // have param traits for serialization) and we pass the ownership to to
@@ -86,89 +207,148 @@ void XWalkExtensionServer::OnPostMessageToNative(int64_t instance_id,
   // can be costly depending on the size of Value.
   base::Value* value;
   const_cast<base::ListValue*>(&msg)->Remove(0, &value);
+
+  // Shared runners only get the messages tagged with the instance that
+  // posted them. They are all threaded runners.
+  if (IsSharedRunner(it->second)) {
+    static_cast<XWalkExtensionThreadedRunner*>(it->second)->
+        PostContextMessageToNative(instance_id, scoped_ptr<base::Value>(value));
+    return;
+  }
   (it->second)->PostMessageToNative(scoped_ptr<base::Value>(value));
 }
 
-bool XWalkExtensionServer::Send(IPC::Message* msg) {
-  if (sender_cancellation_flag_.IsSet())
-    return false;
+void XWalkExtensionServer::OnPostBinaryMessageToNative(int64_t instance_id,
+    const scoped_refptr<base::RefCountedMemory>& data) {
+  TRACE_EVENT1("xwalk", "XWalkExtensionServer::OnPostBinaryMessageToNative",
+               "instance_id", instance_id);
+  RunnerMap::const_iterator it = runners_.find(instance_id);
+  if (it == runners_.end()) {
+    LOG(WARNING) << "Can't PostBinaryMessage to invalid Extension instance id: "
+        << instance_id;
+    return;
+  }
 
-  DCHECK(sender_);
-  return sender_->Send(msg);
-}
+  // Counts the payload, which may have come in shared memory.
+  XWalkExtensionMetrics::GetInstance()->RecordMessageIn(
+      it->second->extension_name(), data->size());
 
-namespace {
+  (it->second)->PostBinaryMessageToNative(data);
+}
 
-bool ValidateExtensionName(const std::string& extension_name) {
-  bool dot_allowed = false;
-  bool digit_or_underscore_allowed = false;
-  for (size_t i = 0; i < extension_name.size(); ++i) {
-    char c = extension_name[i];
-    if (IsAsciiDigit(c)) {
-      if (!digit_or_underscore_allowed)
-        return false;
-    } else if (c == '_') {
-      if (!digit_or_underscore_allowed)
-        return false;
-    } else if (c == '.') {
-      if (!dot_allowed)
-        return false;
-      dot_allowed = false;
-      digit_or_underscore_allowed = false;
-    } else if (IsAsciiAlpha(c)) {
-      dot_allowed = true;
-      digit_or_underscore_allowed = true;
-    } else {
-      return false;
-    }
+void XWalkExtensionServer::OnPostSharedMemoryMessageToNative(
+    int64_t instance_id, int segment_id, base::SharedMemoryHandle handle,
+    uint32_t segment_size, uint32_t size) {
+  if (!shared_memory_reader_) {
+    // The renderer can still write to the segment, so the message is copied
+    // out of it before any extension looks at it.
+    shared_memory_reader_.reset(new XWalkExtensionSharedMemoryReader(
+        base::MessageLoopProxy::current(),
+        base::Bind(&XWalkExtensionServer::ReleaseClientSharedMemorySegment,
+                   weak_ptr_factory_.GetWeakPtr()),
+        XWalkExtensionSharedMemoryReader::READ_COPY));
   }
 
-  // If after going through the entire name we finish with dot_allowed, it means
-  // the previous character is not a dot, so it's a valid name.
-  return dot_allowed;
+  // The segment must be read even if the instance is gone, so the client
+  // gets it back.
+  scoped_refptr<base::RefCountedMemory> data =
+      shared_memory_reader_->Read(segment_id, handle, segment_size, size);
+  if (!data)
+    return;
+
+  OnPostBinaryMessageToNative(instance_id, data);
 }
 
-}  // namespace
+void XWalkExtensionServer::OnReleaseSharedMemorySegment(int segment_id) {
+  if (shared_memory_pool_)
+    shared_memory_pool_->Release(segment_id);
+}
+
+void XWalkExtensionServer::ReleaseClientSharedMemorySegment(int segment_id) {
+  Send(new XWalkExtensionClientMsg_ReleaseSharedMemorySegment(segment_id));
+}
+
+bool XWalkExtensionServer::Send(IPC::Message* msg) {
+  if (sender_cancellation_flag_.IsSet())
+    return false;
+
+  DCHECK(sender_);
+  return sender_->Send(msg);
+}
 
 bool XWalkExtensionServer::RegisterExtension(
     scoped_ptr<XWalkExtension> extension) {
-  if (!ValidateExtensionName(extension->name())) {
-    LOG(WARNING) << "Ignoring extension with invalid name: "
-                 << extension->name();
-    return false;
-  }
+  return extensions_->Add(extension.Pass());
+}
 
-  if (extensions_.find(extension->name()) != extensions_.end()) {
-    LOG(WARNING) << "Ignoring extension with name already registered: "
-                 << extension->name();
-    return false;
+void XWalkExtensionServer::HandleMessagesFromNative(
+    const XWalkExtensionRunner* runner, int64_t instance_id,
+    scoped_ptr<base::ListValue> msgs) {
+  TRACE_EVENT2("xwalk", "XWalkExtensionServer::HandleMessagesFromNative",
+               "instance_id", instance_id,
+               "messages", msgs->GetSize());
+  std::vector<int64_t> destinations;
+  GetMessageDestinations(runner, instance_id, &destinations);
+  for (size_t i = 0; i < destinations.size(); ++i) {
+    IPC::Message* message = new XWalkExtensionClientMsg_PostMessageToJS(
+        destinations[i], *msgs);
+    XWalkExtensionMetrics::GetInstance()->RecordMessagesOut(
+        runner->extension_name(), msgs->GetSize(), message->size());
+    Send(message);
   }
+}
 
-  std::string name = extension->name();
-  extensions_[name] = extension.release();
-  return true;
+void XWalkExtensionServer::HandleBinaryMessageFromNative(
+    const XWalkExtensionRunner* runner,
+    const scoped_refptr<base::RefCountedMemory>& data) {
+  TRACE_EVENT1("xwalk", "XWalkExtensionServer::HandleBinaryMessageFromNative",
+               "instance_id", runner->instance_id());
+  std::vector<int64_t> destinations;
+  GetMessageDestinations(runner, runner->instance_id(), &destinations);
+  for (size_t i = 0; i < destinations.size(); ++i) {
+    XWalkExtensionMetrics::GetInstance()->RecordMessagesOut(
+        runner->extension_name(), 1, data->size());
+    SendBinaryMessageToJS(destinations[i], data);
+  }
 }
 
-void XWalkExtensionServer::HandleMessageFromNative(
-    const XWalkExtensionRunner* runner, scoped_ptr<base::Value> msg) {
-  base::ListValue list;
-  list.Append(msg.release());
+void XWalkExtensionServer::SendBinaryMessageToJS(int64_t instance_id,
+    const scoped_refptr<base::RefCountedMemory>& data) {
+  if (data->size() >= kSharedMemoryMessageThreshold &&
+      peer_handle_ != base::kNullProcessHandle) {
+    if (!shared_memory_pool_)
+      shared_memory_pool_.reset(new XWalkExtensionSharedMemoryPool);
+
+    int segment_id;
+    base::SharedMemoryHandle handle;
+    size_t segment_size;
+    if (shared_memory_pool_->Write(data, peer_handle_, &segment_id, &handle,
+                                   &segment_size)) {
+      Send(new XWalkExtensionClientMsg_PostSharedMemoryMessageToJS(
+          instance_id, segment_id, handle, segment_size, data->size()));
+      return;
+    }
+  }
 
-  Send(new XWalkExtensionClientMsg_PostMessageToJS(runner->instance_id(),
-      list));
+  Send(new XWalkExtensionClientMsg_PostBinaryMessageToJS(instance_id, data));
 }
 
 void XWalkExtensionServer::HandleReplyMessageFromNative(
+      const XWalkExtensionRunner* runner,
       scoped_ptr<IPC::Message> ipc_reply, scoped_ptr<base::Value> msg) {
   base::ListValue result;
   result.Append(msg.release());
 
   IPC::WriteParam(ipc_reply.get(), result);
+  XWalkExtensionMetrics::GetInstance()->RecordMessagesOut(
+      runner->extension_name(), 1, ipc_reply->size());
   Send(ipc_reply.release());
 }
 
 void XWalkExtensionServer::OnSendSyncMessageToNative(int64_t instance_id,
     const base::ListValue& msg, IPC::Message* ipc_reply) {
+  TRACE_EVENT1("xwalk", "XWalkExtensionServer::OnSendSyncMessageToNative",
+               "instance_id", instance_id);
   RunnerMap::const_iterator it = runners_.find(instance_id);
   if (it == runners_.end()) {
     LOG(WARNING) << "Can't SendSyncMessage to invalid Extension instance id: "
@@ -176,6 +356,9 @@ void XWalkExtensionServer::OnSendSyncMessageToNative(int64_t instance_id,
     return;
   }
 
+  XWalkExtensionMetrics::GetInstance()->RecordMessageIn(
+      it->second->extension_name(), incoming_message_size_);
+
   base::Value* value;
   const_cast<base::ListValue*>(&msg)->Remove(0, &value);
 
@@ -186,6 +369,107 @@ void XWalkExtensionServer::OnSendSyncMessageToNative(int64_t instance_id,
                                         scoped_ptr<base::Value>(value));
 }
 
+void XWalkExtensionServer::OnPostRequestToNative(int64_t instance_id,
+    int request_id, const base::ListValue& msg) {
+  TRACE_EVENT2("xwalk", "XWalkExtensionServer::OnPostRequestToNative",
+               "instance_id", instance_id, "request_id", request_id);
+  RunnerMap::const_iterator it = runners_.find(instance_id);
+  if (it == runners_.end()) {
+    LOG(WARNING) << "Can't PostRequest to invalid Extension instance id: "
+        << instance_id;
+    return;
+  }
+
+  XWalkExtensionMetrics::GetInstance()->RecordMessageIn(
+      it->second->extension_name(), incoming_message_size_);
+
+  if (IsSharedRunner(it->second)) {
+    const int instance_request_id = request_id;
+    // Wraps around instead of overflowing, skipping the ids still waiting
+    // for a reply.
+    do {
+      if (next_shared_request_id_ == std::numeric_limits<int>::max())
+        next_shared_request_id_ = 0;
+      request_id = next_shared_request_id_++;
+    } while (shared_requests_.count(request_id));
+    shared_requests_[request_id] =
+        std::make_pair(instance_id, instance_request_id);
+  }
+
+  // See OnPostMessageToNative() for why the const_cast is safe.
+  base::Value* value;
+  const_cast<base::ListValue*>(&msg)->Remove(0, &value);
+  (it->second)->PostRequestToNative(request_id,
+                                    scoped_ptr<base::Value>(value));
+}
+
+void XWalkExtensionServer::HandleRequestReplyFromNative(
+    const XWalkExtensionRunner* runner, int request_id,
+    scoped_ptr<base::Value> reply) {
+  int64_t instance_id = runner->instance_id();
+  if (IsSharedRunner(runner)) {
+    SharedRequestMap::iterator it = shared_requests_.find(request_id);
+    if (it == shared_requests_.end())
+      return;
+    instance_id = it->second.first;
+    request_id = it->second.second;
+    shared_requests_.erase(it);
+    if (!runners_.count(instance_id))
+      return;
+  }
+
+  base::ListValue wrapped_reply;
+  wrapped_reply.Append(reply.release());
+  IPC::Message* message = new XWalkExtensionClientMsg_PostRequestReplyToJS(
+      instance_id, request_id, wrapped_reply);
+  XWalkExtensionMetrics::GetInstance()->RecordMessagesOut(
+      runner->extension_name(), 1, message->size());
+  Send(message);
+}
+
+void XWalkExtensionServer::HandleMessageQueueFullFromNative(
+    const XWalkExtensionRunner* runner, bool full, bool block_sender) {
+  TRACE_EVENT2("xwalk", "XWalkExtensionServer::HandleMessageQueueFull",
+               "instance_id", runner->instance_id(), "full", full);
+
+  // The queue of a shared runner is the queue of all its instances.
+  std::vector<int64_t> destinations;
+  GetMessageDestinations(runner, runner->instance_id(), &destinations);
+  for (size_t i = 0; i < destinations.size(); ++i) {
+    int64_t instance_id = destinations[i];
+    if (full) {
+      full_queues_.insert(instance_id);
+    } else {
+      full_queues_.erase(instance_id);
+      ReleaseMessageQueueWaiter(instance_id);
+    }
+
+    Send(new XWalkExtensionClientMsg_MessageQueueFull(instance_id, full,
+                                                      block_sender));
+  }
+}
+
+void XWalkExtensionServer::OnWaitForMessageQueue(int64_t instance_id,
+    IPC::Message* ipc_reply) {
+  // The queue may have made room before the renderer knew about it.
+  if (!full_queues_.count(instance_id) || queue_waiters_.count(instance_id)) {
+    Send(ipc_reply);
+    return;
+  }
+
+  queue_waiters_[instance_id] = ipc_reply;
+}
+
+void XWalkExtensionServer::ReleaseMessageQueueWaiter(int64_t instance_id) {
+  QueueWaiterMap::iterator it = queue_waiters_.find(instance_id);
+  if (it == queue_waiters_.end())
+    return;
+
+  IPC::Message* ipc_reply = it->second;
+  queue_waiters_.erase(it);
+  Send(ipc_reply);
+}
+
 void XWalkExtensionServer::OnDestroyInstance(int64_t instance_id) {
   RunnerMap::iterator it = runners_.find(instance_id);
   if (it == runners_.end()) {
@@ -193,32 +477,199 @@ void XWalkExtensionServer::OnDestroyInstance(int64_t instance_id) {
     return;
   }
 
-  delete it->second;
+  XWalkExtensionRunner* runner = it->second;
   runners_.erase(it);
+  if (IsSharedRunner(runner))
+    DestroySharedInstance(runner, instance_id);
+  else
+    delete runner;
+
+  // The replies to the requests of the instance are dropped anyway.
+  SharedRequestMap::iterator request = shared_requests_.begin();
+  while (request != shared_requests_.end()) {
+    if (request->second.first == instance_id)
+      shared_requests_.erase(request++);
+    else
+      ++request;
+  }
+
+  full_queues_.erase(instance_id);
+  ReleaseMessageQueueWaiter(instance_id);
 
   Send(new XWalkExtensionClientMsg_InstanceDestroyed(instance_id));
 }
 
+// The runner goes away with the last instance sharing it.
+void XWalkExtensionServer::DestroySharedInstance(XWalkExtensionRunner* runner,
+                                                 int64_t instance_id) {
+  SharedRunnerMap::iterator it =
+      shared_runners_.find(runner->extension_name());
+  DCHECK(it != shared_runners_.end());
+  SharedRunner& shared = it->second;
+  shared.runner->RemoveContext(instance_id);
+  shared.instance_ids.erase(instance_id);
+  if (!shared.instance_ids.empty())
+    return;
+
+  delete shared.runner;
+  shared_runners_.erase(it);
+}
+
 void XWalkExtensionServer::RegisterExtensionsInRenderProcess() {
   // Having a sender means we have a RenderProcessHost ready.
   DCHECK(sender_);
 
-  ExtensionMap::iterator it = extensions_.begin();
-  for (; it != extensions_.end(); ++it) {
-    XWalkExtension* extension = it->second;
-    Send(new XWalkExtensionClientMsg_RegisterExtension(
-        extension->name(), extension->GetJavaScriptAPI()));
+#if defined(OS_POSIX)
+  // The JS API code goes in a region mapped by all the render processes,
+  // instead of being copied in a message for each extension. The render
+  // process is usually not launched yet, which is fine here since the handle
+  // is a file descriptor sent along with the message. The descriptor is
+  // read-only so the render process can't change the code seen by the others.
+  // Where the snapshot can't be shared that way we use the messages.
+  scoped_refptr<XWalkExtensionAPISnapshot> snapshot =
+      extensions_->GetAPISnapshot();
+  base::SharedMemoryHandle handle;
+  if (snapshot &&
+      snapshot->ShareToProcess(base::GetCurrentProcessHandle(), &handle)) {
+    Send(new XWalkExtensionClientMsg_RegisterExtensions(
+        handle, snapshot->region_size(), snapshot->names(),
+        snapshot->hashes(), snapshot->sizes()));
+    return;
+  }
+#endif
+
+  std::vector<std::string> names;
+  std::vector<std::string> apis;
+  extensions_->GetJavaScriptAPIs(&names, &apis);
+  for (size_t i = 0; i < names.size(); ++i)
+    RegisterExtensionInRenderProcess(names[i], apis[i]);
+}
+
+void XWalkExtensionServer::RegisterExtensionInRenderProcess(
+    const std::string& name, const std::string& api) {
+  Send(new XWalkExtensionClientMsg_RegisterExtension(name, api));
+}
+
+void XWalkExtensionServer::UnregisterExtensionInRenderProcess(
+    const std::string& name) {
+  Send(new XWalkExtensionClientMsg_UnregisterExtension(name));
+}
+
+void XWalkExtensionServer::SetCodeCacheStore(
+    const scoped_refptr<XWalkExtensionCodeCacheStore>& store) {
+  code_cache_store_ = store;
+}
+
+void XWalkExtensionServer::SendCodeCacheToClient() {
+  if (!code_cache_store_)
+    return;
+
+  std::vector<std::string> names;
+  std::vector<std::string> apis;
+  extensions_->GetJavaScriptAPIs(&names, &apis);
+  std::vector<uint32_t> api_hashes;
+  for (size_t i = 0; i < apis.size(); ++i)
+    api_hashes.push_back(base::Hash(apis[i]));
+
+  code_cache_store_->Load(names, api_hashes,
+      base::Bind(&XWalkExtensionServer::OnCodeCacheLoaded,
+                 weak_ptr_factory_.GetWeakPtr()));
+}
+
+void XWalkExtensionServer::OnCodeCacheLoaded(
+    XWalkExtensionCodeCacheStore::EntryList* entries) {
+  for (size_t i = 0; i < entries->size(); ++i) {
+    const XWalkExtensionCodeCacheStore::Entry& entry = (*entries)[i];
+    Send(new XWalkExtensionClientMsg_SetCodeCacheData(
+        entry.name, entry.key, entry.data));
   }
 }
 
+void XWalkExtensionServer::OnStoreCodeCacheData(const std::string& name,
+    const std::string& key, const std::string& data) {
+  if (!code_cache_store_)
+    return;
+
+  // The name is used as file name, so only accept the ones we know about.
+  std::string api;
+  if (!extensions_->GetJavaScriptAPI(name, &api)) {
+    LOG(WARNING) << "Ignoring code cache for unknown extension: " << name;
+    return;
+  }
+
+  // The renderer only tells which code the data is for, the entry is bound
+  // to the code we know, so other renderers don't get data for other code.
+  code_cache_store_->Store(name, base::Hash(api), key, data);
+}
+
 void XWalkExtensionServer::Invalidate() {
   sender_cancellation_flag_.Set();
   sender_ = 0;
 }
 
+namespace {
+
+// Kept next to the libraries, see XWalkExternalExtensionIndex.
+const base::FilePath::CharType kExternalExtensionIndexFileName[] =
+    FILE_PATH_LITERAL(".xwalk_extensions_index");
+
+// An external extension library, loaded in a worker thread if it is missing
+// from the index.
+struct ExternalExtensionLoad {
+  ExternalExtensionLoad()
+      : loading(false),
+        done(false, false),
+        indexable(false) {}
+
+  base::FilePath path;
+  base::PlatformFileInfo info;
+  bool loading;
+  base::WaitableEvent done;
+
+  scoped_ptr<XWalkExtension> extension;
+  // Only libraries using the XW_Initialize entry point can be registered
+  // without being loaded.
+  bool indexable;
+};
+
+void LoadExternalExtension(ExternalExtensionLoad* load) {
+  TRACE_EVENT1("xwalk", "LoadExternalExtension",
+               "path", load->path.AsUTF8Unsafe());
+
+  // FIXME(cmarcelo): Once we get rid of the current C API in favor of the new
+  // one, move this NativeLibrary manipulation back inside
+  // XWalkExternalExtension.
+  base::ScopedNativeLibrary library(load->path);
+  if (!library.is_valid()) {
+    LOG(WARNING) << "Ignoring " << load->path.AsUTF8Unsafe()
+                 << " as external extension because is not valid library.";
+  } else if (library.GetFunctionPointer("XW_Initialize")) {
+    scoped_ptr<XWalkExternalExtension> extension(
+        new XWalkExternalExtension(load->path, library.Release()));
+    if (extension->is_valid()) {
+      load->extension = extension.PassAs<XWalkExtension>();
+      load->indexable = true;
+    }
+  } else if (library.GetFunctionPointer("xwalk_extension_init")) {
+    scoped_ptr<old::XWalkExternalExtension> extension(
+        new old::XWalkExternalExtension(library.Release()));
+    if (extension->is_valid())
+      load->extension = extension.PassAs<XWalkExtension>();
+  } else {
+    LOG(WARNING) << "Ignoring " << load->path.AsUTF8Unsafe()
+                 << " as external extension because"
+                 << " doesn't contain valid entry point.";
+  }
+
+  load->done.Signal();
+}
+
+}  // namespace
+
 void RegisterExternalExtensionsInDirectory(
-    XWalkExtensionServer* server, const base::FilePath& dir) {
-  CHECK(server);
+    XWalkExtensionSet* extensions, const base::FilePath& dir) {
+  CHECK(extensions);
+  TRACE_EVENT0("xwalk", "RegisterExternalExtensionsInDirectory");
 
   if (!file_util::DirectoryExists(dir)) {
     LOG(WARNING) << "Couldn't load external extensions from non-existent"
@@ -226,44 +677,71 @@ void RegisterExternalExtensionsInDirectory(
     return;
   }
 
+  XWalkExternalExtensionIndex index(
+      dir.Append(kExternalExtensionIndexFileName));
+  index.Load();
+
   // FIXME(leandro): Use GetNativeLibraryName() to obtain the proper
   // extension for the current platform.
   const base::FilePath::StringType pattern = FILE_PATH_LITERAL("*.so");
   base::FileEnumerator libraries(
       dir, false, base::FileEnumerator::FILES, pattern);
 
+  // Sorted, so the extensions are registered in the same order no matter
+  // which ones had to be loaded.
+  std::vector<base::FilePath> paths;
   for (base::FilePath extension_path = libraries.Next();
-        !extension_path.empty(); extension_path = libraries.Next()) {
-    // FIXME(cmarcelo): Once we get rid of the current C API in favor of the new
-    // one, move this NativeLibrary manipulation back inside
-    // XWalkExternalExtension.
-    base::ScopedNativeLibrary library(extension_path);
-    if (!library.is_valid()) {
-      LOG(WARNING) << "Ignoring " << extension_path.AsUTF8Unsafe()
-                   << " as external extension because is not valid library.";
+        !extension_path.empty(); extension_path = libraries.Next())
+    paths.push_back(extension_path);
+  std::sort(paths.begin(), paths.end());
+
+  // Libraries that didn't change since they were indexed are registered
+  // right away, without loading them. The other ones are loaded in parallel.
+  ScopedVector<ExternalExtensionLoad> loads;
+  for (size_t i = 0; i < paths.size(); ++i) {
+    ExternalExtensionLoad* load = new ExternalExtensionLoad;
+    load->path = paths[i];
+    if (!file_util::GetFileInfo(load->path, &load->info)) {
+      delete load;
+      continue;
+    }
+    loads.push_back(load);
+
+    XWalkExternalExtensionIndex::Entry entry;
+    if (index.Lookup(load->path, load->info, &entry)) {
+      load->extension.reset(
+          new XWalkExternalExtension(load->path, entry.name, entry.js_api,
+              entry.instance_per_process ?
+                  XWalkExtension::INSTANCE_PER_PROCESS :
+                  XWalkExtension::INSTANCE_PER_CONTEXT));
       continue;
     }
 
-    if (library.GetFunctionPointer("XW_Initialize")) {
-      scoped_ptr<XWalkExternalExtension> extension(
-          new XWalkExternalExtension(extension_path, library.Release()));
-      if (extension->is_valid())
-        server->RegisterExtension(extension.PassAs<XWalkExtension>());
-    } else if (library.GetFunctionPointer("xwalk_extension_init")) {
-      scoped_ptr<old::XWalkExternalExtension> extension(
-          new old::XWalkExternalExtension(library.Release()));
-      if (extension->is_valid())
-        server->RegisterExtension(extension.PassAs<XWalkExtension>());
-    } else {
-      LOG(WARNING) << "Ignoring " << extension_path.AsUTF8Unsafe()
-                   << " as external extension because"
-                   << " doesn't contain valid entry point.";
+    load->loading = true;
+    if (!base::WorkerPool::PostTask(FROM_HERE,
+            base::Bind(&LoadExternalExtension, base::Unretained(load)), true))
+      LoadExternalExtension(load);
+  }
+
+  for (size_t i = 0; i < loads.size(); ++i) {
+    ExternalExtensionLoad* load = loads[i];
+    if (load->loading) {
+      load->done.Wait();
+      if (load->extension && load->indexable) {
+        XWalkExternalExtensionIndex::Entry entry;
+        entry.name = load->extension->name();
+        entry.js_api = load->extension->GetJavaScriptAPI();
+        entry.instance_per_process = load->extension->instance_mode() ==
+            XWalkExtension::INSTANCE_PER_PROCESS;
+        index.Update(load->path, load->info, entry);
+      }
     }
+
+    if (load->extension)
+      extensions->Add(load->extension.Pass());
   }
-}
 
-bool ValidateExtensionNameForTesting(const std::string& extension_name) {
-  return ValidateExtensionName(extension_name);
+  index.Save();
 }
 
 }  // namespace extensions
@@ -7,13 +7,21 @@
 
 #include <stdint.h>
 #include <map>
+#include <set>
 #include <string>
+#include <utility>
+#include <vector>
 
+#include "base/memory/weak_ptr.h"
+#include "base/process_util.h"
 #include "base/synchronization/cancellation_flag.h"
 #include "base/values.h"
 #include "ipc/ipc_channel_proxy.h"
 #include "ipc/ipc_listener.h"
+#include "xwalk/extensions/common/xwalk_extension_code_cache_store.h"
 #include "xwalk/extensions/common/xwalk_extension_runner.h"
+#include "xwalk/extensions/common/xwalk_extension_set.h"
+#include "xwalk/extensions/common/xwalk_extension_shared_memory.h"
 
 namespace base {
 class FilePath;
@@ -31,18 +39,26 @@ namespace xwalk {
 namespace extensions {
 
 class XWalkExtension;
+class XWalkExtensionThreadedRunner;
 
 // This class holds the Native context of Extensions. It can live in the Browser
 // Process (for in-process extensions) or on the Extension Process. It
 // communicates with its associated XWalkExtensionClient through an IPC channel.
+//
+// Each render process has its own server, so instances of one process can be
+// destroyed without affecting the others. The servers share the extensions
+// themselves, see XWalkExtensionSet.
 class XWalkExtensionServer : public IPC::Listener,
                              public XWalkExtensionRunner::Client {
  public:
   XWalkExtensionServer();
+  explicit XWalkExtensionServer(
+      const scoped_refptr<XWalkExtensionSet>& extensions);
   virtual ~XWalkExtensionServer();
 
   // IPC::Listener Implementation.
   virtual bool OnMessageReceived(const IPC::Message& message) OVERRIDE;
+  virtual void OnChannelConnected(int32 peer_pid) OVERRIDE;
 
   void Initialize(IPC::Sender* sender) { sender_ = sender; }
   bool Send(IPC::Message* msg);
@@ -50,6 +66,21 @@ class XWalkExtensionServer : public IPC::Listener,
   bool RegisterExtension(scoped_ptr<XWalkExtension> extension);
   void RegisterExtensionsInRenderProcess();
 
+  // Tell the client about an extension registered or unregistered after
+  // RegisterExtensionsInRenderProcess(). Can be called from any thread.
+  void RegisterExtensionInRenderProcess(const std::string& name,
+                                        const std::string& api);
+  void UnregisterExtensionInRenderProcess(const std::string& name);
+
+  // Keeps the compiled JS API code produced by the client in |store|, so it
+  // can be sent back to the clients of later launches.
+  void SetCodeCacheStore(
+      const scoped_refptr<XWalkExtensionCodeCacheStore>& store);
+
+  // Sends the code cache to the client, must be called in the thread the
+  // server lives.
+  void SendCodeCacheToClient();
+
   void Invalidate();
 
  private:
@@ -57,30 +88,109 @@ class XWalkExtensionServer : public IPC::Listener,
   void OnCreateInstance(int64_t instance_id, std::string name);
   void OnDestroyInstance(int64_t instance_id);
   void OnPostMessageToNative(int64_t instance_id, const base::ListValue& msg);
+  void OnPostBinaryMessageToNative(
+      int64_t instance_id, const scoped_refptr<base::RefCountedMemory>& data);
+  void OnPostSharedMemoryMessageToNative(int64_t instance_id, int segment_id,
+      base::SharedMemoryHandle handle, uint32_t segment_size, uint32_t size);
+  void OnReleaseSharedMemorySegment(int segment_id);
   void OnSendSyncMessageToNative(int64_t instance_id,
       const base::ListValue& msg, IPC::Message* ipc_reply);
+  void OnPostRequestToNative(int64_t instance_id, int request_id,
+      const base::ListValue& msg);
+  void OnWaitForMessageQueue(int64_t instance_id, IPC::Message* ipc_reply);
+  void OnStoreCodeCacheData(const std::string& name, const std::string& key,
+                            const std::string& data);
+
+  void OnCodeCacheLoaded(XWalkExtensionCodeCacheStore::EntryList* entries);
+
+  void ReleaseClientSharedMemorySegment(int segment_id);
+
+  // Replies to the renderer waiting for room in the queue of the instance.
+  void ReleaseMessageQueueWaiter(int64_t instance_id);
+
+  bool IsSharedRunner(const XWalkExtensionRunner* runner) const;
+
+  // Fills |instance_ids| with the instances a message posted by |runner| to
+  // |instance_id| goes to: all the instances sharing the runner for the
+  // messages posted to the runner itself, |instance_id| otherwise.
+  void GetMessageDestinations(const XWalkExtensionRunner* runner,
+                              int64_t instance_id,
+                              std::vector<int64_t>* instance_ids) const;
+
+  void DestroySharedInstance(XWalkExtensionRunner* runner,
+                             int64_t instance_id);
+
+  void SendBinaryMessageToJS(int64_t instance_id,
+                             const scoped_refptr<base::RefCountedMemory>& data);
 
   // XWalkExtensionRunner::Client implementation.
-  virtual void HandleMessageFromNative(const XWalkExtensionRunner* runner,
-                                        scoped_ptr<base::Value> msg) OVERRIDE;
+  virtual void HandleMessagesFromNative(
+      const XWalkExtensionRunner* runner, int64_t instance_id,
+      scoped_ptr<base::ListValue> msgs) OVERRIDE;
+  virtual void HandleBinaryMessageFromNative(
+      const XWalkExtensionRunner* runner,
+      const scoped_refptr<base::RefCountedMemory>& data) OVERRIDE;
   virtual void HandleReplyMessageFromNative(
+      const XWalkExtensionRunner* runner,
       scoped_ptr<IPC::Message> ipc_reply, scoped_ptr<base::Value> msg) OVERRIDE;
+  virtual void HandleRequestReplyFromNative(
+      const XWalkExtensionRunner* runner, int request_id,
+      scoped_ptr<base::Value> reply) OVERRIDE;
+  virtual void HandleMessageQueueFullFromNative(
+      const XWalkExtensionRunner* runner, bool full,
+      bool block_sender) OVERRIDE;
 
   IPC::Sender* sender_;
 
-  typedef std::map<std::string, XWalkExtension*> ExtensionMap;
-  ExtensionMap extensions_;
+  // Size of the message being dispatched, for XWalkExtensionMetrics.
+  size_t incoming_message_size_;
+
+  scoped_refptr<XWalkExtensionSet> extensions_;
 
   typedef std::map<int64_t, XWalkExtensionRunner*> RunnerMap;
   RunnerMap runners_;
 
+  // The instances of INSTANCE_PER_PROCESS extensions share a runner, owned
+  // here, which is in |runners_| under the id of each of them.
+  struct SharedRunner {
+    SharedRunner() : runner(NULL) {}
+    XWalkExtensionThreadedRunner* runner;
+    std::set<int64_t> instance_ids;
+  };
+  typedef std::map<std::string, SharedRunner> SharedRunnerMap;
+  SharedRunnerMap shared_runners_;
+
+  // Request ids are only unique per instance, so requests to shared runners
+  // get a new one. Maps it to the instance and its own request id.
+  typedef std::map<int, std::pair<int64_t, int> > SharedRequestMap;
+  SharedRequestMap shared_requests_;
+  int next_shared_request_id_;
+
+  // Instances whose message queue is full, and the renderer waiting for room
+  // in one of them, see XWalkExtension::QueueFullPolicy.
+  std::set<int64_t> full_queues_;
+  typedef std::map<int64_t, IPC::Message*> QueueWaiterMap;
+  QueueWaiterMap queue_waiters_;
+
   base::CancellationFlag sender_cancellation_flag_;
+
+  // Used to share memory segments with the client process, see
+  // XWalkExtensionSharedMemoryPool.
+  base::ProcessHandle peer_handle_;
+  scoped_ptr<XWalkExtensionSharedMemoryPool> shared_memory_pool_;
+  scoped_ptr<XWalkExtensionSharedMemoryReader> shared_memory_reader_;
+
+  scoped_refptr<XWalkExtensionCodeCacheStore> code_cache_store_;
+
+  base::WeakPtrFactory<XWalkExtensionServer> weak_ptr_factory_;
 };
 
+// Registers the external extension libraries found in |dir|. The libraries
+// that changed since the last call are loaded in parallel in worker threads,
+// the other ones are registered from an index kept in |dir| and loaded when
+// their first instance is created.
 void RegisterExternalExtensionsInDirectory(
-    XWalkExtensionServer* server, const base::FilePath& dir);
-
-bool ValidateExtensionNameForTesting(const std::string& extension_name);
+    XWalkExtensionSet* extensions, const base::FilePath& dir);
 
 }  // namespace extensions
 }  // namespace xwalk
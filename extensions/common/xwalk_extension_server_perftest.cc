@@ -0,0 +1,416 @@
+// Copyright (c) 2013 Intel Corporation. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "xwalk/extensions/common/xwalk_extension_server.h"
+
+#include <stdio.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include "base/atomicops.h"
+#include "base/basictypes.h"
+#include "base/message_loop/message_loop.h"
+#include "base/run_loop.h"
+#include "base/strings/stringprintf.h"
+#include "base/time/time.h"
+#include "base/values.h"
+#include "ipc/ipc_sender.h"
+#include "ipc/ipc_sync_message.h"
+#include "testing/gtest/include/gtest/gtest.h"
+#include "xwalk/extensions/browser/xwalk_extension_internal.h"
+#include "xwalk/extensions/common/xwalk_extension.h"
+#include "xwalk/extensions/common/xwalk_extension_messages.h"
+
+#if defined(USE_TCMALLOC)
+#include "third_party/tcmalloc/chromium/src/gperftools/malloc_hook.h"
+#endif
+
+using xwalk::extensions::XWalkExtension;
+using xwalk::extensions::XWalkExtensionInstance;
+using xwalk::extensions::XWalkExtensionServer;
+using xwalk::extensions::XWalkInternalExtension;
+using xwalk::extensions::XWalkInternalExtensionInstance;
+
+namespace {
+
+const size_t kPayloadSizes[] = {
+  16,          // 16 B
+  1024,        // 1 KB
+  64 * 1024,   // 64 KB
+};
+
+const int kInstanceCounts[] = { 1, 4, 16 };
+
+// Messages sent for the throughput measure, all in flight at the same time
+// except for sync messages, and round trips timed one by one for latency.
+const int kThroughputMessages = 2000;
+const int kLatencyRoundTrips = 500;
+
+enum MessagePath {
+  ASYNC_MESSAGE,
+  SYNC_MESSAGE,
+  REQUEST,
+  INTERNAL_FUNCTION,
+};
+
+const char* MessagePathName(MessagePath path) {
+  switch (path) {
+    case ASYNC_MESSAGE:
+      return "async";
+    case SYNC_MESSAGE:
+      return "sync";
+    case REQUEST:
+      return "request";
+    case INTERNAL_FUNCTION:
+      return "internal";
+  }
+  NOTREACHED();
+  return "";
+}
+
+base::subtle::Atomic32 g_allocations = 0;
+
+#if defined(USE_TCMALLOC)
+void CountAllocation(const void* ptr, size_t size) {
+  base::subtle::NoBarrier_AtomicIncrement(&g_allocations, 1);
+}
+#endif
+
+// Counts the allocations made by all threads while in scope, i.e. by the
+// server and by the extension threads. Needs the tcmalloc hooks, count() is
+// -1 without them.
+class ScopedAllocationCounter {
+ public:
+  ScopedAllocationCounter() {
+    base::subtle::NoBarrier_Store(&g_allocations, 0);
+#if defined(USE_TCMALLOC)
+    MallocHook::AddNewHook(&CountAllocation);
+#endif
+  }
+
+  ~ScopedAllocationCounter() {
+#if defined(USE_TCMALLOC)
+    MallocHook::RemoveNewHook(&CountAllocation);
+#endif
+  }
+
+  int count() const {
+#if defined(USE_TCMALLOC)
+    return base::subtle::NoBarrier_Load(&g_allocations);
+#else
+    return -1;
+#endif
+  }
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(ScopedAllocationCounter);
+};
+
+class EchoInstance : public XWalkExtensionInstance {
+ public:
+  explicit EchoInstance(
+      const XWalkExtension::PostMessageCallback& post_message) {
+    SetPostMessageCallback(post_message);
+  }
+
+  virtual void HandleMessage(scoped_ptr<base::Value> msg) OVERRIDE {
+    PostMessageToJS(msg.Pass());
+  }
+
+  // Also used to reply to requests.
+  virtual scoped_ptr<base::Value> HandleSyncMessage(
+      scoped_ptr<base::Value> msg) OVERRIDE {
+    return msg.Pass();
+  }
+};
+
+class EchoExtension : public XWalkExtension {
+ public:
+  EchoExtension() { set_name("echo"); }
+  virtual const char* GetJavaScriptAPI() OVERRIDE { return ""; }
+  virtual XWalkExtensionInstance* CreateInstance(
+      const PostMessageCallback& post_message) OVERRIDE {
+    return new EchoInstance(post_message);
+  }
+};
+
+// What the IDL compiler would generate for 'static void echo(DOMString
+// payload, EchoCallback callback)'.
+const int kEchoFunction = 0;
+
+struct EchoParams {
+  static scoped_ptr<EchoParams> Create(const base::ListValue& args) {
+    scoped_ptr<EchoParams> params(new EchoParams);
+    if (args.GetSize() != 1 || !args.GetString(0, &params->payload))
+      return scoped_ptr<EchoParams>();
+    return params.Pass();
+  }
+
+  std::string payload;
+};
+
+class InternalEchoInstance : public XWalkInternalExtensionInstance {
+ public:
+  explicit InternalEchoInstance(
+      const XWalkExtension::PostMessageCallback& post_message)
+      : XWalkInternalExtensionInstance(post_message) {
+    RegisterFunction(kEchoFunction, &InternalEchoInstance::OnEcho);
+  }
+
+ private:
+  void OnEcho(int callback_id, scoped_ptr<EchoParams> params) {
+    scoped_ptr<base::ListValue> result(new base::ListValue);
+    result->AppendString(params->payload);
+    PostResult(callback_id, result.Pass());
+  }
+};
+
+class InternalEchoExtension : public XWalkInternalExtension {
+ public:
+  InternalEchoExtension() { set_name("internal_echo"); }
+  virtual const char* GetJavaScriptAPI() OVERRIDE { return ""; }
+  virtual XWalkExtensionInstance* CreateInstance(
+      const PostMessageCallback& post_message) OVERRIDE {
+    return new InternalEchoInstance(post_message);
+  }
+};
+
+// Plays the render process: reads the replies of the server like
+// XWalkExtensionClient would, and tells when the expected ones arrived.
+class BenchmarkSender : public IPC::Sender {
+ public:
+  BenchmarkSender() : pending_replies_(0) {}
+
+  void ExpectReplies(int count, const base::Closure& done) {
+    pending_replies_ = count;
+    done_ = done;
+  }
+
+  virtual bool Send(IPC::Message* msg) OVERRIDE {
+    scoped_ptr<IPC::Message> message(msg);
+    int replies = 0;
+
+    if (message->is_reply()) {
+      PickleIterator iter = IPC::SyncMessage::GetDataIterator(message.get());
+      base::ListValue reply;
+      CHECK(IPC::ReadParam(message.get(), &iter, &reply));
+      replies = 1;
+    } else if (message->type() ==
+               XWalkExtensionClientMsg_PostMessageToJS::ID) {
+      XWalkExtensionClientMsg_PostMessageToJS::Schema::Param param;
+      CHECK(XWalkExtensionClientMsg_PostMessageToJS::Read(message.get(),
+                                                          &param));
+      // Bursts of messages from an instance arrive together.
+      replies = param.b.GetSize();
+    } else if (message->type() ==
+               XWalkExtensionClientMsg_PostRequestReplyToJS::ID) {
+      XWalkExtensionClientMsg_PostRequestReplyToJS::Schema::Param param;
+      CHECK(XWalkExtensionClientMsg_PostRequestReplyToJS::Read(message.get(),
+                                                               &param));
+      replies = 1;
+    }
+
+    if (replies && pending_replies_ > 0) {
+      pending_replies_ -= replies;
+      if (pending_replies_ <= 0)
+        done_.Run();
+    }
+    return true;
+  }
+
+ private:
+  int pending_replies_;
+  base::Closure done_;
+};
+
+// Drives a server with |instance_count| echo instances, feeding it the same
+// IPC messages a render process would send.
+class ServerBenchmark {
+ public:
+  ServerBenchmark(MessagePath path, size_t payload_size, int instance_count)
+      : path_(path),
+        payload_(payload_size, 'x'),
+        instance_count_(instance_count),
+        next_serial_(0),
+        server_(new XWalkExtensionServer) {
+    server_->Initialize(&sender_);
+    server_->RegisterExtension(
+        scoped_ptr<XWalkExtension>(new EchoExtension));
+    server_->RegisterExtension(
+        scoped_ptr<XWalkExtension>(new InternalEchoExtension));
+
+    const char* extension_name =
+        path == INTERNAL_FUNCTION ? "internal_echo" : "echo";
+    for (int i = 0; i < instance_count_; ++i) {
+      server_->OnMessageReceived(
+          XWalkExtensionServerMsg_CreateInstance(i, extension_name));
+    }
+  }
+
+  ~ServerBenchmark() {
+    for (int i = 0; i < instance_count_; ++i)
+      server_->OnMessageReceived(XWalkExtensionServerMsg_DestroyInstance(i));
+    // Waits for the instances to be destroyed with the extensions.
+    server_.reset();
+  }
+
+  // Sends |count| messages spread over the instances and waits for all the
+  // replies. Sync messages go one at a time, as the renderer blocks on them.
+  base::TimeDelta RunThroughput(int count) {
+    base::TimeTicks start = base::TimeTicks::HighResNow();
+    if (path_ == SYNC_MESSAGE) {
+      for (int i = 0; i < count; ++i)
+        RunRoundTrip(i % instance_count_);
+    } else {
+      base::RunLoop run_loop;
+      sender_.ExpectReplies(count, run_loop.QuitClosure());
+      for (int i = 0; i < count; ++i)
+        SendMessage(i % instance_count_);
+      run_loop.Run();
+    }
+    return base::TimeTicks::HighResNow() - start;
+  }
+
+  // Times |count| round trips, one message in flight at a time. Adds the
+  // times to |samples|, in microseconds.
+  void RunLatency(int count, std::vector<double>* samples) {
+    for (int i = 0; i < count; ++i) {
+      base::TimeTicks start = base::TimeTicks::HighResNow();
+      RunRoundTrip(i % instance_count_);
+      samples->push_back(
+          (base::TimeTicks::HighResNow() - start).InMicrosecondsF());
+    }
+  }
+
+ private:
+  void RunRoundTrip(int64_t instance_id) {
+    base::RunLoop run_loop;
+    sender_.ExpectReplies(1, run_loop.QuitClosure());
+    SendMessage(instance_id);
+    run_loop.Run();
+  }
+
+  void SendMessage(int64_t instance_id) {
+    int serial = next_serial_++;
+    base::ListValue msg;
+
+    switch (path_) {
+      case ASYNC_MESSAGE:
+        msg.AppendString(payload_);
+        server_->OnMessageReceived(
+            XWalkExtensionServerMsg_PostMessageToNative(instance_id, msg));
+        break;
+      case SYNC_MESSAGE: {
+        msg.AppendString(payload_);
+        // The reply is read by BenchmarkSender, this one is never filled.
+        base::ListValue unused_reply;
+        server_->OnMessageReceived(
+            XWalkExtensionServerMsg_SendSyncMessageToNative(
+                instance_id, msg, &unused_reply));
+        break;
+      }
+      case REQUEST:
+        msg.AppendString(payload_);
+        server_->OnMessageReceived(
+            XWalkExtensionServerMsg_PostRequestToNative(
+                instance_id, serial, msg));
+        break;
+      case INTERNAL_FUNCTION: {
+        // Same layout as extension_obj._internal.postMessage() in
+        // xwalk_api.js.
+        base::ListValue* call = new base::ListValue;
+        call->AppendInteger(kEchoFunction);
+        // Callback id 0 stands for no callback, which gets no reply.
+        call->AppendInteger(serial + 1);
+        base::ListValue* args = new base::ListValue;
+        args->AppendString(payload_);
+        call->Append(args);
+        msg.Append(call);
+        server_->OnMessageReceived(
+            XWalkExtensionServerMsg_PostMessageToNative(instance_id, msg));
+        break;
+      }
+    }
+  }
+
+  MessagePath path_;
+  std::string payload_;
+  int instance_count_;
+  int next_serial_;
+
+  BenchmarkSender sender_;
+  scoped_ptr<XWalkExtensionServer> server_;
+
+  DISALLOW_COPY_AND_ASSIGN(ServerBenchmark);
+};
+
+double Percentile(const std::vector<double>& sorted_samples, int percent) {
+  size_t index = std::min(sorted_samples.size() - 1,
+                          sorted_samples.size() * percent / 100);
+  return sorted_samples[index];
+}
+
+// Results are printed in the format understood by Chromium perf dashboards:
+// RESULT <graph>: <trace>= <value> <units>
+void RunBenchmark(MessagePath path, size_t payload_size, int instance_count) {
+  std::string trace = base::StringPrintf("%s_%uB_%dinstances",
+      MessagePathName(path), static_cast<unsigned>(payload_size),
+      instance_count);
+  ServerBenchmark benchmark(path, payload_size, instance_count);
+
+  // Warms up the threads of the instances and the allocator.
+  benchmark.RunThroughput(kThroughputMessages / 10);
+
+  int allocations;
+  base::TimeDelta elapsed;
+  {
+    ScopedAllocationCounter counter;
+    elapsed = benchmark.RunThroughput(kThroughputMessages);
+    allocations = counter.count();
+  }
+
+  std::vector<double> samples;
+  benchmark.RunLatency(kLatencyRoundTrips, &samples);
+  std::sort(samples.begin(), samples.end());
+
+  printf("RESULT extension_server_throughput: %s= %.0f msgs/s\n",
+         trace.c_str(), kThroughputMessages / elapsed.InSecondsF());
+  printf("RESULT extension_server_latency_p50: %s= %.1f us\n",
+         trace.c_str(), Percentile(samples, 50));
+  printf("RESULT extension_server_latency_p90: %s= %.1f us\n",
+         trace.c_str(), Percentile(samples, 90));
+  printf("RESULT extension_server_latency_p99: %s= %.1f us\n",
+         trace.c_str(), Percentile(samples, 99));
+  if (allocations >= 0) {
+    printf("RESULT extension_server_allocations: %s= %.1f allocs/msg\n",
+           trace.c_str(),
+           static_cast<double>(allocations) / kThroughputMessages);
+  }
+}
+
+void RunBenchmarks(MessagePath path) {
+  base::MessageLoop loop(base::MessageLoop::TYPE_IO);
+  for (size_t i = 0; i < arraysize(kPayloadSizes); ++i) {
+    for (size_t j = 0; j < arraysize(kInstanceCounts); ++j)
+      RunBenchmark(path, kPayloadSizes[i], kInstanceCounts[j]);
+  }
+}
+
+}  // namespace
+
+TEST(XWalkExtensionServerPerfTest, AsyncMessages) {
+  RunBenchmarks(ASYNC_MESSAGE);
+}
+
+TEST(XWalkExtensionServerPerfTest, SyncMessages) {
+  RunBenchmarks(SYNC_MESSAGE);
+}
+
+TEST(XWalkExtensionServerPerfTest, Requests) {
+  RunBenchmarks(REQUEST);
+}
+
+TEST(XWalkExtensionServerPerfTest, InternalFunctions) {
+  RunBenchmarks(INTERNAL_FUNCTION);
+}
@@ -4,10 +4,167 @@
 
 #include "xwalk/extensions/common/xwalk_extension_server.h"
 
+#include <map>
+
 #include "base/basictypes.h"
+#include "base/message_loop/message_loop.h"
+#include "base/run_loop.h"
+#include "base/synchronization/lock.h"
+#include "base/threading/platform_thread.h"
+#include "base/time/time.h"
+#include "ipc/ipc_sender.h"
 #include "testing/gtest/include/gtest/gtest.h"
+#include "xwalk/extensions/common/xwalk_extension.h"
+#include "xwalk/extensions/common/xwalk_extension_messages.h"
+#include "xwalk/extensions/common/xwalk_extension_set.h"
+#include "xwalk/extensions/common/xwalk_extension_threaded_runner.h"
 
 using xwalk::extensions::ValidateExtensionNameForTesting;
+using xwalk::extensions::XWalkExtension;
+using xwalk::extensions::XWalkExtensionInstance;
+using xwalk::extensions::XWalkExtensionServer;
+using xwalk::extensions::XWalkExtensionSet;
+using xwalk::extensions::XWalkExtensionThreadedRunner;
+
+namespace {
+
+const int kSlowDestructionMs = 50;
+
+base::Lock g_destroyed_instances_lock;
+int g_destroyed_instances = 0;
+
+class SlowDestructionInstance : public XWalkExtensionInstance {
+ public:
+  virtual ~SlowDestructionInstance() {
+    base::PlatformThread::Sleep(
+        base::TimeDelta::FromMilliseconds(kSlowDestructionMs));
+    base::AutoLock lock(g_destroyed_instances_lock);
+    g_destroyed_instances++;
+  }
+  virtual void HandleMessage(scoped_ptr<base::Value> msg) OVERRIDE {}
+};
+
+// Number of instances destroyed when the extension itself was deleted, or -1
+// if it wasn't deleted yet.
+int g_destroyed_instances_at_extension_deletion = -1;
+
+class SlowDestructionExtension : public XWalkExtension {
+ public:
+  SlowDestructionExtension() { set_name("slow"); }
+  virtual ~SlowDestructionExtension() {
+    base::AutoLock lock(g_destroyed_instances_lock);
+    g_destroyed_instances_at_extension_deletion = g_destroyed_instances;
+  }
+  virtual const char* GetJavaScriptAPI() OVERRIDE { return ""; }
+  virtual XWalkExtensionInstance* CreateInstance(
+      const PostMessageCallback& post_message) OVERRIDE {
+    return new SlowDestructionInstance;
+  }
+};
+
+class NullSender : public IPC::Sender {
+ public:
+  virtual bool Send(IPC::Message* msg) OVERRIDE {
+    delete msg;
+    return true;
+  }
+};
+
+base::Lock g_shared_instances_lock;
+int g_created_shared_instances = 0;
+int g_destroyed_shared_instances = 0;
+int g_shared_instance_contexts = 0;
+
+// Echoes the messages back to the context that posted them, or to all of
+// them for "broadcast".
+class SharedInstance : public XWalkExtensionInstance {
+ public:
+  SharedInstance() {
+    base::AutoLock lock(g_shared_instances_lock);
+    g_created_shared_instances++;
+  }
+  virtual ~SharedInstance() {
+    base::AutoLock lock(g_shared_instances_lock);
+    g_destroyed_shared_instances++;
+  }
+  virtual void HandleMessage(scoped_ptr<base::Value> msg) OVERRIDE {}
+  virtual void HandleContextMessage(int64_t context_id,
+                                    scoped_ptr<base::Value> msg) OVERRIDE {
+    std::string text;
+    if (msg->GetAsString(&text) && text == "broadcast")
+      PostMessageToJS(msg.Pass());
+    else
+      PostMessageToContext(context_id, msg.Pass());
+  }
+  virtual void DidCreateContext(int64_t context_id) OVERRIDE {
+    base::AutoLock lock(g_shared_instances_lock);
+    g_shared_instance_contexts++;
+  }
+  virtual void WillDestroyContext(int64_t context_id) OVERRIDE {
+    base::AutoLock lock(g_shared_instances_lock);
+    g_shared_instance_contexts--;
+  }
+};
+
+class SharedExtension : public XWalkExtension {
+ public:
+  SharedExtension() {
+    set_name("shared");
+    set_instance_mode(INSTANCE_PER_PROCESS);
+  }
+  virtual const char* GetJavaScriptAPI() OVERRIDE { return ""; }
+  virtual XWalkExtensionInstance* CreateInstance(
+      const PostMessageCallback& post_message) OVERRIDE {
+    return new SharedInstance;
+  }
+};
+
+// Counts the messages posted to each instance, and quits the current run
+// loop once |expected_messages| arrived.
+class RecordingSender : public IPC::Sender {
+ public:
+  RecordingSender() : expected_messages_(0), received_messages_(0) {}
+
+  virtual bool Send(IPC::Message* msg) OVERRIDE {
+    if (msg->type() == XWalkExtensionClientMsg_PostMessageToJS::ID) {
+      XWalkExtensionClientMsg_PostMessageToJS::Param param;
+      EXPECT_TRUE(XWalkExtensionClientMsg_PostMessageToJS::Read(msg, &param));
+      messages_per_instance_[param.a]++;
+      if (++received_messages_ == expected_messages_)
+        run_loop_->Quit();
+    }
+    delete msg;
+    return true;
+  }
+
+  void WaitForMessages(int count) {
+    messages_per_instance_.clear();
+    expected_messages_ = count;
+    received_messages_ = 0;
+    run_loop_.reset(new base::RunLoop);
+    run_loop_->Run();
+  }
+
+  int MessagesTo(int64_t instance_id) {
+    return messages_per_instance_[instance_id];
+  }
+
+ private:
+  int expected_messages_;
+  int received_messages_;
+  std::map<int64_t, int> messages_per_instance_;
+  scoped_ptr<base::RunLoop> run_loop_;
+};
+
+void PostStringToNative(XWalkExtensionServer* server, int64_t instance_id,
+                        const std::string& text) {
+  base::ListValue msg;
+  msg.AppendString(text);
+  server->OnMessageReceived(
+      XWalkExtensionServerMsg_PostMessageToNative(instance_id, msg));
+}
+
+}  // namespace
 
 TEST(XWalkExtensionServerTest, ValidateExtensionName) {
   const std::string valid_names[] = {
@@ -42,3 +199,168 @@ TEST(XWalkExtensionServerTest, ValidateExtensionName) {
         << "Extension name should be invalid: " << invalid_names[i];
   }
 }
+
+// The server lives in the IO thread of the browser, destroying instances
+// shouldn't block it even if the extension takes its time to clean up.
+TEST(XWalkExtensionServerTest, DestroyInstancesDoesNotBlock) {
+  base::MessageLoop loop(base::MessageLoop::TYPE_IO);
+  {
+    base::AutoLock lock(g_destroyed_instances_lock);
+    g_destroyed_instances = 0;
+  }
+  NullSender sender;
+  scoped_ptr<XWalkExtensionServer> server(new XWalkExtensionServer);
+  server->Initialize(&sender);
+  server->RegisterExtension(
+      scoped_ptr<XWalkExtension>(new SlowDestructionExtension));
+
+  const int kInstances = 20;
+  for (int i = 0; i < kInstances; ++i) {
+    server->OnMessageReceived(
+        XWalkExtensionServerMsg_CreateInstance(i, "slow"));
+  }
+
+  base::TimeTicks start = base::TimeTicks::HighResNow();
+  for (int i = 0; i < kInstances; ++i)
+    server->OnMessageReceived(XWalkExtensionServerMsg_DestroyInstance(i));
+  base::TimeDelta stall = base::TimeTicks::HighResNow() - start;
+
+  EXPECT_LT(stall.InMilliseconds(), kSlowDestructionMs)
+      << "Destroying " << kInstances << " instances blocked the server for "
+      << stall.InMilliseconds() << "ms";
+
+  XWalkExtensionThreadedRunner::WaitForPendingDestructions();
+  {
+    base::AutoLock lock(g_destroyed_instances_lock);
+    EXPECT_EQ(kInstances, g_destroyed_instances);
+  }
+
+  server.reset();
+}
+
+// Deleting the server, and the extensions with it, doesn't wait for the
+// instances being destroyed either. The extensions are deleted later, in the
+// thread that released them.
+TEST(XWalkExtensionServerTest, DeleteServerDoesNotBlock) {
+  base::MessageLoop loop(base::MessageLoop::TYPE_IO);
+  {
+    base::AutoLock lock(g_destroyed_instances_lock);
+    g_destroyed_instances = 0;
+    g_destroyed_instances_at_extension_deletion = -1;
+  }
+  NullSender sender;
+  scoped_ptr<XWalkExtensionServer> server(new XWalkExtensionServer);
+  server->Initialize(&sender);
+  server->RegisterExtension(
+      scoped_ptr<XWalkExtension>(new SlowDestructionExtension));
+
+  const int kInstances = 5;
+  for (int i = 0; i < kInstances; ++i) {
+    server->OnMessageReceived(
+        XWalkExtensionServerMsg_CreateInstance(i, "slow"));
+  }
+
+  base::TimeTicks start = base::TimeTicks::HighResNow();
+  server.reset();
+  base::TimeDelta stall = base::TimeTicks::HighResNow() - start;
+  EXPECT_LT(stall.InMilliseconds(), kSlowDestructionMs);
+
+  XWalkExtensionThreadedRunner::WaitForPendingDestructions();
+  base::RunLoop().RunUntilIdle();
+  base::AutoLock lock(g_destroyed_instances_lock);
+  EXPECT_EQ(kInstances, g_destroyed_instances_at_extension_deletion);
+}
+
+// An extension removed while running is deleted once its last instance is
+// gone, without waiting for the set to go away.
+TEST(XWalkExtensionServerTest, RemovedExtensionIsDeletedAfterItsInstances) {
+  base::MessageLoop loop(base::MessageLoop::TYPE_IO);
+  {
+    base::AutoLock lock(g_destroyed_instances_lock);
+    g_destroyed_instances = 0;
+    g_destroyed_instances_at_extension_deletion = -1;
+  }
+  NullSender sender;
+  scoped_refptr<XWalkExtensionSet> extensions(new XWalkExtensionSet);
+  scoped_ptr<XWalkExtensionServer> server(
+      new XWalkExtensionServer(extensions));
+  server->Initialize(&sender);
+  server->RegisterExtension(
+      scoped_ptr<XWalkExtension>(new SlowDestructionExtension));
+
+  const int kInstances = 3;
+  for (int i = 0; i < kInstances; ++i) {
+    server->OnMessageReceived(
+        XWalkExtensionServerMsg_CreateInstance(i, "slow"));
+  }
+
+  EXPECT_TRUE(extensions->Remove("slow"));
+  EXPECT_FALSE(extensions->Get("slow"));
+  {
+    base::AutoLock lock(g_destroyed_instances_lock);
+    EXPECT_EQ(-1, g_destroyed_instances_at_extension_deletion);
+  }
+
+  for (int i = 0; i < kInstances; ++i)
+    server->OnMessageReceived(XWalkExtensionServerMsg_DestroyInstance(i));
+  XWalkExtensionThreadedRunner::WaitForPendingDestructions();
+  base::RunLoop().RunUntilIdle();
+  {
+    base::AutoLock lock(g_destroyed_instances_lock);
+    EXPECT_EQ(kInstances, g_destroyed_instances_at_extension_deletion);
+  }
+
+  // The server and the set are still around.
+  server.reset();
+}
+
+// The instances of an INSTANCE_PER_PROCESS extension are contexts of a single
+// XWalkExtensionInstance, which can reply to one of them or to all.
+TEST(XWalkExtensionServerTest, SharedInstance) {
+  {
+    // Other runs of the test, e.g. with --gtest_repeat, counted too.
+    base::AutoLock lock(g_shared_instances_lock);
+    g_created_shared_instances = 0;
+    g_destroyed_shared_instances = 0;
+    g_shared_instance_contexts = 0;
+  }
+
+  base::MessageLoop loop(base::MessageLoop::TYPE_IO);
+  RecordingSender sender;
+  scoped_ptr<XWalkExtensionServer> server(new XWalkExtensionServer);
+  server->Initialize(&sender);
+  server->RegisterExtension(
+      scoped_ptr<XWalkExtension>(new SharedExtension));
+
+  const int kInstances = 3;
+  for (int i = 1; i <= kInstances; ++i) {
+    server->OnMessageReceived(
+        XWalkExtensionServerMsg_CreateInstance(i, "shared"));
+  }
+
+  PostStringToNative(server.get(), 2, "ping");
+  sender.WaitForMessages(1);
+  EXPECT_EQ(1, sender.MessagesTo(2));
+
+  PostStringToNative(server.get(), 1, "broadcast");
+  sender.WaitForMessages(kInstances);
+  for (int i = 1; i <= kInstances; ++i)
+    EXPECT_EQ(1, sender.MessagesTo(i));
+
+  {
+    base::AutoLock lock(g_shared_instances_lock);
+    EXPECT_EQ(1, g_created_shared_instances);
+    EXPECT_EQ(kInstances, g_shared_instance_contexts);
+  }
+
+  for (int i = 1; i <= kInstances; ++i)
+    server->OnMessageReceived(XWalkExtensionServerMsg_DestroyInstance(i));
+
+  XWalkExtensionThreadedRunner::WaitForPendingDestructions();
+  {
+    base::AutoLock lock(g_shared_instances_lock);
+    EXPECT_EQ(1, g_destroyed_shared_instances);
+  }
+
+  server.reset();
+}
@@ -0,0 +1,232 @@
+// Copyright (c) 2013 Intel Corporation. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "xwalk/extensions/common/xwalk_extension_set.h"
+
+#include "base/bind.h"
+#include "base/location.h"
+#include "base/logging.h"
+#include "base/message_loop/message_loop.h"
+#include "base/message_loop/message_loop_proxy.h"
+#include "base/strings/string_util.h"
+#include "xwalk/extensions/common/xwalk_extension.h"
+
+namespace xwalk {
+namespace extensions {
+
+namespace {
+
+bool ValidateExtensionName(const std::string& extension_name) {
+  bool dot_allowed = false;
+  bool digit_or_underscore_allowed = false;
+  for (size_t i = 0; i < extension_name.size(); ++i) {
+    char c = extension_name[i];
+    if (IsAsciiDigit(c)) {
+      if (!digit_or_underscore_allowed)
+        return false;
+    } else if (c == '_') {
+      if (!digit_or_underscore_allowed)
+        return false;
+    } else if (c == '.') {
+      if (!dot_allowed)
+        return false;
+      dot_allowed = false;
+      digit_or_underscore_allowed = false;
+    } else if (IsAsciiAlpha(c)) {
+      dot_allowed = true;
+      digit_or_underscore_allowed = true;
+    } else {
+      return false;
+    }
+  }
+
+  // If after going through the entire name we finish with dot_allowed, it means
+  // the previous character is not a dot, so it's a valid name.
+  return dot_allowed;
+}
+
+}  // namespace
+
+// Counts the live instances of each extension of a set. Once the set lets go
+// of an extension, it is deleted as soon as it has no instances. This is
+// shared with the callbacks given by GetForInstance(), so it can outlive the
+// set.
+class XWalkExtensionSet::InstanceCounter
+    : public base::RefCountedThreadSafe<InstanceCounter> {
+ public:
+  InstanceCounter() {}
+
+  // Called with the lock of the set held, so |extension| can't be released
+  // meanwhile.
+  void AddInstance(XWalkExtension* extension) {
+    base::AutoLock lock(lock_);
+    entries_[extension].instances++;
+  }
+
+  void RemoveInstance(XWalkExtension* extension) {
+    scoped_refptr<base::SingleThreadTaskRunner> task_runner;
+    {
+      base::AutoLock lock(lock_);
+      EntryMap::iterator it = entries_.find(extension);
+      DCHECK(it != entries_.end());
+      if (--it->second.instances > 0 || !it->second.released)
+        return;
+      task_runner = it->second.task_runner;
+      entries_.erase(it);
+    }
+    DeleteExtension(extension, task_runner.get());
+  }
+
+  // Takes ownership of |extension|, which is deleted right away if it has no
+  // instances. Otherwise it is deleted after the last one, on the current
+  // thread if possible.
+  void Release(XWalkExtension* extension) {
+    {
+      base::AutoLock lock(lock_);
+      EntryMap::iterator it = entries_.find(extension);
+      if (it != entries_.end() && it->second.instances > 0) {
+        it->second.released = true;
+        if (base::MessageLoop::current())
+          it->second.task_runner = base::MessageLoopProxy::current();
+        return;
+      }
+      if (it != entries_.end())
+        entries_.erase(it);
+    }
+    delete extension;
+  }
+
+ private:
+  friend class base::RefCountedThreadSafe<InstanceCounter>;
+  ~InstanceCounter() {}
+
+  void DeleteExtension(XWalkExtension* extension,
+                       base::SingleThreadTaskRunner* task_runner) {
+    // If the thread that released the extension is gone, it is deleted by
+    // the thread of its last instance instead.
+    if (!task_runner || task_runner->BelongsToCurrentThread() ||
+        !task_runner->DeleteSoon(FROM_HERE, extension)) {
+      delete extension;
+    }
+  }
+
+  struct Entry {
+    Entry() : instances(0), released(false) {}
+    int instances;
+    bool released;
+    scoped_refptr<base::SingleThreadTaskRunner> task_runner;
+  };
+
+  base::Lock lock_;
+  typedef std::map<XWalkExtension*, Entry> EntryMap;
+  EntryMap entries_;
+
+  DISALLOW_COPY_AND_ASSIGN(InstanceCounter);
+};
+
+XWalkExtensionSet::XWalkExtensionSet()
+    : instance_counter_(new InstanceCounter) {}
+
+XWalkExtensionSet::~XWalkExtensionSet() {
+  // Instances may still be using their extensions while being destroyed, in
+  // this case the extensions are deleted later.
+  ExtensionMap::const_iterator it = extensions_.begin();
+  for (; it != extensions_.end(); ++it)
+    instance_counter_->Release(it->second);
+}
+
+bool XWalkExtensionSet::Add(scoped_ptr<XWalkExtension> extension) {
+  if (!ValidateExtensionName(extension->name())) {
+    LOG(WARNING) << "Ignoring extension with invalid name: "
+                 << extension->name();
+    return false;
+  }
+
+  base::AutoLock lock(lock_);
+  if (extensions_.find(extension->name()) != extensions_.end()) {
+    LOG(WARNING) << "Ignoring extension with name already registered: "
+                 << extension->name();
+    return false;
+  }
+
+  std::string name = extension->name();
+  extensions_[name] = extension.release();
+  api_snapshot_ = NULL;
+  return true;
+}
+
+bool XWalkExtensionSet::Remove(const std::string& name) {
+  base::AutoLock lock(lock_);
+  ExtensionMap::iterator it = extensions_.find(name);
+  if (it == extensions_.end())
+    return false;
+
+  instance_counter_->Release(it->second);
+  extensions_.erase(it);
+  api_snapshot_ = NULL;
+  return true;
+}
+
+XWalkExtension* XWalkExtensionSet::Get(const std::string& name) const {
+  base::AutoLock lock(lock_);
+  ExtensionMap::const_iterator it = extensions_.find(name);
+  if (it == extensions_.end())
+    return NULL;
+  return it->second;
+}
+
+XWalkExtension* XWalkExtensionSet::GetForInstance(
+    const std::string& name, base::Closure* instance_destroyed) {
+  base::AutoLock lock(lock_);
+  ExtensionMap::const_iterator it = extensions_.find(name);
+  if (it == extensions_.end())
+    return NULL;
+  instance_counter_->AddInstance(it->second);
+  *instance_destroyed = base::Bind(&InstanceCounter::RemoveInstance,
+                                   instance_counter_, it->second);
+  return it->second;
+}
+
+bool XWalkExtensionSet::GetJavaScriptAPI(const std::string& name,
+                                         std::string* api) const {
+  base::AutoLock lock(lock_);
+  ExtensionMap::const_iterator it = extensions_.find(name);
+  if (it == extensions_.end())
+    return false;
+  *api = it->second->GetJavaScriptAPI();
+  return true;
+}
+
+void XWalkExtensionSet::GetJavaScriptAPIs(
+    std::vector<std::string>* names, std::vector<std::string>* apis) const {
+  base::AutoLock lock(lock_);
+  ExtensionMap::const_iterator it = extensions_.begin();
+  for (; it != extensions_.end(); ++it) {
+    names->push_back(it->first);
+    apis->push_back(it->second->GetJavaScriptAPI());
+  }
+}
+
+scoped_refptr<XWalkExtensionAPISnapshot> XWalkExtensionSet::GetAPISnapshot() {
+  base::AutoLock lock(lock_);
+  if (api_snapshot_)
+    return api_snapshot_;
+
+  std::vector<std::string> names;
+  std::vector<std::string> apis;
+  ExtensionMap::const_iterator it = extensions_.begin();
+  for (; it != extensions_.end(); ++it) {
+    names.push_back(it->first);
+    apis.push_back(it->second->GetJavaScriptAPI());
+  }
+  api_snapshot_ = XWalkExtensionAPISnapshot::Create(names, apis);
+  return api_snapshot_;
+}
+
+bool ValidateExtensionNameForTesting(const std::string& extension_name) {
+  return ValidateExtensionName(extension_name);
+}
+
+}  // namespace extensions
+}  // namespace xwalk
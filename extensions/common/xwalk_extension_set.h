@@ -0,0 +1,90 @@
+// Copyright (c) 2013 Intel Corporation. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef XWALK_EXTENSIONS_COMMON_XWALK_EXTENSION_SET_H_
+#define XWALK_EXTENSIONS_COMMON_XWALK_EXTENSION_SET_H_
+
+#include <map>
+#include <string>
+#include <vector>
+#include "base/callback.h"
+#include "base/memory/ref_counted.h"
+#include "base/memory/scoped_ptr.h"
+#include "base/synchronization/lock.h"
+#include "xwalk/extensions/common/xwalk_extension_api_snapshot.h"
+
+namespace xwalk {
+namespace extensions {
+
+class XWalkExtension;
+
+// Holds the registered extensions. The set can be shared by many
+// XWalkExtensionServers, e.g. one for each render process, so all of them
+// expose the same extensions. The extensions are deleted once the last server
+// using them is gone and the instances created from them are destroyed. The
+// set never waits for those instances: an extension that still has some is
+// deleted after the last one, on the thread that released the set.
+//
+// Extensions can be added and removed while the servers use the set, from
+// any thread.
+class XWalkExtensionSet
+    : public base::RefCountedThreadSafe<XWalkExtensionSet> {
+ public:
+  typedef std::map<std::string, XWalkExtension*> ExtensionMap;
+
+  XWalkExtensionSet();
+
+  // Returns false if the name of |extension| is invalid or already used.
+  bool Add(scoped_ptr<XWalkExtension> extension);
+
+  // Returns false if there's no extension called |name|. The extension is
+  // deleted once the instances created from it are gone, right away if there
+  // are none.
+  bool Remove(const std::string& name);
+
+  // Returns NULL if there's no extension called |name|. The extension can be
+  // deleted as soon as it is removed, so the pointer is only good for the
+  // threads that remove extensions.
+  XWalkExtension* Get(const std::string& name) const;
+
+  // Copies the JavaScript API code of the extension called |name|, which is
+  // safe from any thread. Returns false if there's no such extension.
+  bool GetJavaScriptAPI(const std::string& name, std::string* api) const;
+
+  // Same as Get(), for creating an instance of the extension. The extension
+  // is kept alive, even after the set is gone, until |instance_destroyed| is
+  // run once the instance is destroyed. It can be run from any thread.
+  XWalkExtension* GetForInstance(const std::string& name,
+                                 base::Closure* instance_destroyed);
+
+  // Copies the names and JavaScript API code of the extensions registered at
+  // the time of the call.
+  void GetJavaScriptAPIs(std::vector<std::string>* names,
+                         std::vector<std::string>* apis) const;
+
+  // Returns the JavaScript API code of the extensions registered at the time
+  // of the call, or NULL if the snapshot couldn't be created. The snapshot is
+  // built once and shared by all the callers until the set changes.
+  scoped_refptr<XWalkExtensionAPISnapshot> GetAPISnapshot();
+
+ private:
+  friend class base::RefCountedThreadSafe<XWalkExtensionSet>;
+  ~XWalkExtensionSet();
+
+  class InstanceCounter;
+
+  mutable base::Lock lock_;
+  scoped_refptr<InstanceCounter> instance_counter_;
+  ExtensionMap extensions_;
+  scoped_refptr<XWalkExtensionAPISnapshot> api_snapshot_;
+
+  DISALLOW_COPY_AND_ASSIGN(XWalkExtensionSet);
+};
+
+bool ValidateExtensionNameForTesting(const std::string& extension_name);
+
+}  // namespace extensions
+}  // namespace xwalk
+
+#endif  // XWALK_EXTENSIONS_COMMON_XWALK_EXTENSION_SET_H_
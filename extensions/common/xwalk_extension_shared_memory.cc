@@ -0,0 +1,239 @@
+// Copyright (c) 2013 Intel Corporation. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "xwalk/extensions/common/xwalk_extension_shared_memory.h"
+
+#include <string.h>
+#include <vector>
+#include "base/bind.h"
+#include "base/location.h"
+#include "base/logging.h"
+#include "base/single_thread_task_runner.h"
+
+namespace xwalk {
+namespace extensions {
+
+namespace {
+
+// Segments are allocated in power of two sizes between these limits, so that
+// a segment can be reused for messages of similar sizes.
+const size_t kMinSegmentSize = 256 * 1024;
+const size_t kMaxSegmentSize = 64 * 1024 * 1024;
+
+size_t GetSegmentSizeForMessage(size_t size) {
+  size_t segment_size = kMinSegmentSize;
+  while (segment_size < size)
+    segment_size *= 2;
+  return segment_size;
+}
+
+}  // namespace
+
+XWalkExtensionSharedMemoryPool::Segment::Segment()
+    : size(0),
+      in_use(false),
+      shared_with_peer(false) {}
+
+XWalkExtensionSharedMemoryPool::Segment::~Segment() {}
+
+XWalkExtensionSharedMemoryPool::XWalkExtensionSharedMemoryPool() {}
+
+XWalkExtensionSharedMemoryPool::XWalkExtensionSharedMemoryPool(
+    const AllocateCallback& allocate)
+    : allocate_(allocate) {}
+
+XWalkExtensionSharedMemoryPool::~XWalkExtensionSharedMemoryPool() {}
+
+bool XWalkExtensionSharedMemoryPool::Write(
+    const scoped_refptr<base::RefCountedMemory>& data,
+    base::ProcessHandle peer, int* segment_id,
+    base::SharedMemoryHandle* handle, size_t* segment_size) {
+  if (data->size() > kMaxSegmentSize)
+    return false;
+
+  Segment* segment = GetFreeSegment(data->size(), segment_id);
+  if (!segment)
+    return false;
+
+  *handle = base::SharedMemory::NULLHandle();
+  if (!segment->shared_with_peer) {
+    if (!segment->memory->ShareToProcess(peer, handle))
+      return false;
+    segment->shared_with_peer = true;
+  }
+
+  memcpy(segment->memory->memory(), data->front(), data->size());
+  segment->in_use = true;
+  *segment_size = segment->size;
+  return true;
+}
+
+void XWalkExtensionSharedMemoryPool::Release(int segment_id) {
+  if (segment_id < 0 || segment_id >= kMaxSegments) {
+    LOG(WARNING) << "Can't release invalid shared memory segment: "
+                 << segment_id;
+    return;
+  }
+  segments_[segment_id].in_use = false;
+}
+
+XWalkExtensionSharedMemoryPool::Segment*
+XWalkExtensionSharedMemoryPool::GetFreeSegment(size_t size, int* segment_id) {
+  // Prefer reusing a segment that is already shared with the peer.
+  for (int i = 0; i < kMaxSegments; ++i) {
+    Segment* segment = &segments_[i];
+    if (segment->memory && !segment->in_use && segment->size >= size) {
+      *segment_id = i;
+      return segment;
+    }
+  }
+
+  // Then fill empty slots, and only after replace free segments that are too
+  // small for this message.
+  int candidate = -1;
+  for (int i = 0; i < kMaxSegments; ++i) {
+    if (!segments_[i].memory) {
+      candidate = i;
+      break;
+    }
+    if (!segments_[i].in_use && candidate == -1)
+      candidate = i;
+  }
+
+  if (candidate == -1)
+    return NULL;
+
+  Segment* segment = &segments_[candidate];
+  if (!AllocateSegment(segment, GetSegmentSizeForMessage(size)))
+    return NULL;
+
+  *segment_id = candidate;
+  return segment;
+}
+
+bool XWalkExtensionSharedMemoryPool::AllocateSegment(Segment* segment,
+                                                     size_t size) {
+  scoped_ptr<base::SharedMemory> memory;
+  if (!allocate_.is_null()) {
+    memory = allocate_.Run(size);
+  } else {
+    memory.reset(new base::SharedMemory);
+    if (!memory->CreateAnonymous(size))
+      memory.reset();
+  }
+
+  if (!memory || !memory->Map(size)) {
+    LOG(WARNING) << "Couldn't allocate shared memory segment of size "
+                 << size << " for extension messages.";
+    return false;
+  }
+
+  segment->memory = memory.Pass();
+  segment->size = size;
+  segment->in_use = false;
+  segment->shared_with_peer = false;
+  return true;
+}
+
+// Keeps a segment mapped for as long as there is data referencing it, even
+// if the segment was replaced or the reader was destroyed.
+class XWalkExtensionSharedMemoryReader::MappedSegment
+    : public base::RefCountedThreadSafe<MappedSegment> {
+ public:
+  MappedSegment(base::SharedMemoryHandle handle, size_t size)
+      : memory_(handle, true /* read_only */),
+        size_(size) {}
+
+  bool Map() { return memory_.Map(size_); }
+
+  const unsigned char* memory() const {
+    return static_cast<const unsigned char*>(memory_.memory());
+  }
+  size_t size() const { return size_; }
+
+ private:
+  friend class base::RefCountedThreadSafe<MappedSegment>;
+  ~MappedSegment() {}
+
+  base::SharedMemory memory_;
+  size_t size_;
+};
+
+// Exposes the contents of a message directly from the mapped segment. Once
+// the last reference goes away, the segment is released back to the sending
+// side.
+class XWalkExtensionSharedMemoryReader::SharedMemoryBytes
+    : public base::RefCountedMemory {
+ public:
+  SharedMemoryBytes(const scoped_refptr<MappedSegment>& segment, size_t size,
+                    base::SingleThreadTaskRunner* task_runner,
+                    const base::Closure& release)
+      : segment_(segment),
+        size_(size),
+        task_runner_(task_runner),
+        release_(release) {}
+
+  virtual const unsigned char* front() const OVERRIDE {
+    return segment_->memory();
+  }
+
+  virtual size_t size() const OVERRIDE { return size_; }
+
+ private:
+  virtual ~SharedMemoryBytes() {
+    // This might be the last reference of data handled by an extension
+    // thread, so we go back to the thread owning the reader.
+    task_runner_->PostTask(FROM_HERE, release_);
+  }
+
+  scoped_refptr<MappedSegment> segment_;
+  size_t size_;
+  scoped_refptr<base::SingleThreadTaskRunner> task_runner_;
+  base::Closure release_;
+};
+
+XWalkExtensionSharedMemoryReader::XWalkExtensionSharedMemoryReader(
+    base::SingleThreadTaskRunner* task_runner, const ReleaseCallback& release,
+    ReadMode mode)
+    : task_runner_(task_runner),
+      release_(release),
+      mode_(mode) {}
+
+XWalkExtensionSharedMemoryReader::~XWalkExtensionSharedMemoryReader() {}
+
+scoped_refptr<base::RefCountedMemory> XWalkExtensionSharedMemoryReader::Read(
+    int segment_id, base::SharedMemoryHandle handle, size_t segment_size,
+    size_t size) {
+  if (base::SharedMemory::IsHandleValid(handle)) {
+    scoped_refptr<MappedSegment> segment(
+        new MappedSegment(handle, segment_size));
+    if (!segment->Map()) {
+      LOG(WARNING) << "Couldn't map shared memory segment " << segment_id;
+      segments_.erase(segment_id);
+      task_runner_->PostTask(FROM_HERE, base::Bind(release_, segment_id));
+      return NULL;
+    }
+    segments_[segment_id] = segment;
+  }
+
+  SegmentMap::const_iterator it = segments_.find(segment_id);
+  if (it == segments_.end() || size > it->second->size()) {
+    LOG(WARNING) << "Invalid message in shared memory segment " << segment_id;
+    task_runner_->PostTask(FROM_HERE, base::Bind(release_, segment_id));
+    return NULL;
+  }
+
+  if (mode_ == READ_COPY) {
+    const unsigned char* front = it->second->memory();
+    std::vector<unsigned char> bytes(front, front + size);
+    task_runner_->PostTask(FROM_HERE, base::Bind(release_, segment_id));
+    return base::RefCountedBytes::TakeVector(&bytes);
+  }
+
+  return new SharedMemoryBytes(it->second, size, task_runner_.get(),
+                               base::Bind(release_, segment_id));
+}
+
+}  // namespace extensions
+}  // namespace xwalk
@@ -0,0 +1,129 @@
+// Copyright (c) 2013 Intel Corporation. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef XWALK_EXTENSIONS_COMMON_XWALK_EXTENSION_SHARED_MEMORY_H_
+#define XWALK_EXTENSIONS_COMMON_XWALK_EXTENSION_SHARED_MEMORY_H_
+
+#include <map>
+#include "base/basictypes.h"
+#include "base/callback.h"
+#include "base/memory/ref_counted.h"
+#include "base/memory/ref_counted_memory.h"
+#include "base/memory/scoped_ptr.h"
+#include "base/memory/shared_memory.h"
+#include "base/process_util.h"
+
+namespace base {
+class SingleThreadTaskRunner;
+}
+
+namespace xwalk {
+namespace extensions {
+
+// Binary messages of this size or bigger are transported using shared memory
+// instead of being copied into the IPC message.
+const size_t kSharedMemoryMessageThreshold = 64 * 1024;
+
+// Sending side of the shared memory transport. It keeps a small ring of
+// shared memory segments that are reused for each big message, so the
+// message contents are copied once into the segment and only a segment id
+// (plus the handle, the first time the segment is used) goes through the IPC
+// channel. Segments are recycled once the receiving side calls Release() for
+// them. All methods should be called on the same thread.
+class XWalkExtensionSharedMemoryPool {
+ public:
+  // Used to allocate new segments. This is needed in the renderer, where
+  // shared memory must be allocated by the browser process.
+  typedef base::Callback<scoped_ptr<base::SharedMemory>(size_t)>
+      AllocateCallback;
+
+  XWalkExtensionSharedMemoryPool();
+  explicit XWalkExtensionSharedMemoryPool(const AllocateCallback& allocate);
+  ~XWalkExtensionSharedMemoryPool();
+
+  // Copies |data| into a free segment. On success, |segment_id| and
+  // |segment_size| identify the segment, and |handle| is either a handle
+  // shared with |peer| (the first time a segment is sent) or a NULL handle.
+  // Returns false if no segment is available, in this case the message should
+  // be sent the regular way.
+  bool Write(const scoped_refptr<base::RefCountedMemory>& data,
+             base::ProcessHandle peer, int* segment_id,
+             base::SharedMemoryHandle* handle, size_t* segment_size);
+
+  // Marks the segment as free to be used by other messages.
+  void Release(int segment_id);
+
+ private:
+  struct Segment {
+    Segment();
+    ~Segment();
+
+    scoped_ptr<base::SharedMemory> memory;
+    size_t size;
+    bool in_use;
+    bool shared_with_peer;
+  };
+
+  Segment* GetFreeSegment(size_t size, int* segment_id);
+  bool AllocateSegment(Segment* segment, size_t size);
+
+  static const int kMaxSegments = 8;
+  Segment segments_[kMaxSegments];
+
+  AllocateCallback allocate_;
+
+  DISALLOW_COPY_AND_ASSIGN(XWalkExtensionSharedMemoryPool);
+};
+
+// Receiving side of the shared memory transport. It keeps the segments
+// mapped between messages. Depending on the ReadMode, the message contents
+// are either exposed directly from the mapped memory or copied out of it.
+// When the segment is not used anymore, the release callback is called on the
+// given task runner with the segment id, so the sending side can be notified.
+class XWalkExtensionSharedMemoryReader {
+ public:
+  typedef base::Callback<void(int segment_id)> ReleaseCallback;
+
+  enum ReadMode {
+    // The data returned by Read() points into the segment, which is released
+    // once that data is not referenced anymore. Only for trusted senders: the
+    // sender can still write to the segment while it is being read.
+    READ_IN_PLACE,
+    // The data returned by Read() is a copy, and the segment is released
+    // right away. Use it when the sender is less trusted than the receiver,
+    // e.g. a renderer, so the bytes can't change while being parsed.
+    READ_COPY,
+  };
+
+  XWalkExtensionSharedMemoryReader(base::SingleThreadTaskRunner* task_runner,
+                                   const ReleaseCallback& release,
+                                   ReadMode mode);
+  ~XWalkExtensionSharedMemoryReader();
+
+  // Returns NULL if the segment couldn't be mapped or if the message doesn't
+  // fit in it, the segment is released right away in this case. A valid
+  // |handle| replaces the segment previously known by |segment_id|.
+  scoped_refptr<base::RefCountedMemory> Read(int segment_id,
+                                             base::SharedMemoryHandle handle,
+                                             size_t segment_size,
+                                             size_t size);
+
+ private:
+  class MappedSegment;
+  class SharedMemoryBytes;
+
+  typedef std::map<int, scoped_refptr<MappedSegment> > SegmentMap;
+  SegmentMap segments_;
+
+  scoped_refptr<base::SingleThreadTaskRunner> task_runner_;
+  ReleaseCallback release_;
+  ReadMode mode_;
+
+  DISALLOW_COPY_AND_ASSIGN(XWalkExtensionSharedMemoryReader);
+};
+
+}  // namespace extensions
+}  // namespace xwalk
+
+#endif  // XWALK_EXTENSIONS_COMMON_XWALK_EXTENSION_SHARED_MEMORY_H_
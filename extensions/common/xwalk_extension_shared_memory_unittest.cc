@@ -0,0 +1,158 @@
+// Copyright (c) 2013 Intel Corporation. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "xwalk/extensions/common/xwalk_extension_shared_memory.h"
+
+#include <string.h>
+#include <string>
+#include <vector>
+#include "base/bind.h"
+#include "base/message_loop/message_loop.h"
+#include "base/message_loop/message_loop_proxy.h"
+#include "base/run_loop.h"
+#include "testing/gtest/include/gtest/gtest.h"
+
+using xwalk::extensions::XWalkExtensionSharedMemoryPool;
+using xwalk::extensions::XWalkExtensionSharedMemoryReader;
+using xwalk::extensions::kSharedMemoryMessageThreshold;
+
+namespace {
+
+void StoreReleasedSegment(std::vector<int>* released, int segment_id) {
+  released->push_back(segment_id);
+}
+
+scoped_refptr<base::RefCountedMemory> CreateMessage(size_t size, char c) {
+  std::string str(size, c);
+  return base::RefCountedString::TakeString(&str);
+}
+
+}  // namespace
+
+TEST(XWalkExtensionSharedMemoryTest, SegmentsAreRecycled) {
+  base::MessageLoop message_loop;
+  std::vector<int> released;
+
+  XWalkExtensionSharedMemoryPool pool;
+  XWalkExtensionSharedMemoryReader reader(
+      base::MessageLoopProxy::current(),
+      base::Bind(&StoreReleasedSegment, &released),
+      XWalkExtensionSharedMemoryReader::READ_IN_PLACE);
+
+  scoped_refptr<base::RefCountedMemory> msg =
+      CreateMessage(kSharedMemoryMessageThreshold, 'a');
+
+  int segment_id;
+  base::SharedMemoryHandle handle;
+  size_t segment_size;
+  ASSERT_TRUE(pool.Write(msg, base::GetCurrentProcessHandle(), &segment_id,
+                         &handle, &segment_size));
+  EXPECT_TRUE(base::SharedMemory::IsHandleValid(handle));
+
+  scoped_refptr<base::RefCountedMemory> data =
+      reader.Read(segment_id, handle, segment_size, msg->size());
+  ASSERT_TRUE(data);
+  ASSERT_EQ(msg->size(), data->size());
+  EXPECT_EQ(0, memcmp(msg->front(), data->front(), msg->size()));
+
+  // The segment is released only when the data is not referenced anymore.
+  base::RunLoop().RunUntilIdle();
+  EXPECT_TRUE(released.empty());
+  data = NULL;
+  base::RunLoop().RunUntilIdle();
+  ASSERT_EQ(1u, released.size());
+  EXPECT_EQ(segment_id, released[0]);
+  pool.Release(segment_id);
+
+  // Once released, the segment is reused without sharing its handle again.
+  msg = CreateMessage(kSharedMemoryMessageThreshold, 'b');
+  int second_segment_id;
+  ASSERT_TRUE(pool.Write(msg, base::GetCurrentProcessHandle(),
+                         &second_segment_id, &handle, &segment_size));
+  EXPECT_EQ(segment_id, second_segment_id);
+  EXPECT_FALSE(base::SharedMemory::IsHandleValid(handle));
+
+  data = reader.Read(second_segment_id, handle, segment_size, msg->size());
+  ASSERT_TRUE(data);
+  EXPECT_EQ(0, memcmp(msg->front(), data->front(), msg->size()));
+}
+
+TEST(XWalkExtensionSharedMemoryTest, CopiedSegmentsAreReleasedRightAway) {
+  base::MessageLoop message_loop;
+  std::vector<int> released;
+
+  XWalkExtensionSharedMemoryPool pool;
+  XWalkExtensionSharedMemoryReader reader(
+      base::MessageLoopProxy::current(),
+      base::Bind(&StoreReleasedSegment, &released),
+      XWalkExtensionSharedMemoryReader::READ_COPY);
+
+  scoped_refptr<base::RefCountedMemory> msg =
+      CreateMessage(kSharedMemoryMessageThreshold, 'a');
+
+  int segment_id;
+  base::SharedMemoryHandle handle;
+  size_t segment_size;
+  ASSERT_TRUE(pool.Write(msg, base::GetCurrentProcessHandle(), &segment_id,
+                         &handle, &segment_size));
+
+  scoped_refptr<base::RefCountedMemory> data =
+      reader.Read(segment_id, handle, segment_size, msg->size());
+  ASSERT_TRUE(data);
+  base::RunLoop().RunUntilIdle();
+  ASSERT_EQ(1u, released.size());
+  EXPECT_EQ(segment_id, released[0]);
+
+  // The sender reusing the segment doesn't change the data already read.
+  pool.Release(segment_id);
+  scoped_refptr<base::RefCountedMemory> second_msg =
+      CreateMessage(kSharedMemoryMessageThreshold, 'b');
+  int second_segment_id;
+  ASSERT_TRUE(pool.Write(second_msg, base::GetCurrentProcessHandle(),
+                         &second_segment_id, &handle, &segment_size));
+  EXPECT_EQ(segment_id, second_segment_id);
+  ASSERT_EQ(msg->size(), data->size());
+  EXPECT_EQ(0, memcmp(msg->front(), data->front(), msg->size()));
+}
+
+TEST(XWalkExtensionSharedMemoryTest, BusySegmentsAreNotReused) {
+  XWalkExtensionSharedMemoryPool pool;
+  scoped_refptr<base::RefCountedMemory> msg =
+      CreateMessage(kSharedMemoryMessageThreshold, 'a');
+
+  // Without releases, the pool runs out of segments and the caller is
+  // expected to fall back to regular IPC messages.
+  std::vector<int> segment_ids;
+  int segment_id;
+  base::SharedMemoryHandle handle;
+  size_t segment_size;
+  while (pool.Write(msg, base::GetCurrentProcessHandle(), &segment_id,
+                    &handle, &segment_size)) {
+    for (size_t i = 0; i < segment_ids.size(); ++i)
+      EXPECT_NE(segment_ids[i], segment_id);
+    segment_ids.push_back(segment_id);
+    ASSERT_LT(segment_ids.size(), 100u);
+  }
+  EXPECT_FALSE(segment_ids.empty());
+
+  pool.Release(segment_ids[0]);
+  ASSERT_TRUE(pool.Write(msg, base::GetCurrentProcessHandle(), &segment_id,
+                         &handle, &segment_size));
+  EXPECT_EQ(segment_ids[0], segment_id);
+}
+
+TEST(XWalkExtensionSharedMemoryTest, InvalidSegmentIsReleased) {
+  base::MessageLoop message_loop;
+  std::vector<int> released;
+
+  XWalkExtensionSharedMemoryReader reader(
+      base::MessageLoopProxy::current(),
+      base::Bind(&StoreReleasedSegment, &released),
+      XWalkExtensionSharedMemoryReader::READ_IN_PLACE);
+
+  EXPECT_FALSE(reader.Read(3, base::SharedMemory::NULLHandle(), 1024, 16));
+  base::RunLoop().RunUntilIdle();
+  ASSERT_EQ(1u, released.size());
+  EXPECT_EQ(3, released[0]);
+}
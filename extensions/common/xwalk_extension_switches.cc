@@ -13,4 +13,11 @@ namespace switches {
 const char kXWalkEnableExtensionProcess[] =
     "enable-extension-process";
 
+// Value of switches::kProcessType for the extension process.
+const char kXWalkExtensionProcess[] = "xwalk-extension-process";
+
+// Don't keep the compiled JS API code of extensions in the data path.
+const char kXWalkDisableExtensionCodeCache[] =
+    "disable-extension-code-cache";
+
 }  // namespace switches
@@ -9,6 +9,8 @@
 namespace switches {
 
 extern const char kXWalkEnableExtensionProcess[];
+extern const char kXWalkExtensionProcess[];
+extern const char kXWalkDisableExtensionCodeCache[];
 
 }  // namespace switches
 
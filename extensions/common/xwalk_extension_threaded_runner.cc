@@ -4,22 +4,198 @@
 
 #include "xwalk/extensions/common/xwalk_extension_threaded_runner.h"
 
+#include <deque>
+#include <map>
+#include <vector>
 #include "base/bind.h"
+#include "base/debug/trace_event.h"
+#include "base/lazy_instance.h"
 #include "base/single_thread_task_runner.h"
+#include "base/stl_util.h"
+#include "base/synchronization/condition_variable.h"
 #include "base/synchronization/lock.h"
+#include "base/threading/sequenced_worker_pool.h"
 #include "base/threading/thread.h"
 #include "base/threading/thread_restrictions.h"
+#include "base/threading/worker_pool.h"
+#include "base/time/time.h"
+#include "xwalk/extensions/common/xwalk_extension_metrics.h"
 
 namespace xwalk {
 namespace extensions {
 
+namespace {
+
+// Upper bound for the number of threads running instances of POOLED_THREAD
+// extensions, regardless of how many instances exist.
+const size_t kMaxPooledThreads = 4;
+
+struct ExtensionWorkerPool {
+  ExtensionWorkerPool()
+      : pool(new base::SequencedWorkerPool(kMaxPooledThreads,
+                                           "XWalk_ExtensionWorker")) {}
+  scoped_refptr<base::SequencedWorkerPool> pool;
+};
+
+// Created by InitializeWorkerPool(), or by the first POOLED_THREAD runner when
+// nobody did, and shut down by ShutdownWorkerPool().
+base::LazyInstance<ExtensionWorkerPool>::Leaky g_worker_pool =
+    LAZY_INSTANCE_INITIALIZER;
+
+// Counts the contexts that are still being destroyed in their threads after
+// their runners were deleted.
+class PendingDestructions {
+ public:
+  PendingDestructions() : condition_(&lock_), count_(0) {}
+
+  void Add() {
+    base::AutoLock lock(lock_);
+    count_++;
+  }
+
+  void Remove() {
+    base::AutoLock lock(lock_);
+    DCHECK_GT(count_, 0);
+    if (--count_ == 0)
+      condition_.Broadcast();
+  }
+
+  void Wait() {
+    base::AutoLock lock(lock_);
+    while (count_ > 0)
+      condition_.Wait();
+  }
+
+ private:
+  base::Lock lock_;
+  base::ConditionVariable condition_;
+  int count_;
+};
+
+base::LazyInstance<PendingDestructions>::Leaky g_pending_destructions =
+    LAZY_INSTANCE_INITIALIZER;
+
+// Accounts a message handled by an instance: it leaves the queue of the
+// extension thread, and the time spent in the handler is recorded.
+class ScopedHandlerMetrics {
+ public:
+  explicit ScopedHandlerMetrics(const std::string& extension_name)
+      : extension_name_(extension_name),
+        start_(base::TimeTicks::Now()) {
+    XWalkExtensionMetrics::GetInstance()->RecordTaskDone(extension_name_);
+  }
+
+  ~ScopedHandlerMetrics() {
+    XWalkExtensionMetrics::GetInstance()->RecordHandlerTime(
+        extension_name_, base::TimeTicks::Now() - start_);
+  }
+
+ private:
+  const std::string& extension_name_;
+  base::TimeTicks start_;
+
+  DISALLOW_COPY_AND_ASSIGN(ScopedHandlerMetrics);
+};
+
+// The pooled threads are shared by the instances of every POOLED_THREAD
+// extension, so their handlers must not block: waiting or doing IO in them
+// hits the thread restrictions DCHECKs.
+class ScopedDisallowBlocking {
+ public:
+  explicit ScopedDisallowBlocking(bool disallow) : disallow_(disallow) {
+    if (!disallow_)
+      return;
+    wait_allowed_ = base::ThreadRestrictions::SetWaitAllowed(false);
+    io_allowed_ = base::ThreadRestrictions::SetIOAllowed(false);
+  }
+
+  ~ScopedDisallowBlocking() {
+    if (!disallow_)
+      return;
+    base::ThreadRestrictions::SetIOAllowed(io_allowed_);
+    base::ThreadRestrictions::SetWaitAllowed(wait_allowed_);
+  }
+
+ private:
+  bool disallow_;
+  bool wait_allowed_;
+  bool io_allowed_;
+
+  DISALLOW_COPY_AND_ASSIGN(ScopedDisallowBlocking);
+};
+
+// Joins a dedicated extension thread. Runs in a worker thread so the thread
+// that deleted the runner doesn't block.
+void StopThread(scoped_ptr<base::Thread> thread) {
+  thread->Stop();
+}
+
+}  // namespace
+
+// Messages waiting to be delivered to the client, all going to the same
+// instance id. Coalesced messages keep their key, so a newer message can
+// replace them.
+class XWalkExtensionThreadedRunner::MessageBatch {
+ public:
+  explicit MessageBatch(int64_t instance_id)
+      : instance_id_(instance_id) {}
+
+  ~MessageBatch() {
+    STLDeleteElements(&msgs_);
+  }
+
+  int64_t instance_id() const { return instance_id_; }
+
+  void Add(const std::string& key, scoped_ptr<base::Value> msg) {
+    if (!key.empty()) {
+      std::pair<KeyMap::iterator, bool> result =
+          keys_.insert(std::make_pair(key, msgs_.size()));
+      // The replaced message leaves a hole, skipped by TakeMessages().
+      if (!result.second) {
+        delete msgs_[result.first->second];
+        msgs_[result.first->second] = NULL;
+        result.first->second = msgs_.size();
+      }
+    }
+    msgs_.push_back(msg.release());
+  }
+
+  scoped_ptr<base::ListValue> TakeMessages() {
+    scoped_ptr<base::ListValue> list(new base::ListValue);
+    for (size_t i = 0; i < msgs_.size(); ++i) {
+      if (msgs_[i])
+        list->Append(msgs_[i]);
+    }
+    msgs_.clear();
+    keys_.clear();
+    return list.Pass();
+  }
+
+ private:
+  int64_t instance_id_;
+  std::vector<base::Value*> msgs_;
+
+  // Position in |msgs_| of the latest message posted with each key.
+  typedef std::map<std::string, size_t> KeyMap;
+  KeyMap keys_;
+
+  DISALLOW_COPY_AND_ASSIGN(MessageBatch);
+};
+
 // This object is responsible for calling the client on behalf of the extension
 // thread. When the threaded runner is destroyed, it detaches this object so
 // pending tasks posted to client_task_runner are ignored gracefully.
 class XWalkExtensionThreadedRunner::PostHelper {
  public:
   explicit PostHelper(XWalkExtensionThreadedRunner* runner)
-      : runner_(runner) {}
+      : runner_(runner),
+        batch_open_(false) {}
+
+  ~PostHelper() {
+    // Batches whose tasks were dropped by the client task runner, e.g. at
+    // shutdown.
+    STLDeleteElements(&batches_);
+  }
 
   // Threaded runner calls this when is destroyed, so any pending tasks will not
   // call the client anymore. To be called in the thread controlling the
@@ -29,23 +205,98 @@ class XWalkExtensionThreadedRunner::PostHelper {
     runner_ = NULL;
   }
 
-  void PostMessageToClient(scoped_ptr<base::Value> msg) {
+  // Adds |msg| to the batch that was posted to |client_task_runner| but not
+  // delivered yet. If there's no such batch, or it goes to another instance
+  // id, opens a new one and posts the PostMessagesToClient() task delivering
+  // it. Further messages are added to it until CloseBatchAndPost() is called.
+  //
+  // Messages can be posted from several threads at once, so it all happens
+  // under the lock: otherwise a thread could close or take over the batch
+  // another one just opened, before its task is posted.
+  void AppendOrOpenBatch(base::SingleThreadTaskRunner* client_task_runner,
+                         int64_t instance_id, const std::string& key,
+                         scoped_ptr<base::Value> msg) {
+    base::AutoLock lock(lock_);
+    if (batch_open_ && batches_.back()->instance_id() == instance_id) {
+      batches_.back()->Add(key, msg.Pass());
+      return;
+    }
+
+    scoped_ptr<MessageBatch> batch(new MessageBatch(instance_id));
+    batch->Add(key, msg.Pass());
+    bool posted = client_task_runner->PostTask(
+        FROM_HERE,
+        base::Bind(&PostHelper::PostMessagesToClient, base::Unretained(this)));
+    if (!posted)
+      return;
+    batches_.push_back(batch.release());
+    batch_open_ = true;
+  }
+
+  // Posts |task|, which doesn't go in a batch, to |client_task_runner|.
+  // Messages posted after it go in a new batch, so the order is kept. Done
+  // under the lock for the same reason as AppendOrOpenBatch().
+  void CloseBatchAndPost(base::SingleThreadTaskRunner* client_task_runner,
+                         const base::Closure& task) {
     base::AutoLock lock(lock_);
+    batch_open_ = false;
+    client_task_runner->PostTask(FROM_HERE, task);
+  }
+
+  // Delivers the oldest batch. One task is posted for each batch, and tasks
+  // run in order, so this is the batch the task was posted for.
+  void PostMessagesToClient() {
+    base::AutoLock lock(lock_);
+    DCHECK(!batches_.empty());
+    scoped_ptr<MessageBatch> batch(batches_.front());
+    batches_.pop_front();
+    if (batches_.empty())
+      batch_open_ = false;
     if (!runner_)
       return;
     CHECK(runner_->client_task_runner_ == base::MessageLoopProxy::current());
-    runner_->PostMessageToClient(msg.Pass());
+    runner_->PostMessagesToClient(batch->instance_id(),
+                                  batch->TakeMessages());
   }
 
-  void PostReplyMessageToClient(scoped_ptr<IPC::Message> ipc_reply,
+  void PostBinaryMessageToClient(
+      const scoped_refptr<base::RefCountedMemory>& data) {
+    base::AutoLock lock(lock_);
+    if (!runner_)
+      return;
+    CHECK(runner_->client_task_runner_ == base::MessageLoopProxy::current());
+    runner_->PostBinaryMessageToClient(data);
+  }
+
+  void PostReplyMessageToClient(base::TimeTicks sent_time,
+                                scoped_ptr<IPC::Message> ipc_reply,
                                 scoped_ptr<base::Value> msg) {
     base::AutoLock lock(lock_);
     if (!runner_)
       return;
     CHECK(runner_->client_task_runner_ == base::MessageLoopProxy::current());
+    XWalkExtensionMetrics::GetInstance()->RecordSyncReply(
+        runner_->extension_name(), base::TimeTicks::Now() - sent_time);
     runner_->PostReplyMessageToClient(ipc_reply.Pass(), msg.Pass());
   }
 
+  void PostRequestReplyToClient(int request_id,
+                                scoped_ptr<base::Value> reply) {
+    base::AutoLock lock(lock_);
+    if (!runner_)
+      return;
+    CHECK(runner_->client_task_runner_ == base::MessageLoopProxy::current());
+    runner_->PostRequestReplyToClient(request_id, reply.Pass());
+  }
+
+  void PostMessageQueueReadyToClient() {
+    base::AutoLock lock(lock_);
+    if (!runner_)
+      return;
+    CHECK(runner_->client_task_runner_ == base::MessageLoopProxy::current());
+    runner_->OnMessageQueueReady();
+  }
+
   // The helper will be destroyed when this function leaves and the scoped_ptr
   // goes out of scope. We post this function passing the internal helper object
   // in the client task runner so that is run after all pending post messages
@@ -55,24 +306,410 @@ class XWalkExtensionThreadedRunner::PostHelper {
  private:
   base::Lock lock_;
   XWalkExtensionThreadedRunner* runner_;
+
+  // Batches posted to the client task runner and not delivered yet, oldest
+  // first. The last one still takes messages if |batch_open_| is set.
+  std::deque<MessageBatch*> batches_;
+  bool batch_open_;
+};
+
+// Owns the extension context and everything used in the extension thread.
+// It is not attached to the lifetime of the runner: the runner posts its
+// destruction to the extension thread, so pending tasks in the thread can
+// still use it safely after the runner is gone.
+class XWalkExtensionThreadedRunner::ContextHolder {
+ public:
+  ContextHolder(XWalkExtension* extension, int64_t instance_id,
+                base::SequencedTaskRunner* task_runner,
+                base::SingleThreadTaskRunner* client_task_runner,
+                PostHelper* helper, const base::Closure& context_destroyed)
+      : extension_(extension),
+        extension_name_(extension->name()),
+        pooled_(extension->runner_mode() == XWalkExtension::POOLED_THREAD),
+        instance_id_(instance_id),
+        task_runner_(task_runner),
+        client_task_runner_(client_task_runner),
+        helper_(helper),
+        queue_limit_(extension->message_queue_limit()),
+        queue_full_policy_(extension->queue_full_policy()),
+        queue_full_(false),
+        next_sync_reply_id_(1),
+        context_destroyed_(context_destroyed) {}
+
+  // Usually right after DestroyContext(), unless the extension thread was
+  // gone before running it.
+  ~ContextHolder() {
+    context_.reset();
+    XWalkExtensionMetrics::GetInstance()->RecordTasksDiscarded(
+        extension_name_, queue_.size());
+    if (!context_destroyed_.is_null())
+      context_destroyed_.Run();
+    g_pending_destructions.Get().Remove();
+  }
+
+  // Called in the client thread to queue a message for the instance, the
+  // message is handled by a task running HandleNextMessage(). Returns false
+  // if an older message was dropped to make room, in which case the task
+  // posted for that one will handle |task| instead. |became_full| is set
+  // when the queue reaches its limit under the policies relying on the
+  // sender to slow down.
+  bool EnqueueMessage(const base::Closure& task, bool droppable,
+                      bool* became_full) {
+    base::AutoLock lock(queue_lock_);
+    bool replaced = false;
+    if (queue_limit_ && queue_.size() >= queue_limit_ &&
+        queue_full_policy_ == XWalkExtension::DROP_OLDEST) {
+      std::deque<QueuedMessage>::iterator it = queue_.begin();
+      for (; it != queue_.end(); ++it) {
+        if (!it->droppable)
+          continue;
+        queue_.erase(it);
+        XWalkExtensionMetrics::GetInstance()->RecordMessageDropped(
+            extension_name_);
+        replaced = true;
+        break;
+      }
+    }
+
+    queue_.push_back(QueuedMessage(task, droppable));
+
+    if (queue_limit_ && queue_.size() >= queue_limit_ && !queue_full_ &&
+        queue_full_policy_ != XWalkExtension::DROP_OLDEST) {
+      queue_full_ = true;
+      *became_full = true;
+    }
+    return !replaced;
+  }
+
+  bool queue_full() {
+    base::AutoLock lock(queue_lock_);
+    return queue_full_;
+  }
+
+  void HandleNextMessage() {
+    CHECK(CalledOnExtensionThread());
+
+    base::Closure task;
+    bool became_ready = false;
+    {
+      base::AutoLock lock(queue_lock_);
+      if (queue_.empty())
+        return;
+      task = queue_.front().task;
+      queue_.pop_front();
+
+      // Half the limit, so a sender waiting for room doesn't wake up for
+      // every message handled.
+      if (queue_full_ && queue_.size() <= queue_limit_ / 2) {
+        queue_full_ = false;
+        became_ready = true;
+      }
+    }
+
+    if (became_ready) {
+      client_task_runner_->PostTask(
+          FROM_HERE,
+          base::Bind(&PostHelper::PostMessageQueueReadyToClient,
+                     base::Unretained(helper_.get())));
+    }
+
+    task.Run();
+  }
+
+  void CreateContext() {
+    CHECK(CalledOnExtensionThread());
+
+    XWalkExtensionInstance* instance = extension_->CreateInstance(base::Bind(
+        &ContextHolder::PostMessageToClientTaskRunner,
+        base::Unretained(this)));
+    // Without a context, messages are dropped until the runner is destroyed
+    // by its owner.
+    if (!instance) {
+      VLOG(0) << "Could not create instance for extension '"
+              << extension_->name() << "'.";
+      return;
+    }
+
+    instance->SetPostBinaryMessageCallback(base::Bind(
+        &ContextHolder::PostBinaryMessageToClientTaskRunner,
+        base::Unretained(this)));
+    instance->SetPostCoalescedMessageCallback(base::Bind(
+        &ContextHolder::PostCoalescedMessageToClientTaskRunner,
+        base::Unretained(this)));
+    instance->SetPostReplyCallback(base::Bind(
+        &ContextHolder::PostRequestReplyToClientTaskRunner,
+        base::Unretained(this)));
+    instance->SetPostSyncReplyCallback(base::Bind(
+        &ContextHolder::PostSyncReplyToClientTaskRunner,
+        base::Unretained(this)));
+    if (extension_->instance_mode() == XWalkExtension::INSTANCE_PER_PROCESS) {
+      instance->SetPostContextMessageCallback(base::Bind(
+          &ContextHolder::PostContextMessageToClientTaskRunner,
+          base::Unretained(this)));
+    }
+    context_.reset(instance);
+  }
+
+  // The holder itself is deleted after this, see ~XWalkExtensionThreadedRunner.
+  void DestroyContext() {
+    CHECK(CalledOnExtensionThread());
+    context_.reset();
+
+    // The renderer may be blocked on sync messages the instance never
+    // answered.
+    std::vector<int> unanswered;
+    {
+      base::AutoLock lock(sync_replies_lock_);
+      SyncReplyMap::const_iterator it = pending_sync_replies_.begin();
+      for (; it != pending_sync_replies_.end(); ++it)
+        unanswered.push_back(it->first);
+    }
+    for (size_t i = 0; i < unanswered.size(); ++i)
+      PostSyncReplyToClientTaskRunner(unanswered[i], scoped_ptr<base::Value>());
+
+    // Trigger destruction of the helper object. We do at this point so that
+    // it will be after any pending task posted by the extension thread.
+    client_task_runner_->PostTask(
+        FROM_HERE,
+        base::Bind(&PostHelper::Destroy, base::Passed(&helper_)));
+  }
+
+  void CallHandleMessage(scoped_ptr<base::Value> msg) {
+    CHECK(CalledOnExtensionThread());
+    TRACE_EVENT1("xwalk", "XWalkExtensionInstance::HandleMessage",
+                 "extension", extension_name_);
+    ScopedHandlerMetrics metrics(extension_name_);
+    ScopedDisallowBlocking disallow_blocking(pooled_);
+    if (!context_)
+      return;
+    context_->HandleMessage(msg.Pass());
+  }
+
+  void CallHandleContextMessage(int64_t context_id,
+                                scoped_ptr<base::Value> msg) {
+    CHECK(CalledOnExtensionThread());
+    TRACE_EVENT1("xwalk", "XWalkExtensionInstance::HandleContextMessage",
+                 "extension", extension_name_);
+    ScopedHandlerMetrics metrics(extension_name_);
+    ScopedDisallowBlocking disallow_blocking(pooled_);
+    if (!context_)
+      return;
+    context_->HandleContextMessage(context_id, msg.Pass());
+  }
+
+  void CallDidCreateContext(int64_t context_id) {
+    CHECK(CalledOnExtensionThread());
+    if (context_)
+      context_->DidCreateContext(context_id);
+  }
+
+  void CallWillDestroyContext(int64_t context_id) {
+    CHECK(CalledOnExtensionThread());
+    if (context_)
+      context_->WillDestroyContext(context_id);
+  }
+
+  void CallHandleBinaryMessage(
+      const scoped_refptr<base::RefCountedMemory>& data) {
+    CHECK(CalledOnExtensionThread());
+    TRACE_EVENT1("xwalk", "XWalkExtensionInstance::HandleBinaryMessage",
+                 "extension", extension_name_);
+    ScopedHandlerMetrics metrics(extension_name_);
+    ScopedDisallowBlocking disallow_blocking(pooled_);
+    if (!context_)
+      return;
+    context_->HandleBinaryMessage(data);
+  }
+
+  void CallHandleSyncMessage(base::TimeTicks sent_time,
+                             scoped_ptr<IPC::Message> ipc_reply,
+                             scoped_ptr<base::Value> msg) {
+    CHECK(CalledOnExtensionThread());
+
+    int reply_id;
+    {
+      base::AutoLock lock(sync_replies_lock_);
+      reply_id = next_sync_reply_id_++;
+      PendingSyncReply& pending = pending_sync_replies_[reply_id];
+      pending.sent_time = sent_time;
+      pending.ipc_reply = ipc_reply.release();
+    }
+
+    {
+      TRACE_EVENT1("xwalk", "XWalkExtensionInstance::HandleSyncMessage",
+                   "extension", extension_name_);
+      ScopedHandlerMetrics metrics(extension_name_);
+    ScopedDisallowBlocking disallow_blocking(pooled_);
+      if (context_) {
+        context_->HandleDeferrableSyncMessage(reply_id, msg.Pass());
+        return;
+      }
+    }
+
+    // The renderer is blocked waiting for the reply, so we reply even without
+    // a context.
+    PostSyncReplyToClientTaskRunner(reply_id, scoped_ptr<base::Value>());
+  }
+
+  void CallHandleRequest(int request_id, scoped_ptr<base::Value> msg) {
+    CHECK(CalledOnExtensionThread());
+    TRACE_EVENT1("xwalk", "XWalkExtensionInstance::HandleRequest",
+                 "extension", extension_name_);
+    ScopedHandlerMetrics metrics(extension_name_);
+    ScopedDisallowBlocking disallow_blocking(pooled_);
+
+    // Without a context nobody would reply, leaving the promise pending
+    // forever.
+    if (!context_) {
+      PostRequestReplyToClientTaskRunner(
+          request_id, scoped_ptr<base::Value>(base::Value::CreateNullValue()));
+      return;
+    }
+    context_->HandleRequest(request_id, msg.Pass());
+  }
+
+ private:
+  bool CalledOnExtensionThread() const {
+    return task_runner_->RunsTasksOnCurrentThread();
+  }
+
+  void PostMessageToClientTaskRunner(scoped_ptr<base::Value> msg) {
+    PostBatchedMessageToClientTaskRunner(instance_id_, std::string(),
+                                         msg.Pass());
+  }
+
+  void PostCoalescedMessageToClientTaskRunner(const std::string& key,
+                                              scoped_ptr<base::Value> msg) {
+    PostBatchedMessageToClientTaskRunner(instance_id_, key, msg.Pass());
+  }
+
+  void PostContextMessageToClientTaskRunner(int64_t context_id,
+                                            scoped_ptr<base::Value> msg) {
+    PostBatchedMessageToClientTaskRunner(context_id, std::string(),
+                                         msg.Pass());
+  }
+
+  void PostBatchedMessageToClientTaskRunner(int64_t instance_id,
+                                            const std::string& key,
+                                            scoped_ptr<base::Value> msg) {
+    helper_->AppendOrOpenBatch(client_task_runner_.get(), instance_id, key,
+                               msg.Pass());
+  }
+
+  void PostBinaryMessageToClientTaskRunner(
+      const scoped_refptr<base::RefCountedMemory>& data) {
+    helper_->CloseBatchAndPost(client_task_runner_.get(),
+        base::Bind(&PostHelper::PostBinaryMessageToClient,
+                   base::Unretained(helper_.get()),
+                   data));
+  }
+
+  // Unlike the other posts, this may be called from any thread.
+  void PostRequestReplyToClientTaskRunner(int request_id,
+                                          scoped_ptr<base::Value> reply) {
+    helper_->CloseBatchAndPost(client_task_runner_.get(),
+        base::Bind(&PostHelper::PostRequestReplyToClient,
+                   base::Unretained(helper_.get()),
+                   request_id,
+                   base::Passed(&reply)));
+  }
+
+  // Can be called from any thread, until the context is destroyed.
+  void PostSyncReplyToClientTaskRunner(int reply_id,
+                                       scoped_ptr<base::Value> reply) {
+    PendingSyncReply pending;
+    {
+      base::AutoLock lock(sync_replies_lock_);
+      SyncReplyMap::iterator it = pending_sync_replies_.find(reply_id);
+      if (it == pending_sync_replies_.end()) {
+        LOG(WARNING) << "Ignoring reply to unknown sync message " << reply_id
+                     << " of extension " << extension_name_;
+        return;
+      }
+      pending = it->second;
+      pending_sync_replies_.erase(it);
+    }
+
+    scoped_ptr<IPC::Message> ipc_reply(pending.ipc_reply);
+    if (!reply)
+      reply.reset(base::Value::CreateNullValue());
+
+    helper_->CloseBatchAndPost(client_task_runner_.get(),
+        base::Bind(&PostHelper::PostReplyMessageToClient,
+                   base::Unretained(helper_.get()),
+                   pending.sent_time,
+                   base::Passed(&ipc_reply),
+                   base::Passed(&reply)));
+  }
+
+  XWalkExtension* extension_;
+  std::string extension_name_;
+  bool pooled_;
+  int64_t instance_id_;
+  scoped_ptr<XWalkExtensionInstance> context_;
+  scoped_refptr<base::SequencedTaskRunner> task_runner_;
+  scoped_refptr<base::SingleThreadTaskRunner> client_task_runner_;
+  scoped_ptr<PostHelper> helper_;
+
+  struct QueuedMessage {
+    QueuedMessage(const base::Closure& task, bool droppable)
+        : task(task), droppable(droppable) {}
+    base::Closure task;
+    bool droppable;
+  };
+
+  // Messages waiting to be handled by the instance, see
+  // XWalkExtension::QueueFullPolicy.
+  base::Lock queue_lock_;
+  std::deque<QueuedMessage> queue_;
+  size_t queue_limit_;
+  XWalkExtension::QueueFullPolicy queue_full_policy_;
+  bool queue_full_;
+
+  struct PendingSyncReply {
+    PendingSyncReply() : ipc_reply(NULL) {}
+    base::TimeTicks sent_time;
+    IPC::Message* ipc_reply;
+  };
+
+  // Sync messages waiting for the instance to answer. Answers can come from
+  // any thread.
+  base::Lock sync_replies_lock_;
+  typedef std::map<int, PendingSyncReply> SyncReplyMap;
+  SyncReplyMap pending_sync_replies_;
+  int next_sync_reply_id_;
+
+  base::Closure context_destroyed_;
+
+  DISALLOW_COPY_AND_ASSIGN(ContextHolder);
 };
 
 XWalkExtensionThreadedRunner::XWalkExtensionThreadedRunner(
     XWalkExtension* extension, Client* client,
-    base::SingleThreadTaskRunner* client_task_runner, int64_t instance_id)
+    base::SingleThreadTaskRunner* client_task_runner, int64_t instance_id,
+    const base::Closure& context_destroyed)
     : XWalkExtensionRunner(extension->name(), client, instance_id),
-      extension_(extension),
-      sync_message_event_(false, false),
       client_task_runner_(client_task_runner),
-      helper_(new PostHelper(this)) {
+      helper_(new PostHelper(this)),
+      message_queue_full_(false),
+      block_sender_(extension->queue_full_policy() ==
+                    XWalkExtension::BLOCK_SENDER) {
   CHECK(client_task_runner_);
-  std::string thread_name = "XWalk_ExtensionThread_" + extension_->name();
-  thread_.reset(new base::Thread(thread_name.c_str()));
-  thread_->Start();
+  if (extension->runner_mode() == XWalkExtension::DEDICATED_THREAD) {
+    std::string thread_name = "XWalk_ExtensionThread_" + extension->name();
+    thread_.reset(new base::Thread(thread_name.c_str()));
+    thread_->Start();
+    task_runner_ = thread_->message_loop_proxy();
+  } else {
+    base::SequencedWorkerPool* pool = g_worker_pool.Get().pool.get();
+    task_runner_ = pool->GetSequencedTaskRunner(pool->GetSequenceToken());
+  }
+
+  holder_ = new ContextHolder(extension, instance_id, task_runner_.get(),
+                              client_task_runner_, helper_, context_destroyed);
   PostTaskToExtensionThread(
       FROM_HERE,
-      base::Bind(&XWalkExtensionThreadedRunner::CreateContext,
-                 base::Unretained(this)));
+      base::Bind(&ContextHolder::CreateContext, base::Unretained(holder_)));
 }
 
 XWalkExtensionThreadedRunner::~XWalkExtensionThreadedRunner() {
@@ -80,111 +717,146 @@ XWalkExtensionThreadedRunner::~XWalkExtensionThreadedRunner() {
   // since the client doesn't care about us anymore.
   helper_->Invalidate();
 
-  // All Context related code should run in the thread.
+  // All Context related code should run in the thread. The holder is deleted
+  // after destroying the context, once the task is done. We don't wait for
+  // it, so deleting many runners doesn't block the client thread.
+  // If the task can't be posted, the holder is deleted right away.
+  g_pending_destructions.Get().Add();
   PostTaskToExtensionThread(
       FROM_HERE,
-      base::Bind(&XWalkExtensionThreadedRunner::DestroyContext,
-                 base::Unretained(this)));
-
-  // Waiting on the browser thread is frowned upon since it might cause jank
-  // (there's no way to know how much time the extension thread might be blocked
-  // for).  However, it's not safe to destroy the extension context from a
-  // thread other than the extension thread.  We temporarily turn off this
-  // restriction, wait for the extension thread to be properly destroyed, and
-  // enable the restriction again.
-  //
-  // FIXME(leandro): Find a way to properly destroy an extension context without
-  // blocking the browser thread.
-  base::ThreadRestrictions::ScopedAllowIO allow_io;
-  thread_->Stop();
+      base::Bind(&ContextHolder::DestroyContext, base::Owned(holder_)));
+
+  // The dedicated thread is joined by a worker thread, after it runs the
+  // pending tasks including the context destruction.
+  if (thread_) {
+    base::WorkerPool::PostTask(
+        FROM_HERE, base::Bind(&StopThread, base::Passed(&thread_)),
+        true /* task_is_slow */);
+  }
+}
+
+// static
+void XWalkExtensionThreadedRunner::WaitForPendingDestructions() {
+  g_pending_destructions.Get().Wait();
+}
+
+// static
+void XWalkExtensionThreadedRunner::InitializeWorkerPool() {
+  g_worker_pool.Get();
+}
+
+// static
+void XWalkExtensionThreadedRunner::ShutdownWorkerPool() {
+  g_worker_pool.Get().pool->Shutdown();
 }
 
 void XWalkExtensionThreadedRunner::HandleMessageFromClient(
     scoped_ptr<base::Value> msg) {
-  PostTaskToExtensionThread(
+  PostMessageTaskToExtensionThread(
       FROM_HERE,
-      base::Bind(&XWalkExtensionThreadedRunner::CallHandleMessage,
-                 base::Unretained(this),
-                 base::Passed(&msg)));
+      base::Bind(&ContextHolder::CallHandleMessage,
+                 base::Unretained(holder_),
+                 base::Passed(&msg)),
+      true /* droppable */);
 }
 
-void XWalkExtensionThreadedRunner::HandleSyncMessageFromClient(
-    scoped_ptr<IPC::Message> ipc_reply, scoped_ptr<base::Value> msg) {
+void XWalkExtensionThreadedRunner::AddContext(int64_t context_id) {
   PostTaskToExtensionThread(
       FROM_HERE,
-      base::Bind(&XWalkExtensionThreadedRunner::CallHandleSyncMessage,
-                 base::Unretained(this),
-                 base::Passed(&ipc_reply),
-                 base::Passed(&msg)));
+      base::Bind(&ContextHolder::CallDidCreateContext,
+                 base::Unretained(holder_),
+                 context_id));
 }
 
-bool XWalkExtensionThreadedRunner::CalledOnExtensionThread() const {
-  return base::MessageLoop::current() == thread_->message_loop();
+void XWalkExtensionThreadedRunner::RemoveContext(int64_t context_id) {
+  PostTaskToExtensionThread(
+      FROM_HERE,
+      base::Bind(&ContextHolder::CallWillDestroyContext,
+                 base::Unretained(holder_),
+                 context_id));
 }
 
-bool XWalkExtensionThreadedRunner::PostTaskToExtensionThread(
-    const tracked_objects::Location& from_here,
-    const base::Closure& task) {
-  // FIXME(cmarcelo): Can we cache this message_loop_proxy?
-  return thread_->message_loop_proxy()->PostTask(from_here, task);
+void XWalkExtensionThreadedRunner::PostContextMessageToNative(
+    int64_t context_id, scoped_ptr<base::Value> msg) {
+  PostMessageTaskToExtensionThread(
+      FROM_HERE,
+      base::Bind(&ContextHolder::CallHandleContextMessage,
+                 base::Unretained(holder_),
+                 context_id,
+                 base::Passed(&msg)),
+      true /* droppable */);
 }
 
-void XWalkExtensionThreadedRunner::CreateContext() {
-  CHECK(CalledOnExtensionThread());
-
-  XWalkExtensionInstance* instance = extension_->CreateInstance(base::Bind(
-      &XWalkExtensionThreadedRunner::PostMessageToClientTaskRunner,
-      base::Unretained(this)));
-  if (!instance) {
-    VLOG(0) << "Could not create instance for extension '"
-            << extension_->name() << "'. Destroying extension thread.";
-    delete this;
-    return;
-  }
-
-  context_.reset(instance);
+void XWalkExtensionThreadedRunner::HandleBinaryMessageFromClient(
+    const scoped_refptr<base::RefCountedMemory>& data) {
+  PostMessageTaskToExtensionThread(
+      FROM_HERE,
+      base::Bind(&ContextHolder::CallHandleBinaryMessage,
+                 base::Unretained(holder_),
+                 data),
+      true /* droppable */);
 }
 
-void XWalkExtensionThreadedRunner::DestroyContext() {
-  CHECK(CalledOnExtensionThread());
-  context_.reset();
+void XWalkExtensionThreadedRunner::HandleSyncMessageFromClient(
+    scoped_ptr<IPC::Message> ipc_reply, scoped_ptr<base::Value> msg) {
+  // The renderer is blocked until the reply, dropping it would hang it.
+  PostMessageTaskToExtensionThread(
+      FROM_HERE,
+      base::Bind(&ContextHolder::CallHandleSyncMessage,
+                 base::Unretained(holder_),
+                 base::TimeTicks::Now(),
+                 base::Passed(&ipc_reply),
+                 base::Passed(&msg)),
+      false /* droppable */);
+}
 
-  // Trigger destruction of the helper object. We do at this point so that it
-  // will be after any pending task posted by the extension thread.
-  client_task_runner_->PostTask(
+void XWalkExtensionThreadedRunner::HandleRequestFromClient(
+    int request_id, scoped_ptr<base::Value> msg) {
+  // Requests expect a reply, and aren't dropped either.
+  PostMessageTaskToExtensionThread(
       FROM_HERE,
-      base::Bind(&PostHelper::Destroy, base::Passed(&helper_)));
+      base::Bind(&ContextHolder::CallHandleRequest,
+                 base::Unretained(holder_),
+                 request_id,
+                 base::Passed(&msg)),
+      false /* droppable */);
 }
 
-void XWalkExtensionThreadedRunner::CallHandleMessage(
-    scoped_ptr<base::Value> msg) {
-  CHECK(CalledOnExtensionThread());
-  CHECK(context_);
-  context_->HandleMessage(msg.Pass());
+bool XWalkExtensionThreadedRunner::PostTaskToExtensionThread(
+    const tracked_objects::Location& from_here,
+    const base::Closure& task) {
+  return task_runner_->PostTask(from_here, task);
 }
 
-void XWalkExtensionThreadedRunner::CallHandleSyncMessage(
-    scoped_ptr<IPC::Message> ipc_reply, scoped_ptr<base::Value> msg) {
-  CHECK(CalledOnExtensionThread());
+bool XWalkExtensionThreadedRunner::PostMessageTaskToExtensionThread(
+    const tracked_objects::Location& from_here,
+    const base::Closure& task, bool droppable) {
+  XWalkExtensionMetrics* metrics = XWalkExtensionMetrics::GetInstance();
+  int depth = metrics->RecordTaskQueued(extension_name());
+  TRACE_COUNTER_ID1("xwalk", "XWalkExtensionQueueDepth", holder_, depth);
 
-  scoped_ptr<base::Value> result_msg(
-      context_->HandleSyncMessage(msg.Pass()));
+  bool became_full = false;
+  bool needs_task = holder_->EnqueueMessage(task, droppable, &became_full);
+  if (became_full && !message_queue_full_) {
+    message_queue_full_ = true;
+    PostMessageQueueFullToClient(true, block_sender_);
+  }
 
-  client_task_runner_->PostTask(
-      FROM_HERE,
-      base::Bind(&PostHelper::PostReplyMessageToClient,
-                 base::Unretained(helper_.get()),
-                 base::Passed(&ipc_reply),
-                 base::Passed(&result_msg)));
+  if (!needs_task)
+    return true;
+  // Otherwise the message stays in the queue until the holder is deleted,
+  // which accounts for it.
+  return PostTaskToExtensionThread(
+      from_here, base::Bind(&ContextHolder::HandleNextMessage,
+                            base::Unretained(holder_)));
 }
 
-void XWalkExtensionThreadedRunner::PostMessageToClientTaskRunner(
-    scoped_ptr<base::Value> msg) {
-  client_task_runner_->PostTask(
-      FROM_HERE,
-      base::Bind(&PostHelper::PostMessageToClient,
-                 base::Unretained(helper_.get()),
-                 base::Passed(&msg)));
+void XWalkExtensionThreadedRunner::OnMessageQueueReady() {
+  // The queue may be full again by the time this runs.
+  if (message_queue_full_ && !holder_->queue_full()) {
+    message_queue_full_ = false;
+    PostMessageQueueFullToClient(false, block_sender_);
+  }
 }
 
 }  // namespace extensions
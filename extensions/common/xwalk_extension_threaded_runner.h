@@ -6,14 +6,15 @@
 #define XWALK_EXTENSIONS_COMMON_XWALK_EXTENSION_THREADED_RUNNER_H_
 
 #include <string>
-#include "base/callback_forward.h"
+#include "base/callback.h"
 #include "base/compiler_specific.h"
+#include "base/memory/ref_counted.h"
 #include "base/memory/scoped_ptr.h"
-#include "base/synchronization/waitable_event.h"
 #include "xwalk/extensions/common/xwalk_extension.h"
 #include "xwalk/extensions/common/xwalk_extension_runner.h"
 
 namespace base {
+class SequencedTaskRunner;
 class SingleThreadTaskRunner;
 class Thread;
 }
@@ -26,46 +27,99 @@ namespace xwalk {
 namespace extensions {
 
 // Creates and runs an extension context in a thread. All operations from the
-// extension context will be called in the separated thread.
+// extension context will be called in the separated thread. Depending on the
+// extension's RunnerMode, the thread is owned by the runner or is a sequence
+// of a worker pool shared by all the pooled runners, which avoids having one
+// idle thread per instance.
 //
 // The given task runner correspond to the thread that will handle the calls
 // to Client. After XWalkExtensionThreadedRunner is deleted, the client will
-// not be called anymore.
+// not be called anymore. The extension must outlive the context, which is
+// destroyed after the runner: |context_destroyed| is run once it is gone,
+// usually in the extension thread.
+//
+// Messages posted by the context while the previous ones are still waiting to
+// be handled by the client are batched, so bursts of messages cost a single
+// task in the client thread.
 class XWalkExtensionThreadedRunner : public XWalkExtensionRunner {
  public:
   XWalkExtensionThreadedRunner(
       XWalkExtension* extension, Client* client,
       base::SingleThreadTaskRunner* client_task_runner,
-      int64_t instance_id = -1);
+      int64_t instance_id = -1,
+      const base::Closure& context_destroyed = base::Closure());
+
+  // Doesn't block: the context is destroyed later in its thread, and a
+  // dedicated thread is joined by a worker thread.
   virtual ~XWalkExtensionThreadedRunner();
 
+  // Blocks until the contexts of all deleted runners are destroyed, mostly
+  // useful for tests. Owners of extensions should rather wait for the
+  // |context_destroyed| callback of the runners using them.
+  static void WaitForPendingDestructions();
+
+  // The threads of POOLED_THREAD instances belong to a pool shared by all the
+  // runners of the process. The thread owning the extensions creates it on
+  // startup and shuts it down on exit, which runs the tasks already posted to
+  // the pool and joins its threads. Runners can't reach their pooled contexts
+  // after that.
+  static void InitializeWorkerPool();
+  static void ShutdownWorkerPool();
+
+  // For runners of INSTANCE_PER_PROCESS extensions, whose context is shared
+  // by the JavaScript contexts of a render process. Each JavaScript context
+  // is identified by the instance id it would have with a runner of its own,
+  // and messages the shared context posts to one of them go to the client
+  // with that instance id.
+  void AddContext(int64_t context_id);
+  void RemoveContext(int64_t context_id);
+  void PostContextMessageToNative(int64_t context_id,
+                                  scoped_ptr<base::Value> msg);
+
  private:
   // XWalkExtensionRunner implementation.
   virtual void HandleMessageFromClient(scoped_ptr<base::Value> msg) OVERRIDE;
+  virtual void HandleBinaryMessageFromClient(
+      const scoped_refptr<base::RefCountedMemory>& data) OVERRIDE;
   virtual void HandleSyncMessageFromClient(
       scoped_ptr<IPC::Message> ipc_reply, scoped_ptr<base::Value> msg) OVERRIDE;
+  virtual void HandleRequestFromClient(int request_id,
+                                       scoped_ptr<base::Value> msg) OVERRIDE;
 
-  bool CalledOnExtensionThread() const;
   bool PostTaskToExtensionThread(const tracked_objects::Location& from_here,
                                  const base::Closure& task);
-  void CreateContext();
-  void DestroyContext();
 
-  void CallHandleMessage(scoped_ptr<base::Value> msg);
-  void CallHandleSyncMessage(scoped_ptr<IPC::Message> ipc_reply,
-                             scoped_ptr<base::Value> msg);
+  // Same, for the tasks delivering a message to the instance. They go
+  // through a queue bounded as configured by the extension, see
+  // XWalkExtension::QueueFullPolicy, and are accounted in
+  // XWalkExtensionMetrics. Only |droppable| messages can be dropped to make
+  // room in the queue.
+  bool PostMessageTaskToExtensionThread(
+      const tracked_objects::Location& from_here, const base::Closure& task,
+      bool droppable);
 
-  void PostMessageToClientTaskRunner(scoped_ptr<base::Value> msg);
+  // Called once the extension thread made room in a full queue.
+  void OnMessageQueueReady();
 
-  scoped_ptr<XWalkExtensionInstance> context_;
+  // Only used for DEDICATED_THREAD extensions.
   scoped_ptr<base::Thread> thread_;
-  XWalkExtension* extension_;
+  scoped_refptr<base::SequencedTaskRunner> task_runner_;
 
-  base::WaitableEvent sync_message_event_;
   base::SingleThreadTaskRunner* client_task_runner_;
 
+  class MessageBatch;
   class PostHelper;
-  scoped_ptr<PostHelper> helper_;
+  class ContextHolder;
+
+  // Both are owned by tasks posted when the runner is destroyed.
+  PostHelper* helper_;
+  ContextHolder* holder_;
+
+  // Whether the client was told the queue is full.
+  bool message_queue_full_;
+
+  // Copied from the extension, which may be gone before the runner.
+  const bool block_sender_;
 
   DISALLOW_COPY_AND_ASSIGN(XWalkExtensionThreadedRunner);
 };
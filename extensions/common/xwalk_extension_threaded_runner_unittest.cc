@@ -4,11 +4,17 @@
 
 #include "xwalk/extensions/common/xwalk_extension_threaded_runner.h"
 
+#include <string>
+#include <vector>
 #include "base/bind.h"
 #include "base/memory/scoped_ptr.h"
+#include "base/memory/scoped_vector.h"
 #include "base/message_loop/message_loop.h"
 #include "base/run_loop.h"
 #include "base/synchronization/waitable_event.h"
+#include "base/threading/platform_thread.h"
+#include "base/threading/thread.h"
+#include "base/threading/thread_restrictions.h"
 #include "ipc/ipc_message.h"
 #include "testing/gtest/include/gtest/gtest.h"
 
@@ -23,6 +29,11 @@ namespace {
 MessageLoop* g_main_message_loop = NULL;
 MessageLoop* g_extension_message_loop = NULL;
 base::WaitableEvent g_done(false, false);
+base::WaitableEvent g_release(false, false);
+
+base::PlatformThreadId g_main_thread_id;
+
+const int kBurstSize = 100;
 
 class TestExtensionInstance : public XWalkExtensionInstance {
  public:
@@ -46,10 +57,25 @@ class TestExtensionInstance : public XWalkExtensionInstance {
     if (msg_str == "PING") {
       PostMessageToJS(scoped_ptr<base::Value>(
           base::Value::CreateStringValue("PONG")));
+    } else if (msg_str == "BURST") {
+      for (int i = 0; i < kBurstSize; ++i) {
+        PostMessageToJS(scoped_ptr<base::Value>(
+            base::Value::CreateIntegerValue(i)));
+      }
+      PostCoalescedMessageToJS("state", scoped_ptr<base::Value>(
+          base::Value::CreateStringValue("OLD")));
+      PostCoalescedMessageToJS("state", scoped_ptr<base::Value>(
+          base::Value::CreateStringValue("NEW")));
+      g_done.Signal();
     } else {
       g_done.Signal();
     }
   }
+  virtual void HandleBinaryMessage(
+      const scoped_refptr<base::RefCountedMemory>& data) OVERRIDE {
+    EXPECT_EQ(extension_message_loop_, MessageLoop::current());
+    PostBinaryMessageToJS(data);
+  }
   virtual scoped_ptr<base::Value> HandleSyncMessage(
       scoped_ptr<base::Value> msg) OVERRIDE {
     EXPECT_EQ(extension_message_loop_, MessageLoop::current());
@@ -70,15 +96,251 @@ class TestExtension : public XWalkExtension {
   }
 };
 
+// Checks that messages arrive in order and outside the main thread. Replies
+// once the last message of the sequence is received.
+class TestPooledExtensionInstance : public XWalkExtensionInstance {
+ public:
+  explicit TestPooledExtensionInstance(
+      const XWalkExtension::PostMessageCallback& post_message)
+      : next_message_(0) {
+    SetPostMessageCallback(post_message);
+    g_done.Signal();
+  }
+  virtual ~TestPooledExtensionInstance() {
+    g_done.Signal();
+  }
+
+ private:
+  virtual void HandleMessage(scoped_ptr<base::Value> msg) OVERRIDE {
+    EXPECT_NE(g_main_thread_id, base::PlatformThread::CurrentId());
+#if ENABLE_THREAD_RESTRICTIONS
+    // The pooled threads are shared, handlers aren't allowed to block them.
+    bool wait_allowed = base::ThreadRestrictions::SetWaitAllowed(true);
+    base::ThreadRestrictions::SetWaitAllowed(wait_allowed);
+    EXPECT_FALSE(wait_allowed);
+#endif
+    int value = -1;
+    EXPECT_TRUE(msg->GetAsInteger(&value));
+    EXPECT_EQ(next_message_++, value);
+    if (next_message_ == kBurstSize)
+      PostMessageToJS(msg.Pass());
+  }
+
+  int next_message_;
+};
+
+class TestPooledExtension : public XWalkExtension {
+ public:
+  TestPooledExtension() { set_runner_mode(POOLED_THREAD); }
+  virtual const char* GetJavaScriptAPI() OVERRIDE { return ""; }
+  virtual XWalkExtensionInstance* CreateInstance(
+      const PostMessageCallback& post_message) OVERRIDE {
+    return new TestPooledExtensionInstance(post_message);
+  }
+};
+
+// Posts a burst of messages from each of several threads at once, numbered
+// so the messages of each thread can be told apart.
+class TestThreadedPostExtensionInstance : public XWalkExtensionInstance {
+ public:
+  static const int kThreads = 4;
+
+  explicit TestThreadedPostExtensionInstance(
+      const XWalkExtension::PostMessageCallback& post_message) {
+    SetPostMessageCallback(post_message);
+  }
+
+ private:
+  virtual void HandleMessage(scoped_ptr<base::Value> msg) OVERRIDE {
+    ScopedVector<base::Thread> threads;
+    for (int i = 0; i < kThreads; ++i) {
+      threads.push_back(new base::Thread("ThreadedPostTest"));
+      ASSERT_TRUE(threads.back()->Start());
+    }
+    for (int i = 0; i < kThreads; ++i) {
+      threads[i]->message_loop()->PostTask(FROM_HERE,
+          base::Bind(&TestThreadedPostExtensionInstance::PostBurst,
+                     base::Unretained(this), i));
+    }
+    // Waits for the bursts.
+    threads.clear();
+    g_done.Signal();
+  }
+
+  void PostBurst(int thread) {
+    for (int i = 0; i < kBurstSize; ++i) {
+      PostMessageToJS(scoped_ptr<base::Value>(
+          base::Value::CreateIntegerValue(thread * kBurstSize + i)));
+    }
+  }
+};
+
+class TestThreadedPostExtension : public XWalkExtension {
+ public:
+  virtual const char* GetJavaScriptAPI() OVERRIDE { return ""; }
+  virtual XWalkExtensionInstance* CreateInstance(
+      const PostMessageCallback& post_message) OVERRIDE {
+    return new TestThreadedPostExtensionInstance(post_message);
+  }
+};
+
+// Holds the requests until kRequests arrive, then replies to them in reverse
+// order from a thread of its own.
+class TestRequestExtensionInstance : public XWalkExtensionInstance {
+ public:
+  static const int kRequests = 3;
+
+  TestRequestExtensionInstance() : reply_thread_("ReplyThread") {
+    reply_thread_.Start();
+  }
+  virtual ~TestRequestExtensionInstance() {
+    // Replies must not be posted after the instance is gone.
+    reply_thread_.Stop();
+  }
+
+ private:
+  virtual void HandleMessage(scoped_ptr<base::Value> msg) OVERRIDE {}
+  virtual void HandleRequest(int request_id,
+                             scoped_ptr<base::Value> msg) OVERRIDE {
+    pending_.push_back(request_id);
+    if (pending_.size() < static_cast<size_t>(kRequests))
+      return;
+    for (int i = kRequests - 1; i >= 0; --i) {
+      reply_thread_.message_loop()->PostTask(FROM_HERE,
+          base::Bind(&TestRequestExtensionInstance::Reply,
+                     base::Unretained(this), pending_[i]));
+    }
+  }
+
+  void Reply(int request_id) {
+    PostReplyToJS(request_id, scoped_ptr<base::Value>(
+        base::Value::CreateIntegerValue(request_id * 10)));
+  }
+
+  base::Thread reply_thread_;
+  std::vector<int> pending_;
+};
+
+class TestRequestExtension : public XWalkExtension {
+ public:
+  TestRequestExtension() {}
+  virtual const char* GetJavaScriptAPI() OVERRIDE { return ""; }
+  virtual XWalkExtensionInstance* CreateInstance(
+      const PostMessageCallback& post_message) OVERRIDE {
+    return new TestRequestExtensionInstance;
+  }
+};
+
+// Keeps the sync message waiting while it handles the next message, then
+// replies to it from a thread of its own.
+class TestDeferredSyncExtensionInstance : public XWalkExtensionInstance {
+ public:
+  explicit TestDeferredSyncExtensionInstance(
+      const XWalkExtension::PostMessageCallback& post_message)
+      : reply_thread_("ReplyThread"),
+        pending_reply_id_(0) {
+    SetPostMessageCallback(post_message);
+    reply_thread_.Start();
+  }
+  virtual ~TestDeferredSyncExtensionInstance() {
+    reply_thread_.Stop();
+  }
+
+ private:
+  virtual void HandleMessage(scoped_ptr<base::Value> msg) OVERRIDE {
+    PostMessageToJS(scoped_ptr<base::Value>(
+        base::Value::CreateStringValue("PONG")));
+    reply_thread_.message_loop()->PostTask(FROM_HERE,
+        base::Bind(&TestDeferredSyncExtensionInstance::Reply,
+                   base::Unretained(this), pending_reply_id_));
+  }
+  virtual void HandleDeferrableSyncMessage(
+      int reply_id, scoped_ptr<base::Value> msg) OVERRIDE {
+    pending_reply_id_ = reply_id;
+  }
+
+  void Reply(int reply_id) {
+    PostSyncReplyToJS(reply_id, scoped_ptr<base::Value>(
+        base::Value::CreateStringValue("DEFERRED")));
+  }
+
+  base::Thread reply_thread_;
+  int pending_reply_id_;
+};
+
+class TestDeferredSyncExtension : public XWalkExtension {
+ public:
+  TestDeferredSyncExtension() {}
+  virtual const char* GetJavaScriptAPI() OVERRIDE { return ""; }
+  virtual XWalkExtensionInstance* CreateInstance(
+      const PostMessageCallback& post_message) OVERRIDE {
+    return new TestDeferredSyncExtensionInstance(post_message);
+  }
+};
+
+// Blocks on "WAIT" until |g_release| is signaled, so messages pile up in its
+// queue. Replies with all the numbers received once it gets kLastMessage.
+class TestSlowExtensionInstance : public XWalkExtensionInstance {
+ public:
+  static const int kLastMessage = 9;
+
+  explicit TestSlowExtensionInstance(
+      const XWalkExtension::PostMessageCallback& post_message) {
+    SetPostMessageCallback(post_message);
+    g_done.Signal();
+  }
+  virtual ~TestSlowExtensionInstance() {
+    g_done.Signal();
+  }
+
+ private:
+  virtual void HandleMessage(scoped_ptr<base::Value> msg) OVERRIDE {
+    std::string msg_str;
+    if (msg->GetAsString(&msg_str) && msg_str == "WAIT") {
+      g_done.Signal();
+      g_release.Wait();
+      return;
+    }
+
+    int value = -1;
+    EXPECT_TRUE(msg->GetAsInteger(&value));
+    received_.AppendInteger(value);
+    if (value == kLastMessage)
+      PostMessageToJS(scoped_ptr<base::Value>(received_.DeepCopy()));
+  }
+
+  base::ListValue received_;
+};
+
+class TestSlowExtension : public XWalkExtension {
+ public:
+  TestSlowExtension(size_t queue_limit, QueueFullPolicy policy) {
+    set_message_queue_limit(queue_limit);
+    set_queue_full_policy(policy);
+  }
+  virtual const char* GetJavaScriptAPI() OVERRIDE { return ""; }
+  virtual XWalkExtensionInstance* CreateInstance(
+      const PostMessageCallback& post_message) OVERRIDE {
+    return new TestSlowExtensionInstance(post_message);
+  }
+};
+
 class TestRunnerClient : public XWalkExtensionRunner::Client {
  public:
   TestRunnerClient(const base::Closure& handle_message = base::Closure())
       : handle_message_(handle_message) {}
 
-  virtual void HandleMessageFromNative(
-      const XWalkExtensionRunner* runner,
-      scoped_ptr<base::Value> msg) OVERRIDE {
+  virtual void HandleMessagesFromNative(
+      const XWalkExtensionRunner* runner, int64_t instance_id,
+      scoped_ptr<base::ListValue> msgs) OVERRIDE {
     EXPECT_EQ(g_main_message_loop, MessageLoop::current());
+    batch_sizes_.push_back(msgs->GetSize());
+    for (size_t i = 0; i < msgs->GetSize(); ++i) {
+      const base::Value* msg;
+      msgs->Get(i, &msg);
+      all_messages_.Append(msg->DeepCopy());
+    }
+    last_batch_ = msgs.Pass();
 
     // Posting instead of calling directly because if the expectation above
     // fails, we will be in the wrong thread.
@@ -88,9 +350,23 @@ class TestRunnerClient : public XWalkExtensionRunner::Client {
     }
   }
 
-  virtual void HandleReplyMessageFromNative(scoped_ptr<IPC::Message> ipc_reply,
+  virtual void HandleBinaryMessageFromNative(
+      const XWalkExtensionRunner* runner,
+      const scoped_refptr<base::RefCountedMemory>& data) OVERRIDE {
+    EXPECT_EQ(g_main_message_loop, MessageLoop::current());
+    EXPECT_EQ(3u, data->size());
+
+    if (!handle_message_.is_null()) {
+      g_main_message_loop->message_loop_proxy()->PostTask(
+          FROM_HERE, handle_message_);
+    }
+  }
+
+  virtual void HandleReplyMessageFromNative(
+      const XWalkExtensionRunner* runner, scoped_ptr<IPC::Message> ipc_reply,
       scoped_ptr<base::Value> msg) OVERRIDE {
     EXPECT_EQ(g_main_message_loop, MessageLoop::current());
+    sync_replies_.push_back(msg.release());
 
     // Posting instead of calling directly because if the expectation above
     // fails, we will be in the wrong thread.
@@ -100,10 +376,61 @@ class TestRunnerClient : public XWalkExtensionRunner::Client {
     }
   }
 
+  virtual void HandleRequestReplyFromNative(
+      const XWalkExtensionRunner* runner, int request_id,
+      scoped_ptr<base::Value> reply) OVERRIDE {
+    EXPECT_EQ(g_main_message_loop, MessageLoop::current());
+    int value = -1;
+    EXPECT_TRUE(reply->GetAsInteger(&value));
+    EXPECT_EQ(request_id * 10, value);
+    replied_requests_.push_back(request_id);
+
+    if (!handle_message_.is_null()) {
+      g_main_message_loop->message_loop_proxy()->PostTask(
+          FROM_HERE, handle_message_);
+    }
+  }
+
+  virtual void HandleMessageQueueFullFromNative(
+      const XWalkExtensionRunner* runner, bool full,
+      bool block_sender) OVERRIDE {
+    EXPECT_EQ(g_main_message_loop, MessageLoop::current());
+    queue_full_states_.push_back(full);
+
+    if (!handle_message_.is_null()) {
+      g_main_message_loop->message_loop_proxy()->PostTask(
+          FROM_HERE, handle_message_);
+    }
+  }
+
+  const std::vector<size_t>& batch_sizes() const { return batch_sizes_; }
+  const base::ListValue* last_batch() const { return last_batch_.get(); }
+  const base::ListValue& all_messages() const { return all_messages_; }
+  const std::vector<int>& replied_requests() const {
+    return replied_requests_;
+  }
+  const std::vector<bool>& queue_full_states() const {
+    return queue_full_states_;
+  }
+  const ScopedVector<base::Value>& sync_replies() const {
+    return sync_replies_;
+  }
+
  private:
   base::Closure handle_message_;
+  std::vector<size_t> batch_sizes_;
+  scoped_ptr<base::ListValue> last_batch_;
+  base::ListValue all_messages_;
+  std::vector<int> replied_requests_;
+  std::vector<bool> queue_full_states_;
+  ScopedVector<base::Value> sync_replies_;
 };
 
+void QuitWhenDone(int* pending, const base::Closure& quit) {
+  if (--*pending == 0)
+    quit.Run();
+}
+
 }  // namespace
 
 TEST(XWalkExtensionThreadedRunnerTest,
@@ -186,3 +513,309 @@ TEST(XWalkExtensionThreadedRunnerTest,
 
   g_main_message_loop = NULL;
 }
+
+TEST(XWalkExtensionThreadedRunnerTest, BinaryMessagesAreEchoed) {
+  MessageLoop loop(MessageLoop::TYPE_DEFAULT);
+  g_main_message_loop = &loop;
+  base::RunLoop run_loop;
+
+  TestExtension extension;
+  TestRunnerClient client(run_loop.QuitClosure());
+
+  XWalkExtensionRunner* runner =
+      new XWalkExtensionThreadedRunner(&extension, &client,
+                                       loop.message_loop_proxy());
+  g_done.Wait();
+
+  std::string bytes("\x01\x00\x02", 3);
+  runner->PostBinaryMessageToNative(base::RefCountedString::TakeString(&bytes));
+
+  run_loop.Run();
+
+  delete runner;
+  g_done.Wait();
+
+  g_main_message_loop = NULL;
+}
+
+TEST(XWalkExtensionThreadedRunnerTest, BurstOfMessagesIsBatched) {
+  MessageLoop loop(MessageLoop::TYPE_DEFAULT);
+  g_main_message_loop = &loop;
+  base::RunLoop run_loop;
+
+  TestExtension extension;
+  TestRunnerClient client(run_loop.QuitClosure());
+
+  XWalkExtensionRunner* runner =
+      new XWalkExtensionThreadedRunner(&extension, &client,
+                                       loop.message_loop_proxy());
+  g_done.Wait();
+
+  // The main loop doesn't run until the whole burst was posted, so all the
+  // messages should arrive in a single batch, with the coalesced messages
+  // replaced by the newest one.
+  runner->PostMessageToNative(scoped_ptr<base::Value>(
+      base::Value::CreateStringValue("BURST")));
+  g_done.Wait();
+
+  run_loop.Run();
+
+  ASSERT_EQ(1u, client.batch_sizes().size());
+  const base::ListValue* batch = client.last_batch();
+  ASSERT_EQ(static_cast<size_t>(kBurstSize + 1), batch->GetSize());
+  for (int i = 0; i < kBurstSize; ++i) {
+    int value = -1;
+    EXPECT_TRUE(batch->GetInteger(i, &value));
+    EXPECT_EQ(i, value);
+  }
+  std::string state;
+  EXPECT_TRUE(batch->GetString(kBurstSize, &state));
+  EXPECT_EQ("NEW", state);
+
+  delete runner;
+  g_done.Wait();
+
+  g_main_message_loop = NULL;
+}
+
+// Messages posted from several threads at once are neither lost nor
+// reordered within each thread.
+TEST(XWalkExtensionThreadedRunnerTest, MessagesPostedFromManyThreads) {
+  MessageLoop loop(MessageLoop::TYPE_DEFAULT);
+  g_main_message_loop = &loop;
+
+  TestThreadedPostExtension extension;
+  TestRunnerClient client;
+
+  XWalkExtensionRunner* runner =
+      new XWalkExtensionThreadedRunner(&extension, &client,
+                                       loop.message_loop_proxy());
+  runner->PostMessageToNative(scoped_ptr<base::Value>(
+      base::Value::CreateStringValue("POST")));
+  g_done.Wait();
+
+  // Every batch task was posted before the instance returned.
+  base::RunLoop().RunUntilIdle();
+
+  const int kThreads = TestThreadedPostExtensionInstance::kThreads;
+  const base::ListValue& msgs = client.all_messages();
+  ASSERT_EQ(static_cast<size_t>(kThreads * kBurstSize), msgs.GetSize());
+  std::vector<int> next(kThreads, 0);
+  for (size_t i = 0; i < msgs.GetSize(); ++i) {
+    int value = -1;
+    ASSERT_TRUE(msgs.GetInteger(i, &value));
+    int thread = value / kBurstSize;
+    ASSERT_LE(0, thread);
+    ASSERT_GT(kThreads, thread);
+    EXPECT_EQ(next[thread]++, value % kBurstSize);
+  }
+
+  delete runner;
+  XWalkExtensionThreadedRunner::WaitForPendingDestructions();
+
+  g_main_message_loop = NULL;
+}
+
+TEST(XWalkExtensionThreadedRunnerTest, PooledRunnersKeepMessageOrder) {
+  MessageLoop loop(MessageLoop::TYPE_DEFAULT);
+  g_main_message_loop = &loop;
+  g_main_thread_id = base::PlatformThread::CurrentId();
+  base::RunLoop run_loop;
+
+  // Several instances share the pool, each one should still get its own
+  // messages in order.
+  const int kInstances = 8;
+  int pending_replies = kInstances;
+
+  TestPooledExtension extension;
+  TestRunnerClient client(base::Bind(&QuitWhenDone, &pending_replies,
+                                     run_loop.QuitClosure()));
+
+  XWalkExtensionRunner* runners[kInstances];
+  for (int i = 0; i < kInstances; ++i) {
+    runners[i] = new XWalkExtensionThreadedRunner(&extension, &client,
+                                                  loop.message_loop_proxy());
+    g_done.Wait();
+  }
+
+  for (int j = 0; j < kBurstSize; ++j) {
+    for (int i = 0; i < kInstances; ++i) {
+      runners[i]->PostMessageToNative(scoped_ptr<base::Value>(
+          base::Value::CreateIntegerValue(j)));
+    }
+  }
+
+  // Wait until all instances replied.
+  run_loop.Run();
+  EXPECT_EQ(static_cast<size_t>(kInstances), client.batch_sizes().size());
+
+  for (int i = 0; i < kInstances; ++i) {
+    delete runners[i];
+    g_done.Wait();
+  }
+
+  g_main_message_loop = NULL;
+}
+
+TEST(XWalkExtensionThreadedRunnerTest, RequestsRepliedFromAnotherThread) {
+  MessageLoop loop(MessageLoop::TYPE_DEFAULT);
+  g_main_message_loop = &loop;
+  base::RunLoop run_loop;
+
+  const int kRequests = TestRequestExtensionInstance::kRequests;
+  int pending_replies = kRequests;
+
+  TestRequestExtension extension;
+  TestRunnerClient client(base::Bind(&QuitWhenDone, &pending_replies,
+                                     run_loop.QuitClosure()));
+
+  XWalkExtensionRunner* runner =
+      new XWalkExtensionThreadedRunner(&extension, &client,
+                                       loop.message_loop_proxy());
+
+  // All the requests are in flight at the same time, and the replies can
+  // come in any order.
+  for (int i = 0; i < kRequests; ++i) {
+    runner->PostRequestToNative(i, scoped_ptr<base::Value>(
+        base::Value::CreateNullValue()));
+  }
+
+  run_loop.Run();
+
+  ASSERT_EQ(static_cast<size_t>(kRequests), client.replied_requests().size());
+  for (int i = 0; i < kRequests; ++i)
+    EXPECT_EQ(kRequests - 1 - i, client.replied_requests()[i]);
+
+  delete runner;
+  XWalkExtensionThreadedRunner::WaitForPendingDestructions();
+
+  g_main_message_loop = NULL;
+}
+
+TEST(XWalkExtensionThreadedRunnerTest, FullQueueDropsOldestMessages) {
+  MessageLoop loop(MessageLoop::TYPE_DEFAULT);
+  g_main_message_loop = &loop;
+  base::RunLoop run_loop;
+
+  const size_t kQueueLimit = 4;
+  TestSlowExtension extension(kQueueLimit, XWalkExtension::DROP_OLDEST);
+  TestRunnerClient client(run_loop.QuitClosure());
+
+  XWalkExtensionRunner* runner =
+      new XWalkExtensionThreadedRunner(&extension, &client,
+                                       loop.message_loop_proxy());
+  g_done.Wait();
+
+  runner->PostMessageToNative(scoped_ptr<base::Value>(
+      base::Value::CreateStringValue("WAIT")));
+  g_done.Wait();
+
+  const int kMessages = TestSlowExtensionInstance::kLastMessage + 1;
+  for (int i = 0; i < kMessages; ++i) {
+    runner->PostMessageToNative(scoped_ptr<base::Value>(
+        base::Value::CreateIntegerValue(i)));
+  }
+  g_release.Signal();
+
+  run_loop.Run();
+
+  // Only the newest messages fit in the queue.
+  const base::ListValue* batch = client.last_batch();
+  ASSERT_TRUE(batch);
+  const base::ListValue* received = NULL;
+  ASSERT_TRUE(batch->GetList(0, &received));
+  ASSERT_EQ(kQueueLimit, received->GetSize());
+  for (size_t i = 0; i < kQueueLimit; ++i) {
+    int value = -1;
+    EXPECT_TRUE(received->GetInteger(i, &value));
+    EXPECT_EQ(static_cast<int>(kMessages - kQueueLimit + i), value);
+  }
+  EXPECT_TRUE(client.queue_full_states().empty());
+
+  delete runner;
+  g_done.Wait();
+
+  g_main_message_loop = NULL;
+}
+
+TEST(XWalkExtensionThreadedRunnerTest, FullQueueIsReportedToClient) {
+  MessageLoop loop(MessageLoop::TYPE_DEFAULT);
+  g_main_message_loop = &loop;
+  base::RunLoop run_loop;
+
+  // Waits for the reply and for the queue to have room again.
+  int pending = 2;
+  const size_t kQueueLimit = 4;
+  TestSlowExtension extension(kQueueLimit, XWalkExtension::BLOCK_SENDER);
+  TestRunnerClient client(base::Bind(&QuitWhenDone, &pending,
+                                     run_loop.QuitClosure()));
+
+  XWalkExtensionRunner* runner =
+      new XWalkExtensionThreadedRunner(&extension, &client,
+                                       loop.message_loop_proxy());
+  g_done.Wait();
+
+  runner->PostMessageToNative(scoped_ptr<base::Value>(
+      base::Value::CreateStringValue("WAIT")));
+  g_done.Wait();
+
+  // Messages over the limit are still queued, holding back the sender is up
+  // to the client.
+  const int kMessages = TestSlowExtensionInstance::kLastMessage + 1;
+  for (int i = 0; i < kMessages; ++i) {
+    runner->PostMessageToNative(scoped_ptr<base::Value>(
+        base::Value::CreateIntegerValue(i)));
+  }
+  ASSERT_EQ(1u, client.queue_full_states().size());
+  EXPECT_TRUE(client.queue_full_states()[0]);
+  g_release.Signal();
+
+  run_loop.Run();
+
+  ASSERT_EQ(2u, client.queue_full_states().size());
+  EXPECT_FALSE(client.queue_full_states()[1]);
+  const base::ListValue* received = NULL;
+  ASSERT_TRUE(client.last_batch()->GetList(0, &received));
+  EXPECT_EQ(static_cast<size_t>(kMessages), received->GetSize());
+
+  delete runner;
+  g_done.Wait();
+
+  g_main_message_loop = NULL;
+}
+
+TEST(XWalkExtensionThreadedRunnerTest, SyncMessageRepliedFromAnotherThread) {
+  MessageLoop loop(MessageLoop::TYPE_DEFAULT);
+  g_main_message_loop = &loop;
+  base::RunLoop run_loop;
+
+  // Waits for the message and the sync reply.
+  int pending = 2;
+  TestDeferredSyncExtension extension;
+  TestRunnerClient client(base::Bind(&QuitWhenDone, &pending,
+                                     run_loop.QuitClosure()));
+
+  XWalkExtensionRunner* runner =
+      new XWalkExtensionThreadedRunner(&extension, &client,
+                                       loop.message_loop_proxy());
+
+  // The instance handles the message while the sync message is waiting for
+  // its reply.
+  runner->SendSyncMessageToNative(make_scoped_ptr(new IPC::Message),
+      scoped_ptr<base::Value>(base::Value::CreateStringValue("SYNC")));
+  runner->PostMessageToNative(scoped_ptr<base::Value>(
+      base::Value::CreateStringValue("PING")));
+
+  run_loop.Run();
+
+  ASSERT_EQ(1u, client.batch_sizes().size());
+  ASSERT_EQ(1u, client.sync_replies().size());
+  std::string reply;
+  EXPECT_TRUE(client.sync_replies()[0]->GetAsString(&reply));
+  EXPECT_EQ("DEFERRED", reply);
+
+  delete runner;
+  XWalkExtensionThreadedRunner::WaitForPendingDestructions();
+
+  g_main_message_loop = NULL;
+}
@@ -9,9 +9,7 @@
 namespace xwalk {
 namespace extensions {
 
-XWalkExternalAdapter::XWalkExternalAdapter()
-    : next_xw_extension_(1),
-      next_xw_instance_(1) {}
+XWalkExternalAdapter::XWalkExternalAdapter() {}
 
 XWalkExternalAdapter::~XWalkExternalAdapter() {}
 
@@ -20,41 +18,29 @@ XWalkExternalAdapter* XWalkExternalAdapter::GetInstance() {
 }
 
 XW_Extension XWalkExternalAdapter::GetNextXWExtension() {
-  return next_xw_extension_++;
+  return extension_table_.Reserve();
 }
 
 XW_Instance XWalkExternalAdapter::GetNextXWInstance() {
-  return next_xw_instance_++;
+  return instance_table_.Reserve();
 }
 
 void XWalkExternalAdapter::RegisterExtension(
     XWalkExternalExtension* extension) {
-  XW_Extension xw_extension = extension->xw_extension_;
-  CHECK(IsValidXWExtension(xw_extension));
-  CHECK(extension_map_.find(xw_extension) == extension_map_.end());
-  extension_map_[xw_extension] = extension;
+  extension_table_.Publish(extension->xw_extension_, extension);
 }
 
 void XWalkExternalAdapter::UnregisterExtension(
     XWalkExternalExtension* extension) {
-  XW_Extension xw_extension = extension->xw_extension_;
-  CHECK(IsValidXWExtension(xw_extension));
-  CHECK(extension_map_.find(xw_extension) != extension_map_.end());
-  extension_map_.erase(xw_extension);
+  extension_table_.Remove(extension->xw_extension_);
 }
 
 void XWalkExternalAdapter::RegisterInstance(XWalkExternalContext* context) {
-  XW_Instance xw_instance = context->xw_instance_;
-  CHECK(IsValidXWInstance(xw_instance));
-  CHECK(instance_map_.find(xw_instance) == instance_map_.end());
-  instance_map_[xw_instance] = context;
+  instance_table_.Publish(context->xw_instance_, context);
 }
 
 void XWalkExternalAdapter::UnregisterInstance(XWalkExternalContext* context) {
-  XW_Instance xw_instance = context->xw_instance_;
-  CHECK(IsValidXWInstance(xw_instance));
-  CHECK(instance_map_.find(xw_instance) != instance_map_.end());
-  instance_map_.erase(xw_instance);
+  instance_table_.Remove(context->xw_instance_);
 }
 
 const void* XWalkExternalAdapter::GetInterface(const char* name) {
@@ -78,6 +64,17 @@ const void* XWalkExternalAdapter::GetInterface(const char* name) {
     return &messagingInterface1;
   }
 
+  if (!strcmp(name, XW_MESSAGING_INTERFACE_2)) {
+    static const XW_MessagingInterface_2 messagingInterface2 = {
+      MessagingRegister,
+      MessagingPostMessage,
+      MessagingRegisterBinaryMessageCallback,
+      MessagingPostBinaryMessage,
+      MessagingPostBinaryMessageBuffer
+    };
+    return &messagingInterface2;
+  }
+
   if (!strcmp(name, XW_INTERNAL_SYNC_MESSAGING_INTERFACE_1)) {
     static const XW_Internal_SyncMessagingInterface_1
         syncMessagingInterface1 = {
@@ -87,34 +84,62 @@ const void* XWalkExternalAdapter::GetInterface(const char* name) {
     return &syncMessagingInterface1;
   }
 
+  if (!strcmp(name, XW_INTERNAL_SYNC_MESSAGING_INTERFACE_2)) {
+    static const XW_Internal_SyncMessagingInterface_2
+        syncMessagingInterface2 = {
+      SyncMessagingRegister,
+      SyncMessagingSetSyncReply,
+      SyncMessagingDeferSyncReply,
+      SyncMessagingSetDeferredSyncReply
+    };
+    return &syncMessagingInterface2;
+  }
+
+  if (!strcmp(name, XW_INTERNAL_INSTANCE_MODE_INTERFACE_1)) {
+    static const XW_Internal_InstanceModeInterface_1 instanceModeInterface1 = {
+      InstanceModeSetInstanceMode
+    };
+    return &instanceModeInterface1;
+  }
+
   LOG(WARNING) << "Interface '" << name << "' is not supported.";
   return NULL;
 }
 
-bool XWalkExternalAdapter::IsValidXWExtension(XW_Extension xw_extension) {
-  return xw_extension > 0 && xw_extension < next_xw_extension_;
+// static
+XWalkExternalAdapter::ExtensionTable*
+XWalkExternalAdapter::GetExtensionTable() {
+  return &GetInstance()->extension_table_;
 }
 
-bool XWalkExternalAdapter::IsValidXWInstance(XW_Instance xw_instance) {
-  return xw_instance > 0 && xw_instance < next_xw_instance_;
+// static
+XWalkExternalAdapter::InstanceTable* XWalkExternalAdapter::GetInstanceTable() {
+  return &GetInstance()->instance_table_;
 }
 
-XWalkExternalExtension* XWalkExternalAdapter::GetExtension(
-    XW_Extension xw_extension) {
-  XWalkExternalAdapter* adapter = XWalkExternalAdapter::GetInstance();
-  ExtensionMap::iterator it = adapter->extension_map_.find(xw_extension);
-  if (it == adapter->extension_map_.end())
-    return NULL;
-  return it->second;
+// static
+void XWalkExternalAdapter::MessagingPostBinaryMessageBuffer(
+    XW_Instance xw, void* data, size_t size,
+    XW_FreeBufferCallback free_buffer, void* user_data) {
+  InstanceTable::ScopedLookup ptr(GetInstanceTable(), xw);
+  if (!ptr.get()) {
+    LogInvalidCall(xw, "Instance", "Messaging", "PostBinaryMessageBuffer");
+    if (free_buffer)
+      free_buffer(data, size, user_data);
+    return;
+  }
+  ptr->MessagingPostBinaryMessageBuffer(data, size, free_buffer, user_data);
 }
 
-XWalkExternalContext* XWalkExternalAdapter::GetInstance(
-    XW_Instance xw_instance) {
-  XWalkExternalAdapter* adapter = XWalkExternalAdapter::GetInstance();
-  InstanceMap::iterator it = adapter->instance_map_.find(xw_instance);
-  if (it == adapter->instance_map_.end())
-    return NULL;
-  return it->second;
+// static
+XW_SyncReplyToken XWalkExternalAdapter::SyncMessagingDeferSyncReply(
+    XW_Instance xw) {
+  InstanceTable::ScopedLookup ptr(GetInstanceTable(), xw);
+  if (!ptr.get()) {
+    LogInvalidCall(xw, "Instance", "SyncMessaging", "DeferSyncReply");
+    return 0;
+  }
+  return ptr->SyncMessagingDeferSyncReply();
 }
 
 // static
@@ -5,21 +5,23 @@
 #ifndef XWALK_EXTENSIONS_COMMON_XWALK_EXTERNAL_ADAPTER_H_
 #define XWALK_EXTENSIONS_COMMON_XWALK_EXTERNAL_ADAPTER_H_
 
-#include <map>
 #include "base/memory/singleton.h"
 #include "xwalk/extensions/public/XW_Extension.h"
+#include "xwalk/extensions/public/XW_Extension_InstanceMode.h"
 #include "xwalk/extensions/public/XW_Extension_SyncMessage.h"
 #include "xwalk/extensions/common/xwalk_external_context.h"
 #include "xwalk/extensions/common/xwalk_external_extension.h"
+#include "xwalk/extensions/common/xwalk_external_handle_table.h"
 
 // NOTE: Those macros define functions that are used in the structs by
 // GetInterface(). They dispatch the function to the appropriate
-// extension or instance.
+// extension or instance. The object is kept alive during the call, see
+// XWalkExternalHandleTable.
 
 #define DEFINE_FUNCTION_1(TYPE, INTERFACE, NAME, ARG1)          \
   static void INTERFACE ## NAME(XW_ ## TYPE xw, ARG1 arg1) {    \
-    XWalkExternal ## TYPE * ptr = Get ## TYPE(xw);              \
-    if (!ptr)                                                   \
+    TYPE ## Table::ScopedLookup ptr(Get ## TYPE ## Table(), xw); \
+    if (!ptr.get())                                             \
       LogInvalidCall(xw, #TYPE, #INTERFACE, #NAME);             \
     else                                                        \
       ptr->INTERFACE ## NAME(arg1);                             \
@@ -27,8 +29,8 @@
 
 #define DEFINE_FUNCTION_2(TYPE, INTERFACE, NAME, ARG1, ARG2)             \
   static void INTERFACE ## NAME(XW_ ## TYPE xw, ARG1 arg1, ARG2 arg2) {  \
-    XWalkExternal ## TYPE * ptr = Get ## TYPE(xw);                       \
-    if (!ptr)                                                            \
+    TYPE ## Table::ScopedLookup ptr(Get ## TYPE ## Table(), xw);         \
+    if (!ptr.get())                                                      \
       LogInvalidCall(xw, #TYPE, #INTERFACE, #NAME);                      \
     else                                                                 \
       ptr->INTERFACE ## NAME(arg1, arg2);                                \
@@ -36,8 +38,8 @@
 
 #define DEFINE_RET_FUNCTION_0(TYPE, INTERFACE, NAME, RET_ARG)   \
   static RET_ARG INTERFACE ## NAME(XW_ ## TYPE xw) {            \
-    XWalkExternal ## TYPE * ptr = Get ## TYPE(xw);              \
-    if (ptr)                                                    \
+    TYPE ## Table::ScopedLookup ptr(Get ## TYPE ## Table(), xw); \
+    if (ptr.get())                                              \
       return ptr->INTERFACE ## NAME();                          \
     LogInvalidCall(xw, #TYPE, #INTERFACE, #NAME);               \
     return NULL;                                                \
@@ -59,10 +61,15 @@ typedef XWalkExternalContext XWalkExternalInstance;
 // functions from external extension to their implementations in
 // XWalkExternalExtension and XWalkExternalContext. We have only one
 // adapter per process.
+//
+// The C functions can be called from any thread, e.g. PostMessage() from
+// threads of the extension, while instances are created and destroyed.
 class XWalkExternalAdapter {
  public:
   static XWalkExternalAdapter* GetInstance();
 
+  // Reserve the identifier of a new extension or instance, it is valid once
+  // the object is registered.
   XW_Extension GetNextXWExtension();
   XW_Instance GetNextXWInstance();
 
@@ -72,7 +79,8 @@ class XWalkExternalAdapter {
   void UnregisterExtension(XWalkExternalExtension* extension);
 
   // This adds the context to the adapter's mapping, so C calls to
-  // its corresponding XW_Instance are correctly dispatched.
+  // its corresponding XW_Instance are correctly dispatched. Unregistering
+  // waits for the calls to the context in progress in other threads.
   void RegisterInstance(XWalkExternalContext* context);
   void UnregisterInstance(XWalkExternalContext* context);
 
@@ -86,13 +94,13 @@ class XWalkExternalAdapter {
   XWalkExternalAdapter();
   ~XWalkExternalAdapter();
 
-  bool IsValidXWExtension(XW_Extension xw_extension);
-  bool IsValidXWInstance(XW_Instance xw_instance);
+  typedef XWalkExternalHandleTable<XWalkExternalExtension> ExtensionTable;
+  typedef XWalkExternalHandleTable<XWalkExternalInstance> InstanceTable;
 
   // Used by the DEFINE_* macros to bridge the calls using C API identifiers
   // XW_Extension and XW_Instance to the right C++ object.
-  static XWalkExternalExtension* GetExtension(XW_Extension xw_extension);
-  static XWalkExternalContext* GetInstance(XW_Instance xw_instance);
+  static ExtensionTable* GetExtensionTable();
+  static InstanceTable* GetInstanceTable();
   static void LogInvalidCall(int32_t value, const char* type,
                              const char* interface, const char* function);
 
@@ -106,23 +114,35 @@ class XWalkExternalAdapter {
   DEFINE_FUNCTION_1(Instance, Core, SetInstanceData, void*);
   DEFINE_RET_FUNCTION_0(Instance, Core, GetInstanceData, void*);
 
-  // XW_MessagingInterface_1 from XW_Extension.h.
+  // XW_MessagingInterface_1 and XW_MessagingInterface_2 from XW_Extension.h.
   DEFINE_FUNCTION_1(Extension, Messaging, Register, XW_HandleMessageCallback);
   DEFINE_FUNCTION_1(Instance, Messaging, PostMessage, const char*);
-
-  // XW_Internal_SyncMessaging_1 from XW_Extension_SyncMessage.h.
+  DEFINE_FUNCTION_1(Extension, Messaging, RegisterBinaryMessageCallback,
+                    XW_HandleBinaryMessageCallback);
+  DEFINE_FUNCTION_2(Instance, Messaging, PostBinaryMessage, const void*,
+                    size_t);
+  // The buffer is freed even if the instance is invalid, so it can't use
+  // the macros.
+  static void MessagingPostBinaryMessageBuffer(
+      XW_Instance xw, void* data, size_t size,
+      XW_FreeBufferCallback free_buffer, void* user_data);
+
+  // XW_Internal_SyncMessaging_1 and XW_Internal_SyncMessaging_2 from
+  // XW_Extension_SyncMessage.h.
   DEFINE_FUNCTION_1(Extension, SyncMessaging, Register,
                     XW_HandleSyncMessageCallback);
   DEFINE_FUNCTION_1(Instance, SyncMessaging, SetSyncReply, const char*);
+  DEFINE_FUNCTION_2(Instance, SyncMessaging, SetDeferredSyncReply,
+                    XW_SyncReplyToken, const char*);
+  // Returns a token rather than a pointer, so it can't use the macros.
+  static XW_SyncReplyToken SyncMessagingDeferSyncReply(XW_Instance xw);
 
-  typedef std::map<XW_Extension, XWalkExternalExtension*> ExtensionMap;
-  ExtensionMap extension_map_;
-
-  typedef std::map<XW_Instance, XWalkExternalContext*> InstanceMap;
-  InstanceMap instance_map_;
+  // XW_Internal_InstanceModeInterface_1 from XW_Extension_InstanceMode.h.
+  DEFINE_FUNCTION_1(Extension, InstanceMode, SetInstanceMode,
+                    XW_InstanceMode);
 
-  XW_Extension next_xw_extension_;
-  XW_Instance next_xw_instance_;
+  ExtensionTable extension_table_;
+  InstanceTable instance_table_;
 
   DISALLOW_COPY_AND_ASSIGN(XWalkExternalAdapter);
 };
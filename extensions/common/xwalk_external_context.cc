@@ -6,12 +6,50 @@
 
 #include <string>
 #include "base/logging.h"
+#include "base/memory/ref_counted_memory.h"
 #include "xwalk/extensions/common/xwalk_external_extension.h"
 #include "xwalk/extensions/common/xwalk_external_adapter.h"
 
 namespace xwalk {
 namespace extensions {
 
+namespace {
+
+// A buffer given by the extension with PostBinaryMessageBuffer(). It is
+// passed down to the server without copying, which copies it once into the
+// message to the renderer, and given back to the extension once the last
+// reference is gone.
+class ExternalBuffer : public base::RefCountedMemory {
+ public:
+  ExternalBuffer(void* data, size_t size, XW_FreeBufferCallback free_buffer,
+                 void* user_data)
+      : data_(data),
+        size_(size),
+        free_buffer_(free_buffer),
+        user_data_(user_data) {}
+
+  virtual const unsigned char* front() const OVERRIDE {
+    return static_cast<const unsigned char*>(data_);
+  }
+
+  virtual size_t size() const OVERRIDE { return size_; }
+
+ private:
+  virtual ~ExternalBuffer() {
+    if (free_buffer_)
+      free_buffer_(data_, size_, user_data_);
+  }
+
+  void* data_;
+  size_t size_;
+  XW_FreeBufferCallback free_buffer_;
+  void* user_data_;
+
+  DISALLOW_COPY_AND_ASSIGN(ExternalBuffer);
+};
+
+}  // namespace
+
 XWalkExternalContext::XWalkExternalContext(
     XWalkExternalExtension* extension,
     const XWalkExtension::PostMessageCallback& post_message,
@@ -19,7 +57,9 @@ XWalkExternalContext::XWalkExternalContext(
     : xw_instance_(xw_instance),
       extension_(extension),
       instance_data_(NULL),
-      is_handling_sync_msg_(false) {
+      is_handling_sync_msg_(false),
+      current_token_(0),
+      next_token_(1) {
   SetPostMessageCallback(post_message);
   XWalkExternalAdapter::GetInstance()->RegisterInstance(this);
   XW_CreatedInstanceCallback callback = extension_->created_instance_callback_;
@@ -48,13 +88,49 @@ void XWalkExternalContext::HandleMessage(scoped_ptr<base::Value> msg) {
   callback(xw_instance_, string_msg.c_str());
 }
 
-scoped_ptr<base::Value> XWalkExternalContext::HandleSyncMessage(
-    scoped_ptr<base::Value> msg) {
+void XWalkExternalContext::HandleBinaryMessage(
+    const scoped_refptr<base::RefCountedMemory>& data) {
+  XW_HandleBinaryMessageCallback callback =
+      extension_->handle_binary_msg_callback_;
+  if (callback) {
+    callback(xw_instance_, data->front(), data->size());
+    return;
+  }
+
+  // The bytes are given as they are to the string callback, see
+  // XW_MessagingInterface_2::RegisterBinaryMessageCallback().
+  XW_HandleMessageCallback handle_msg = extension_->handle_msg_callback_;
+  if (!handle_msg) {
+    LOG(WARNING) << "Ignoring binary message sent for external extension '"
+                 << extension_->name() << "' which doesn't support it.";
+    return;
+  }
+
+  std::string string_msg(reinterpret_cast<const char*>(data->front()),
+                         data->size());
+  handle_msg(xw_instance_, string_msg.c_str());
+}
+
+void XWalkExternalContext::HandleDeferrableSyncMessage(
+    int reply_id, scoped_ptr<base::Value> msg) {
+  PendingReply pending = { false, reply_id };
+  RunSyncMessageCallback(pending, msg.Pass());
+}
+
+void XWalkExternalContext::HandleRequest(int request_id,
+                                         scoped_ptr<base::Value> msg) {
+  PendingReply pending = { true, request_id };
+  RunSyncMessageCallback(pending, msg.Pass());
+}
+
+void XWalkExternalContext::RunSyncMessageCallback(
+    const PendingReply& pending, scoped_ptr<base::Value> msg) {
   XW_HandleSyncMessageCallback callback = extension_->handle_sync_msg_callback_;
   if (!callback) {
     LOG(WARNING) << "Ignoring sync message sent for external extension '"
                  << extension_->name() << "' which doesn't support it.";
-    return scoped_ptr<base::Value>(base::Value::CreateNullValue());
+    PostPendingReply(pending, std::string());
+    return;
   }
 
   CHECK(sync_reply_.empty());
@@ -62,16 +138,31 @@ scoped_ptr<base::Value> XWalkExternalContext::HandleSyncMessage(
   std::string string_msg;
   msg->GetAsString(&string_msg);
 
-  // This flag is used to ensure that SetSyncReply() will only be calling during
-  // this callback execution.
+  // This flag is used to ensure that SetSyncReply() and DeferSyncReply() will
+  // only be called during this callback execution.
+  current_reply_ = pending;
+  current_token_ = 0;
   is_handling_sync_msg_ = true;
   callback(xw_instance_, string_msg.c_str());
   is_handling_sync_msg_ = false;
 
-  scoped_ptr<base::Value> reply(new base::StringValue(sync_reply_));
-  sync_reply_.clear();
+  std::string reply;
+  reply.swap(sync_reply_);
+
+  // Answered later with SetDeferredSyncReply().
+  if (current_token_)
+    return;
+
+  PostPendingReply(pending, reply);
+}
 
-  return reply.Pass();
+void XWalkExternalContext::PostPendingReply(const PendingReply& pending,
+                                            const std::string& reply) {
+  scoped_ptr<base::Value> value(new base::StringValue(reply));
+  if (pending.is_request)
+    PostReplyToJS(pending.id, value.Pass());
+  else
+    PostSyncReplyToJS(pending.id, value.Pass());
 }
 
 void XWalkExternalContext::CoreSetInstanceData(void* data) {
@@ -86,6 +177,19 @@ void XWalkExternalContext::MessagingPostMessage(const char* msg) {
   PostMessageToJS(scoped_ptr<base::Value>(new base::StringValue(msg)));
 }
 
+void XWalkExternalContext::MessagingPostBinaryMessage(const void* data,
+                                                      size_t size) {
+  PostBinaryMessageToJS(new base::RefCountedBytes(
+      static_cast<const unsigned char*>(data), size));
+}
+
+void XWalkExternalContext::MessagingPostBinaryMessageBuffer(
+    void* data, size_t size, XW_FreeBufferCallback free_buffer,
+    void* user_data) {
+  PostBinaryMessageToJS(
+      new ExternalBuffer(data, size, free_buffer, user_data));
+}
+
 void XWalkExternalContext::SyncMessagingSetSyncReply(const char* reply) {
   if (!is_handling_sync_msg_) {
     LOG(WARNING) << "Error: can't call SetSyncMessage from"
@@ -96,5 +200,42 @@ void XWalkExternalContext::SyncMessagingSetSyncReply(const char* reply) {
   sync_reply_ = reply;
 }
 
+XW_SyncReplyToken XWalkExternalContext::SyncMessagingDeferSyncReply() {
+  if (!is_handling_sync_msg_) {
+    LOG(WARNING) << "Error: can't call DeferSyncReply from"
+        " Internal_SyncMessagingInterface"
+        " outside HandleSyncMessageCallback.";
+    return 0;
+  }
+
+  if (current_token_)
+    return current_token_;
+
+  base::AutoLock lock(deferred_replies_lock_);
+  current_token_ = next_token_;
+  next_token_ = next_token_ == kint32max ? 1 : next_token_ + 1;
+  deferred_replies_[current_token_] = current_reply_;
+  return current_token_;
+}
+
+void XWalkExternalContext::SyncMessagingSetDeferredSyncReply(
+    XW_SyncReplyToken token, const char* reply) {
+  PendingReply pending;
+  {
+    base::AutoLock lock(deferred_replies_lock_);
+    DeferredReplyMap::iterator it = deferred_replies_.find(token);
+    if (it == deferred_replies_.end()) {
+      LOG(WARNING) << "Ignoring deferred sync reply for external extension '"
+                   << extension_->name() << "' with unknown token " << token
+                   << ".";
+      return;
+    }
+    pending = it->second;
+    deferred_replies_.erase(it);
+  }
+
+  PostPendingReply(pending, reply ? reply : "");
+}
+
 }  // namespace extensions
 }  // namespace xwalk
@@ -5,7 +5,9 @@
 #ifndef XWALK_EXTENSIONS_COMMON_XWALK_EXTERNAL_CONTEXT_H_
 #define XWALK_EXTENSIONS_COMMON_XWALK_EXTERNAL_CONTEXT_H_
 
+#include <map>
 #include <string>
+#include "base/synchronization/lock.h"
 #include "xwalk/extensions/common/xwalk_extension.h"
 #include "xwalk/extensions/public/XW_Extension.h"
 #include "xwalk/extensions/public/XW_Extension_SyncMessage.h"
@@ -35,19 +37,41 @@ class XWalkExternalContext : public XWalkExtensionInstance {
 
   // XWalkExtensionInstance implementation.
   virtual void HandleMessage(scoped_ptr<base::Value> msg) OVERRIDE;
-  virtual scoped_ptr<base::Value>
-      HandleSyncMessage(scoped_ptr<base::Value> msg) OVERRIDE;
+  virtual void HandleBinaryMessage(
+      const scoped_refptr<base::RefCountedMemory>& data) OVERRIDE;
+  virtual void HandleDeferrableSyncMessage(
+      int reply_id, scoped_ptr<base::Value> msg) OVERRIDE;
+  virtual void HandleRequest(
+      int request_id, scoped_ptr<base::Value> msg) OVERRIDE;
+
+  // Sync messages and requests are both handled by the sync message callback
+  // of the extension, and answered with the same API.
+  struct PendingReply {
+    bool is_request;
+    int id;
+  };
+
+  void RunSyncMessageCallback(const PendingReply& pending,
+                              scoped_ptr<base::Value> msg);
+  void PostPendingReply(const PendingReply& pending, const std::string& reply);
 
   // XW_CoreInterface_1 (from XW_Extension.h) implementation.
   void CoreSetInstanceData(void* data);
   void* CoreGetInstanceData();
 
-  // XW_MessagingInterface_1 (from XW_Extension.h) implementation.
+  // XW_MessagingInterface_2 (from XW_Extension.h) implementation.
   void MessagingPostMessage(const char* msg);
+  void MessagingPostBinaryMessage(const void* data, size_t size);
+  void MessagingPostBinaryMessageBuffer(
+      void* data, size_t size, XW_FreeBufferCallback free_buffer,
+      void* user_data);
 
-  // XW_Internal_SyncMessagingInterface_1 (from XW_Extension_SyncMessage.h)
+  // XW_Internal_SyncMessagingInterface_2 (from XW_Extension_SyncMessage.h)
   // implementation.
   void SyncMessagingSetSyncReply(const char* reply);
+  XW_SyncReplyToken SyncMessagingDeferSyncReply();
+  void SyncMessagingSetDeferredSyncReply(XW_SyncReplyToken token,
+                                         const char* reply);
 
   XW_Instance xw_instance_;
   std::string sync_reply_;
@@ -55,6 +79,17 @@ class XWalkExternalContext : public XWalkExtensionInstance {
   void* instance_data_;
   bool is_handling_sync_msg_;
 
+  // The message being handled by the sync message callback, and its token if
+  // the extension deferred the reply.
+  PendingReply current_reply_;
+  XW_SyncReplyToken current_token_;
+
+  // Deferred replies can be given from any thread.
+  base::Lock deferred_replies_lock_;
+  typedef std::map<XW_SyncReplyToken, PendingReply> DeferredReplyMap;
+  DeferredReplyMap deferred_replies_;
+  XW_SyncReplyToken next_token_;
+
   DISALLOW_COPY_AND_ASSIGN(XWalkExternalContext);
 };
 
@@ -15,13 +15,52 @@ namespace extensions {
 
 XWalkExternalExtension::XWalkExternalExtension(
     const base::FilePath& path, base::NativeLibrary native_library)
-    : xw_extension_(0),
+    : library_path_(path),
+      xw_extension_(0),
       created_instance_callback_(NULL),
       destroyed_instance_callback_(NULL),
       shutdown_callback_(NULL),
       handle_msg_callback_(NULL),
+      handle_binary_msg_callback_(NULL),
       handle_sync_msg_callback_(NULL),
-      initialized_(false) {
+      initialized_(false),
+      is_lazy_(false),
+      matches_index_(true),
+      initialize_failed_(false) {
+  Initialize(native_library);
+}
+
+XWalkExternalExtension::XWalkExternalExtension(
+    const base::FilePath& path, const std::string& name,
+    const std::string& js_api, InstanceMode instance_mode)
+    : library_path_(path),
+      xw_extension_(0),
+      created_instance_callback_(NULL),
+      destroyed_instance_callback_(NULL),
+      shutdown_callback_(NULL),
+      handle_msg_callback_(NULL),
+      handle_binary_msg_callback_(NULL),
+      handle_sync_msg_callback_(NULL),
+      js_api_(js_api),
+      initialized_(false),
+      is_lazy_(true),
+      matches_index_(true),
+      initialize_failed_(false) {
+  set_name(name);
+  set_instance_mode(instance_mode);
+}
+
+XWalkExternalExtension::~XWalkExternalExtension() {
+  if (initialized_ && shutdown_callback_)
+    shutdown_callback_(xw_extension_);
+
+  // Also registered if XW_Initialize failed.
+  if (xw_extension_)
+    XWalkExternalAdapter::GetInstance()->UnregisterExtension(this);
+}
+
+bool XWalkExternalExtension::Initialize(base::NativeLibrary native_library) {
+  const base::FilePath& path = library_path_;
   std::string error;
   if (!native_library)
     native_library = base::LoadNativeLibrary(path, &error);
@@ -30,7 +69,8 @@ XWalkExternalExtension::XWalkExternalExtension(
   if (!library.is_valid()) {
     LOG(WARNING) << "Error loading extension '" << path.AsUTF8Unsafe() << "': "
                  << error;
-    return;
+    initialize_failed_ = true;
+    return false;
   }
 
   XW_Initialize_Func initialize = reinterpret_cast<XW_Initialize_Func>(
@@ -38,7 +78,8 @@ XWalkExternalExtension::XWalkExternalExtension(
   if (!initialize) {
     LOG(WARNING) << "Error loading extension '" << path.AsUTF8Unsafe() << "': "
                  << "couldn't get XW_Initialize function.";
-    return;
+    initialize_failed_ = true;
+    return false;
   }
 
   XWalkExternalAdapter* external_adapter = XWalkExternalAdapter::GetInstance();
@@ -48,24 +89,36 @@ XWalkExternalExtension::XWalkExternalExtension(
   if (ret != XW_OK) {
     LOG(WARNING) << "Error loading extension '" << path.AsUTF8Unsafe() << "': "
                  << "XW_Initialize function returned error value.";
-    return;
+    initialize_failed_ = true;
+    return false;
   }
 
   library_.Reset(library.Release());
   initialized_ = true;
+
+  if (!matches_index_) {
+    LOG(WARNING) << "Error loading extension '" << path.AsUTF8Unsafe() << "': "
+                 << "it changed since it was registered, restart to use it.";
+    initialize_failed_ = true;
+    return false;
+  }
+  return true;
 }
 
-XWalkExternalExtension::~XWalkExternalExtension() {
-  if (!initialized_)
-    return;
+bool XWalkExternalExtension::EnsureInitialized() {
+  if (!is_lazy_)
+    return initialized_;
 
-  if (shutdown_callback_)
-    shutdown_callback_(xw_extension_);
-  XWalkExternalAdapter::GetInstance()->UnregisterExtension(this);
+  base::AutoLock lock(initialize_lock_);
+  if (initialize_failed_)
+    return false;
+  if (initialized_)
+    return true;
+  return Initialize(NULL);
 }
 
 bool XWalkExternalExtension::is_valid() {
-  return initialized_;
+  return initialized_ || (is_lazy_ && !initialize_failed_);
 }
 
 const char* XWalkExternalExtension::GetJavaScriptAPI() {
@@ -74,6 +127,9 @@ const char* XWalkExternalExtension::GetJavaScriptAPI() {
 
 XWalkExtensionInstance* XWalkExternalExtension::CreateInstance(
     const XWalkExtension::PostMessageCallback& post_message) {
+  if (!EnsureInitialized())
+    return NULL;
+
   XW_Instance xw_instance =
       XWalkExternalAdapter::GetInstance()->GetNextXWInstance();
   return new XWalkExternalContext(this, post_message, xw_instance);
@@ -89,11 +145,19 @@ XWalkExtensionInstance* XWalkExternalExtension::CreateInstance(
 
 void XWalkExternalExtension::CoreSetExtensionName(const char* name) {
   RETURN_IF_INITIALIZED("SetExtensionName from CoreInterface");
+  if (is_lazy_) {
+    matches_index_ = matches_index_ && this->name() == name;
+    return;
+  }
   set_name(name);
 }
 
 void XWalkExternalExtension::CoreSetJavaScriptAPI(const char* js_api) {
   RETURN_IF_INITIALIZED("SetJavaScriptAPI from CoreInterface");
+  if (is_lazy_) {
+    matches_index_ = matches_index_ && js_api_ == js_api;
+    return;
+  }
   js_api_ = std::string(js_api);
 }
 
@@ -117,11 +181,37 @@ void XWalkExternalExtension::MessagingRegister(
   handle_msg_callback_ = callback;
 }
 
+void XWalkExternalExtension::MessagingRegisterBinaryMessageCallback(
+    XW_HandleBinaryMessageCallback callback) {
+  RETURN_IF_INITIALIZED(
+      "RegisterBinaryMessageCallback from MessagingInterface");
+  handle_binary_msg_callback_ = callback;
+}
+
 void XWalkExternalExtension::SyncMessagingRegister(
     XW_HandleSyncMessageCallback callback) {
   RETURN_IF_INITIALIZED("Register from Internal_SyncMessagingInterface");
   handle_sync_msg_callback_ = callback;
 }
 
+void XWalkExternalExtension::InstanceModeSetInstanceMode(
+    XW_InstanceMode mode) {
+  RETURN_IF_INITIALIZED("SetInstanceMode from Internal_InstanceModeInterface");
+  if (mode != XW_INSTANCE_PER_CONTEXT && mode != XW_INSTANCE_PER_PROCESS) {
+    LOG(WARNING) << "Ignoring invalid instance mode " << mode
+                 << " of extension '" << this->name() << "'.";
+    return;
+  }
+
+  InstanceMode instance_mode = mode == XW_INSTANCE_PER_PROCESS ?
+      INSTANCE_PER_PROCESS : INSTANCE_PER_CONTEXT;
+  // The server already relies on the mode of the index.
+  if (is_lazy_) {
+    matches_index_ = matches_index_ && instance_mode == this->instance_mode();
+    return;
+  }
+  set_instance_mode(instance_mode);
+}
+
 }  // namespace extensions
 }  // namespace xwalk
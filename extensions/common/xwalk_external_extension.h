@@ -6,15 +6,14 @@
 #define XWALK_EXTENSIONS_COMMON_XWALK_EXTERNAL_EXTENSION_H_
 
 #include <string>
+#include "base/files/file_path.h"
 #include "base/scoped_native_library.h"
+#include "base/synchronization/lock.h"
 #include "xwalk/extensions/common/xwalk_extension.h"
 #include "xwalk/extensions/public/XW_Extension.h"
+#include "xwalk/extensions/public/XW_Extension_InstanceMode.h"
 #include "xwalk/extensions/public/XW_Extension_SyncMessage.h"
 
-namespace base {
-class FilePath;
-};
-
 namespace xwalk {
 namespace extensions {
 
@@ -36,6 +35,15 @@ class XWalkExternalExtension : public XWalkExtension {
   explicit XWalkExternalExtension(const base::FilePath& path,
                                   base::NativeLibrary = NULL);
 
+  // Registers the library at |path| with the |name|, |js_api| and
+  // |instance_mode| it had before, see XWalkExternalExtensionIndex. The
+  // library is only loaded and initialized when the first instance is
+  // created, so XW_Initialize runs on the extension thread of that instance.
+  // Instances fail to be created if the library doesn't match them anymore.
+  XWalkExternalExtension(const base::FilePath& path, const std::string& name,
+                         const std::string& js_api,
+                         InstanceMode instance_mode);
+
   virtual ~XWalkExternalExtension();
 
   bool is_valid();
@@ -49,6 +57,11 @@ class XWalkExternalExtension : public XWalkExtension {
   virtual XWalkExtensionInstance* CreateInstance(
       const PostMessageCallback& post_message) OVERRIDE;
 
+  // Loads the library if needed and calls XW_Initialize. Returns false if it
+  // failed, now or before.
+  bool Initialize(base::NativeLibrary native_library);
+  bool EnsureInitialized();
+
   // XW_CoreInterface_1 (from XW_Extension.h) implementation.
   void CoreSetExtensionName(const char* name);
   void CoreSetJavaScriptAPI(const char* js_api);
@@ -57,12 +70,19 @@ class XWalkExternalExtension : public XWalkExtension {
       XW_DestroyedInstanceCallback destroyed_callback);
   void CoreRegisterShutdownCallback(XW_ShutdownCallback callback);
 
-  // XW_MessagingInterface_1 (from XW_Extension.h) implementation.
+  // XW_MessagingInterface_2 (from XW_Extension.h) implementation.
   void MessagingRegister(XW_HandleMessageCallback callback);
+  void MessagingRegisterBinaryMessageCallback(
+      XW_HandleBinaryMessageCallback callback);
 
   // XW_Internal_SyncMessagingInterface_1 (from XW_Extension.h) implementation.
   void SyncMessagingRegister(XW_HandleSyncMessageCallback callback);
 
+  // XW_Internal_InstanceModeInterface_1 (from XW_Extension_InstanceMode.h)
+  // implementation.
+  void InstanceModeSetInstanceMode(XW_InstanceMode mode);
+
+  const base::FilePath library_path_;
   base::ScopedNativeLibrary library_;
   XW_Extension xw_extension_;
 
@@ -70,11 +90,22 @@ class XWalkExternalExtension : public XWalkExtension {
   XW_DestroyedInstanceCallback destroyed_instance_callback_;
   XW_ShutdownCallback shutdown_callback_;
   XW_HandleMessageCallback handle_msg_callback_;
+  XW_HandleBinaryMessageCallback handle_binary_msg_callback_;
   XW_HandleSyncMessageCallback handle_sync_msg_callback_;
 
   std::string js_api_;
   bool initialized_;
 
+  // Set when the name and JavaScript API come from the index. They can be
+  // read from other threads by then, so the library only checks them.
+  const bool is_lazy_;
+  bool matches_index_;
+  bool initialize_failed_;
+
+  // Serializes the lazy initialization, instances can be created in the
+  // threads of many runners.
+  base::Lock initialize_lock_;
+
   DISALLOW_COPY_AND_ASSIGN(XWalkExternalExtension);
 };
 
@@ -0,0 +1,157 @@
+// Copyright (c) 2013 Intel Corporation. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "xwalk/extensions/common/xwalk_external_extension_index.h"
+
+#include "base/file_util.h"
+#include "base/files/important_file_writer.h"
+#include "base/json/json_reader.h"
+#include "base/json/json_writer.h"
+#include "base/logging.h"
+#include "base/strings/string_number_conversions.h"
+#include "base/values.h"
+
+namespace xwalk {
+namespace extensions {
+
+namespace {
+
+// Bumped when the layout of the entries changes, older indexes are ignored.
+const int kIndexVersion = 2;
+
+// The index holds a few short strings per library, bigger files are not ours.
+const int64 kMaxIndexSize = 4 * 1024 * 1024;
+
+const char kVersionKey[] = "version";
+const char kLibrariesKey[] = "libraries";
+const char kModifiedKey[] = "modified";
+const char kSizeKey[] = "size";
+const char kNameKey[] = "name";
+const char kJavaScriptAPIKey[] = "api";
+const char kInstancePerProcessKey[] = "instance_per_process";
+
+// Times and sizes are int64, which don't fit in JSON numbers.
+std::string GetModifiedString(const base::PlatformFileInfo& info) {
+  return base::Int64ToString(info.last_modified.ToInternalValue());
+}
+
+std::string GetSizeString(const base::PlatformFileInfo& info) {
+  return base::Int64ToString(info.size);
+}
+
+}  // namespace
+
+XWalkExternalExtensionIndex::XWalkExternalExtensionIndex(
+    const base::FilePath& index_path)
+    : index_path_(index_path),
+      loaded_libraries_(new base::DictionaryValue),
+      libraries_(new base::DictionaryValue),
+      changed_(false) {
+}
+
+XWalkExternalExtensionIndex::~XWalkExternalExtensionIndex() {}
+
+void XWalkExternalExtensionIndex::Load() {
+  int64 size;
+  if (!file_util::GetFileSize(index_path_, &size) || size > kMaxIndexSize)
+    return;
+
+  std::string contents;
+  if (!file_util::ReadFileToString(index_path_, &contents))
+    return;
+
+  scoped_ptr<base::Value> value(base::JSONReader::Read(contents));
+  base::DictionaryValue* index;
+  int version;
+  base::DictionaryValue* libraries;
+  if (!value || !value->GetAsDictionary(&index) ||
+      !index->GetInteger(kVersionKey, &version) || version != kIndexVersion ||
+      !index->GetDictionary(kLibrariesKey, &libraries)) {
+    LOG(WARNING) << "Ignoring invalid external extension index "
+                 << index_path_.AsUTF8Unsafe();
+    return;
+  }
+
+  loaded_libraries_.reset(libraries->DeepCopy());
+}
+
+bool XWalkExternalExtensionIndex::Lookup(const base::FilePath& library_path,
+                                         const base::PlatformFileInfo& info,
+                                         Entry* entry) {
+  // Paths contain dots, so the keys can't be expanded as paths.
+  const std::string key = library_path.AsUTF8Unsafe();
+  const base::DictionaryValue* library;
+  if (!loaded_libraries_->GetDictionaryWithoutPathExpansion(key, &library))
+    return false;
+
+  std::string modified;
+  std::string size;
+  if (!library->GetString(kModifiedKey, &modified) ||
+      !library->GetString(kSizeKey, &size) ||
+      modified != GetModifiedString(info) || size != GetSizeString(info))
+    return false;
+
+  Entry result;
+  if (!library->GetString(kNameKey, &result.name) ||
+      !library->GetString(kJavaScriptAPIKey, &result.js_api) ||
+      !library->GetBoolean(kInstancePerProcessKey,
+                           &result.instance_per_process) ||
+      result.name.empty())
+    return false;
+
+  *entry = result;
+  libraries_->SetWithoutPathExpansion(key, library->DeepCopy());
+  return true;
+}
+
+void XWalkExternalExtensionIndex::Update(const base::FilePath& library_path,
+                                         const base::PlatformFileInfo& info,
+                                         const Entry& entry) {
+  base::DictionaryValue* library = new base::DictionaryValue;
+  library->SetString(kModifiedKey, GetModifiedString(info));
+  library->SetString(kSizeKey, GetSizeString(info));
+  library->SetString(kNameKey, entry.name);
+  library->SetString(kJavaScriptAPIKey, entry.js_api);
+  library->SetBoolean(kInstancePerProcessKey, entry.instance_per_process);
+  libraries_->SetWithoutPathExpansion(library_path.AsUTF8Unsafe(), library);
+  changed_ = true;
+}
+
+bool XWalkExternalExtensionIndex::Save() {
+  if (!changed_ && libraries_->size() == loaded_libraries_->size())
+    return true;
+
+  base::DictionaryValue index;
+  index.SetInteger(kVersionKey, kIndexVersion);
+  index.Set(kLibrariesKey, libraries_->DeepCopy());
+
+  std::string contents;
+  base::JSONWriter::Write(&index, &contents);
+  // Load() would ignore it anyway.
+  if (contents.size() > static_cast<size_t>(kMaxIndexSize)) {
+    LOG(WARNING) << "Not writing external extension index "
+                 << index_path_.AsUTF8Unsafe() << ", it is too big.";
+    return false;
+  }
+
+  // Read-only installations just load the libraries every time.
+  if (!file_util::PathIsWritable(index_path_.DirName()))
+    return false;
+
+  // Written to a temporary file first, so a crash or another process
+  // reading it never sees it half written.
+  if (!base::ImportantFileWriter::WriteFileAtomically(index_path_,
+                                                      contents)) {
+    LOG(WARNING) << "Couldn't write external extension index "
+                 << index_path_.AsUTF8Unsafe();
+    return false;
+  }
+
+  loaded_libraries_.reset(libraries_->DeepCopy());
+  changed_ = false;
+  return true;
+}
+
+}  // namespace extensions
+}  // namespace xwalk
@@ -0,0 +1,72 @@
+// Copyright (c) 2013 Intel Corporation. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef XWALK_EXTENSIONS_COMMON_XWALK_EXTERNAL_EXTENSION_INDEX_H_
+#define XWALK_EXTENSIONS_COMMON_XWALK_EXTERNAL_EXTENSION_INDEX_H_
+
+#include <string>
+#include "base/files/file_path.h"
+#include "base/memory/scoped_ptr.h"
+#include "base/platform_file.h"
+
+namespace base {
+class DictionaryValue;
+}
+
+namespace xwalk {
+namespace extensions {
+
+// Remembers the name, JavaScript API and instance mode of the external
+// extension libraries of a directory, so they can be registered at startup
+// without loading them. Entries are keyed by the path of the library, and are only valid while its
+// modification time and size stay the same.
+//
+// The index is a small JSON file. Failing to read or write it only means the
+// libraries are loaded as if it wasn't there.
+class XWalkExternalExtensionIndex {
+ public:
+  struct Entry {
+    Entry() : instance_per_process(false) {}
+    std::string name;
+    std::string js_api;
+    // Whether the library set XW_INSTANCE_PER_PROCESS.
+    bool instance_per_process;
+  };
+
+  explicit XWalkExternalExtensionIndex(const base::FilePath& index_path);
+  ~XWalkExternalExtensionIndex();
+
+  // Reads the index file, a missing or invalid one leaves the index empty.
+  void Load();
+
+  // Returns false if |library_path| is not in the index, or changed since it
+  // was added according to |info|. Libraries found are kept by Save().
+  bool Lookup(const base::FilePath& library_path,
+              const base::PlatformFileInfo& info, Entry* entry);
+
+  // Adds or replaces the entry of |library_path|.
+  void Update(const base::FilePath& library_path,
+              const base::PlatformFileInfo& info, const Entry& entry);
+
+  // Writes the index file if it changed. Only the libraries looked up or
+  // updated since Load() are written, so removed libraries are forgotten.
+  // Returns false without writing if the directory of the index isn't
+  // writable, or the index is bigger than Load() accepts.
+  bool Save();
+
+ private:
+  const base::FilePath index_path_;
+
+  // What was read by Load(), and what Save() will write.
+  scoped_ptr<base::DictionaryValue> loaded_libraries_;
+  scoped_ptr<base::DictionaryValue> libraries_;
+  bool changed_;
+
+  DISALLOW_COPY_AND_ASSIGN(XWalkExternalExtensionIndex);
+};
+
+}  // namespace extensions
+}  // namespace xwalk
+
+#endif  // XWALK_EXTENSIONS_COMMON_XWALK_EXTERNAL_EXTENSION_INDEX_H_
@@ -0,0 +1,155 @@
+// Copyright (c) 2013 Intel Corporation. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "xwalk/extensions/common/xwalk_external_extension_index.h"
+
+#include <string>
+#include "base/file_util.h"
+#include "base/files/scoped_temp_dir.h"
+#include "base/time/time.h"
+#include "testing/gtest/include/gtest/gtest.h"
+
+using xwalk::extensions::XWalkExternalExtensionIndex;
+
+namespace {
+
+base::PlatformFileInfo MakeFileInfo(int64 modified, int64 size) {
+  base::PlatformFileInfo info;
+  info.last_modified = base::Time::FromInternalValue(modified);
+  info.size = size;
+  return info;
+}
+
+XWalkExternalExtensionIndex::Entry MakeEntry(const std::string& name,
+                                             const std::string& js_api) {
+  XWalkExternalExtensionIndex::Entry entry;
+  entry.name = name;
+  entry.js_api = js_api;
+  return entry;
+}
+
+}  // namespace
+
+TEST(XWalkExternalExtensionIndexTest, SavedEntriesAreFound) {
+  base::ScopedTempDir temp_dir;
+  ASSERT_TRUE(temp_dir.CreateUniqueTempDir());
+  const base::FilePath index_path = temp_dir.path().AppendASCII("index");
+  const base::FilePath library = temp_dir.path().AppendASCII("libecho.so");
+  const base::PlatformFileInfo info = MakeFileInfo(1234567890123LL, 42);
+
+  {
+    XWalkExternalExtensionIndex index(index_path);
+    index.Load();
+    XWalkExternalExtensionIndex::Entry entry;
+    EXPECT_FALSE(index.Lookup(library, info, &entry));
+
+    XWalkExternalExtensionIndex::Entry echo =
+        MakeEntry("echo", "exports.x = 1;");
+    echo.instance_per_process = true;
+    index.Update(library, info, echo);
+    EXPECT_TRUE(index.Save());
+  }
+
+  XWalkExternalExtensionIndex index(index_path);
+  index.Load();
+  XWalkExternalExtensionIndex::Entry entry;
+  ASSERT_TRUE(index.Lookup(library, info, &entry));
+  EXPECT_EQ("echo", entry.name);
+  EXPECT_EQ("exports.x = 1;", entry.js_api);
+  EXPECT_TRUE(entry.instance_per_process);
+}
+
+TEST(XWalkExternalExtensionIndexTest, ChangedLibrariesAreNotFound) {
+  base::ScopedTempDir temp_dir;
+  ASSERT_TRUE(temp_dir.CreateUniqueTempDir());
+  const base::FilePath index_path = temp_dir.path().AppendASCII("index");
+  const base::FilePath library = temp_dir.path().AppendASCII("libecho.so");
+
+  {
+    XWalkExternalExtensionIndex index(index_path);
+    index.Update(library, MakeFileInfo(100, 42), MakeEntry("echo", ""));
+    EXPECT_TRUE(index.Save());
+  }
+
+  XWalkExternalExtensionIndex index(index_path);
+  index.Load();
+  XWalkExternalExtensionIndex::Entry entry;
+  EXPECT_FALSE(index.Lookup(library, MakeFileInfo(101, 42), &entry));
+  EXPECT_FALSE(index.Lookup(library, MakeFileInfo(100, 43), &entry));
+  EXPECT_FALSE(index.Lookup(temp_dir.path().AppendASCII("libother.so"),
+                            MakeFileInfo(100, 42), &entry));
+  EXPECT_TRUE(index.Lookup(library, MakeFileInfo(100, 42), &entry));
+}
+
+TEST(XWalkExternalExtensionIndexTest, LibrariesNotSeenAreForgotten) {
+  base::ScopedTempDir temp_dir;
+  ASSERT_TRUE(temp_dir.CreateUniqueTempDir());
+  const base::FilePath index_path = temp_dir.path().AppendASCII("index");
+  const base::FilePath kept = temp_dir.path().AppendASCII("libkept.so");
+  const base::FilePath removed = temp_dir.path().AppendASCII("libremoved.so");
+  const base::PlatformFileInfo info = MakeFileInfo(100, 42);
+
+  {
+    XWalkExternalExtensionIndex index(index_path);
+    index.Update(kept, info, MakeEntry("kept", ""));
+    index.Update(removed, info, MakeEntry("removed", ""));
+    EXPECT_TRUE(index.Save());
+  }
+
+  {
+    XWalkExternalExtensionIndex index(index_path);
+    index.Load();
+    XWalkExternalExtensionIndex::Entry entry;
+    EXPECT_TRUE(index.Lookup(kept, info, &entry));
+    EXPECT_TRUE(index.Save());
+  }
+
+  XWalkExternalExtensionIndex index(index_path);
+  index.Load();
+  XWalkExternalExtensionIndex::Entry entry;
+  EXPECT_TRUE(index.Lookup(kept, info, &entry));
+  EXPECT_FALSE(index.Lookup(removed, info, &entry));
+}
+
+TEST(XWalkExternalExtensionIndexTest, InvalidIndexIsIgnored) {
+  base::ScopedTempDir temp_dir;
+  ASSERT_TRUE(temp_dir.CreateUniqueTempDir());
+  const base::FilePath index_path = temp_dir.path().AppendASCII("index");
+
+  const std::string contents("{\"version\": 1, \"libraries\": [");
+  ASSERT_EQ(static_cast<int>(contents.size()),
+            file_util::WriteFile(index_path, contents.data(),
+                                 contents.size()));
+
+  XWalkExternalExtensionIndex index(index_path);
+  index.Load();
+  XWalkExternalExtensionIndex::Entry entry;
+  EXPECT_FALSE(index.Lookup(temp_dir.path().AppendASCII("libecho.so"),
+                            MakeFileInfo(100, 42), &entry));
+}
+
+TEST(XWalkExternalExtensionIndexTest, TooBigIndexIsNotWritten) {
+  base::ScopedTempDir temp_dir;
+  ASSERT_TRUE(temp_dir.CreateUniqueTempDir());
+  const base::FilePath index_path = temp_dir.path().AppendASCII("index");
+
+  XWalkExternalExtensionIndex index(index_path);
+  index.Update(temp_dir.path().AppendASCII("libbig.so"), MakeFileInfo(100, 42),
+               MakeEntry("big", std::string(5 * 1024 * 1024, 'x')));
+  EXPECT_FALSE(index.Save());
+  EXPECT_FALSE(file_util::PathExists(index_path));
+}
+
+TEST(XWalkExternalExtensionIndexTest, UnwritableDirectoryIsSkipped) {
+  base::ScopedTempDir temp_dir;
+  ASSERT_TRUE(temp_dir.CreateUniqueTempDir());
+  const base::FilePath index_path =
+      temp_dir.path().AppendASCII("missing").AppendASCII("index");
+
+  XWalkExternalExtensionIndex index(index_path);
+  index.Update(temp_dir.path().AppendASCII("libecho.so"),
+               MakeFileInfo(100, 42), MakeEntry("echo", ""));
+  EXPECT_FALSE(index.Save());
+  EXPECT_FALSE(file_util::PathExists(index_path));
+}
@@ -0,0 +1,229 @@
+// Copyright (c) 2013 Intel Corporation. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef XWALK_EXTENSIONS_COMMON_XWALK_EXTERNAL_HANDLE_TABLE_H_
+#define XWALK_EXTENSIONS_COMMON_XWALK_EXTERNAL_HANDLE_TABLE_H_
+
+#include <stdint.h>
+#include <deque>
+#include "base/atomicops.h"
+#include "base/basictypes.h"
+#include "base/logging.h"
+#include "base/synchronization/lock.h"
+#include "base/threading/platform_thread.h"
+
+namespace xwalk {
+namespace extensions {
+
+// Maps the integer handles given to external extensions (XW_Extension and
+// XW_Instance) to the objects implementing them.
+//
+// A handle holds the index of its slot in the table and the generation of
+// the slot when it was reserved, so handles of removed objects are told
+// apart from the handles of the objects reusing their slots later. Free slots
+// are reused in the order they were freed, and a slot is retired once its
+// generations run out, so a handle never resolves to another object.
+//
+// Lookups don't take any lock, they can happen from any thread while
+// objects are added and removed. Remove() waits for the lookups of the
+// object in progress to finish, so a ScopedLookup always sees a live object.
+// Adding and removing objects is serialized with a lock, which isn't held
+// while waiting, so the threads doing those lookups can add and remove other
+// objects meanwhile.
+template <typename T>
+class XWalkExternalHandleTable {
+ private:
+  struct Slot;
+
+ public:
+  // Keeps the object of |handle| alive while in scope. get() is NULL if the
+  // handle is invalid or its object was removed.
+  class ScopedLookup {
+   public:
+    ScopedLookup(XWalkExternalHandleTable* table, int32_t handle)
+        : slot_(NULL),
+          object_(NULL) {
+      table->Lookup(handle, &slot_, &object_);
+    }
+    ~ScopedLookup() {
+      if (slot_)
+        base::subtle::Barrier_AtomicIncrement(&slot_->readers, -1);
+    }
+
+    T* get() const { return object_; }
+    T* operator->() const { return object_; }
+
+   private:
+    Slot* slot_;
+    T* object_;
+
+    DISALLOW_COPY_AND_ASSIGN(ScopedLookup);
+  };
+
+  XWalkExternalHandleTable() : used_slots_(0) {
+    for (size_t i = 0; i < kMaxChunks; ++i)
+      chunks_[i] = 0;
+  }
+
+  ~XWalkExternalHandleTable() {
+    for (size_t i = 0; i < kMaxChunks; ++i)
+      delete[] reinterpret_cast<Slot*>(chunks_[i]);
+  }
+
+  // Returns a new handle, which doesn't resolve to any object until
+  // Publish() is called with it.
+  int32_t Reserve() {
+    base::AutoLock lock(lock_);
+
+    uint32_t index;
+    if (!free_slots_.empty()) {
+      index = free_slots_.front();
+      free_slots_.pop_front();
+    } else {
+      index = used_slots_++;
+      CHECK(index < kMaxSlots) << "Too many external extension handles.";
+      if (index % kChunkSize == 0) {
+        // Published after being initialized, for the lookups of other
+        // threads.
+        Slot* chunk = new Slot[kChunkSize];
+        base::subtle::Release_Store(&chunks_[index / kChunkSize],
+            reinterpret_cast<base::subtle::AtomicWord>(chunk));
+      }
+    }
+
+    Slot* slot = GetSlot(index);
+    return static_cast<int32_t>((slot->generation << kIndexBits) | index);
+  }
+
+  void Publish(int32_t handle, T* object) {
+    base::AutoLock lock(lock_);
+    Slot* slot = GetReservedSlot(handle);
+    CHECK(slot);
+    CHECK_EQ(0, base::subtle::NoBarrier_Load(&slot->handle));
+
+    base::subtle::NoBarrier_Store(&slot->object,
+        reinterpret_cast<base::subtle::AtomicWord>(object));
+    base::subtle::Release_Store(&slot->handle, handle);
+  }
+
+  // Invalidates |handle|, waiting for the lookups in other threads that
+  // already got its object. Removing an object from the thread holding a
+  // ScopedLookup of it would wait forever, e.g. an extension destroying an
+  // instance from a callback it got through that instance, so callers must
+  // release their lookup first.
+  void Remove(int32_t handle) {
+    Slot* slot;
+    {
+      base::AutoLock lock(lock_);
+      slot = GetReservedSlot(handle);
+      CHECK(slot);
+
+      // The slot isn't free until the lookups are done, but the handle is
+      // already stale for the other calls of Remove() and Publish().
+      base::subtle::NoBarrier_Store(&slot->handle, 0);
+      slot->generation++;
+    }
+
+    // Pairs with the barrier of the reader counting itself before checking
+    // the handle: either it sees the handle gone, or we see it reading.
+    base::subtle::MemoryBarrier();
+    while (base::subtle::Acquire_Load(&slot->readers))
+      base::PlatformThread::YieldCurrentThread();
+
+    base::AutoLock lock(lock_);
+    base::subtle::NoBarrier_Store(&slot->object, 0);
+    // Starting over would give the handles of old objects again.
+    if (slot->generation > kMaxGeneration)
+      return;
+    free_slots_.push_back(handle & kIndexMask);
+  }
+
+ private:
+  // Handles are positive int32_t values: 20 bits of index and 11 bits of
+  // generation, which starts at 1 so zero is never a valid handle.
+  static const uint32_t kIndexBits = 20;
+  static const uint32_t kIndexMask = (1u << kIndexBits) - 1;
+  static const uint32_t kMaxGeneration = (1u << (31 - kIndexBits)) - 1;
+  static const uint32_t kMaxSlots = 1u << kIndexBits;
+
+  // Slots are allocated in chunks that never move, so lookups can use them
+  // while the table grows.
+  static const uint32_t kChunkSize = 256;
+  static const uint32_t kMaxChunks = kMaxSlots / kChunkSize;
+
+  struct Slot {
+    Slot() : handle(0), object(0), readers(0), generation(1) {}
+
+    // The handle currently resolving to |object|, zero if none.
+    base::subtle::Atomic32 handle;
+    base::subtle::AtomicWord object;
+
+    // Lookups in progress.
+    base::subtle::Atomic32 readers;
+
+    // Guarded by |lock_|.
+    uint32_t generation;
+  };
+
+  Slot* GetSlot(uint32_t index) const {
+    if (index >= kMaxSlots)
+      return NULL;
+    Slot* chunk = reinterpret_cast<Slot*>(
+        base::subtle::Acquire_Load(&chunks_[index / kChunkSize]));
+    if (!chunk)
+      return NULL;
+    return &chunk[index % kChunkSize];
+  }
+
+  // Returns the slot of |handle| if it was reserved and not removed since.
+  // Must be called with |lock_| held.
+  Slot* GetReservedSlot(int32_t handle) const {
+    lock_.AssertAcquired();
+    if (handle <= 0)
+      return NULL;
+    uint32_t index = handle & kIndexMask;
+    if (index >= used_slots_)
+      return NULL;
+    Slot* slot = GetSlot(index);
+    if (slot->generation != (static_cast<uint32_t>(handle) >> kIndexBits))
+      return NULL;
+    return slot;
+  }
+
+  void Lookup(int32_t handle, Slot** slot_out, T** object_out) {
+    if (handle <= 0)
+      return;
+    Slot* slot = GetSlot(handle & kIndexMask);
+    if (!slot)
+      return;
+
+    // Counted before checking the handle, so Remove() waits for us if it
+    // didn't invalidate the handle yet.
+    base::subtle::Barrier_AtomicIncrement(&slot->readers, 1);
+    if (base::subtle::Acquire_Load(&slot->handle) != handle) {
+      base::subtle::Barrier_AtomicIncrement(&slot->readers, -1);
+      return;
+    }
+
+    *slot_out = slot;
+    *object_out = reinterpret_cast<T*>(
+        base::subtle::NoBarrier_Load(&slot->object));
+  }
+
+  base::subtle::AtomicWord chunks_[kMaxChunks];
+
+  base::Lock lock_;
+  // Slots ever reserved, the ones after them were never used.
+  uint32_t used_slots_;
+  // Oldest freed first, so a slot goes through its generations as slowly as
+  // possible.
+  std::deque<uint32_t> free_slots_;
+
+  DISALLOW_COPY_AND_ASSIGN(XWalkExternalHandleTable);
+};
+
+}  // namespace extensions
+}  // namespace xwalk
+
+#endif  // XWALK_EXTENSIONS_COMMON_XWALK_EXTERNAL_HANDLE_TABLE_H_
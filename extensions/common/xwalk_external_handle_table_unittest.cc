@@ -0,0 +1,272 @@
+// Copyright (c) 2013 Intel Corporation. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "xwalk/extensions/common/xwalk_external_handle_table.h"
+
+#include <set>
+#include <vector>
+#include "base/atomicops.h"
+#include "base/memory/scoped_vector.h"
+#include "base/synchronization/waitable_event.h"
+#include "base/threading/platform_thread.h"
+#include "base/threading/simple_thread.h"
+#include "base/time/time.h"
+#include "testing/gtest/include/gtest/gtest.h"
+
+using xwalk::extensions::XWalkExternalHandleTable;
+
+namespace {
+
+const int kAlive = 0x600d;
+const int kDead = 0xdead;
+
+struct TestObject {
+  TestObject() : state(kAlive) {}
+  ~TestObject() { state = kDead; }
+  int state;
+};
+
+typedef XWalkExternalHandleTable<TestObject> TestTable;
+
+int32_t Add(TestTable* table, TestObject* object) {
+  int32_t handle = table->Reserve();
+  table->Publish(handle, object);
+  return handle;
+}
+
+TestObject* Get(TestTable* table, int32_t handle) {
+  TestTable::ScopedLookup lookup(table, handle);
+  return lookup.get();
+}
+
+// Looks up the handles in |handles| until told to stop, checking that every
+// object found is alive. Plays an extension thread calling PostMessage().
+class LookupThread : public base::DelegateSimpleThread::Delegate {
+ public:
+  LookupThread(TestTable* table, base::subtle::Atomic32* handles,
+               int handle_count, base::subtle::Atomic32* stop)
+      : table_(table),
+        handles_(handles),
+        handle_count_(handle_count),
+        stop_(stop),
+        found_(0),
+        missed_(0) {}
+
+  virtual void Run() OVERRIDE {
+    int i = 0;
+    while (!base::subtle::Acquire_Load(stop_)) {
+      int32_t handle =
+          base::subtle::NoBarrier_Load(&handles_[i++ % handle_count_]);
+      TestTable::ScopedLookup lookup(table_, handle);
+      if (!lookup.get()) {
+        missed_++;
+        continue;
+      }
+      EXPECT_EQ(kAlive, lookup->state);
+      found_++;
+    }
+  }
+
+  int found() const { return found_; }
+  int missed() const { return missed_; }
+
+ private:
+  TestTable* table_;
+  base::subtle::Atomic32* handles_;
+  int handle_count_;
+  base::subtle::Atomic32* stop_;
+  int found_;
+  int missed_;
+};
+
+// Holds a lookup of |handle| and, while the main thread is removing it, adds
+// and removes another object before letting the lookup go. Plays an
+// extension creating and destroying instances from another thread.
+class ReentrantThread : public base::DelegateSimpleThread::Delegate {
+ public:
+  ReentrantThread(TestTable* table, int32_t handle)
+      : table_(table),
+        handle_(handle),
+        looked_up_(false, false) {}
+
+  virtual void Run() OVERRIDE {
+    TestTable::ScopedLookup lookup(table_, handle_);
+    EXPECT_TRUE(lookup.get());
+    looked_up_.Signal();
+
+    // Gives the main thread time to get into Remove().
+    base::PlatformThread::Sleep(base::TimeDelta::FromMilliseconds(50));
+    TestObject other;
+    table_->Remove(Add(table_, &other));
+  }
+
+  void WaitForLookup() { looked_up_.Wait(); }
+
+ private:
+  TestTable* table_;
+  int32_t handle_;
+  base::WaitableEvent looked_up_;
+};
+
+}  // namespace
+
+TEST(XWalkExternalHandleTableTest, HandlesResolveToTheirObjects) {
+  TestTable table;
+  TestObject a, b;
+  int32_t handle_a = Add(&table, &a);
+  int32_t handle_b = Add(&table, &b);
+
+  EXPECT_GT(handle_a, 0);
+  EXPECT_GT(handle_b, 0);
+  EXPECT_NE(handle_a, handle_b);
+  EXPECT_EQ(&a, Get(&table, handle_a));
+  EXPECT_EQ(&b, Get(&table, handle_b));
+
+  EXPECT_EQ(NULL, Get(&table, 0));
+  EXPECT_EQ(NULL, Get(&table, -1));
+  EXPECT_EQ(NULL, Get(&table, handle_b + 1));
+
+  table.Remove(handle_a);
+  table.Remove(handle_b);
+}
+
+TEST(XWalkExternalHandleTableTest, ReservedHandleIsNotResolved) {
+  TestTable table;
+  TestObject object;
+  int32_t handle = table.Reserve();
+  EXPECT_EQ(NULL, Get(&table, handle));
+
+  table.Publish(handle, &object);
+  EXPECT_EQ(&object, Get(&table, handle));
+  table.Remove(handle);
+}
+
+TEST(XWalkExternalHandleTableTest, StaleHandlesAreDetected) {
+  TestTable table;
+  TestObject old_object, new_object;
+  int32_t old_handle = Add(&table, &old_object);
+  table.Remove(old_handle);
+  EXPECT_EQ(NULL, Get(&table, old_handle));
+
+  // The new object reuses the slot, under a different handle.
+  int32_t new_handle = Add(&table, &new_object);
+  EXPECT_NE(old_handle, new_handle);
+  EXPECT_EQ(NULL, Get(&table, old_handle));
+  EXPECT_EQ(&new_object, Get(&table, new_handle));
+  table.Remove(new_handle);
+}
+
+// Enough cycles of a single slot to go through all its generations, which
+// must not give any handle twice.
+TEST(XWalkExternalHandleTableTest, HandlesAreNeverReused) {
+  TestTable table;
+  TestObject object;
+  std::set<int32_t> handles;
+  for (int i = 0; i < 5000; ++i) {
+    int32_t handle = Add(&table, &object);
+    EXPECT_TRUE(handles.insert(handle).second);
+    table.Remove(handle);
+  }
+  std::set<int32_t>::const_iterator it = handles.begin();
+  for (; it != handles.end(); ++it)
+    EXPECT_EQ(NULL, Get(&table, *it));
+}
+
+TEST(XWalkExternalHandleTableTest, FreedSlotsAreReusedInOrder) {
+  TestTable table;
+  TestObject a, b, c;
+  int32_t handle_a = Add(&table, &a);
+  int32_t handle_b = Add(&table, &b);
+  table.Remove(handle_a);
+  table.Remove(handle_b);
+
+  // Slot of |a| first, as it was freed first.
+  int32_t handle_c = Add(&table, &c);
+  EXPECT_EQ(handle_a & 0xfffff, handle_c & 0xfffff);
+  table.Remove(handle_c);
+}
+
+TEST(XWalkExternalHandleTableTest, RemoveLetsReadersUseTheTable) {
+  TestTable table;
+  TestObject object;
+  int32_t handle = Add(&table, &object);
+
+  ReentrantThread delegate(&table, handle);
+  base::DelegateSimpleThread thread(&delegate, "ReentrantThread");
+  thread.Start();
+  delegate.WaitForLookup();
+
+  // Returns once the other thread is done with its lookup, which needs the
+  // table meanwhile.
+  table.Remove(handle);
+  EXPECT_EQ(NULL, Get(&table, handle));
+  thread.Join();
+}
+
+TEST(XWalkExternalHandleTableTest, GrowsBeyondOneChunk) {
+  TestTable table;
+  const int kObjects = 1000;
+  ScopedVector<TestObject> objects;
+  std::vector<int32_t> handles;
+  for (int i = 0; i < kObjects; ++i) {
+    objects.push_back(new TestObject);
+    handles.push_back(Add(&table, objects.back()));
+  }
+
+  for (int i = 0; i < kObjects; ++i) {
+    EXPECT_EQ(objects[i], Get(&table, handles[i]));
+    table.Remove(handles[i]);
+  }
+}
+
+// Many threads look objects up while they are added and removed. Objects are
+// deleted right after being removed, so a lookup getting a removed object
+// would see it dead.
+TEST(XWalkExternalHandleTableTest, StressLookupsWhileAddingAndRemoving) {
+  TestTable table;
+  const int kHandles = 64;
+  const int kThreads = 8;
+  const int kIterations = 20000;
+
+  base::subtle::Atomic32 handles[kHandles];
+  TestObject* objects[kHandles];
+  for (int i = 0; i < kHandles; ++i) {
+    objects[i] = new TestObject;
+    handles[i] = Add(&table, objects[i]);
+  }
+
+  base::subtle::Atomic32 stop = 0;
+  ScopedVector<LookupThread> delegates;
+  ScopedVector<base::DelegateSimpleThread> threads;
+  for (int i = 0; i < kThreads; ++i) {
+    delegates.push_back(new LookupThread(&table, handles, kHandles, &stop));
+    threads.push_back(
+        new base::DelegateSimpleThread(delegates.back(), "LookupThread"));
+    threads.back()->Start();
+  }
+
+  // Stale handles stay visible to the lookup threads for a while, as the old
+  // handle is replaced only after the object is gone.
+  for (int i = 0; i < kIterations; ++i) {
+    int index = i % kHandles;
+    int32_t old_handle = base::subtle::NoBarrier_Load(&handles[index]);
+    table.Remove(old_handle);
+    delete objects[index];
+
+    objects[index] = new TestObject;
+    base::subtle::NoBarrier_Store(&handles[index],
+                                  Add(&table, objects[index]));
+  }
+
+  base::subtle::Release_Store(&stop, 1);
+  for (int i = 0; i < kThreads; ++i) {
+    threads[i]->Join();
+    EXPECT_GT(delegates[i]->found() + delegates[i]->missed(), 0);
+  }
+
+  for (int i = 0; i < kHandles; ++i) {
+    table.Remove(handles[i]);
+    delete objects[i];
+  }
+}
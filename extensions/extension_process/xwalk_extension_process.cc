@@ -0,0 +1,102 @@
+// Copyright (c) 2013 Intel Corporation. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "xwalk/extensions/extension_process/xwalk_extension_process.h"
+
+#include <string>
+#include <vector>
+#include "base/command_line.h"
+#include "base/files/file_path.h"
+#include "base/message_loop/message_loop.h"
+#include "content/public/common/content_switches.h"
+#include "ipc/ipc_channel_handle.h"
+#include "ipc/ipc_channel_proxy.h"
+#include "xwalk/extensions/common/xwalk_extension.h"
+#include "xwalk/extensions/common/xwalk_extension_messages.h"
+#include "xwalk/extensions/common/xwalk_extension_server.h"
+#include "xwalk/extensions/common/xwalk_extension_set.h"
+
+namespace xwalk {
+namespace extensions {
+
+XWalkExtensionProcess::XWalkExtensionProcess()
+    : io_thread_("XWalkExtensionProcess_IOThread"),
+      extensions_(new XWalkExtensionSet),
+      server_(new XWalkExtensionServer(extensions_)) {
+  io_thread_.StartWithOptions(
+      base::Thread::Options(base::MessageLoop::TYPE_IO, 0));
+
+  std::string channel_id = CommandLine::ForCurrentProcess()->
+      GetSwitchValueASCII(switches::kProcessChannelID);
+  browser_channel_.reset(new IPC::ChannelProxy(
+      channel_id, IPC::Channel::MODE_CLIENT, this,
+      io_thread_.message_loop_proxy().get()));
+}
+
+XWalkExtensionProcess::~XWalkExtensionProcess() {
+  server_->Invalidate();
+  render_process_channel_.reset();
+  browser_channel_.reset();
+  io_thread_.Stop();
+  server_.reset();
+}
+
+bool XWalkExtensionProcess::OnMessageReceived(const IPC::Message& message) {
+  bool handled = true;
+  IPC_BEGIN_MESSAGE_MAP(XWalkExtensionProcess, message)
+    IPC_MESSAGE_HANDLER(XWalkExtensionProcessMsg_RegisterExtensions,
+        OnRegisterExtensions)
+    IPC_MESSAGE_UNHANDLED(handled = false)
+  IPC_END_MESSAGE_MAP()
+
+  return handled;
+}
+
+void XWalkExtensionProcess::OnChannelError() {
+  // The browser is gone, or decided to kill us.
+  base::MessageLoop::current()->Quit();
+}
+
+void XWalkExtensionProcess::OnRegisterExtensions(
+    const base::FilePath& extensions_path) {
+  if (!extensions_path.empty())
+    RegisterExternalExtensionsInDirectory(extensions_.get(), extensions_path);
+
+  // The browser tells the render process about the extensions, together
+  // with the channel to reach them.
+  std::vector<std::string> names;
+  std::vector<std::string> apis;
+  extensions_->GetJavaScriptAPIs(&names, &apis);
+  for (size_t i = 0; i < names.size(); ++i) {
+    browser_channel_->Send(
+        new XWalkExtensionClientMsg_RegisterExtension(names[i], apis[i]));
+  }
+
+  CreateRenderProcessChannel();
+}
+
+void XWalkExtensionProcess::CreateRenderProcessChannel() {
+  IPC::ChannelHandle handle(IPC::Channel::GenerateVerifiedChannelID(
+      std::string()));
+  render_process_channel_.reset(new IPC::ChannelProxy(
+      handle, IPC::Channel::MODE_SERVER, server_.get(),
+      io_thread_.message_loop_proxy().get()));
+
+#if defined(OS_POSIX)
+  // The render process can't open our socket by name, so the browser passes
+  // the client end along.
+  handle.socket = base::FileDescriptor(
+      render_process_channel_->TakeClientFileDescriptor(), true);
+#endif
+
+  // Being connected to the render process itself, the server can share
+  // memory segments with it.
+  server_->Initialize(render_process_channel_.get());
+
+  browser_channel_->Send(
+      new XWalkExtensionProcessHostMsg_RenderProcessChannelCreated(handle));
+}
+
+}  // namespace extensions
+}  // namespace xwalk
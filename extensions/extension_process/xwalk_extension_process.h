@@ -0,0 +1,58 @@
+// Copyright (c) 2013 Intel Corporation. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef XWALK_EXTENSIONS_EXTENSION_PROCESS_XWALK_EXTENSION_PROCESS_H_
+#define XWALK_EXTENSIONS_EXTENSION_PROCESS_XWALK_EXTENSION_PROCESS_H_
+
+#include "base/memory/ref_counted.h"
+#include "base/memory/scoped_ptr.h"
+#include "base/threading/thread.h"
+#include "ipc/ipc_listener.h"
+
+namespace base {
+class FilePath;
+}
+
+namespace IPC {
+class ChannelProxy;
+}
+
+namespace xwalk {
+namespace extensions {
+
+class XWalkExtensionServer;
+class XWalkExtensionSet;
+
+// Main object of the extension process. It hosts the external extensions in
+// an XWalkExtensionServer, which talks directly to the render process the
+// extension process was launched for: the browser only hands it the channel
+// created here. See XWalkExtensionProcessHost for the browser side.
+class XWalkExtensionProcess : public IPC::Listener {
+ public:
+  XWalkExtensionProcess();
+  virtual ~XWalkExtensionProcess();
+
+ private:
+  // IPC::Listener implementation.
+  virtual bool OnMessageReceived(const IPC::Message& message) OVERRIDE;
+  virtual void OnChannelError() OVERRIDE;
+
+  void OnRegisterExtensions(const base::FilePath& extensions_path);
+
+  void CreateRenderProcessChannel();
+
+  base::Thread io_thread_;
+
+  scoped_refptr<XWalkExtensionSet> extensions_;
+  scoped_ptr<XWalkExtensionServer> server_;
+  scoped_ptr<IPC::ChannelProxy> browser_channel_;
+  scoped_ptr<IPC::ChannelProxy> render_process_channel_;
+
+  DISALLOW_COPY_AND_ASSIGN(XWalkExtensionProcess);
+};
+
+}  // namespace extensions
+}  // namespace xwalk
+
+#endif  // XWALK_EXTENSIONS_EXTENSION_PROCESS_XWALK_EXTENSION_PROCESS_H_
@@ -0,0 +1,31 @@
+// Copyright (c) 2013 Intel Corporation. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "xwalk/extensions/extension_process/xwalk_extension_process_main.h"
+
+#include "base/message_loop/message_loop.h"
+#include "base/threading/platform_thread.h"
+#include "content/public/common/main_function_params.h"
+#include "xwalk/extensions/common/xwalk_extension_threaded_runner.h"
+#include "xwalk/extensions/extension_process/xwalk_extension_process.h"
+
+namespace xwalk {
+namespace extensions {
+
+int XWalkExtensionProcessMain(const content::MainFunctionParams& parameters) {
+  base::MessageLoop main_message_loop(base::MessageLoop::TYPE_DEFAULT);
+  base::PlatformThread::SetName("XWalkExtensionProcess");
+
+  XWalkExtensionThreadedRunner::InitializeWorkerPool();
+  {
+    XWalkExtensionProcess extension_process;
+    base::MessageLoop::current()->Run();
+  }
+  XWalkExtensionThreadedRunner::ShutdownWorkerPool();
+
+  return 0;
+}
+
+}  // namespace extensions
+}  // namespace xwalk
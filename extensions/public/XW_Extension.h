@@ -21,7 +21,10 @@
 // can call the extension at specific situations.
 //
 // Crosswalk won't call an extension's XW_Initialize() multiple times in the
-// same process.
+// same process. Extensions seen in a previous launch can be initialized only
+// when their first instance is created, in which case XW_Initialize() runs on
+// the thread of that instance, not on the thread that loaded the others, so
+// it must not rely on the thread it is called from.
 
 #ifdef __cplusplus
 extern "C" {
@@ -33,6 +36,7 @@ extern "C" {
 #define XW_EXPORT __declspec(dllexport)
 #endif
 
+#include <stddef.h>
 #include <stdint.h>
 
 
@@ -154,7 +158,8 @@ typedef struct XW_CoreInterface_1 XW_CoreInterface;
 //
 
 #define XW_MESSAGING_INTERFACE_1 "XW_MessagingInterface_1"
-#define XW_MESSAGING_INTERFACE XW_MESSAGING_INTERFACE_1
+#define XW_MESSAGING_INTERFACE_2 "XW_MessagingInterface_2"
+#define XW_MESSAGING_INTERFACE XW_MESSAGING_INTERFACE_2
 
 typedef void (*XW_HandleMessageCallback)(XW_Instance instance,
                                          const char* message);
@@ -176,7 +181,56 @@ struct XW_MessagingInterface_1 {
   void (*PostMessage)(XW_Instance instance, const char* message);
 };
 
-typedef struct XW_MessagingInterface_1 XW_MessagingInterface;
+// Binary messages are ArrayBuffers on the JavaScript side: posted with
+// extension.postMessage(arrayBuffer), and given to the message listener as
+// ArrayBuffers. The bytes are passed as is, without any encoding.
+//
+// The data given to the callback is only valid during the call.
+typedef void (*XW_HandleBinaryMessageCallback)(XW_Instance instance,
+                                               const void* data,
+                                               size_t size);
+
+// Called once Crosswalk is done with a buffer given to
+// PostBinaryMessageBuffer(), possibly from another thread.
+typedef void (*XW_FreeBufferCallback)(void* data, size_t size,
+                                      void* user_data);
+
+struct XW_MessagingInterface_2 {
+  // Same as in XW_MessagingInterface_1.
+  void (*Register)(XW_Extension extension,
+                   XW_HandleMessageCallback handle_message);
+  void (*PostMessage)(XW_Instance instance, const char* message);
+
+  // Register a callback to be called when the JavaScript code posts an
+  // ArrayBuffer. Without it, binary messages are given to the
+  // XW_HandleMessageCallback as strings, which are cut at the first zero
+  // byte.
+  void (*RegisterBinaryMessageCallback)(
+      XW_Extension extension,
+      XW_HandleBinaryMessageCallback handle_binary_message);
+
+  // Post |size| bytes from |data| to the web content associated with the
+  // instance, the data is copied before returning.
+  //
+  // This function is thread-safe and can be called until the instance is
+  // destroyed.
+  void (*PostBinaryMessage)(XW_Instance instance, const void* data,
+                            size_t size);
+
+  // Same as PostBinaryMessage(), but Crosswalk takes ownership of |data|
+  // instead of copying it right away. The extension must not touch the
+  // buffer after the call, |free_buffer| is called with |user_data| when
+  // Crosswalk doesn't need it anymore, or if the message can't be posted.
+  // This saves the copy made by PostBinaryMessage(), but the bytes are still
+  // copied once to reach the web content, into the IPC message or into
+  // shared memory for large messages, after which the buffer is freed.
+  void (*PostBinaryMessageBuffer)(XW_Instance instance, void* data,
+                                  size_t size,
+                                  XW_FreeBufferCallback free_buffer,
+                                  void* user_data);
+};
+
+typedef struct XW_MessagingInterface_2 XW_MessagingInterface;
 
 #ifdef __cplusplus
 }  // extern "C"
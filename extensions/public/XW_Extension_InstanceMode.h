@@ -0,0 +1,52 @@
+// Copyright (c) 2013 Intel Corporation. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef XWALK_EXTENSIONS_PUBLIC_XW_EXTENSION_INSTANCEMODE_H_
+#define XWALK_EXTENSIONS_PUBLIC_XW_EXTENSION_INSTANCEMODE_H_
+
+// NOTE: This file and interfaces marked as internal are not considered stable
+// and can be modified in incompatible ways between Crosswalk versions.
+
+#ifndef XWALK_EXTENSIONS_PUBLIC_XW_EXTENSION_H_
+#error "You should include XW_Extension.h before this file"
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//
+// XW_INTERNAL_INSTANCE_MODE_INTERFACE: allow an extension that keeps no
+// state per frame to have a single instance in each render process.
+//
+
+#define XW_INTERNAL_INSTANCE_MODE_INTERFACE_1 \
+  "XW_InternalInstanceModeInterface_1"
+#define XW_INTERNAL_INSTANCE_MODE_INTERFACE \
+  XW_INTERNAL_INSTANCE_MODE_INTERFACE_1
+
+enum {
+  // The default, each frame gets an XW_Instance of its own.
+  XW_INSTANCE_PER_CONTEXT = 0,
+  // A single XW_Instance serves all the frames of a render process. The
+  // messages of every frame arrive to its callbacks, and PostMessage() goes
+  // to all of them. Replies to sync messages go to the frame that sent them.
+  XW_INSTANCE_PER_PROCESS = 1
+};
+
+typedef int32_t XW_InstanceMode;
+
+struct XW_Internal_InstanceModeInterface_1 {
+  // Can only be called during XW_Initialize().
+  void (*SetInstanceMode)(XW_Extension extension, XW_InstanceMode mode);
+};
+
+typedef struct XW_Internal_InstanceModeInterface_1
+    XW_Internal_InstanceModeInterface;
+
+#ifdef __cplusplus
+}  // extern "C"
+#endif
+
+#endif  // XWALK_EXTENSIONS_PUBLIC_XW_EXTENSION_INSTANCEMODE_H_
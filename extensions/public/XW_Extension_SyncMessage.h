@@ -24,8 +24,10 @@ extern "C" {
 
 #define XW_INTERNAL_SYNC_MESSAGING_INTERFACE_1 \
   "XW_InternalSyncMessagingInterface_1"
+#define XW_INTERNAL_SYNC_MESSAGING_INTERFACE_2 \
+  "XW_InternalSyncMessagingInterface_2"
 #define XW_INTERNAL_SYNC_MESSAGING_INTERFACE \
-  XW_INTERNAL_SYNC_MESSAGING_INTERFACE_1
+  XW_INTERNAL_SYNC_MESSAGING_INTERFACE_2
 
 typedef void (*XW_HandleSyncMessageCallback)(XW_Instance instance,
                                              const char* message);
@@ -36,7 +38,30 @@ struct XW_Internal_SyncMessagingInterface_1 {
   void (*SetSyncReply)(XW_Instance instance, const char* reply);
 };
 
-typedef struct XW_Internal_SyncMessagingInterface_1
+// Identifies a synchronous message whose reply was deferred. Zero is never a
+// valid token.
+typedef int32_t XW_SyncReplyToken;
+
+struct XW_Internal_SyncMessagingInterface_2 {
+  void (*Register)(XW_Extension extension,
+                   XW_HandleSyncMessageCallback handle_sync_message);
+  void (*SetSyncReply)(XW_Instance instance, const char* reply);
+
+  // Called from the XW_HandleSyncMessageCallback instead of SetSyncReply(),
+  // to give the reply after the callback returns, e.g. once the work is done
+  // in a thread of the extension. The JavaScript code stays blocked until
+  // SetDeferredSyncReply() is called with the token. Returns zero if called
+  // outside the callback.
+  XW_SyncReplyToken (*DeferSyncReply)(XW_Instance instance);
+
+  // Replies to the message of |token|. Can be called from any thread, once
+  // per token. Messages still waiting for a reply when the instance is
+  // destroyed get null in JavaScript.
+  void (*SetDeferredSyncReply)(XW_Instance instance, XW_SyncReplyToken token,
+                               const char* reply);
+};
+
+typedef struct XW_Internal_SyncMessagingInterface_2
     XW_Internal_SyncMessagingInterface;
 
 #ifdef __cplusplus
@@ -5,41 +5,312 @@
 var xwalk = xwalk || {};
 
 xwalk._setupExtensionInternal = function(extension_obj) {
-  var callback_listeners = {};
-  var callback_id = 0;
+  // Callbacks waiting for replies of the extension are kept in a table of
+  // slots, reused once the callback is released, so a stream of calls doesn't
+  // allocate nor turns the table into a dictionary. The id of a callback
+  // combines its slot and the generation of the slot, which changes each time
+  // the slot is released, so late replies to a released callback are dropped
+  // instead of reaching the one reusing its slot. Slot 0 is never used, an id
+  // of 0 means there is no callback. Ids always fit in a small integer.
+  var kSlotBits = 20;
+  var kMaxSlots = 1 << kSlotBits;
+  var kSlotMask = kMaxSlots - 1;
+  var kMaxGenerations = 1 << 10;
+  var kInitialSlots = 64;
 
-  function wrapCallback(args, callback) {
-    if (callback) {
-      var id = (callback_id++).toString();
-      callback_listeners[id] = callback;
-      args.unshift(id);
-    } else {
-      // The function name and the callback ID are prepended before
-      // the arguments. If there is no callback, an empty string is
-      // should be used. This will be sorted out by the InternalInstance
-      // message handler.
-      args.unshift("");
+  var callbacks = [];
+  var generations = [];
+  var multi_shot = [];
+  var free_slots = [];
+
+  function growSlots() {
+    var size = callbacks.length;
+    var new_size = Math.min(size ? size * 2 : kInitialSlots, kMaxSlots);
+    if (new_size == size)
+      throw new Error("Too many callbacks waiting for the extension");
+
+    for (var i = size; i < new_size; i++) {
+      callbacks.push(null);
+      generations.push(0);
+      multi_shot.push(false);
     }
+    // Lower slots are handed out first.
+    for (var i = new_size - 1; i >= size && i > 0; i--)
+      free_slots.push(i);
   }
 
-  extension_obj.setMessageListener(function(msg) {
-    var args = arguments[0];
-    var id = args.shift();
-    var listener = callback_listeners[id];
+  function releaseSlot(slot) {
+    callbacks[slot] = null;
+    generations[slot] = (generations[slot] + 1) % kMaxGenerations;
+    free_slots.push(slot);
+  }
+
+  // Returns the slot of the callback with |id|, or 0 if it was released.
+  function slotOf(id) {
+    if (typeof id !== "number")
+      return 0;
+    var slot = id & kSlotMask;
+    if (slot >= callbacks.length || callbacks[slot] === null ||
+        generations[slot] !== (id >>> kSlotBits))
+      return 0;
+    return slot;
+  }
+
+  // Multi-shot callbacks stay registered until released with
+  // _internal.unsubscribe(), the others are released by their reply.
+  function wrapCallback(callback, is_multi_shot) {
+    if (!callback)
+      return 0;
+    if (free_slots.length == 0)
+      growSlots();
+    var slot = free_slots.pop();
+    callbacks[slot] = callback;
+    multi_shot[slot] = is_multi_shot;
+    return generations[slot] * kMaxSlots + slot;
+  }
 
-    if (listener !== undefined) {
-      listener.apply(null, args);
-      delete callback_listeners[id];
+  growSlots();
+
+  // Listeners of each event, indexed by event id. The native side is only
+  // told when an event gets its first listener or loses its last one, and
+  // sends each event once for all of them. The lists are replaced instead of
+  // modified, so dispatching doesn't need to copy them in case a listener
+  // removes itself.
+  var kEventListenersChangedFunctionId = -1;
+  var event_listeners = [];
+
+  function dispatchEvent(event_id, args) {
+    var listeners = event_listeners[event_id];
+    if (!listeners)
+      return;
+    for (var i = 0; i < listeners.length; i++)
+      listeners[i].apply(null, args);
+  }
+
+  // Replies are [callback_id, [results]], see
+  // XWalkInternalExtensionInstance::PostResult(). Events are
+  // [0, event_id, [args]], see XWalkInternalExtensionInstance::DispatchEvent().
+  extension_obj.setMessageListener(function(msg) {
+    if (msg[0] === 0) {
+      dispatchEvent(msg[1], msg[2]);
+      return;
     }
+
+    var slot = slotOf(msg[0]);
+    if (!slot)
+      return;
+
+    // Released before running it, so the callback can post new messages that
+    // reuse the slot, and an exception doesn't leak it.
+    var callback = callbacks[slot];
+    if (!multi_shot[slot])
+      releaseSlot(slot);
+    callback.apply(null, msg[1]);
   });
 
   // All Internal Extensions functions should only be exposed by
   // this _internal object, acting like a namespace.
   extension_obj._internal = {};
 
-  extension_obj._internal.postMessage = function(function_name, args, callback) {
-    wrapCallback(args, callback);
-    args.unshift(function_name);
-    extension_obj.postMessage(args);
+  // Posts the message for |callback_id|, releasing its callback if the
+  // extension refused it, see XWalkExtension::QueueFullPolicy. No reply
+  // would ever come for it.
+  function postWithCallback(function_id, callback_id, args) {
+    if (extension_obj.postMessage([function_id, callback_id, args]))
+      return true;
+    var slot = slotOf(callback_id);
+    if (slot)
+      releaseSlot(slot);
+    return false;
+  }
+
+  // The function is identified by its id in the 'functionIds' generated from
+  // the IDL of the extension. The arguments are sent as a list of their own,
+  // after the function and the callback IDs. The callback runs once, with the
+  // results of the function. Returns false if the message couldn't be sent.
+  extension_obj._internal.postMessage = function(function_id, args, callback) {
+    return postWithCallback(function_id, wrapCallback(callback, false), args);
+  };
+
+  // Like postMessage(), but the callback runs with every result posted for
+  // it, e.g. for event subscriptions. Returns the id of the callback, to be
+  // passed to unsubscribe() once the extension won't be posting results for
+  // it anymore, or 0 if the message couldn't be sent.
+  extension_obj._internal.subscribe = function(function_id, args, callback) {
+    var callback_id = wrapCallback(callback, true);
+    if (!postWithCallback(function_id, callback_id, args))
+      return 0;
+    return callback_id;
+  };
+
+  extension_obj._internal.unsubscribe = function(callback_id) {
+    var slot = slotOf(callback_id);
+    if (slot && multi_shot[slot])
+      releaseSlot(slot);
+  };
+
+  // The listener runs with the arguments of each event with |event_id|, one
+  // of the 'eventIds' generated from the IDL of the extension. Adding the
+  // same listener twice has no effect.
+  extension_obj._internal.addListener = function(event_id, listener) {
+    var listeners = event_listeners[event_id] || [];
+    if (listeners.indexOf(listener) != -1)
+      return;
+
+    event_listeners[event_id] = listeners.concat(listener);
+    if (listeners.length == 0) {
+      extension_obj.postMessage(
+          [kEventListenersChangedFunctionId, 0, [event_id, true]]);
+    }
+  };
+
+  extension_obj._internal.removeListener = function(event_id, listener) {
+    var listeners = event_listeners[event_id];
+    if (!listeners || listeners.indexOf(listener) == -1)
+      return;
+
+    event_listeners[event_id] = listeners.filter(function(l) {
+      return l !== listener;
+    });
+    if (listeners.length == 1) {
+      extension_obj.postMessage(
+          [kEventListenersChangedFunctionId, 0, [event_id, false]]);
+    }
+  };
+};
+
+// V8 doesn't provide Promise yet, so extension.request() returns this minimal
+// thenable instead. It follows the Promises/A+ resolution rules, including
+// adopting the state of thenables, and never runs callbacks synchronously.
+xwalk._Promise = (function() {
+  if (typeof Promise === "function")
+    return Promise;
+
+  // Implemented by the renderer, see XWalkAPIExtension. Callbacks due in the
+  // same turn share a single task.
+  native function RunAsync();
+  var queue = [];
+
+  function runQueue() {
+    var callbacks = queue;
+    queue = [];
+    for (var i = 0; i < callbacks.length; i++)
+      callbacks[i]();
+  }
+
+  function runAsync(callback) {
+    queue.push(callback);
+    if (queue.length === 1)
+      RunAsync(runQueue);
+  }
+
+  function ThenablePromise(executor) {
+    var self = this;
+    var done = false;
+    this._state = "pending";
+    this._value = undefined;
+    this._handlers = [];
+
+    function settle(state, value) {
+      var handlers = self._handlers;
+      self._state = state;
+      self._value = value;
+      self._handlers = null;
+      for (var i = 0; i < handlers.length; i++)
+        runAsync(handlers[i]);
+    }
+
+    function adopt(value) {
+      if (value === self) {
+        settle("rejected", new TypeError("Promise resolved with itself"));
+        return;
+      }
+      if (value && (typeof value === "object" || typeof value === "function")) {
+        var then;
+        try {
+          then = value.then;
+        } catch (e) {
+          settle("rejected", e);
+          return;
+        }
+        if (typeof then === "function") {
+          var called = false;
+          try {
+            then.call(value, function(v) {
+              if (!called) { called = true; adopt(v); }
+            }, function(e) {
+              if (!called) { called = true; settle("rejected", e); }
+            });
+          } catch (e) {
+            if (!called) { called = true; settle("rejected", e); }
+          }
+          return;
+        }
+      }
+      settle("fulfilled", value);
+    }
+
+    function resolve(value) {
+      if (done) return;
+      done = true;
+      adopt(value);
+    }
+
+    function reject(reason) {
+      if (done) return;
+      done = true;
+      settle("rejected", reason);
+    }
+
+    try {
+      executor(resolve, reject);
+    } catch (e) {
+      reject(e);
+    }
+  }
+
+  ThenablePromise.prototype.then = function(onFulfilled, onRejected) {
+    var self = this;
+    return new ThenablePromise(function(resolve, reject) {
+      function run() {
+        var fulfilled = self._state === "fulfilled";
+        var callback = fulfilled ? onFulfilled : onRejected;
+        if (typeof callback !== "function") {
+          (fulfilled ? resolve : reject)(self._value);
+          return;
+        }
+        try {
+          resolve(callback(self._value));
+        } catch (e) {
+          reject(e);
+        }
+      }
+
+      if (self._handlers)
+        self._handlers.push(run);
+      else
+        runAsync(run);
+    });
+  };
+
+  ThenablePromise.prototype["catch"] = function(onRejected) {
+    return this.then(undefined, onRejected);
+  };
+
+  return ThenablePromise;
+})();
+
+// Exposes extension.request(msg), which returns a promise resolved with the
+// reply of the extension. Unlike extension.internal.sendSyncMessage(), the
+// renderer doesn't block waiting for it.
+xwalk._setupExtensionRequest = function(extension_obj) {
+  var postRequest = extension_obj.postRequest;
+  delete extension_obj.postRequest;
+
+  extension_obj.request = function(msg) {
+    return new xwalk._Promise(function(resolve, reject) {
+      if (!postRequest(msg, resolve))
+        reject(new Error("Couldn't send request to the extension"));
+    });
   };
 };
@@ -4,8 +4,12 @@
 
 #include "xwalk/extensions/renderer/xwalk_extension_client.h"
 
+#include "base/bind.h"
+#include "base/hash.h"
+#include "base/message_loop/message_loop_proxy.h"
 #include "base/values.h"
 #include "ipc/ipc_sender.h"
+#include "xwalk/extensions/common/xwalk_extension_api_snapshot.h"
 #include "xwalk/extensions/common/xwalk_extension_messages.h"
 #include "xwalk/extensions/renderer/xwalk_extension_module.h"
 #include "xwalk/extensions/renderer/xwalk_module_system.h"
@@ -13,12 +17,24 @@
 namespace xwalk {
 namespace extensions {
 
+XWalkExtensionClient::ExtensionAPI::ExtensionAPI()
+    : hash(0) {}
+
+XWalkExtensionClient::ExtensionAPI::~ExtensionAPI() {}
+
 XWalkExtensionClient::XWalkExtensionClient(IPC::Sender* sender)
     : sender_(sender),
-      next_instance_id_(0) {
+      next_instance_id_(0),
+      peer_handle_(base::kNullProcessHandle),
+      weak_ptr_factory_(this) {
+  code_cache_.SetStoreDataCallback(
+      base::Bind(&XWalkExtensionClient::StoreCodeCacheData,
+                 weak_ptr_factory_.GetWeakPtr()));
 }
 
 XWalkExtensionClient::~XWalkExtensionClient() {
+  if (peer_handle_ != base::kNullProcessHandle)
+    base::CloseProcessHandle(peer_handle_);
 }
 
 bool XWalkExtensionClient::Send(IPC::Message* msg) {
@@ -39,6 +55,7 @@ XWalkRemoteExtensionRunner* XWalkExtensionClient::CreateRunner(
       this, next_instance_id_);
 
   runners_[next_instance_id_] = runner;
+  instance_extensions_[next_instance_id_] = extension_name;
   next_instance_id_++;
 
   return runner;
@@ -49,18 +66,84 @@ bool XWalkExtensionClient::OnMessageReceived(const IPC::Message& message) {
   IPC_BEGIN_MESSAGE_MAP(XWalkExtensionClient, message)
     IPC_MESSAGE_HANDLER(XWalkExtensionClientMsg_PostMessageToJS,
         OnPostMessageToJS)
+    IPC_MESSAGE_HANDLER(XWalkExtensionClientMsg_PostBinaryMessageToJS,
+        OnPostBinaryMessageToJS)
+    IPC_MESSAGE_HANDLER(XWalkExtensionClientMsg_PostSharedMemoryMessageToJS,
+        OnPostSharedMemoryMessageToJS)
+    IPC_MESSAGE_HANDLER(XWalkExtensionClientMsg_ReleaseSharedMemorySegment,
+        OnReleaseSharedMemorySegment)
+    IPC_MESSAGE_HANDLER(XWalkExtensionClientMsg_PostRequestReplyToJS,
+        OnPostRequestReplyToJS)
+    IPC_MESSAGE_HANDLER(XWalkExtensionClientMsg_RegisterExtensions,
+        OnRegisterExtensions)
     IPC_MESSAGE_HANDLER(XWalkExtensionClientMsg_RegisterExtension,
         OnRegisterExtension)
+    IPC_MESSAGE_HANDLER(XWalkExtensionClientMsg_UnregisterExtension,
+        OnUnregisterExtension)
     IPC_MESSAGE_HANDLER(XWalkExtensionClientMsg_InstanceDestroyed,
         OnInstanceDestroyed)
+    IPC_MESSAGE_HANDLER(XWalkExtensionClientMsg_SetCodeCacheData,
+        OnSetCodeCacheData)
+    IPC_MESSAGE_HANDLER(XWalkExtensionClientMsg_MessageQueueFull,
+        OnMessageQueueFull)
     IPC_MESSAGE_UNHANDLED(handled = false)
   IPC_END_MESSAGE_MAP()
 
   return handled;
 }
 
+void XWalkExtensionClient::OnChannelConnected(int32 peer_pid) {
+  if (peer_handle_ != base::kNullProcessHandle)
+    base::CloseProcessHandle(peer_handle_);
+  // Sandboxed renderers may not be allowed to open the peer, see
+  // CanShareMemoryWithServer().
+  if (!base::OpenProcessHandle(peer_pid, &peer_handle_))
+    peer_handle_ = base::kNullProcessHandle;
+}
+
+void XWalkExtensionClient::OnChannelError() {
+  // The server is gone with the extension process. Instances are created
+  // again if a new one is launched, see RecreateInstances().
+  DropServerState();
+}
+
+void XWalkExtensionClient::DropServerState() {
+  RequestSet requests;
+  requests.swap(pending_requests_);
+  base::Value* null_reply = base::Value::CreateNullValue();
+  for (RequestSet::const_iterator it = requests.begin();
+       it != requests.end(); ++it) {
+    RunnerMap::const_iterator runner = runners_.find(it->first);
+    if (runner != runners_.end() && runner->second)
+      runner->second->PostRequestReplyToJS(it->second, *null_reply);
+  }
+  delete null_reply;
+
+  // Nobody is going to tell us these were destroyed.
+  RunnerMap::iterator it = runners_.begin();
+  while (it != runners_.end()) {
+    if (!it->second) {
+      runners_.erase(it++);
+    } else {
+      it->second->SetMessageQueueFull(false, false);
+      ++it;
+    }
+  }
+}
+
+void XWalkExtensionClient::RecreateInstances() {
+  DropServerState();
+
+  // Recreated with the same ids, so the runners don't notice.
+  RunnerMap::const_iterator it = runners_.begin();
+  for (; it != runners_.end(); ++it) {
+    Send(new XWalkExtensionServerMsg_CreateInstance(
+        it->first, instance_extensions_[it->first]));
+  }
+}
+
 void XWalkExtensionClient::OnPostMessageToJS(int64_t instance_id,
-    const base::ListValue& msg) {
+    const base::ListValue& msgs) {
   RunnerMap::const_iterator it = runners_.find(instance_id);
   if (it == runners_.end() || !it->second) {
     LOG(WARNING) << "Can't PostMessage to invalid Extension instance id: "
@@ -68,9 +151,87 @@ void XWalkExtensionClient::OnPostMessageToJS(int64_t instance_id,
     return;
   }
 
+  (it->second)->PostMessagesToJS(msgs);
+}
+
+void XWalkExtensionClient::OnPostBinaryMessageToJS(int64_t instance_id,
+    const scoped_refptr<base::RefCountedMemory>& data) {
+  RunnerMap::const_iterator it = runners_.find(instance_id);
+  if (it == runners_.end() || !it->second) {
+    LOG(WARNING) << "Can't PostBinaryMessage to invalid Extension instance id: "
+        << instance_id;
+    return;
+  }
+
+  (it->second)->PostBinaryMessageToJS(data);
+}
+
+void XWalkExtensionClient::OnPostSharedMemoryMessageToJS(int64_t instance_id,
+    int segment_id, base::SharedMemoryHandle handle, uint32_t segment_size,
+    uint32_t size) {
+  if (!shared_memory_reader_) {
+    shared_memory_reader_.reset(new XWalkExtensionSharedMemoryReader(
+        base::MessageLoopProxy::current(),
+        base::Bind(&XWalkExtensionClient::ReleaseServerSharedMemorySegment,
+                   weak_ptr_factory_.GetWeakPtr()),
+        XWalkExtensionSharedMemoryReader::READ_IN_PLACE));
+  }
+
+  scoped_refptr<base::RefCountedMemory> data =
+      shared_memory_reader_->Read(segment_id, handle, segment_size, size);
+  if (!data)
+    return;
+
+  OnPostBinaryMessageToJS(instance_id, data);
+}
+
+void XWalkExtensionClient::OnPostRequestReplyToJS(int64_t instance_id,
+    int request_id, const base::ListValue& reply) {
+  pending_requests_.erase(std::make_pair(instance_id, request_id));
+
+  RunnerMap::const_iterator it = runners_.find(instance_id);
+  if (it == runners_.end() || !it->second) {
+    LOG(WARNING) << "Can't reply request of invalid Extension instance id: "
+        << instance_id;
+    return;
+  }
+
   const base::Value* value;
-  msg.Get(0, &value);
-  (it->second)->PostMessageToJS(*value);
+  if (!reply.Get(0, &value))
+    return;
+  (it->second)->PostRequestReplyToJS(request_id, *value);
+}
+
+void XWalkExtensionClient::OnMessageQueueFull(int64_t instance_id, bool full,
+    bool block_sender) {
+  RunnerMap::const_iterator it = runners_.find(instance_id);
+  if (it == runners_.end() || !it->second)
+    return;
+  (it->second)->SetMessageQueueFull(full, block_sender);
+}
+
+void XWalkExtensionClient::OnReleaseSharedMemorySegment(int segment_id) {
+  if (shared_memory_pool_)
+    shared_memory_pool_->Release(segment_id);
+}
+
+void XWalkExtensionClient::ReleaseServerSharedMemorySegment(int segment_id) {
+  Send(new XWalkExtensionServerMsg_ReleaseSharedMemorySegment(segment_id));
+}
+
+void XWalkExtensionClient::OnSetCodeCacheData(const std::string& name,
+    const std::string& key, const std::string& data) {
+  code_cache_.SetCachedData(name, key, data);
+}
+
+void XWalkExtensionClient::StoreCodeCacheData(const std::string& name,
+    const std::string& key, const std::string& data) {
+  Send(new XWalkExtensionServerMsg_StoreCodeCacheData(name, key, data));
+}
+
+void XWalkExtensionClient::SetSharedMemoryAllocator(
+    const XWalkExtensionSharedMemoryPool::AllocateCallback& allocate) {
+  shared_memory_pool_.reset(new XWalkExtensionSharedMemoryPool(allocate));
 }
 
 void XWalkExtensionClient::DestroyInstance(int64_t instance_id) {
@@ -82,6 +243,7 @@ void XWalkExtensionClient::DestroyInstance(int64_t instance_id) {
 
   Send(new XWalkExtensionServerMsg_DestroyInstance(instance_id));
 
+  instance_extensions_.erase(instance_id);
   delete it->second;
   it->second = 0;
 }
@@ -104,22 +266,95 @@ void XWalkExtensionClient::OnInstanceDestroyed(int64_t instance_id) {
   runners_.erase(it);
 }
 
-void XWalkExtensionClient::CreateRunnersForModuleSystem(XWalkModuleSystem*
+void XWalkExtensionClient::CreateModulesForModuleSystem(XWalkModuleSystem*
     module_system) {
+  module_systems_.insert(module_system);
+
   // FIXME(cmarcelo): Load extensions sorted by name so parent comes first, so
   // that we can safely register all them.
   ExtensionAPIMap::const_iterator it = extension_apis_.begin();
   for (; it != extension_apis_.end(); ++it) {
-    if (it->second.empty())
+    if (!it->second.code->size())
       continue;
-    scoped_ptr<XWalkExtensionModule> module(
-        new XWalkExtensionModule(module_system, it->first, it->second));
-    XWalkRemoteExtensionRunner* runner = CreateRunner(it->first, module.get());
-    module->set_runner(runner);
+    scoped_ptr<XWalkExtensionModule> module(new XWalkExtensionModule(
+        module_system, this, it->first, it->second.code, it->second.hash));
     module_system->RegisterExtensionModule(module.Pass());
   }
 }
 
+void XWalkExtensionClient::WillDestroyModuleSystem(
+    XWalkModuleSystem* module_system) {
+  module_systems_.erase(module_system);
+}
+
+void XWalkExtensionClient::RegisterExtension(const std::string& name,
+                                             const std::string& api) {
+  ExtensionAPI& entry = extension_apis_[name];
+  std::string code(api);
+  entry.code = base::RefCountedString::TakeString(&code);
+  entry.hash = base::Hash(api);
+  AddExtensionToModuleSystems(name);
+}
+
+void XWalkExtensionClient::OnRegisterExtensions(
+    base::SharedMemoryHandle handle, uint32_t region_size,
+    const std::vector<std::string>& names,
+    const std::vector<uint32_t>& hashes,
+    const std::vector<uint32_t>& sizes) {
+  if (names.size() != hashes.size() || names.size() != sizes.size()) {
+    LOG(WARNING) << "Ignoring invalid extension registration.";
+    if (base::SharedMemory::IsHandleValid(handle))
+      base::SharedMemory::CloseHandle(handle);
+    return;
+  }
+
+  // The code is read from the shared region, nothing is copied until a
+  // module is loaded.
+  std::vector<scoped_refptr<base::RefCountedMemory> > codes;
+  if (!MapExtensionAPISnapshot(handle, region_size, sizes, &codes))
+    return;
+
+  for (size_t i = 0; i < names.size(); ++i) {
+    ExtensionAPI& api = extension_apis_[names[i]];
+    api.code = codes[i];
+    api.hash = hashes[i];
+    AddExtensionToModuleSystems(names[i]);
+  }
+}
+
+void XWalkExtensionClient::OnRegisterExtension(const std::string& name,
+                                               const std::string& api) {
+  RegisterExtension(name, api);
+}
+
+void XWalkExtensionClient::AddExtensionToModuleSystems(
+    const std::string& name) {
+  const ExtensionAPI& api = extension_apis_[name];
+  if (!api.code->size())
+    return;
+
+  // Like for new contexts, the JS API is only run when first used. A context
+  // that kept the loaded module of an extension registered before under the
+  // same name goes on using it.
+  std::set<XWalkModuleSystem*>::const_iterator it = module_systems_.begin();
+  for (; it != module_systems_.end(); ++it) {
+    XWalkModuleSystem* module_system = *it;
+    if (module_system->HasExtensionModule(name))
+      continue;
+    scoped_ptr<XWalkExtensionModule> module(new XWalkExtensionModule(
+        module_system, this, name, api.code, api.hash));
+    module_system->RegisterExtensionModule(module.Pass());
+  }
+}
+
+void XWalkExtensionClient::OnUnregisterExtension(const std::string& name) {
+  extension_apis_.erase(name);
+
+  std::set<XWalkModuleSystem*>::const_iterator it = module_systems_.begin();
+  for (; it != module_systems_.end(); ++it)
+    (*it)->UnregisterExtensionModule(name);
+}
+
 namespace {
 // Regular base::Value doesn't have param traits, so can't be passed as is
 // through IPC. We wrap it in a base::ListValue that have traits before
@@ -143,17 +378,64 @@ void XWalkExtensionClient::PostMessageToNative(int64_t instance_id,
   Send(new XWalkExtensionServerMsg_PostMessageToNative(instance_id, *list_msg));
 }
 
+void XWalkExtensionClient::PostBinaryMessageToNative(int64_t instance_id,
+    const scoped_refptr<base::RefCountedMemory>& data) {
+  if (shared_memory_pool_ && data->size() >= kSharedMemoryMessageThreshold &&
+      CanShareMemoryWithServer()) {
+    int segment_id;
+    base::SharedMemoryHandle handle;
+    size_t segment_size;
+    if (shared_memory_pool_->Write(data, peer_handle_, &segment_id, &handle,
+                                   &segment_size)) {
+      Send(new XWalkExtensionServerMsg_PostSharedMemoryMessageToNative(
+          instance_id, segment_id, handle, segment_size, data->size()));
+      return;
+    }
+  }
+
+  Send(new XWalkExtensionServerMsg_PostBinaryMessageToNative(instance_id,
+      data));
+}
+
+bool XWalkExtensionClient::CanShareMemoryWithServer() const {
+#if defined(OS_POSIX)
+  // The descriptor travels inside the IPC message, so any peer will do. This
+  // also covers the client talking to the browser, which never gets
+  // OnChannelConnected() since it doesn't own that channel.
+  return true;
+#else
+  // Handles must be duplicated into the peer. Without one, big messages are
+  // sent inside the IPC message.
+  return peer_handle_ != base::kNullProcessHandle;
+#endif
+}
+
 scoped_ptr<base::Value> XWalkExtensionClient::SendSyncMessageToNative(
     int64_t instance_id, scoped_ptr<base::Value> msg) {
   scoped_ptr<base::ListValue> wrapped_msg = WrapValueInList(msg.Pass());
-  base::ListValue* wrapped_reply = new base::ListValue;
-  Send(new XWalkExtensionServerMsg_SendSyncMessageToNative(instance_id,
-      *wrapped_msg, wrapped_reply));
-
+  base::ListValue wrapped_reply;
   base::Value* reply;
-  wrapped_reply->Remove(0, &reply);
+  // Fails if the server went away, e.g. when the extension process dies.
+  if (!Send(new XWalkExtensionServerMsg_SendSyncMessageToNative(instance_id,
+          *wrapped_msg, &wrapped_reply)) ||
+      !wrapped_reply.Remove(0, &reply)) {
+    return scoped_ptr<base::Value>(base::Value::CreateNullValue());
+  }
   return scoped_ptr<base::Value>(reply);
 }
 
+void XWalkExtensionClient::PostRequestToNative(int64_t instance_id,
+    int request_id, scoped_ptr<base::Value> msg) {
+  scoped_ptr<base::ListValue> list_msg = WrapValueInList(msg.Pass());
+  pending_requests_.insert(std::make_pair(instance_id, request_id));
+  Send(new XWalkExtensionServerMsg_PostRequestToNative(instance_id, request_id,
+      *list_msg));
+}
+
+void XWalkExtensionClient::WaitForMessageQueue(int64_t instance_id) {
+  // Returns early if the server goes away meanwhile.
+  Send(new XWalkExtensionServerMsg_WaitForMessageQueue(instance_id));
+}
+
 }  // namespace extensions
 }  // namespace xwalk
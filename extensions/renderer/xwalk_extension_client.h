@@ -6,11 +6,18 @@
 #define XWALK_EXTENSIONS_RENDERER_XWALK_EXTENSION_CLIENT_H_
 
 #include <map>
+#include <set>
 #include <stdint.h>
 #include <string>
+#include <utility>
+#include <vector>
 
+#include "base/memory/ref_counted_memory.h"
 #include "base/memory/scoped_ptr.h"
+#include "base/memory/weak_ptr.h"
 #include "ipc/ipc_listener.h"
+#include "xwalk/extensions/common/xwalk_extension_shared_memory.h"
+#include "xwalk/extensions/renderer/xwalk_extension_code_cache.h"
 #include "xwalk/extensions/renderer/xwalk_remote_extension_runner.h"
 
 namespace base {
@@ -36,37 +43,132 @@ class XWalkExtensionClient : public IPC::Listener {
 
   // IPC::Listener Implementation.
   virtual bool OnMessageReceived(const IPC::Message& message) OVERRIDE;
+  virtual void OnChannelConnected(int32 peer_pid) OVERRIDE;
+  virtual void OnChannelError() OVERRIDE;
 
-  void CreateRunnersForModuleSystem(XWalkModuleSystem* module_system);
+  // Changes the channel used to reach the server, e.g. when connecting to a
+  // new extension process.
+  void Initialize(IPC::Sender* sender) { sender_ = sender; }
+
+  // Also adds the extension to the module systems given so far.
+  void RegisterExtension(const std::string& name, const std::string& api);
+
+  // Creates the live instances again in the server, after |sender| was
+  // connected to a new one. The requests sent to the old server are dropped.
+  void RecreateInstances();
+
+  // Registers a module for each extension in |module_system|. The runner of
+  // each module is created only when its JS API is first used. Extensions
+  // registered later are added to the module system too, until
+  // WillDestroyModuleSystem() is called.
+  void CreateModulesForModuleSystem(XWalkModuleSystem* module_system);
+  void WillDestroyModuleSystem(XWalkModuleSystem* module_system);
+
+  XWalkRemoteExtensionRunner* CreateRunner(const std::string& extension_name,
+      XWalkRemoteExtensionRunner::Client* client);
 
   void DestroyInstance(int64_t instance_id);
 
   void PostMessageToNative(int64_t instance_id, scoped_ptr<base::Value> msg);
+  void PostBinaryMessageToNative(
+      int64_t instance_id, const scoped_refptr<base::RefCountedMemory>& data);
   scoped_ptr<base::Value> SendSyncMessageToNative(int64_t instance_id,
       scoped_ptr<base::Value> msg);
+  void PostRequestToNative(int64_t instance_id, int request_id,
+      scoped_ptr<base::Value> msg);
 
- private:
-  XWalkRemoteExtensionRunner* CreateRunner(const std::string& extension_name,
-      XWalkRemoteExtensionRunner::Client* client);
+  // Blocks until the message queue of the instance has room again.
+  void WaitForMessageQueue(int64_t instance_id);
 
+  // Renderers can't create shared memory by themselves, so the segments used
+  // to send big binary messages are allocated using |allocate|. If not set,
+  // binary messages are always sent inside the IPC message.
+  void SetSharedMemoryAllocator(
+      const XWalkExtensionSharedMemoryPool::AllocateCallback& allocate);
+
+  // Compiled JS API code shared by all the script contexts of the process.
+  XWalkExtensionCodeCache* code_cache() { return &code_cache_; }
+
+ private:
   bool Send(IPC::Message* msg);
 
   // Message Handlers.
   void OnInstanceDestroyed(int64_t instance_id);
-  void OnPostMessageToJS(int64_t instance_id, const base::ListValue& msg);
-  void OnRegisterExtension(const std::string& name, const std::string& api) {
-    extension_apis_[name] = api;
-  }
+  void OnPostMessageToJS(int64_t instance_id, const base::ListValue& msgs);
+  void OnPostBinaryMessageToJS(
+      int64_t instance_id, const scoped_refptr<base::RefCountedMemory>& data);
+  void OnPostSharedMemoryMessageToJS(int64_t instance_id, int segment_id,
+      base::SharedMemoryHandle handle, uint32_t segment_size, uint32_t size);
+  void OnReleaseSharedMemorySegment(int segment_id);
+  void OnPostRequestReplyToJS(int64_t instance_id, int request_id,
+                              const base::ListValue& reply);
+  void OnMessageQueueFull(int64_t instance_id, bool full, bool block_sender);
+  void OnRegisterExtensions(base::SharedMemoryHandle handle,
+                            uint32_t region_size,
+                            const std::vector<std::string>& names,
+                            const std::vector<uint32_t>& hashes,
+                            const std::vector<uint32_t>& sizes);
+  void OnRegisterExtension(const std::string& name, const std::string& api);
+  void OnUnregisterExtension(const std::string& name);
+  void OnSetCodeCacheData(const std::string& name, const std::string& key,
+                          const std::string& data);
+
+  void ReleaseServerSharedMemorySegment(int segment_id);
+
+  // Whether big binary messages can be sent to the server through shared
+  // memory, which requires a handle of the server process on some platforms.
+  bool CanShareMemoryWithServer() const;
+  void StoreCodeCacheData(const std::string& name, const std::string& key,
+                          const std::string& data);
+
+  // Forgets the server state: the pending requests get a null reply, the
+  // queues are empty and the instances being destroyed are gone.
+  void DropServerState();
+
+  // JS API code of an extension, and its hash. The code is usually a view of
+  // the region shared by the browser process, see XWalkExtensionAPISnapshot.
+  struct ExtensionAPI {
+    ExtensionAPI();
+    ~ExtensionAPI();
+
+    scoped_refptr<base::RefCountedMemory> code;
+    uint32_t hash;
+  };
+
+  // Adds a module for the registered extension |name| to the live module
+  // systems.
+  void AddExtensionToModuleSystems(const std::string& name);
 
   IPC::Sender* sender_;
 
-  typedef std::map<std::string, std::string> ExtensionAPIMap;
+  typedef std::map<std::string, ExtensionAPI> ExtensionAPIMap;
   ExtensionAPIMap extension_apis_;
 
+  // Module systems of the live script contexts.
+  std::set<XWalkModuleSystem*> module_systems_;
+
   typedef std::map<int64_t, XWalkRemoteExtensionRunner*> RunnerMap;
   RunnerMap runners_;
 
+  // Extension of each live instance, so it can be created again.
+  typedef std::map<int64_t, std::string> InstanceExtensionMap;
+  InstanceExtensionMap instance_extensions_;
+
+  // Requests waiting for a reply, as (instance id, request id) pairs.
+  typedef std::set<std::pair<int64_t, int> > RequestSet;
+  RequestSet pending_requests_;
+
   int64_t next_instance_id_;
+
+  // Process on the other end of the channel, used to share the segments of
+  // |shared_memory_pool_|. Only known when this client owns the channel.
+  base::ProcessHandle peer_handle_;
+  scoped_ptr<XWalkExtensionSharedMemoryPool> shared_memory_pool_;
+  scoped_ptr<XWalkExtensionSharedMemoryReader> shared_memory_reader_;
+
+  XWalkExtensionCodeCache code_cache_;
+
+  base::WeakPtrFactory<XWalkExtensionClient> weak_ptr_factory_;
 };
 
 }  // namespace extensions
@@ -0,0 +1,118 @@
+// Copyright (c) 2013 Intel Corporation. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "xwalk/extensions/renderer/xwalk_extension_code_cache.h"
+
+#include "base/hash.h"
+#include "base/memory/scoped_ptr.h"
+#include "base/stl_util.h"
+#include "base/strings/stringprintf.h"
+
+namespace xwalk {
+namespace extensions {
+
+XWalkExtensionCodeCache::Entry::Entry() {}
+
+XWalkExtensionCodeCache::Entry::~Entry() {
+  script.Dispose(v8::Isolate::GetCurrent());
+  script.Clear();
+}
+
+XWalkExtensionCodeCache::XWalkExtensionCodeCache() {}
+
+XWalkExtensionCodeCache::~XWalkExtensionCodeCache() {
+  STLDeleteValues(&entries_);
+}
+
+void XWalkExtensionCodeCache::SetStoreDataCallback(
+    const StoreDataCallback& store_data) {
+  store_data_ = store_data;
+}
+
+void XWalkExtensionCodeCache::SetCachedData(const std::string& name,
+                                            const std::string& key,
+                                            const std::string& data) {
+  Entry* entry = GetEntry(name);
+
+  // Already compiled, there's nothing left to save.
+  if (!entry->script.IsEmpty())
+    return;
+
+  entry->key = key;
+  entry->cached_data = data;
+}
+
+v8::Handle<v8::Script> XWalkExtensionCodeCache::GetScript(
+    const std::string& name, const std::string& code,
+    const std::string& resource_name) {
+  return GetScript(name, ComputeKey(code), code, resource_name);
+}
+
+v8::Handle<v8::Script> XWalkExtensionCodeCache::GetScript(
+    const std::string& name, const std::string& key, const std::string& code,
+    const std::string& resource_name) {
+  v8::Isolate* isolate = v8::Isolate::GetCurrent();
+  v8::HandleScope handle_scope(isolate);
+
+  Entry* entry = GetEntry(name);
+
+  if (entry->key == key && !entry->script.IsEmpty())
+    return handle_scope.Close(
+        v8::Handle<v8::Script>::New(isolate, entry->script));
+
+  v8::Handle<v8::String> v8_code(v8::String::New(code.data(), code.size()));
+
+  scoped_ptr<v8::ScriptData> pre_data;
+  bool produced_pre_data = false;
+  if (entry->key == key && !entry->cached_data.empty()) {
+    pre_data.reset(v8::ScriptData::New(entry->cached_data.data(),
+                                       entry->cached_data.size()));
+  } else {
+    pre_data.reset(v8::ScriptData::PreCompile(v8_code));
+    produced_pre_data = true;
+  }
+  if (pre_data && pre_data->HasError())
+    pre_data.reset();
+
+  v8::ScriptOrigin origin(v8::String::New(resource_name.c_str()));
+  v8::Handle<v8::Script> script(
+      v8::Script::New(v8_code, &origin, pre_data.get()));
+  if (script.IsEmpty())
+    return v8::Handle<v8::Script>();
+
+  entry->key = key;
+  entry->cached_data.clear();
+  entry->script.Dispose(isolate);
+  entry->script.Reset(isolate, script);
+
+  if (produced_pre_data && pre_data && !store_data_.is_null()) {
+    store_data_.Run(name, key,
+                    std::string(pre_data->Data(), pre_data->Length()));
+  }
+
+  return handle_scope.Close(script);
+}
+
+// static
+std::string XWalkExtensionCodeCache::ComputeKey(const std::string& code) {
+  return ComputeKey(base::Hash(code), code.size());
+}
+
+// static
+std::string XWalkExtensionCodeCache::ComputeKey(uint32 code_hash,
+                                                size_t code_size) {
+  return base::StringPrintf("%s-%08x-%u", v8::V8::GetVersion(), code_hash,
+                            static_cast<unsigned>(code_size));
+}
+
+XWalkExtensionCodeCache::Entry* XWalkExtensionCodeCache::GetEntry(
+    const std::string& name) {
+  Entry*& entry = entries_[name];
+  if (!entry)
+    entry = new Entry;
+  return entry;
+}
+
+}  // namespace extensions
+}  // namespace xwalk
@@ -0,0 +1,82 @@
+// Copyright (c) 2013 Intel Corporation. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef XWALK_EXTENSIONS_RENDERER_XWALK_EXTENSION_CODE_CACHE_H_
+#define XWALK_EXTENSIONS_RENDERER_XWALK_EXTENSION_CODE_CACHE_H_
+
+#include <map>
+#include <string>
+#include "base/basictypes.h"
+#include "base/callback.h"
+#include "v8/include/v8.h"
+
+namespace xwalk {
+namespace extensions {
+
+// Keeps the compiled JS API code of the extensions for the lifetime of the
+// render process. Scripts are compiled without being bound to a context, so
+// every new script context runs the same compiled code instead of parsing and
+// compiling the API again.
+//
+// The preparse data produced when a script is compiled for the first time is
+// handed to the StoreDataCallback, so the browser process can keep it on disk
+// and give it back in later launches using SetCachedData().
+class XWalkExtensionCodeCache {
+ public:
+  typedef base::Callback<void(const std::string& name, const std::string& key,
+                              const std::string& data)> StoreDataCallback;
+
+  XWalkExtensionCodeCache();
+  ~XWalkExtensionCodeCache();
+
+  void SetStoreDataCallback(const StoreDataCallback& store_data);
+
+  // Preparse data for extension |name|, only used if |key| matches the key
+  // of the code compiled for it.
+  void SetCachedData(const std::string& name, const std::string& key,
+                     const std::string& data);
+
+  // Returns the compiled |code| of extension |name|, compiling it if needed.
+  // If the code has errors an empty handle is returned, and the exception is
+  // left for the caller's v8::TryCatch.
+  v8::Handle<v8::Script> GetScript(const std::string& name,
+                                   const std::string& code,
+                                   const std::string& resource_name);
+
+  // Same as above, for callers that already know the key of |code|, so it
+  // isn't hashed again.
+  v8::Handle<v8::Script> GetScript(const std::string& name,
+                                   const std::string& key,
+                                   const std::string& code,
+                                   const std::string& resource_name);
+
+  // The key identifies both the source code and the V8 version, since the
+  // preparse data format can change between versions.
+  static std::string ComputeKey(const std::string& code);
+  static std::string ComputeKey(uint32 code_hash, size_t code_size);
+
+ private:
+  struct Entry {
+    Entry();
+    ~Entry();
+
+    std::string key;
+    std::string cached_data;
+    v8::Persistent<v8::Script> script;
+  };
+
+  Entry* GetEntry(const std::string& name);
+
+  typedef std::map<std::string, Entry*> EntryMap;
+  EntryMap entries_;
+
+  StoreDataCallback store_data_;
+
+  DISALLOW_COPY_AND_ASSIGN(XWalkExtensionCodeCache);
+};
+
+}  // namespace extensions
+}  // namespace xwalk
+
+#endif  // XWALK_EXTENSIONS_RENDERER_XWALK_EXTENSION_CODE_CACHE_H_
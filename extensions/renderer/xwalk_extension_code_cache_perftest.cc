@@ -0,0 +1,144 @@
+// Copyright (c) 2013 Intel Corporation. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "xwalk/extensions/renderer/xwalk_extension_code_cache.h"
+
+#include <stdio.h>
+#include <map>
+#include <string>
+#include <vector>
+#include "base/bind.h"
+#include "base/strings/stringprintf.h"
+#include "base/time/time.h"
+#include "testing/gtest/include/gtest/gtest.h"
+
+using xwalk::extensions::XWalkExtensionCodeCache;
+
+namespace {
+
+const size_t kExtensionCounts[] = { 1, 10, 50 };
+
+// Number of script contexts created for each measurement.
+const int kContextsPerRun = 20;
+
+typedef std::map<std::string, std::pair<std::string, std::string> > DataMap;
+
+void SaveData(DataMap* saved, const std::string& name, const std::string& key,
+              const std::string& data) {
+  (*saved)[name] = std::make_pair(key, data);
+}
+
+// Something close in size and shape to the JS API of a real extension, wrapped
+// in a function like XWalkExtensionModule does.
+std::string CreateAPICode(size_t index) {
+  std::string code = base::StringPrintf(
+      "var ext%u = {}; (function(extension) { 'use strict';"
+      "var listeners = {}; var next_id = 0;"
+      "extension.setMessageListener = function(msg) {"
+      "  var l = listeners[msg.id]; delete listeners[msg.id];"
+      "  if (l instanceof Function) l(msg.result);"
+      "};", static_cast<unsigned>(index));
+  for (int i = 0; i < 40; ++i) {
+    code += base::StringPrintf(
+        "ext%u.method%d = function(a, b, callback) {"
+        "  if (typeof a !== 'string' || typeof b !== 'number')"
+        "    throw new TypeError('Invalid arguments for method%d');"
+        "  var id = ++next_id; listeners[id] = callback;"
+        "  return { id: id, cmd: 'method%d', a: a, b: b * 2 };"
+        "};", static_cast<unsigned>(index), i, i, i);
+  }
+  code += "return 0; });";
+  return code;
+}
+
+// Creates a new script context and loads every extension on it, as the
+// renderer does when a page touches all of them.
+void LoadInNewContext(XWalkExtensionCodeCache* cache,
+                      const std::vector<std::string>& codes) {
+  v8::Isolate* isolate = v8::Isolate::GetCurrent();
+  v8::HandleScope handle_scope(isolate);
+  v8::Handle<v8::Context> context = v8::Context::New(isolate);
+  v8::Context::Scope context_scope(context);
+
+  for (size_t i = 0; i < codes.size(); ++i) {
+    std::string name = base::StringPrintf("ext%u", static_cast<unsigned>(i));
+    v8::Handle<v8::Script> script = cache->GetScript(name, codes[i], name);
+    CHECK(!script.IsEmpty());
+    v8::Handle<v8::Value> result = script->Run();
+    CHECK(result->IsFunction());
+    v8::Handle<v8::Value> arg = v8::Object::New();
+    v8::Handle<v8::Function>::Cast(result)->Call(context->Global(), 1, &arg);
+  }
+}
+
+// V8 keeps its own compilation cache for the isolate, which would hide the
+// cost we want to measure. A low memory notification flushes it.
+void FlushV8CompilationCache() {
+  v8::V8::LowMemoryNotification();
+}
+
+void PrintTime(const std::string& trace, size_t count,
+               base::TimeDelta elapsed) {
+  printf("RESULT extension_startup_%s: %uext= %.3f ms\n", trace.c_str(),
+         static_cast<unsigned>(count),
+         elapsed.InMillisecondsF() / kContextsPerRun);
+}
+
+}  // namespace
+
+TEST(XWalkExtensionCodeCachePerfTest, StartupTime) {
+  v8::Isolate* isolate = v8::Isolate::GetCurrent();
+  v8::HandleScope handle_scope(isolate);
+
+  for (size_t c = 0; c < arraysize(kExtensionCounts); ++c) {
+    const size_t count = kExtensionCounts[c];
+    std::vector<std::string> codes;
+    for (size_t i = 0; i < count; ++i)
+      codes.push_back(CreateAPICode(i));
+
+    // Every context uses its own cache: what happened before this change.
+    base::TimeDelta elapsed;
+    for (int i = 0; i < kContextsPerRun; ++i) {
+      FlushV8CompilationCache();
+      XWalkExtensionCodeCache cache;
+      base::TimeTicks start = base::TimeTicks::HighResNow();
+      LoadInNewContext(&cache, codes);
+      elapsed += base::TimeTicks::HighResNow() - start;
+    }
+    PrintTime("no_cache", count, elapsed);
+
+    // First launch: one cache for the whole renderer, which produces the data
+    // saved to disk.
+    DataMap saved;
+    {
+      XWalkExtensionCodeCache cache;
+      cache.SetStoreDataCallback(base::Bind(&SaveData, &saved));
+      FlushV8CompilationCache();
+      LoadInNewContext(&cache, codes);
+
+      base::TimeTicks start = base::TimeTicks::HighResNow();
+      for (int i = 0; i < kContextsPerRun; ++i)
+        LoadInNewContext(&cache, codes);
+      PrintTime("renderer_cache", count,
+                base::TimeTicks::HighResNow() - start);
+    }
+    ASSERT_EQ(count, saved.size());
+
+    // Later launches: the first context of the renderer uses the data from
+    // disk.
+    elapsed = base::TimeDelta();
+    for (int i = 0; i < kContextsPerRun; ++i) {
+      FlushV8CompilationCache();
+      XWalkExtensionCodeCache cache;
+      DataMap::const_iterator it = saved.begin();
+      for (; it != saved.end(); ++it)
+        cache.SetCachedData(it->first, it->second.first, it->second.second);
+
+      base::TimeTicks start = base::TimeTicks::HighResNow();
+      LoadInNewContext(&cache, codes);
+      elapsed += base::TimeTicks::HighResNow() - start;
+    }
+    PrintTime("disk_cache", count, elapsed);
+  }
+}
@@ -5,12 +5,18 @@
 
 #include "xwalk/extensions/renderer/xwalk_extension_module.h"
 
+#include <vector>
+#include "base/hash.h"
 #include "base/logging.h"
 #include "base/strings/stringprintf.h"
 #include "base/values.h"
 #include "content/public/renderer/v8_value_converter.h"
+#include "third_party/WebKit/public/web/WebArrayBuffer.h"
+#include "third_party/WebKit/public/web/WebArrayBufferView.h"
 #include "third_party/WebKit/public/web/WebFrame.h"
 #include "third_party/WebKit/public/web/WebScopedMicrotaskSuppression.h"
+#include "xwalk/extensions/renderer/xwalk_extension_client.h"
+#include "xwalk/extensions/renderer/xwalk_extension_code_cache.h"
 #include "xwalk/extensions/renderer/xwalk_module_system.h"
 
 namespace xwalk {
@@ -26,12 +32,19 @@ const char* kXWalkExtensionModule = "kXWalkExtensionModule";
 
 XWalkExtensionModule::XWalkExtensionModule(
     XWalkModuleSystem* module_system,
+    XWalkExtensionClient* client,
     const std::string& extension_name,
-    const std::string& extension_code)
+    const scoped_refptr<base::RefCountedMemory>& extension_code,
+    uint32_t extension_code_hash)
     : extension_name_(extension_name),
       extension_code_(extension_code),
+      extension_code_hash_(extension_code_hash),
       converter_(content::V8ValueConverter::create()),
-      module_system_(module_system) {
+      module_system_(module_system),
+      client_(client),
+      runner_(NULL),
+      loaded_(false),
+      next_request_id_(0) {
   v8::Isolate* isolate = v8::Isolate::GetCurrent();
   v8::HandleScope handle_scope(isolate);
   v8::Handle<v8::Object> function_data = v8::Object::New();
@@ -48,6 +61,9 @@ XWalkExtensionModule::XWalkExtensionModule(
   object_template->Set(
       "setMessageListener",
       v8::FunctionTemplate::New(SetMessageListenerCallback, function_data));
+  object_template->Set(
+      "postRequest",
+      v8::FunctionTemplate::New(PostRequestCallback, function_data));
 
   function_data_.Reset(isolate, function_data);
   object_template_.Reset(isolate, object_template);
@@ -74,8 +90,17 @@ XWalkExtensionModule::~XWalkExtensionModule() {
   message_listener_.Dispose(isolate);
   message_listener_.Clear();
 
-  CHECK(runner_);
-  runner_->Destroy();
+  // Requests still waiting for a reply will never be resolved.
+  RequestMap::iterator it = pending_requests_.begin();
+  for (; it != pending_requests_.end(); ++it) {
+    it->second->Dispose(isolate);
+    delete it->second;
+  }
+  pending_requests_.clear();
+
+  // Modules that were never loaded have no instance to destroy.
+  if (runner_)
+    runner_->Destroy();
 }
 
 namespace {
@@ -96,9 +121,9 @@ std::string CodeToEnsureNamespace(const std::string& extension_name) {
   return result;
 }
 
-// Wrap API code into a callable form that takes extension object as parameter.
-std::string WrapAPICode(const std::string& extension_code,
-                        const std::string& extension_name) {
+// Code wrapped around the API code, making it a callable form that takes
+// extension object as parameter.
+std::string GetAPICodePrefix(const std::string& extension_name) {
   // We take care here to make sure that line numbering for api_code after
   // wrapping doesn't change, so that syntax errors point to the correct line.
   return base::StringPrintf(
@@ -109,24 +134,28 @@ std::string WrapAPICode(const std::string& extension_code,
       "extension.internal = {};"
       "extension.internal.sendSyncMessage = extension.sendSyncMessage;"
       "delete extension.sendSyncMessage;"
-      "return (function(exports) {'use strict'; %s\n})(%s); });",
-      CodeToEnsureNamespace(extension_name).c_str(),
-      extension_code.c_str(),
-      extension_name.c_str());
+      "xwalk._setupExtensionRequest(extension);"
+      "return (function(exports) {'use strict'; ",
+      CodeToEnsureNamespace(extension_name).c_str());
+}
+
+std::string GetAPICodeSuffix(const std::string& extension_name) {
+  return base::StringPrintf("\n})(%s); });", extension_name.c_str());
 }
 
-v8::Handle<v8::Value> RunString(const std::string& code,
-                                const std::string& name) {
+v8::Handle<v8::Value> RunString(XWalkExtensionCodeCache* code_cache,
+                                const std::string& key,
+                                const std::string& code,
+                                const std::string& extension_name) {
   v8::HandleScope handle_scope;
-  v8::Handle<v8::String> v8_code(v8::String::New(code.c_str()));
-  v8::Handle<v8::String> v8_name(v8::String::New(name.c_str()));
 
   WebKit::WebScopedMicrotaskSuppression suppression;
   v8::TryCatch try_catch;
   try_catch.SetVerbose(true);
 
-  v8::Handle<v8::Script> script(v8::Script::New(v8_code, v8_name));
-  if (try_catch.HasCaught())
+  v8::Handle<v8::Script> script(code_cache->GetScript(
+      extension_name, key, code, "JS API code for " + extension_name));
+  if (script.IsEmpty() || try_catch.HasCaught())
     return v8::Undefined();
 
   v8::Handle<v8::Value> result = script->Run();
@@ -136,13 +165,71 @@ v8::Handle<v8::Value> RunString(const std::string& code,
   return handle_scope.Close(result);
 }
 
+// Returns a copy of the contents of an ArrayBuffer or ArrayBufferView, or NULL
+// if |value| is neither. These are sent through the binary message path, which
+// skips V8ValueConverter and base::Value, but not the copies: one here, one
+// into the IPC message or shared memory segment, and one into the ArrayBuffer
+// created on the receiving side.
+scoped_refptr<base::RefCountedMemory> GetArrayBufferContents(
+    v8::Handle<v8::Value> value) {
+  const unsigned char* data = NULL;
+  size_t length = 0;
+
+  scoped_ptr<WebKit::WebArrayBuffer> array_buffer(
+      WebKit::WebArrayBuffer::createFromV8Value(value));
+  scoped_ptr<WebKit::WebArrayBufferView> view;
+  if (array_buffer) {
+    data = static_cast<const unsigned char*>(array_buffer->data());
+    length = array_buffer->byteLength();
+  } else {
+    view.reset(WebKit::WebArrayBufferView::createFromV8Value(value));
+    if (!view)
+      return NULL;
+    data = static_cast<const unsigned char*>(view->baseAddress()) +
+        view->byteOffset();
+    length = view->byteLength();
+  }
+
+  std::vector<unsigned char> bytes(data, data + length);
+  return base::RefCountedBytes::TakeVector(&bytes);
+}
+
+v8::Handle<v8::Value> CreateArrayBuffer(
+    const scoped_refptr<base::RefCountedMemory>& data) {
+  WebKit::WebArrayBuffer buffer =
+      WebKit::WebArrayBuffer::create(data->size(), 1);
+  memcpy(buffer.data(), data->front(), data->size());
+  return buffer.toV8Value();
+}
+
 }  // namespace
 
 void XWalkExtensionModule::LoadExtensionCode(
     v8::Handle<v8::Context> context, v8::Handle<v8::Function> requireNative) {
-  std::string wrapped_api_code = WrapAPICode(extension_code_, extension_name_);
-  v8::Handle<v8::Value> result =
-      RunString(wrapped_api_code, "JS API code for " + extension_name_);
+  CHECK(!loaded_);
+  loaded_ = true;
+  runner_ = client_->CreateRunner(extension_name_, this);
+
+  const std::string prefix = GetAPICodePrefix(extension_name_);
+  const std::string suffix = GetAPICodeSuffix(extension_name_);
+  std::string wrapped_api_code;
+  wrapped_api_code.reserve(
+      prefix.size() + extension_code_->size() + suffix.size());
+  wrapped_api_code.append(prefix);
+  wrapped_api_code.append(
+      reinterpret_cast<const char*>(extension_code_->front()),
+      extension_code_->size());
+  wrapped_api_code.append(suffix);
+
+  // The wrapped code is identified by the wrapper and the hash of the API
+  // code we already have, so it isn't hashed again in every context.
+  const std::string key = XWalkExtensionCodeCache::ComputeKey(
+      base::Hash(base::StringPrintf("%s%s%08x", prefix.c_str(),
+                                    suffix.c_str(), extension_code_hash_)),
+      wrapped_api_code.size());
+
+  v8::Handle<v8::Value> result = RunString(
+      client_->code_cache(), key, wrapped_api_code, extension_name_);
   if (!result->IsFunction()) {
     LOG(WARNING) << "Couldn't load JS API code for " << extension_name_;
     return;
@@ -169,22 +256,78 @@ void XWalkExtensionModule::LoadExtensionCode(
   }
 }
 
-void XWalkExtensionModule::HandleMessageFromNative(const base::Value& msg) {
+void XWalkExtensionModule::HandleMessagesFromNative(
+    const base::ListValue& msgs) {
   if (message_listener_.IsEmpty())
     return;
 
+  // The whole batch is delivered with a single entry in the context.
+  v8::Isolate* isolate = v8::Isolate::GetCurrent();
+  v8::HandleScope handle_scope(isolate);
+  v8::Handle<v8::Context> context = module_system_->GetV8Context();
+  v8::Context::Scope context_scope(context);
+
+  for (size_t i = 0; i < msgs.GetSize(); ++i) {
+    const base::Value* msg;
+    msgs.Get(i, &msg);
+    CallMessageListener(context, converter_->ToV8Value(msg, context));
+
+    // The listener might have removed itself.
+    if (message_listener_.IsEmpty())
+      return;
+  }
+}
+
+void XWalkExtensionModule::HandleBinaryMessageFromNative(
+    const scoped_refptr<base::RefCountedMemory>& data) {
+  if (message_listener_.IsEmpty())
+    return;
+
+  v8::Isolate* isolate = v8::Isolate::GetCurrent();
+  v8::HandleScope handle_scope(isolate);
+  v8::Handle<v8::Context> context = module_system_->GetV8Context();
+  v8::Context::Scope context_scope(context);
+
+  CallMessageListener(context, CreateArrayBuffer(data));
+}
+
+void XWalkExtensionModule::HandleRequestReplyFromNative(
+    int request_id, const base::Value& reply) {
+  RequestMap::iterator it = pending_requests_.find(request_id);
+  if (it == pending_requests_.end()) {
+    LOG(WARNING) << "Got reply for unknown request " << request_id
+                 << " of extension " << extension_name_;
+    return;
+  }
+  scoped_ptr<v8::Persistent<v8::Function> > resolve(it->second);
+  pending_requests_.erase(it);
+
   v8::Isolate* isolate = v8::Isolate::GetCurrent();
   v8::HandleScope handle_scope(isolate);
   v8::Handle<v8::Context> context = module_system_->GetV8Context();
   v8::Context::Scope context_scope(context);
 
-  v8::Handle<v8::Value> v8_value(converter_->ToV8Value(&msg, context));
+  v8::Handle<v8::Function> function =
+      v8::Handle<v8::Function>::New(isolate, *resolve);
+  resolve->Dispose(isolate);
+
+  v8::Handle<v8::Value> value = converter_->ToV8Value(&reply, context);
+
+  WebKit::WebScopedMicrotaskSuppression suppression;
+  v8::TryCatch try_catch;
+  function->Call(context->Global(), 1, &value);
+  if (try_catch.HasCaught())
+    LOG(WARNING) << "Exception when resolving request";
+}
+
+void XWalkExtensionModule::CallMessageListener(
+    v8::Handle<v8::Context> context, v8::Handle<v8::Value> msg) {
   v8::Handle<v8::Function> message_listener =
-      v8::Handle<v8::Function>::New(isolate, message_listener_);;
+      v8::Handle<v8::Function>::New(context->GetIsolate(), message_listener_);
 
   WebKit::WebScopedMicrotaskSuppression suppression;
   v8::TryCatch try_catch;
-  message_listener->Call(context->Global(), 1, &v8_value);
+  message_listener->Call(context->Global(), 1, &msg);
   if (try_catch.HasCaught())
     LOG(WARNING) << "Exception when running message listener";
 }
@@ -199,13 +342,21 @@ void XWalkExtensionModule::PostMessageCallback(
     return;
   }
 
+  CHECK(module->runner_);
+
+  scoped_refptr<base::RefCountedMemory> data = GetArrayBufferContents(info[0]);
+  if (data) {
+    result.Set(module->runner_->PostBinaryMessageToNative(data));
+    return;
+  }
+
   v8::Handle<v8::Context> context = info.GetIsolate()->GetCurrentContext();
   scoped_ptr<base::Value> value(
       module->converter_->FromV8Value(info[0], context));
 
-  CHECK(module->runner_);
-  module->runner_->PostMessageToNative(value.Pass());
-  result.Set(true);
+  // False when the queue of the instance is full, see
+  // XWalkExtension::QueueFullPolicy.
+  result.Set(module->runner_->PostMessageToNative(value.Pass()));
 }
 
 // static
@@ -256,6 +407,39 @@ void XWalkExtensionModule::SetMessageListenerCallback(
   result.Set(true);
 }
 
+// static
+void XWalkExtensionModule::PostRequestCallback(
+    const v8::FunctionCallbackInfo<v8::Value>& info) {
+  v8::ReturnValue<v8::Value> result(info.GetReturnValue());
+  XWalkExtensionModule* module = GetExtensionModule(info);
+  if (!module || info.Length() != 2 || !info[1]->IsFunction()) {
+    result.Set(false);
+    return;
+  }
+
+  CHECK(module->runner_);
+
+  v8::Isolate* isolate = info.GetIsolate();
+  v8::Handle<v8::Context> context = isolate->GetCurrentContext();
+  scoped_ptr<base::Value> value(
+      module->converter_->FromV8Value(info[0], context));
+
+  int request_id = module->next_request_id_++;
+  v8::Persistent<v8::Function>* resolve = new v8::Persistent<v8::Function>;
+  resolve->Reset(isolate, info[1].As<v8::Function>());
+  module->pending_requests_[request_id] = resolve;
+
+  if (!module->runner_->PostRequestToNative(request_id, value.Pass())) {
+    // The promise is rejected by xwalk_api.js.
+    module->pending_requests_.erase(request_id);
+    resolve->Dispose(isolate);
+    delete resolve;
+    result.Set(false);
+    return;
+  }
+  result.Set(true);
+}
+
 // static
 XWalkExtensionModule* XWalkExtensionModule::GetExtensionModule(
     const v8::FunctionCallbackInfo<v8::Value>& info) {
@@ -5,7 +5,10 @@
 #ifndef XWALK_EXTENSIONS_RENDERER_XWALK_EXTENSION_MODULE_H_
 #define XWALK_EXTENSIONS_RENDERER_XWALK_EXTENSION_MODULE_H_
 
+#include <stdint.h>
+#include <map>
 #include <string>
+#include "base/memory/ref_counted_memory.h"
 #include "xwalk/extensions/renderer/xwalk_module_system.h"
 #include "xwalk/extensions/renderer/xwalk_remote_extension_runner.h"
 
@@ -20,6 +23,7 @@ class V8ValueConverter;
 namespace xwalk {
 namespace extensions {
 
+class XWalkExtensionClient;
 class XWalkModuleSystem;
 
 // Responsible for running the JS code of a XWalkExtension. This includes
@@ -27,12 +31,17 @@ class XWalkModuleSystem;
 // the extension JS code.
 //
 // We'll create one XWalkExtensionModule per extension/frame pair, so
-// there'll be a set of different modules per v8::Context.
+// there'll be a set of different modules per v8::Context. The JS API code is
+// only run, and the instance in the extension side created, when the module
+// is loaded. See XWalkModuleSystem::RegisterExtensionModule().
 class XWalkExtensionModule : public XWalkRemoteExtensionRunner::Client {
  public:
   XWalkExtensionModule(XWalkModuleSystem* module_system,
+                       XWalkExtensionClient* client,
                        const std::string& extension_name,
-                       const std::string& extension_code);
+                       const scoped_refptr<base::RefCountedMemory>&
+                           extension_code,
+                       uint32_t extension_code_hash);
   virtual ~XWalkExtensionModule();
 
   // TODO(cmarcelo): Make this return a v8::Handle<v8::Object>, and
@@ -41,13 +50,18 @@ class XWalkExtensionModule : public XWalkRemoteExtensionRunner::Client {
                          v8::Handle<v8::Function> requireNative);
 
   std::string extension_name() const { return extension_name_; }
-  void set_runner(XWalkRemoteExtensionRunner* runner) {
-    runner_ = runner;
-  }
+  bool is_loaded() const { return loaded_; }
 
  private:
   // XWalkRemoteExtensionRunner::Client implementation.
-  virtual void HandleMessageFromNative(const base::Value& msg) OVERRIDE;
+  virtual void HandleMessagesFromNative(const base::ListValue& msgs) OVERRIDE;
+  virtual void HandleBinaryMessageFromNative(
+      const scoped_refptr<base::RefCountedMemory>& data) OVERRIDE;
+  virtual void HandleRequestReplyFromNative(int request_id,
+                                            const base::Value& reply) OVERRIDE;
+
+  void CallMessageListener(v8::Handle<v8::Context> context,
+                           v8::Handle<v8::Value> msg);
 
   // Callbacks for JS functions available in 'extension' object.
   static void PostMessageCallback(
@@ -56,6 +70,8 @@ class XWalkExtensionModule : public XWalkRemoteExtensionRunner::Client {
       const v8::FunctionCallbackInfo<v8::Value>& info);
   static void SetMessageListenerCallback(
       const v8::FunctionCallbackInfo<v8::Value>& info);
+  static void PostRequestCallback(
+      const v8::FunctionCallbackInfo<v8::Value>& info);
 
   static XWalkExtensionModule* GetExtensionModule(
       const v8::FunctionCallbackInfo<v8::Value>& info);
@@ -71,15 +87,27 @@ class XWalkExtensionModule : public XWalkRemoteExtensionRunner::Client {
   // This value is registered by using 'extension.setMessageListener()'.
   v8::Persistent<v8::Function> message_listener_;
 
+  // Functions resolving the promises of requests waiting for a reply. See
+  // 'extension.request()' in xwalk_api.js.
+  typedef std::map<int, v8::Persistent<v8::Function>*> RequestMap;
+  RequestMap pending_requests_;
+  int next_request_id_;
+
   std::string extension_name_;
-  std::string extension_code_;
+
+  // Usually a view of the JS API code shared by the browser process, it is
+  // only copied when the module is loaded. See XWalkExtensionAPISnapshot.
+  scoped_refptr<base::RefCountedMemory> extension_code_;
+  uint32_t extension_code_hash_;
 
   // TODO(cmarcelo): Move to a single converter, since we always use same
   // parameters.
   scoped_ptr<content::V8ValueConverter> converter_;
 
   XWalkModuleSystem* module_system_;
+  XWalkExtensionClient* client_;
   XWalkRemoteExtensionRunner* runner_;
+  bool loaded_;
 };
 
 }  // namespace extensions
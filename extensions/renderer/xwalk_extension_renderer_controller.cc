@@ -4,15 +4,24 @@
 
 #include "xwalk/extensions/renderer/xwalk_extension_renderer_controller.h"
 
+#include <string>
+#include <vector>
+#include "base/bind.h"
+#include "base/command_line.h"
+#include "base/debug/trace_event.h"
+#include "base/message_loop/message_loop.h"
 #include "base/values.h"
+#include "content/public/common/content_switches.h"
 #include "content/public/renderer/render_thread.h"
 #include "content/public/renderer/v8_value_converter.h"
+#include "ipc/ipc_channel_handle.h"
 #include "ipc/ipc_sync_channel.h"
 #include "third_party/WebKit/public/web/WebDocument.h"
 #include "third_party/WebKit/public/web/WebFrame.h"
 #include "third_party/WebKit/public/web/WebScopedMicrotaskSuppression.h"
 #include "v8/include/v8.h"
 #include "xwalk/extensions/common/xwalk_extension_messages.h"
+#include "xwalk/extensions/common/xwalk_extension_switches.h"
 #include "xwalk/extensions/renderer/xwalk_extension_client.h"
 #include "xwalk/extensions/renderer/xwalk_extension_module.h"
 #include "xwalk/extensions/renderer/xwalk_module_system.h"
@@ -25,20 +34,113 @@ extern const char kSource_xwalk_api[];
 namespace xwalk {
 namespace extensions {
 
-const GURL kAboutBlankURL = GURL("about:blank");
+namespace {
 
-XWalkExtensionRendererController::XWalkExtensionRendererController() {
+// A function waiting to be called by RunAsync(), with the context it was
+// given in.
+class AsyncCall {
+ public:
+  AsyncCall(v8::Isolate* isolate, v8::Handle<v8::Context> context,
+            v8::Handle<v8::Function> function)
+      : isolate_(isolate) {
+    context_.Reset(isolate, context);
+    function_.Reset(isolate, function);
+  }
+
+  ~AsyncCall() {
+    context_.Dispose(isolate_);
+    context_.Clear();
+    function_.Dispose(isolate_);
+    function_.Clear();
+  }
+
+  void Run() {
+    v8::HandleScope handle_scope(isolate_);
+    v8::Handle<v8::Context> context =
+        v8::Handle<v8::Context>::New(isolate_, context_);
+    v8::Context::Scope context_scope(context);
+    v8::Handle<v8::Function> function =
+        v8::Handle<v8::Function>::New(isolate_, function_);
+
+    WebKit::WebScopedMicrotaskSuppression suppression;
+    v8::TryCatch try_catch;
+    try_catch.SetVerbose(true);
+    function->Call(context->Global(), 0, NULL);
+  }
+
+ private:
+  v8::Isolate* isolate_;
+  v8::Persistent<v8::Context> context_;
+  v8::Persistent<v8::Function> function_;
+
+  DISALLOW_COPY_AND_ASSIGN(AsyncCall);
+};
+
+void RunAsyncCall(AsyncCall* call) {
+  call->Run();
+}
+
+// Calls the given function in a later task of the render thread. Unlike
+// setTimeout(), it is always available and can't be replaced by the page.
+void RunAsyncCallback(const v8::FunctionCallbackInfo<v8::Value>& info) {
+  if (info.Length() != 1 || !info[0]->IsFunction())
+    return;
+  v8::Isolate* isolate = info.GetIsolate();
+  base::MessageLoop::current()->PostTask(FROM_HERE,
+      base::Bind(&RunAsyncCall, base::Owned(new AsyncCall(
+          isolate, isolate->GetCurrentContext(), info[0].As<v8::Function>()))));
+}
+
+// Exposes xwalk_api.js and the native functions it uses.
+class XWalkAPIExtension : public v8::Extension {
+ public:
+  XWalkAPIExtension() : v8::Extension("xwalk", kSource_xwalk_api) {}
+
+  virtual v8::Handle<v8::FunctionTemplate> GetNativeFunction(
+      v8::Handle<v8::String> name) OVERRIDE {
+    if (name->Equals(v8::String::New("RunAsync")))
+      return v8::FunctionTemplate::New(RunAsyncCallback);
+    return v8::Handle<v8::FunctionTemplate>();
+  }
+};
+
+}  // namespace
+
+XWalkExtensionRendererController::XWalkExtensionRendererController()
+    : shutdown_event_(true, false) {
   content::RenderThread* thread = content::RenderThread::Get();
   thread->AddObserver(this);
   // TODO(cmarcelo): Once we have a better solution for the internal
   // extension helpers, remove this v8::Extension.
-  thread->RegisterExtension(new v8::Extension("xwalk", kSource_xwalk_api));
+  thread->RegisterExtension(new XWalkAPIExtension);
 
   in_browser_process_extensions_client_.reset(new XWalkExtensionClient(
       thread->GetChannel()));
+  in_browser_process_extensions_client_->SetSharedMemoryAllocator(
+      base::Bind(&content::RenderThread::HostAllocateSharedMemoryBuffer,
+                 base::Unretained(thread)));
+
+  // In single process mode the browser runs all extensions by itself.
+  CommandLine* cmd_line = CommandLine::ForCurrentProcess();
+  if (!cmd_line->HasSwitch(switches::kXWalkEnableExtensionProcess) ||
+      cmd_line->HasSwitch(switches::kSingleProcess))
+    return;
+
+  // The extension process is launched along with us, we ask for its channel
+  // right away and don't wait for it: the first pages may load without the
+  // extensions it hosts, which are added to them once it's ready.
+  extension_process_extensions_client_.reset(new XWalkExtensionClient(NULL));
+  extension_process_extensions_client_->SetSharedMemoryAllocator(
+      base::Bind(&content::RenderThread::HostAllocateSharedMemoryBuffer,
+                 base::Unretained(thread)));
+  thread->Send(new XWalkExtensionServerMsg_ConnectToExtensionProcess);
 }
 
 XWalkExtensionRendererController::~XWalkExtensionRendererController() {
+  // Unblocks any sync message pending on the extension process channel.
+  shutdown_event_.Signal();
+  extension_process_channel_.reset();
+
   // FIXME(cmarcelo): These call is causing crashes on shutdown with Chromium
   //                  29.0.1547.57 and had to be commented out.
   // content::RenderThread::Get()->RemoveObserver(this);
@@ -46,8 +148,24 @@ XWalkExtensionRendererController::~XWalkExtensionRendererController() {
 
 void XWalkExtensionRendererController::DidCreateScriptContext(
     WebKit::WebFrame* frame, v8::Handle<v8::Context> context) {
-  if (frame->document().url() == kAboutBlankURL)
+  const GURL url = frame->document().url();
+  TRACE_EVENT1("xwalk",
+               "XWalkExtensionRendererController::DidCreateScriptContext",
+               "url", url.possibly_invalid_spec());
+
+  bool is_main_frame = !frame->parent();
+  const GURL top_url =
+      is_main_frame ? url : GURL(frame->top()->document().url());
+  if (!frame_policy_.ShouldSetUpFrame(url, top_url, is_main_frame)) {
+    TRACE_EVENT_INSTANT1("xwalk",
+                         "XWalkExtensionRendererController::SkipFrame",
+                         TRACE_EVENT_SCOPE_THREAD,
+                         "url", url.possibly_invalid_spec());
+    // So WillReleaseScriptContext() finds no module system.
+    XWalkModuleSystem::SetModuleSystemInContext(
+        scoped_ptr<XWalkModuleSystem>(), context);
     return;
+  }
 
   XWalkModuleSystem* module_system = new XWalkModuleSystem(context);
   XWalkModuleSystem::SetModuleSystemInContext(
@@ -56,22 +174,85 @@ void XWalkExtensionRendererController::DidCreateScriptContext(
   module_system->RegisterNativeModule(
       "v8tools", scoped_ptr<XWalkNativeModule>(new XWalkV8ToolsModule));
 
-  in_browser_process_extensions_client_->CreateRunnersForModuleSystem(
+  in_browser_process_extensions_client_->CreateModulesForModuleSystem(
       module_system);
+  if (extension_process_extensions_client_) {
+    extension_process_extensions_client_->CreateModulesForModuleSystem(
+        module_system);
+  }
+}
+
+void XWalkExtensionRendererController::CreateExtensionProcessChannel(
+    const IPC::ChannelHandle& handle) {
+  // Messages are read in the IO-thread of the renderer, and dispatched to the
+  // client in this thread, like the ones coming from the browser.
+  extension_process_channel_.reset(new IPC::SyncChannel(handle,
+      IPC::Channel::MODE_CLIENT, extension_process_extensions_client_.get(),
+      content::RenderThread::Get()->GetIOMessageLoopProxy(), true,
+      &shutdown_event_));
+  extension_process_extensions_client_->Initialize(
+      extension_process_channel_.get());
+}
+
+void XWalkExtensionRendererController::OnExtensionProcessChannelCreated(
+    const IPC::ChannelHandle& handle, const std::vector<std::string>& names,
+    const std::vector<std::string>& apis) {
+  if (!extension_process_extensions_client_ || handle.name.empty())
+    return;
+
+  // The extension process was launched again, the extensions are the same.
+  if (extension_process_channel_) {
+    CreateExtensionProcessChannel(handle);
+    extension_process_extensions_client_->RecreateInstances();
+    return;
+  }
+
+  if (names.size() != apis.size())
+    return;
+  CreateExtensionProcessChannel(handle);
+  for (size_t i = 0; i < names.size(); ++i)
+    extension_process_extensions_client_->RegisterExtension(names[i], apis[i]);
 }
 
 void XWalkExtensionRendererController::WillReleaseScriptContext(
     WebKit::WebFrame* frame, v8::Handle<v8::Context> context) {
-  if (frame->document().url() == kAboutBlankURL)
+  XWalkModuleSystem* module_system =
+      XWalkModuleSystem::GetModuleSystemFromContext(context);
+  if (!module_system)
     return;
 
+  TRACE_EVENT0("xwalk",
+               "XWalkExtensionRendererController::WillReleaseScriptContext");
+  in_browser_process_extensions_client_->WillDestroyModuleSystem(
+      module_system);
+  if (extension_process_extensions_client_) {
+    extension_process_extensions_client_->WillDestroyModuleSystem(
+        module_system);
+  }
+
   XWalkModuleSystem::ResetModuleSystemFromContext(context);
 }
 
+void XWalkExtensionRendererController::OnSetFramePolicy(
+    const base::DictionaryValue& policy) {
+  std::string error;
+  if (!frame_policy_.InitFromValue(policy, &error))
+    LOG(WARNING) << "Ignoring extensions frame policy: " << error;
+}
+
 bool XWalkExtensionRendererController::OnControlMessageReceived(
     const IPC::Message& message) {
+  bool handled = true;
+  IPC_BEGIN_MESSAGE_MAP(XWalkExtensionRendererController, message)
+    IPC_MESSAGE_HANDLER(XWalkExtensionClientMsg_ExtensionProcessChannelCreated,
+        OnExtensionProcessChannelCreated)
+    IPC_MESSAGE_HANDLER(XWalkExtensionClientMsg_SetFramePolicy,
+        OnSetFramePolicy)
+    IPC_MESSAGE_UNHANDLED(handled =
+        in_browser_process_extensions_client_->OnMessageReceived(message))
+  IPC_END_MESSAGE_MAP()
 
-  return in_browser_process_extensions_client_->OnMessageReceived(message);
+  return handled;
 }
 
 }  // namespace extensions
@@ -10,13 +10,24 @@
 #include <vector>
 #include "base/compiler_specific.h"
 #include "base/memory/scoped_ptr.h"
+#include "base/synchronization/waitable_event.h"
 #include "content/public/renderer/render_process_observer.h"
 #include "v8/include/v8.h"
+#include "xwalk/extensions/common/xwalk_extension_frame_policy.h"
+
+namespace base {
+class DictionaryValue;
+}
 
 namespace content {
 class RenderView;
 }
 
+namespace IPC {
+struct ChannelHandle;
+class SyncChannel;
+}
+
 namespace WebKit {
 class WebFrame;
 }
@@ -45,8 +56,25 @@ class XWalkExtensionRendererController : public content::RenderProcessObserver {
   virtual bool OnControlMessageReceived(const IPC::Message& message) OVERRIDE;
 
  private:
+  void OnExtensionProcessChannelCreated(const IPC::ChannelHandle& handle,
+                                        const std::vector<std::string>& names,
+                                        const std::vector<std::string>& apis);
+  void OnSetFramePolicy(const base::DictionaryValue& policy);
+  void CreateExtensionProcessChannel(const IPC::ChannelHandle& handle);
+
   scoped_ptr<XWalkExtensionClient> in_browser_process_extensions_client_;
 
+  // Talks directly to the extension process, the browser only brokers the
+  // channel. NULL if there's no extension process. Until the channel arrives
+  // it only keeps track of the module systems, which get the modules of the
+  // extension process then.
+  scoped_ptr<XWalkExtensionClient> extension_process_extensions_client_;
+  scoped_ptr<IPC::SyncChannel> extension_process_channel_;
+  base::WaitableEvent shutdown_event_;
+
+  // Frames it rules out get neither a module system nor extension instances.
+  XWalkExtensionFramePolicy frame_policy_;
+
   DISALLOW_COPY_AND_ASSIGN(XWalkExtensionRendererController);
 };
 
@@ -4,8 +4,10 @@
 
 #include "xwalk/extensions/renderer/xwalk_module_system.h"
 
+#include <vector>
 #include "base/logging.h"
 #include "base/stl_util.h"
+#include "base/strings/string_split.h"
 #include "xwalk/extensions/renderer/xwalk_extension_module.h"
 
 namespace xwalk {
@@ -22,10 +24,12 @@ const int kModuleSystemEmbedderDataIndex = 8;
 // pointer back to XWalkExtensionModule.
 const char* kXWalkModuleSystem = "kXWalkModuleSystem";
 
-XWalkModuleSystem* GetModuleSystem(
-    const v8::FunctionCallbackInfo<v8::Value>& info) {
-  v8::HandleScope handle_scope(info.GetIsolate());
-  v8::Handle<v8::Object> data = info.Data().As<v8::Object>();
+// Key used in the data object of lazy accessors to store the name of the
+// extension to be loaded.
+const char* kXWalkExtensionName = "kXWalkExtensionName";
+
+XWalkModuleSystem* GetModuleSystem(v8::Handle<v8::Object> data) {
+  v8::HandleScope handle_scope(v8::Isolate::GetCurrent());
   v8::Handle<v8::Value> module_system =
       data->Get(v8::String::New(kXWalkModuleSystem));
   if (module_system.IsEmpty() || module_system->IsUndefined()) {
@@ -40,7 +44,8 @@ XWalkModuleSystem* GetModuleSystem(
 
 void RequireNativeCallback(const v8::FunctionCallbackInfo<v8::Value>& info) {
   v8::ReturnValue<v8::Value> result(info.GetReturnValue());
-  XWalkModuleSystem* module_system = GetModuleSystem(info);
+  XWalkModuleSystem* module_system =
+      GetModuleSystem(info.Data().As<v8::Object>());
   if (info.Length() < 1) {
     // TODO(cmarcelo): Throw appropriate exception or warning.
     result.SetUndefined();
@@ -56,6 +61,25 @@ void RequireNativeCallback(const v8::FunctionCallbackInfo<v8::Value>& info) {
   result.Set(object);
 }
 
+void LazyExtensionGetter(v8::Local<v8::String> property,
+                         const v8::PropertyCallbackInfo<v8::Value>& info) {
+  v8::Handle<v8::Object> data = info.Data().As<v8::Object>();
+  XWalkModuleSystem* module_system = GetModuleSystem(data);
+  if (!module_system)
+    return;
+
+  std::string extension_name(*v8::String::Utf8Value(
+      data->Get(v8::String::New(kXWalkExtensionName))));
+
+  // The JS API code will set the namespace object in the holder, replacing
+  // this accessor.
+  v8::Handle<v8::Object> holder = info.Holder();
+  holder->Delete(property);
+  module_system->LoadExtensionModule(
+      module_system->GetExtensionModule(extension_name));
+  info.GetReturnValue().Set(holder->Get(property));
+}
+
 }  // namespace
 
 XWalkModuleSystem::XWalkModuleSystem(v8::Handle<v8::Context> context) {
@@ -125,15 +149,90 @@ void XWalkModuleSystem::RegisterExtensionModule(
     scoped_ptr<XWalkExtensionModule> module) {
   const std::string& extension_name = module->extension_name();
   CHECK(extension_modules_.find(extension_name) == extension_modules_.end());
-  // TODO(cmarcelo): Setup lazy loader instead of immediatly running
-  // JS API code.
+  extension_modules_[extension_name] = module.release();
+  InstallLazyAccessor(extension_name);
+}
+
+void XWalkModuleSystem::LoadExtensionModule(XWalkExtensionModule* module) {
+  if (module->is_loaded())
+    return;
   v8::Isolate* isolate = v8::Isolate::GetCurrent();
   v8::HandleScope handle_scope(isolate);
   v8::Handle<v8::FunctionTemplate> require_native_template =
       v8::Handle<v8::FunctionTemplate>::New(isolate, require_native_template_);
   module->LoadExtensionCode(GetV8Context(),
                             require_native_template->GetFunction());
-  extension_modules_[extension_name] = module.release();
+}
+
+void XWalkModuleSystem::InstallLazyAccessor(
+    const std::string& extension_name) {
+  v8::Isolate* isolate = v8::Isolate::GetCurrent();
+  v8::HandleScope handle_scope(isolate);
+  v8::Handle<v8::Context> context = GetV8Context();
+  v8::Context::Scope context_scope(context);
+
+  std::vector<std::string> path;
+  base::SplitString(extension_name, '.', &path);
+
+  // Walk the parent namespaces, creating them if needed. Getting a parent that
+  // is an extension namespace will load that extension, so its JS API code
+  // doesn't replace the object where we install the accessor.
+  v8::Handle<v8::Object> holder = context->Global();
+  for (size_t i = 0; i + 1 < path.size(); ++i) {
+    v8::Handle<v8::String> name = v8::String::New(path[i].c_str());
+    v8::Handle<v8::Value> value = holder->Get(name);
+    if (!value->IsObject()) {
+      value = v8::Object::New();
+      holder->Set(name, value);
+    }
+    holder = value.As<v8::Object>();
+  }
+
+  v8::Handle<v8::Object> function_data =
+      v8::Handle<v8::Object>::New(isolate, function_data_);
+  v8::Handle<v8::Object> data = v8::Object::New();
+  data->Set(v8::String::New(kXWalkModuleSystem),
+            function_data->Get(v8::String::New(kXWalkModuleSystem)));
+  data->Set(v8::String::New(kXWalkExtensionName),
+            v8::String::New(extension_name.c_str()));
+  holder->SetAccessor(v8::String::New(path.back().c_str()),
+                      LazyExtensionGetter, NULL, data);
+}
+
+void XWalkModuleSystem::RemoveLazyAccessor(
+    const std::string& extension_name) {
+  v8::Isolate* isolate = v8::Isolate::GetCurrent();
+  v8::HandleScope handle_scope(isolate);
+  v8::Handle<v8::Context> context = GetV8Context();
+  v8::Context::Scope context_scope(context);
+
+  std::vector<std::string> path;
+  base::SplitString(extension_name, '.', &path);
+
+  // The parent namespaces are left alone, other extensions may use them.
+  // Getting one that is the lazy accessor of another extension would load
+  // it, and the accessor being removed can't be under it anyway.
+  v8::Handle<v8::Object> holder = context->Global();
+  std::string parent_name;
+  for (size_t i = 0; i + 1 < path.size(); ++i) {
+    if (!parent_name.empty())
+      parent_name += ".";
+    parent_name += path[i];
+    ExtensionModuleMap::const_iterator it =
+        extension_modules_.find(parent_name);
+    if (it != extension_modules_.end() && !it->second->is_loaded())
+      return;
+
+    v8::Handle<v8::String> name = v8::String::New(path[i].c_str());
+    if (!holder->HasOwnProperty(name))
+      return;
+    v8::Handle<v8::Value> value = holder->Get(name);
+    if (!value->IsObject())
+      return;
+    holder = value.As<v8::Object>();
+  }
+
+  holder->Delete(v8::String::New(path.back().c_str()));
 }
 
 XWalkExtensionModule* XWalkModuleSystem::GetExtensionModule(
@@ -143,6 +242,22 @@ XWalkExtensionModule* XWalkModuleSystem::GetExtensionModule(
   return it->second;
 }
 
+bool XWalkModuleSystem::HasExtensionModule(
+    const std::string& extension_name) const {
+  return extension_modules_.find(extension_name) != extension_modules_.end();
+}
+
+void XWalkModuleSystem::UnregisterExtensionModule(
+    const std::string& extension_name) {
+  ExtensionModuleMap::iterator it = extension_modules_.find(extension_name);
+  if (it == extension_modules_.end() || it->second->is_loaded())
+    return;
+
+  RemoveLazyAccessor(extension_name);
+  delete it->second;
+  extension_modules_.erase(it);
+}
+
 void XWalkModuleSystem::RegisterNativeModule(
     const std::string& name, scoped_ptr<XWalkNativeModule> module) {
   CHECK(native_modules_.find(name) == native_modules_.end());
@@ -44,8 +44,21 @@ class XWalkModuleSystem {
       v8::Handle<v8::Context> context);
   static void ResetModuleSystemFromContext(v8::Handle<v8::Context> context);
 
+  // The module is not loaded right away. Instead, an accessor is installed in
+  // the object that will hold the extension namespace, the module is loaded
+  // when the namespace is first accessed. Modules must be registered in
+  // order, so that parent namespaces come first; registering a module loads
+  // the modules of its parent namespaces.
   void RegisterExtensionModule(scoped_ptr<XWalkExtensionModule> module);
   XWalkExtensionModule* GetExtensionModule(const std::string& extension_name);
+  bool HasExtensionModule(const std::string& extension_name) const;
+
+  // Removes the module if it wasn't loaded yet, together with its accessor.
+  // Loaded modules are kept, the page may hold references to their objects.
+  void UnregisterExtensionModule(const std::string& extension_name);
+
+  // Runs the JS API code of the module if it wasn't loaded yet.
+  void LoadExtensionModule(XWalkExtensionModule* module);
 
   void RegisterNativeModule(const std::string& name,
                             scoped_ptr<XWalkNativeModule> module);
@@ -54,6 +67,9 @@ class XWalkModuleSystem {
   v8::Handle<v8::Context> GetV8Context();
 
  private:
+  void InstallLazyAccessor(const std::string& extension_name);
+  void RemoveLazyAccessor(const std::string& extension_name);
+
   typedef std::map<std::string, XWalkExtensionModule*> ExtensionModuleMap;
   ExtensionModuleMap extension_modules_;
 
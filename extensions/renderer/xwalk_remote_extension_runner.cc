@@ -14,13 +14,26 @@ XWalkRemoteExtensionRunner::XWalkRemoteExtensionRunner(Client* client,
     XWalkExtensionClient* extension_client, int64_t instance_id)
     : client_(client),
       instance_id_(instance_id),
-      extension_client_(extension_client) {}
+      extension_client_(extension_client),
+      message_queue_full_(false),
+      block_sender_(false) {}
 
 XWalkRemoteExtensionRunner::~XWalkRemoteExtensionRunner() {}
 
-void XWalkRemoteExtensionRunner::PostMessageToNative(
+bool XWalkRemoteExtensionRunner::PostMessageToNative(
     scoped_ptr<base::Value> msg) {
+  if (!WaitForMessageQueue())
+    return false;
   extension_client_->PostMessageToNative(instance_id_, msg.Pass());
+  return true;
+}
+
+bool XWalkRemoteExtensionRunner::PostBinaryMessageToNative(
+    const scoped_refptr<base::RefCountedMemory>& data) {
+  if (!WaitForMessageQueue())
+    return false;
+  extension_client_->PostBinaryMessageToNative(instance_id_, data);
+  return true;
 }
 
 scoped_ptr<base::Value> XWalkRemoteExtensionRunner::SendSyncMessageToNative(
@@ -30,9 +43,46 @@ scoped_ptr<base::Value> XWalkRemoteExtensionRunner::SendSyncMessageToNative(
   return reply.Pass();
 }
 
-void XWalkRemoteExtensionRunner::PostMessageToJS(
-    const base::Value& msg) {
-  client_->HandleMessageFromNative(msg);
+bool XWalkRemoteExtensionRunner::PostRequestToNative(int request_id,
+    scoped_ptr<base::Value> msg) {
+  if (!WaitForMessageQueue())
+    return false;
+  extension_client_->PostRequestToNative(instance_id_, request_id, msg.Pass());
+  return true;
+}
+
+void XWalkRemoteExtensionRunner::SetMessageQueueFull(bool full,
+                                                     bool block_sender) {
+  message_queue_full_ = full;
+  block_sender_ = block_sender;
+}
+
+bool XWalkRemoteExtensionRunner::WaitForMessageQueue() {
+  if (!message_queue_full_)
+    return true;
+  if (!block_sender_)
+    return false;
+
+  // Sync messages aren't checked: the renderer waits for them anyway, and
+  // the server never drops them.
+  extension_client_->WaitForMessageQueue(instance_id_);
+  message_queue_full_ = false;
+  return true;
+}
+
+void XWalkRemoteExtensionRunner::PostMessagesToJS(
+    const base::ListValue& msgs) {
+  client_->HandleMessagesFromNative(msgs);
+}
+
+void XWalkRemoteExtensionRunner::PostBinaryMessageToJS(
+    const scoped_refptr<base::RefCountedMemory>& data) {
+  client_->HandleBinaryMessageFromNative(data);
+}
+
+void XWalkRemoteExtensionRunner::PostRequestReplyToJS(int request_id,
+    const base::Value& reply) {
+  client_->HandleRequestReplyFromNative(request_id, reply);
 }
 
 void XWalkRemoteExtensionRunner::Destroy() {
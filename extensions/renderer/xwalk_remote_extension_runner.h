@@ -8,9 +8,11 @@
 #include <stdint.h>
 #include <string>
 #include "base/basictypes.h"
+#include "base/memory/ref_counted_memory.h"
 #include "base/memory/scoped_ptr.h"
 
 namespace base {
+class ListValue;
 class Value;
 }
 
@@ -32,7 +34,11 @@ class XWalkRemoteExtensionRunner {
  public:
   class Client {
    public:
-    virtual void HandleMessageFromNative(const base::Value& msg) = 0;
+    virtual void HandleMessagesFromNative(const base::ListValue& msgs) = 0;
+    virtual void HandleBinaryMessageFromNative(
+        const scoped_refptr<base::RefCountedMemory>& data) = 0;
+    virtual void HandleRequestReplyFromNative(int request_id,
+                                              const base::Value& reply) = 0;
    protected:
     virtual ~Client() {}
   };
@@ -41,21 +47,41 @@ class XWalkRemoteExtensionRunner {
       XWalkExtensionClient* extension_client, int64_t instance_id);
   virtual ~XWalkRemoteExtensionRunner();
 
-  void PostMessageToNative(scoped_ptr<base::Value> msg);
+  // The Post* methods return false if the message was not sent because the
+  // queue of the instance is full and the extension doesn't want the sender
+  // to wait, see XWalkExtension::QueueFullPolicy.
+  bool PostMessageToNative(scoped_ptr<base::Value> msg);
+  bool PostBinaryMessageToNative(
+      const scoped_refptr<base::RefCountedMemory>& data);
   scoped_ptr<base::Value> SendSyncMessageToNative(
       scoped_ptr<base::Value> msg);
+  bool PostRequestToNative(int request_id, scoped_ptr<base::Value> msg);
 
-  void PostMessageToJS(const base::Value& msg);
+  void PostMessagesToJS(const base::ListValue& msgs);
+  void PostBinaryMessageToJS(
+      const scoped_refptr<base::RefCountedMemory>& data);
+  void PostRequestReplyToJS(int request_id, const base::Value& reply);
+
+  // Called by XWalkExtensionClient as the server reports the state of the
+  // queue of the instance.
+  void SetMessageQueueFull(bool full, bool block_sender);
 
  private:
   friend class XWalkExtensionModule;
 
   void Destroy();
 
+  // Returns false if the message can't be posted now. Blocks until the
+  // queue has room if the sender should wait.
+  bool WaitForMessageQueue();
+
   Client* client_;
   int64_t instance_id_;
   XWalkExtensionClient* extension_client_;
 
+  bool message_queue_full_;
+  bool block_sender_;
+
   DISALLOW_COPY_AND_ASSIGN(XWalkRemoteExtensionRunner);
 };
 
@@ -8,6 +8,7 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include "xwalk/extensions/public/XW_Extension.h"
 #include "xwalk/extensions/public/XW_Extension_SyncMessage.h"
 
@@ -28,6 +29,20 @@ void handle_message(XW_Instance instance, const char* message) {
   g_messaging->PostMessage(instance, message);
 }
 
+void free_buffer(void* data, size_t size, void* user_data) {
+  free(data);
+}
+
+// Echoes the bytes through the variant taking ownership of the buffer, which
+// is what extensions producing their own buffers would use.
+void handle_binary_message(XW_Instance instance, const void* data,
+                           size_t size) {
+  void* copy = malloc(size);
+  memcpy(copy, data, size);
+  g_messaging->PostBinaryMessageBuffer(instance, copy, size, free_buffer,
+                                       NULL);
+}
+
 void handle_sync_message(XW_Instance instance, const char* message) {
   g_sync_messaging->SetSyncReply(instance, message);
 }
@@ -39,15 +54,22 @@ void shutdown(XW_Extension extension) {
 int32_t XW_Initialize(XW_Extension extension, XW_GetInterface get_interface) {
   static const char* kAPI =
       "var echoListener = null;"
+      "var binaryEchoListener = null;"
       "extension.setMessageListener(function(msg) {"
-      "  if (echoListener instanceof Function) {"
-      "    echoListener(msg);"
+      "  var listener = msg instanceof ArrayBuffer ?"
+      "      binaryEchoListener : echoListener;"
+      "  if (listener instanceof Function) {"
+      "    listener(msg);"
       "  };"
       "});"
       "exports.echo = function(msg, callback) {"
       "  echoListener = callback;"
       "  extension.postMessage(msg);"
       "};"
+      "exports.binaryEcho = function(buffer, callback) {"
+      "  binaryEchoListener = callback;"
+      "  extension.postMessage(buffer);"
+      "};"
       "exports.syncEcho = function(msg) {"
       "  return extension.internal.sendSyncMessage(msg);"
       "};";
@@ -62,6 +84,7 @@ int32_t XW_Initialize(XW_Extension extension, XW_GetInterface get_interface) {
 
   g_messaging = get_interface(XW_MESSAGING_INTERFACE);
   g_messaging->Register(extension, handle_message);
+  g_messaging->RegisterBinaryMessageCallback(extension, handle_binary_message);
 
   g_sync_messaging = get_interface(XW_INTERNAL_SYNC_MESSAGING_INTERFACE);
   g_sync_messaging->Register(extension, handle_sync_message);
@@ -4,12 +4,15 @@
 
 #include "xwalk/extensions/test/internal_extension_browsertest.h"
 
+#include <stdio.h>
 #include <algorithm>
+#include <string>
 #include "base/logging.h"
 #include "content/public/test/browser_test_utils.h"
 #include "content/public/test/test_utils.h"
 #include "xwalk/extensions/browser/xwalk_extension_service.h"
 #include "xwalk/extensions/test/test.h"
+#include "xwalk/extensions/test/test_functions.h"
 #include "xwalk/extensions/test/xwalk_extensions_test_base.h"
 #include "xwalk/runtime/browser/runtime.h"
 #include "xwalk/test/base/xwalk_test_utils.h"
@@ -21,10 +24,8 @@ using namespace xwalk::jsapi_test::test; // NOLINT
 
 TestExtension::TestExtension() {
   set_name("test");
-}
-
-const char* TestExtension::GetJavaScriptAPI() {
-  return kSource_internal_extension_browsertest_api;
+  SetJavaScriptAPI(kFunctionIdsSource,
+                   kSource_internal_extension_browsertest_api);
 }
 
 XWalkExtensionInstance* TestExtension::CreateInstance(
@@ -35,63 +36,38 @@ XWalkExtensionInstance* TestExtension::CreateInstance(
 TestExtensionInstance::TestExtensionInstance(
     const XWalkExtension::PostMessageCallback& post_message)
     : XWalkInternalExtensionInstance(post_message) {
-  RegisterFunction("clearDatabase", &TestExtensionInstance::OnClearDatabase);
-  RegisterFunction("addPerson", &TestExtensionInstance::OnAddPerson);
-  RegisterFunction("addPersonObject",
+  RegisterFunction(kClearDatabase, &TestExtensionInstance::OnClearDatabase);
+  RegisterFunction(kAddPerson, &TestExtensionInstance::OnAddPerson);
+  RegisterFunction(kAddPersonObject,
       &TestExtensionInstance::OnAddPersonObject);
-  RegisterFunction("getAllPersons", &TestExtensionInstance::OnGetAllPersons);
-  RegisterFunction("getPersonAge", &TestExtensionInstance::OnGetPersonAge);
+  RegisterFunction(kGetAllPersons, &TestExtensionInstance::OnGetAllPersons);
+  RegisterFunction(kGetPersonAge, &TestExtensionInstance::OnGetPersonAge);
+  RegisterFunction(kWatchDatabase, &TestExtensionInstance::OnWatchDatabase);
+  RegisterFunction(kUnwatchDatabase,
+      &TestExtensionInstance::OnUnwatchDatabase);
 }
 
-void TestExtensionInstance::OnClearDatabase(const std::string&,
-                                                          const std::string&,
-                                                          base::ListValue*) {
+void TestExtensionInstance::OnClearDatabase(int) {
   database()->clear();
+  NotifyWatchers();
 }
 
 void TestExtensionInstance::OnAddPerson(
-    const std::string& function_name, const std::string&,
-    base::ListValue* args) {
-  scoped_ptr<AddPerson::Params> params(AddPerson::Params::Create(*args));
-
-  if (!params) {
-    LOG(WARNING) << "Malformed parameters passed to " << function_name;
-    return;
-  }
-
-  std::pair<std::string, int> person(params->name, params->age);
-  database()->push_back(person);
+    int, scoped_ptr<AddPerson::Params> params) {
+  AddPerson(params->name, params->age);
 }
 
 void TestExtensionInstance::OnAddPersonObject(
-    const std::string& function_name, const std::string&,
-    base::ListValue* args) {
-  scoped_ptr<AddPersonObject::Params>
-      params(AddPersonObject::Params::Create(*args));
-
-  if (!params) {
-    LOG(WARNING) << "Malformed parameters passed to " << function_name;
-    return;
-  }
-
-  std::pair<std::string, int> person(params->person.name, params->person.age);
-  database()->push_back(person);
+    int, scoped_ptr<AddPersonObject::Params> params) {
+  AddPerson(params->person.name, params->person.age);
 }
 
 void TestExtensionInstance::OnGetAllPersons(
-    const std::string& function_name, const std::string& callback_id,
-    base::ListValue* args) {
-  if (callback_id.empty())
+    int callback_id,
+    scoped_ptr<GetAllPersons::Params> params) {
+  if (!callback_id)
     return;
 
-  scoped_ptr<GetAllPersons::Params>
-      params(GetAllPersons::Params::Create(*args));
-
-  if (!params) {
-    LOG(WARNING) << "Malformed parameters passed to " << function_name;
-    return;
-  }
-
   unsigned max_size = std::min<unsigned>(database()->size(), params->max_size);
   std::vector<linked_ptr<Person> > persons;
 
@@ -108,19 +84,11 @@ void TestExtensionInstance::OnGetAllPersons(
 }
 
 void TestExtensionInstance::OnGetPersonAge(
-    const std::string& function_name, const std::string& callback_id,
-    base::ListValue* args) {
-  if (callback_id.empty())
+    int callback_id,
+    scoped_ptr<GetPersonAge::Params> params) {
+  if (!callback_id)
     return;
 
-  scoped_ptr<GetPersonAge::Params>
-      params(GetPersonAge::Params::Create(*args));
-
-  if (!params) {
-    LOG(WARNING) << "Malformed parameters passed to " << function_name;
-    return;
-  }
-
   int age = -1;
 
   for (unsigned i = 0; i < database()->size(); ++i) {
@@ -131,6 +99,31 @@ void TestExtensionInstance::OnGetPersonAge(
   PostResult(callback_id, GetPersonAge::Results::Create(age));
 }
 
+void TestExtensionInstance::OnWatchDatabase(int callback_id) {
+  if (callback_id)
+    watchers_.push_back(callback_id);
+}
+
+void TestExtensionInstance::OnUnwatchDatabase(
+    int, scoped_ptr<UnwatchDatabase::Params> params) {
+  watchers_.erase(std::remove(watchers_.begin(), watchers_.end(),
+                              params->watch_id), watchers_.end());
+}
+
+void TestExtensionInstance::AddPerson(const std::string& name, int age) {
+  database()->push_back(std::make_pair(name, age));
+  NotifyWatchers();
+  if (HasEventListeners(kOnPersonAdded))
+    DispatchEvent(kOnPersonAdded, OnPersonAdded::Create(name, age));
+}
+
+void TestExtensionInstance::NotifyWatchers() {
+  for (size_t i = 0; i < watchers_.size(); ++i) {
+    PostResult(watchers_[i],
+               WatchDatabase::Results::Create(database()->size()));
+  }
+}
+
 class InternalExtensionTest : public XWalkExtensionsTestBase {
  public:
   void RegisterExtensions(XWalkExtensionService* extension_service) OVERRIDE {
@@ -152,3 +145,34 @@ IN_PROC_BROWSER_TEST_F(InternalExtensionTest, InternalExtension) {
 
   EXPECT_EQ(kPassString, title_watcher.WaitAndGetTitle());
 }
+
+namespace {
+
+void PrintCallbackTime(xwalk::Runtime* runtime, const std::string& function,
+                       const std::string& trace) {
+  std::string result;
+  ASSERT_TRUE(content::ExecuteScriptAndExtractString(
+      runtime->web_contents(),
+      function + "(function(time) {"
+      "  window.domAutomationController.send(String(time));"
+      "});",
+      &result));
+  printf("RESULT internal_extension_callbacks: %s= %s ms/call\n",
+         trace.c_str(), result.c_str());
+}
+
+}  // namespace
+
+// Exercises the callback table of xwalk_api.js, see
+// internal_extension_callbacks.html.
+IN_PROC_BROWSER_TEST_F(InternalExtensionTest, InternalExtensionCallbacks) {
+  content::RunAllPendingInMessageLoop();
+
+  GURL url = GetExtensionsTestURL(base::FilePath(),
+      base::FilePath().AppendASCII("internal_extension_callbacks.html"));
+  xwalk_test_utils::NavigateToURL(runtime(), url);
+
+  PrintCallbackTime(runtime(), "measureBurst", "burst");
+  PrintCallbackTime(runtime(), "measureSequential", "sequential");
+  PrintCallbackTime(runtime(), "measureSubscription", "subscription");
+}
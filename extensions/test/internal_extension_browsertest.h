@@ -9,13 +9,12 @@
 #include <string>
 #include <vector>
 #include "xwalk/extensions/browser/xwalk_extension_internal.h"
+#include "xwalk/extensions/test/test.h"
 
 class TestExtension : public xwalk::extensions::XWalkInternalExtension {
  public:
   TestExtension();
 
-  virtual const char* GetJavaScriptAPI() OVERRIDE;
-
   virtual xwalk::extensions::XWalkExtensionInstance* CreateInstance(
       const XWalkExtension::PostMessageCallback& post_message) OVERRIDE;
 };
@@ -32,19 +31,31 @@ class TestExtensionInstance
   Database* database() { return &database_; }
 
  private:
-  void OnClearDatabase(const std::string& function_name,
-                       const std::string& callback_id, base::ListValue* args);
-  void OnAddPerson(const std::string& function_name,
-                   const std::string& callback_id, base::ListValue* args);
-  void OnAddPersonObject(const std::string& function_name,
-                         const std::string& callback_id,
-                         base::ListValue* args);
-  void OnGetAllPersons(const std::string& function_name,
-                       const std::string& callback_id, base::ListValue* args);
-  void OnGetPersonAge(const std::string& function_name,
-                      const std::string& callback_id, base::ListValue* args);
+  void OnClearDatabase(int callback_id);
+  void OnAddPerson(
+      int callback_id,
+      scoped_ptr<xwalk::jsapi_test::test::AddPerson::Params> params);
+  void OnAddPersonObject(
+      int callback_id,
+      scoped_ptr<xwalk::jsapi_test::test::AddPersonObject::Params> params);
+  void OnGetAllPersons(
+      int callback_id,
+      scoped_ptr<xwalk::jsapi_test::test::GetAllPersons::Params> params);
+  void OnGetPersonAge(
+      int callback_id,
+      scoped_ptr<xwalk::jsapi_test::test::GetPersonAge::Params> params);
+  void OnWatchDatabase(int callback_id);
+  void OnUnwatchDatabase(
+      int callback_id,
+      scoped_ptr<xwalk::jsapi_test::test::UnwatchDatabase::Params> params);
+
+  void AddPerson(const std::string& name, int age);
+
+  // Posts the size of the database to the callbacks of watchDatabase().
+  void NotifyWatchers();
 
   std::vector<std::pair<std::string, int> > database_;
+  std::vector<int> watchers_;
 };
 
 #endif  // XWALK_EXTENSIONS_TEST_INTERNAL_EXTENSION_BROWSERTEST_H_
@@ -11,21 +11,41 @@ exports.Person = function(name, age) {
 };
 
 exports.clearDatabase = function() {
-  internal.postMessage('clearDatabase', []);
+  internal.postMessage(functionIds.clearDatabase, []);
 };
 
 exports.addPerson = function(arg1, arg2) {
-  internal.postMessage('addPerson', [arg1, arg2]);
+  internal.postMessage(functionIds.addPerson, [arg1, arg2]);
 };
 
 exports.addPersonObject = function(arg1) {
-  internal.postMessage('addPersonObject', [arg1]);
+  internal.postMessage(functionIds.addPersonObject, [arg1]);
 };
 
 exports.getAllPersons = function(arg1, callback) {
-  internal.postMessage('getAllPersons', [arg1], callback);
+  internal.postMessage(functionIds.getAllPersons, [arg1], callback);
 };
 
 exports.getPersonAge = function(arg1, callback) {
-  internal.postMessage('getPersonAge', [arg1], callback);
+  internal.postMessage(functionIds.getPersonAge, [arg1], callback);
+};
+
+// The callback runs each time the database changes, until unwatchDatabase()
+// is called with the returned id.
+exports.watchDatabase = function(callback) {
+  return internal.subscribe(functionIds.watchDatabase, [], callback);
+};
+
+exports.unwatchDatabase = function(watch_id) {
+  internal.postMessage(functionIds.unwatchDatabase, [watch_id]);
+  internal.unsubscribe(watch_id);
+};
+
+exports.onPersonAdded = {
+  addListener: function(listener) {
+    internal.addListener(eventIds.onPersonAdded, listener);
+  },
+  removeListener: function(listener) {
+    internal.removeListener(eventIds.onPersonAdded, listener);
+  }
 };
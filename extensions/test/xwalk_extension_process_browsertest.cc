@@ -0,0 +1,228 @@
+// Copyright (c) 2013 Intel Corporation. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <stdio.h>
+#include <string>
+#include "base/command_line.h"
+#include "base/file_util.h"
+#include "base/files/scoped_temp_dir.h"
+#include "base/json/json_reader.h"
+#include "base/json/json_writer.h"
+#include "base/native_library.h"
+#include "base/path_service.h"
+#include "base/process_util.h"
+#include "base/run_loop.h"
+#include "base/strings/utf_string_conversions.h"
+#include "base/values.h"
+#include "xwalk/extensions/browser/xwalk_extension_service.h"
+#include "xwalk/extensions/common/xwalk_extension_process_type.h"
+#include "xwalk/extensions/common/xwalk_extension_switches.h"
+#include "xwalk/extensions/test/xwalk_extensions_test_base.h"
+#include "xwalk/runtime/browser/runtime.h"
+#include "xwalk/test/base/xwalk_test_utils.h"
+#include "content/public/browser/browser_child_process_host_iterator.h"
+#include "content/public/browser/browser_thread.h"
+#include "content/public/common/result_codes.h"
+#include "content/public/test/browser_test_utils.h"
+#include "content/public/test/test_utils.h"
+
+using content::BrowserThread;
+using xwalk::extensions::XWalkExtensionService;
+
+namespace {
+
+base::FilePath GetNativeLibraryFilePath(const char* name) {
+  base::string16 library_name = base::GetNativeLibraryName(UTF8ToUTF16(name));
+#if defined(OS_WIN)
+  return base::FilePath(library_name);
+#else
+  return base::FilePath(UTF16ToUTF8(library_name));
+#endif
+}
+
+// Must match kRoundTrips in echo_latency.html.
+const int kEchoRoundTrips = 1000;
+
+void KillExtensionProcessesOnIOThread() {
+  content::BrowserChildProcessHostIterator it(
+      xwalk::extensions::PROCESS_TYPE_EXTENSION);
+  for (; !it.Done(); ++it)
+    base::KillProcess(it.GetData().handle, content::RESULT_CODE_KILLED, false);
+}
+
+void KillExtensionProcesses() {
+  base::RunLoop run_loop;
+  BrowserThread::PostTaskAndReply(BrowserThread::IO, FROM_HERE,
+      base::Bind(&KillExtensionProcessesOnIOThread), run_loop.QuitClosure());
+  run_loop.Run();
+}
+
+// Prints the p50 and p99 of the round trip times in |summary|, produced by
+// summarize() in echo_latency.html, together with their histogram. Fails if
+// any echo was lost or didn't come back intact.
+void PrintEchoLatency(const std::string& name, const std::string& trace,
+                      const std::string& summary) {
+  scoped_ptr<base::Value> value(base::JSONReader::Read(summary));
+  base::DictionaryValue* dict;
+  ASSERT_TRUE(value && value->GetAsDictionary(&dict));
+
+  int count, errors;
+  ASSERT_TRUE(dict->GetInteger("count", &count));
+  ASSERT_TRUE(dict->GetInteger("errors", &errors));
+  EXPECT_EQ(kEchoRoundTrips, count);
+  EXPECT_EQ(0, errors);
+
+  double p50, p99;
+  base::DictionaryValue* histogram;
+  ASSERT_TRUE(dict->GetDouble("p50", &p50));
+  ASSERT_TRUE(dict->GetDouble("p99", &p99));
+  ASSERT_TRUE(dict->GetDictionary("histogram", &histogram));
+  std::string histogram_json;
+  base::JSONWriter::Write(histogram, &histogram_json);
+
+  printf("RESULT %s_p50: %s= %f ms\n", name.c_str(), trace.c_str(), p50);
+  printf("RESULT %s_p99: %s= %f ms\n", name.c_str(), trace.c_str(), p99);
+  printf("HISTOGRAM %s: %s= %s ms\n", name.c_str(), trace.c_str(),
+         histogram_json.c_str());
+}
+
+// The render process doesn't wait for the extension process, whose
+// extensions show up in the pages already loaded once it's ready. Polls for
+// the echo extension in the current page.
+void WaitForEchoExtension(xwalk::Runtime* runtime) {
+  bool ready = false;
+  ASSERT_TRUE(content::ExecuteScriptAndExtractBool(
+      runtime->web_contents(),
+      "(function wait() {"
+      "  if (typeof echo === 'undefined')"
+      "    setTimeout(wait, 50);"
+      "  else"
+      "    window.domAutomationController.send(true);"
+      "})();",
+      &ready));
+  ASSERT_TRUE(ready);
+}
+
+// Loads a page that does nothing by itself, and waits for the echo extension
+// in it, so the next pages of the render process have it from the start.
+void WaitForExtensionProcess(xwalk::Runtime* runtime) {
+  GURL url = GetExtensionsTestURL(
+      base::FilePath(), base::FilePath().AppendASCII("echo_latency.html"));
+  xwalk_test_utils::NavigateToURL(runtime, url);
+  WaitForEchoExtension(runtime);
+}
+
+void MeasureEchoLatency(xwalk::Runtime* runtime, const std::string& trace) {
+  GURL url = GetExtensionsTestURL(
+      base::FilePath(), base::FilePath().AppendASCII("echo_latency.html"));
+  xwalk_test_utils::NavigateToURL(runtime, url);
+  WaitForEchoExtension(runtime);
+
+  std::string async_summary;
+  ASSERT_TRUE(content::ExecuteScriptAndExtractString(
+      runtime->web_contents(),
+      "measureAsync(function(summary) {"
+      "  window.domAutomationController.send(summary);"
+      "});",
+      &async_summary));
+  std::string sync_summary;
+  ASSERT_TRUE(content::ExecuteScriptAndExtractString(
+      runtime->web_contents(),
+      "window.domAutomationController.send(measureSync());",
+      &sync_summary));
+
+  PrintEchoLatency("extension_echo_latency_async", trace, async_summary);
+  PrintEchoLatency("extension_echo_latency_sync", trace, sync_summary);
+}
+
+}  // namespace
+
+// Loads the echo external extension from its own directory, like the runtime
+// does with the external extensions path.
+class ExternalEchoExtensionTest : public XWalkExtensionsTestBase {
+ public:
+  virtual void RegisterExtensions(
+      XWalkExtensionService* extension_service) OVERRIDE {
+    ASSERT_TRUE(extensions_dir_.CreateUniqueTempDir());
+    base::FilePath exe_dir;
+    PathService::Get(base::DIR_EXE, &exe_dir);
+    base::FilePath library = GetNativeLibraryFilePath("echo_extension");
+    ASSERT_TRUE(file_util::CopyFile(exe_dir.Append(library),
+                                    extensions_dir_.path().Append(library)));
+    extension_service->RegisterExternalExtensionsForPath(
+        extensions_dir_.path());
+  }
+
+ private:
+  base::ScopedTempDir extensions_dir_;
+};
+
+class XWalkExtensionProcessTest : public ExternalEchoExtensionTest {
+ public:
+  virtual void SetUpCommandLine(CommandLine* command_line) OVERRIDE {
+    command_line->AppendSwitch(switches::kXWalkEnableExtensionProcess);
+  }
+};
+
+IN_PROC_BROWSER_TEST_F(XWalkExtensionProcessTest, EchoFromExtensionProcess) {
+  content::RunAllPendingInMessageLoop();
+  WaitForExtensionProcess(runtime());
+  GURL url = GetExtensionsTestURL(base::FilePath(),
+                                  base::FilePath().AppendASCII("echo.html"));
+  content::TitleWatcher title_watcher(runtime()->web_contents(), kPassString);
+  title_watcher.AlsoWaitForTitle(kFailString);
+  xwalk_test_utils::NavigateToURL(runtime(), url);
+  EXPECT_EQ(kPassString, title_watcher.WaitAndGetTitle());
+}
+
+IN_PROC_BROWSER_TEST_F(XWalkExtensionProcessTest,
+                       SyncEchoFromExtensionProcess) {
+  content::RunAllPendingInMessageLoop();
+  WaitForExtensionProcess(runtime());
+  GURL url = GetExtensionsTestURL(
+      base::FilePath(), base::FilePath().AppendASCII("sync_echo.html"));
+  content::TitleWatcher title_watcher(runtime()->web_contents(), kPassString);
+  title_watcher.AlsoWaitForTitle(kFailString);
+  xwalk_test_utils::NavigateToURL(runtime(), url);
+  EXPECT_EQ(kPassString, title_watcher.WaitAndGetTitle());
+}
+
+IN_PROC_BROWSER_TEST_F(XWalkExtensionProcessTest,
+                       InstancesAreRecreatedAfterCrash) {
+  content::RunAllPendingInMessageLoop();
+  WaitForExtensionProcess(runtime());
+  GURL url = GetExtensionsTestURL(base::FilePath(),
+                                  base::FilePath().AppendASCII("echo.html"));
+  content::TitleWatcher title_watcher(runtime()->web_contents(), kPassString);
+  title_watcher.AlsoWaitForTitle(kFailString);
+  xwalk_test_utils::NavigateToURL(runtime(), url);
+  EXPECT_EQ(kPassString, title_watcher.WaitAndGetTitle());
+
+  KillExtensionProcesses();
+
+  // Messages posted before the browser notices the crash are lost, so the
+  // page keeps trying until the instance in the new process answers.
+  const string16 kRecoveredString = ASCIIToUTF16("Recovered");
+  content::TitleWatcher recovered_watcher(runtime()->web_contents(),
+                                          kRecoveredString);
+  ASSERT_TRUE(content::ExecuteScript(
+      runtime()->web_contents(),
+      "var timer = setInterval(function() {"
+      "  echo.echo('Recovered', function(msg) {"
+      "    clearInterval(timer);"
+      "    document.title = msg;"
+      "  });"
+      "}, 100);"));
+  EXPECT_EQ(kRecoveredString, recovered_watcher.WaitAndGetTitle());
+}
+
+IN_PROC_BROWSER_TEST_F(ExternalEchoExtensionTest, InProcessEchoLatency) {
+  content::RunAllPendingInMessageLoop();
+  MeasureEchoLatency(runtime(), "in_process");
+}
+
+IN_PROC_BROWSER_TEST_F(XWalkExtensionProcessTest, ExtensionProcessEchoLatency) {
+  content::RunAllPendingInMessageLoop();
+  MeasureEchoLatency(runtime(), "extension_process");
+}
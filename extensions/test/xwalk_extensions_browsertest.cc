@@ -4,17 +4,22 @@
 
 #include "xwalk/extensions/test/xwalk_extensions_test_base.h"
 
+#include "base/atomicops.h"
 #include "xwalk/extensions/browser/xwalk_extension_service.h"
 #include "xwalk/extensions/common/xwalk_extension.h"
 #include "xwalk/runtime/browser/runtime.h"
 #include "xwalk/test/base/in_process_browser_test.h"
 #include "xwalk/test/base/xwalk_test_utils.h"
+#include "content/public/browser/render_process_host.h"
+#include "content/public/browser/web_contents.h"
+#include "content/public/common/content_switches.h"
 #include "content/public/test/browser_test_utils.h"
 #include "content/public/test/test_utils.h"
 
 using xwalk::extensions::XWalkExtension;
 using xwalk::extensions::XWalkExtensionInstance;
 using xwalk::extensions::XWalkExtensionService;
+using xwalk::Runtime;
 
 class EchoContext : public XWalkExtensionInstance {
  public:
@@ -29,6 +34,10 @@ class EchoContext : public XWalkExtensionInstance {
       scoped_ptr<base::Value> msg) OVERRIDE {
     return msg.Pass();
   }
+  virtual void HandleRequest(int request_id,
+                             scoped_ptr<base::Value> msg) OVERRIDE {
+    PostReplyToJS(request_id, msg.Pass());
+  }
 };
 
 class EchoExtension : public XWalkExtension {
@@ -51,6 +60,9 @@ class EchoExtension : public XWalkExtension {
         "};"
         "exports.syncEcho = function(msg) {"
         "  return extension.internal.sendSyncMessage(msg);"
+        "};"
+        "exports.requestEcho = function(msg) {"
+        "  return extension.request(msg);"
         "};";
     return kAPI;
   }
@@ -72,9 +84,38 @@ class ExtensionWithInvalidName : public XWalkExtension {
       const XWalkExtension::PostMessageCallback& post_message) { return NULL; }
 };
 
+base::subtle::Atomic32 g_untouched_instances = 0;
+
+class UntouchedExtension : public XWalkExtension {
+ public:
+  UntouchedExtension() : XWalkExtension() {
+    set_name("untouched");
+  }
+
+  virtual const char* GetJavaScriptAPI() {
+    return "exports.ping = function() {};";
+  }
+
+  virtual XWalkExtensionInstance* CreateInstance(
+      const XWalkExtension::PostMessageCallback& post_message) {
+    base::subtle::NoBarrier_AtomicIncrement(&g_untouched_instances, 1);
+    return new EchoContext(post_message);
+  }
+};
+
+// Same as EchoExtension, registered while the page is running.
+class HotPluggedExtension : public EchoExtension {
+ public:
+  HotPluggedExtension() { set_name("hotplug"); }
+};
+
 class XWalkExtensionsTest : public XWalkExtensionsTestBase {
  public:
+  XWalkExtensionsTest() : extension_service_(NULL) {}
+
   void RegisterExtensions(XWalkExtensionService* extension_service) OVERRIDE {
+    extension_service_ = extension_service;
+
     bool registered = extension_service->RegisterExtension(
         scoped_ptr<XWalkExtension>(new EchoExtension));
     ASSERT_TRUE(registered);
@@ -82,7 +123,14 @@ class XWalkExtensionsTest : public XWalkExtensionsTestBase {
     bool invalid_registered = extension_service->RegisterExtension(
         scoped_ptr<XWalkExtension>(new ExtensionWithInvalidName));
     ASSERT_FALSE(invalid_registered);
+
+    registered = extension_service->RegisterExtension(
+        scoped_ptr<XWalkExtension>(new UntouchedExtension));
+    ASSERT_TRUE(registered);
   }
+
+ protected:
+  XWalkExtensionService* extension_service_;
 };
 
 IN_PROC_BROWSER_TEST_F(XWalkExtensionsTest, EchoExtension) {
@@ -105,3 +153,142 @@ IN_PROC_BROWSER_TEST_F(XWalkExtensionsTest, EchoExtensionSync) {
   xwalk_test_utils::NavigateToURL(runtime(), url);
   EXPECT_EQ(kPassString, title_watcher.WaitAndGetTitle());
 }
+
+IN_PROC_BROWSER_TEST_F(XWalkExtensionsTest, EchoExtensionRequest) {
+  content::RunAllPendingInMessageLoop();
+  GURL url = GetExtensionsTestURL(base::FilePath(),
+                                  base::FilePath().AppendASCII(
+                                      "request_echo.html"));
+  content::TitleWatcher title_watcher(runtime()->web_contents(), kPassString);
+  title_watcher.AlsoWaitForTitle(kFailString);
+  xwalk_test_utils::NavigateToURL(runtime(), url);
+  EXPECT_EQ(kPassString, title_watcher.WaitAndGetTitle());
+}
+
+IN_PROC_BROWSER_TEST_F(XWalkExtensionsTest, UnusedExtensionIsNotInstantiated) {
+  content::RunAllPendingInMessageLoop();
+  GURL url = GetExtensionsTestURL(base::FilePath(),
+                                  base::FilePath().AppendASCII("echo.html"));
+  content::TitleWatcher title_watcher(runtime()->web_contents(), kPassString);
+  title_watcher.AlsoWaitForTitle(kFailString);
+  xwalk_test_utils::NavigateToURL(runtime(), url);
+  EXPECT_EQ(kPassString, title_watcher.WaitAndGetTitle());
+  EXPECT_EQ(0, base::subtle::NoBarrier_Load(&g_untouched_instances));
+}
+
+IN_PROC_BROWSER_TEST_F(XWalkExtensionsTest, ExtensionRegisteredWhileRunning) {
+  content::RunAllPendingInMessageLoop();
+  GURL url = GetExtensionsTestURL(base::FilePath(),
+                                  base::FilePath().AppendASCII("hotplug.html"));
+
+  content::TitleWatcher waiting_title_watcher(runtime()->web_contents(),
+                                              ASCIIToUTF16("Waiting"));
+  xwalk_test_utils::NavigateToURL(runtime(), url);
+  waiting_title_watcher.WaitAndGetTitle();
+
+  // The page polls for the extension namespace, which shows up in its
+  // existing context.
+  content::TitleWatcher title_watcher(runtime()->web_contents(), kPassString);
+  title_watcher.AlsoWaitForTitle(kFailString);
+  ASSERT_TRUE(extension_service_->RegisterExtension(
+      scoped_ptr<XWalkExtension>(new HotPluggedExtension)));
+  EXPECT_EQ(kPassString, title_watcher.WaitAndGetTitle());
+
+  EXPECT_TRUE(extension_service_->UnregisterExtension("hotplug"));
+  EXPECT_FALSE(extension_service_->UnregisterExtension("hotplug"));
+}
+
+namespace {
+
+// Sets the title once the presence of the 'hotplug' namespace in the page is
+// |present|. Checked with 'in', since getting it would load the extension.
+std::string WaitForHotplugScript(bool present) {
+  return std::string(
+      "(function poll() {"
+      "  if (('hotplug' in window) == ") + (present ? "true" : "false") + ")"
+      "    document.title = '" + (present ? "Present" : "Absent") + "';"
+      "  else"
+      "    setTimeout(poll, 50);"
+      "})();";
+}
+
+}  // namespace
+
+// An extension registered while a page is open shows up in it, and once
+// unregistered its namespace goes away from that page, as it was never
+// used there, and isn't in the pages loaded later.
+IN_PROC_BROWSER_TEST_F(XWalkExtensionsTest,
+                       ExtensionUnregisteredWhileRunning) {
+  content::RunAllPendingInMessageLoop();
+  GURL url = GetExtensionsTestURL(base::FilePath(),
+                                  base::FilePath().AppendASCII("echo.html"));
+  xwalk_test_utils::NavigateToURL(runtime(), url);
+
+  bool present = true;
+  ASSERT_TRUE(content::ExecuteScriptAndExtractBool(
+      runtime()->web_contents(),
+      "window.domAutomationController.send('hotplug' in window);",
+      &present));
+  EXPECT_FALSE(present);
+
+  content::TitleWatcher present_watcher(runtime()->web_contents(),
+                                        ASCIIToUTF16("Present"));
+  ASSERT_TRUE(extension_service_->RegisterExtension(
+      scoped_ptr<XWalkExtension>(new HotPluggedExtension)));
+  ASSERT_TRUE(content::ExecuteScript(runtime()->web_contents(),
+                                     WaitForHotplugScript(true)));
+  EXPECT_EQ(ASCIIToUTF16("Present"), present_watcher.WaitAndGetTitle());
+
+  content::TitleWatcher absent_watcher(runtime()->web_contents(),
+                                       ASCIIToUTF16("Absent"));
+  ASSERT_TRUE(extension_service_->UnregisterExtension("hotplug"));
+  ASSERT_TRUE(content::ExecuteScript(runtime()->web_contents(),
+                                     WaitForHotplugScript(false)));
+  EXPECT_EQ(ASCIIToUTF16("Absent"), absent_watcher.WaitAndGetTitle());
+
+  xwalk_test_utils::NavigateToURL(runtime(), url);
+  present = true;
+  ASSERT_TRUE(content::ExecuteScriptAndExtractBool(
+      runtime()->web_contents(),
+      "window.domAutomationController.send('hotplug' in window);",
+      &present));
+  EXPECT_FALSE(present);
+}
+
+class XWalkExtensionsMultiProcessTest : public XWalkExtensionsTest {
+ public:
+  virtual void SetUpCommandLine(CommandLine* command_line) OVERRIDE {
+    command_line->AppendSwitch(switches::kProcessPerTab);
+  }
+};
+
+IN_PROC_BROWSER_TEST_F(XWalkExtensionsMultiProcessTest,
+                       ExtensionsWorkInEveryRenderProcess) {
+  content::RunAllPendingInMessageLoop();
+  GURL url = GetExtensionsTestURL(base::FilePath(),
+                                  base::FilePath().AppendASCII("echo.html"));
+
+  content::TitleWatcher title_watcher(runtime()->web_contents(), kPassString);
+  title_watcher.AlsoWaitForTitle(kFailString);
+  xwalk_test_utils::NavigateToURL(runtime(), url);
+  EXPECT_EQ(kPassString, title_watcher.WaitAndGetTitle());
+
+  Runtime* new_runtime = Runtime::Create(runtime()->runtime_context(), url);
+  EXPECT_NE(runtime()->web_contents()->GetRenderProcessHost(),
+            new_runtime->web_contents()->GetRenderProcessHost());
+  content::TitleWatcher new_title_watcher(new_runtime->web_contents(),
+                                          kPassString);
+  new_title_watcher.AlsoWaitForTitle(kFailString);
+  EXPECT_EQ(kPassString, new_title_watcher.WaitAndGetTitle());
+
+  // Closing the first render process must not affect the instances of the
+  // second one.
+  runtime()->Close();
+  content::RunAllPendingInMessageLoop();
+
+  content::TitleWatcher reload_title_watcher(new_runtime->web_contents(),
+                                             kPassString);
+  reload_title_watcher.AlsoWaitForTitle(kFailString);
+  xwalk_test_utils::NavigateToURL(new_runtime, url);
+  EXPECT_EQ(kPassString, reload_title_watcher.WaitAndGetTitle());
+}
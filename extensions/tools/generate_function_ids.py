@@ -0,0 +1,124 @@
+# Copyright (c) 2013 Intel Corporation. All rights reserved.
+# Use of this source code is governed by a BSD-style license that can be
+# found in the LICENSE file.
+
+"""Generates the function and event ids of IDL files, for internal extensions.
+
+For each IDL file, writes <name>_functions.h with enums numbering the
+functions and the events of the namespace in the order they are declared,
+and the same numbering as JavaScript. The JS API code of the extension sends
+the ids instead of the names, and XWalkInternalExtensionInstance uses them as
+indexes of its dispatch and event listener tables.
+"""
+
+import optparse
+import os
+import sys
+
+TEMPLATE = """\
+// Generated from %(source)s by generate_function_ids.py, DO NOT EDIT.
+
+#ifndef %(guard)s
+#define %(guard)s
+
+%(open_namespaces)s
+
+enum FunctionId {
+%(function_values)s  kFunctionCount = %(function_count)d
+};
+
+enum EventId {
+%(event_values)s  kEventCount = %(event_count)d
+};
+
+// Defines 'functionIds' and 'eventIds' for the JS API code, mapping the
+// names to the ids above. See XWalkInternalExtension::SetJavaScriptAPI().
+const char kFunctionIdsSource[] =
+    "var functionIds = {%(js_function_values)s}; "
+    "var eventIds = {%(js_event_values)s};";
+
+%(close_namespaces)s
+
+#endif  // %(guard)s
+"""
+
+
+def LoadNamespace(idl_path):
+  import idl_schema
+  namespaces = idl_schema.Load(idl_path)
+  if len(namespaces) != 1:
+    raise Exception('%s should have a single namespace' % idl_path)
+  return namespaces[0]
+
+
+def EnumValues(names):
+  return ''.join('  k%s%s = %d,\n' % (name[0].upper(), name[1:], i)
+                 for i, name in enumerate(names))
+
+
+def JSValues(names):
+  return ', '.join('\\"%s\\": %d' % (name, i)
+                   for i, name in enumerate(names))
+
+
+def GenerateHeader(idl_path, root_namespace, cc_dir, output_dir):
+  namespace = LoadNamespace(idl_path)
+  functions = [f['name'] for f in namespace.get('functions', [])]
+  events = [e['name'] for e in namespace.get('events', [])]
+  basename = os.path.splitext(os.path.basename(idl_path))[0]
+  header_name = '%s_functions.h' % basename
+
+  guard = ('%s/%s' % (cc_dir, header_name)).upper()
+  for c in '/.':
+    guard = guard.replace(c, '_')
+  guard += '_'
+
+  namespaces = root_namespace.split('::') + [namespace['namespace']]
+  open_namespaces = '\n'.join('namespace %s {' % n for n in namespaces)
+  close_namespaces = '\n'.join('}  // namespace %s' % n
+                               for n in reversed(namespaces))
+
+  output = open(os.path.join(output_dir, header_name), 'w')
+  output.write(TEMPLATE % {
+      'source': os.path.basename(idl_path),
+      'guard': guard,
+      'open_namespaces': open_namespaces,
+      'close_namespaces': close_namespaces,
+      'function_values': EnumValues(functions),
+      'function_count': len(functions),
+      'event_values': EnumValues(events),
+      'event_count': len(events),
+      'js_function_values': JSValues(functions),
+      'js_event_values': JSValues(events),
+  })
+  output.close()
+
+
+def main():
+  parser = optparse.OptionParser(
+      usage='%prog [options] idl_file [idl_file ...]')
+  parser.add_option('--schema-compiler-dir',
+                    help='Directory of the Chromium JSON schema compiler, '
+                         'used to parse the IDL files.')
+  parser.add_option('--root-namespace',
+                    help='C++ namespace of the generated code.')
+  parser.add_option('--cc-dir',
+                    help='Directory of the generated headers, relative to '
+                         'the include path.')
+  parser.add_option('--destdir',
+                    help='Root directory of the generated headers.')
+  options, idl_files = parser.parse_args()
+
+  sys.path.insert(0, options.schema_compiler_dir)
+  output_dir = os.path.join(options.destdir, options.cc_dir)
+  if not os.path.isdir(output_dir):
+    os.makedirs(output_dir)
+
+  for idl_file in idl_files:
+    GenerateHeader(idl_file, options.root_namespace, options.cc_dir,
+                   output_dir)
+  return 0
+
+
+if __name__ == '__main__':
+  sys.exit(main())
@@ -17,5 +17,31 @@
         'cc_dir': 'xwalk/jsapi',
         'root_namespace': 'xwalk::jsapi',
       },
+      'actions': [
+        {
+          # Ids of the functions, for XWalkInternalExtensionInstance.
+          'action_name': 'generate_function_ids',
+          'inputs': [
+            '../extensions/tools/generate_function_ids.py',
+            '<@(schema_files)',
+          ],
+          # One header for each of the schema files. This can't be a rule,
+          # json_schema_compile.gypi already has the one for .idl files.
+          'outputs': [
+            '<(SHARED_INTERMEDIATE_DIR)/<(cc_dir)/dialog_functions.h',
+            '<(SHARED_INTERMEDIATE_DIR)/<(cc_dir)/runtime_functions.h',
+          ],
+          'action': [
+            'python',
+            '../extensions/tools/generate_function_ids.py',
+            '--schema-compiler-dir=<(DEPTH)/tools/json_schema_compiler',
+            '--root-namespace=<(root_namespace)',
+            '--cc-dir=<(cc_dir)',
+            '--destdir=<(SHARED_INTERMEDIATE_DIR)',
+            '<@(schema_files)',
+          ],
+          'message': 'Generating function ids of <(cc_dir)',
+        },
+      ],
    }],
 }
@@ -20,6 +20,8 @@
 #include "xwalk/application/common/application_manifest_constants.h"
 #include "xwalk/experimental/dialog/dialog_extension.h"
 #include "xwalk/extensions/browser/xwalk_extension_service.h"
+#include "xwalk/extensions/common/xwalk_extension_switches.h"
+#include "xwalk/extensions/common/xwalk_extension_threaded_runner.h"
 #include "xwalk/runtime/browser/devtools/remote_debugging_server.h"
 #include "xwalk/runtime/browser/runtime.h"
 #include "xwalk/runtime/browser/runtime_context.h"
@@ -196,6 +198,9 @@ void XWalkBrowserMainParts::PreMainMessageLoopRun() {
 #else
   runtime_context_.reset(new RuntimeContext);
   runtime_registry_.reset(new RuntimeRegistry);
+  // The servers create the pooled runners in the IO thread, but the pool is
+  // shut down from here.
+  extensions::XWalkExtensionThreadedRunner::InitializeWorkerPool();
   extension_service_.reset(
       new extensions::XWalkExtensionService());
 
@@ -203,6 +208,11 @@ void XWalkBrowserMainParts::PreMainMessageLoopRun() {
   RegisterExternalExtensions();
 
   CommandLine* command_line = CommandLine::ForCurrentProcess();
+  if (!command_line->HasSwitch(switches::kXWalkDisableExtensionCodeCache)) {
+    extension_service_->SetCodeCacheDirectory(
+        runtime_context_->GetPath().Append(
+            FILE_PATH_LITERAL("ExtensionCodeCache")));
+  }
   if (command_line->HasSwitch(switches::kRemoteDebuggingPort)) {
     std::string port_str =
         command_line->GetSwitchValueASCII(switches::kRemoteDebuggingPort);
@@ -318,6 +328,7 @@ void XWalkBrowserMainParts::PostMainMessageLoopRun() {
   base::MessageLoopForUI::current()->Start();
 #else
   runtime_context_.reset();
+  extensions::XWalkExtensionThreadedRunner::ShutdownWorkerPool();
 #endif
 }
 
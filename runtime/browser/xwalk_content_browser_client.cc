@@ -9,7 +9,12 @@
 #include "base/command_line.h"
 #include "base/path_service.h"
 #include "base/platform_file.h"
+#include "xwalk/application/browser/application_service.h"
+#include "xwalk/application/browser/application_system.h"
+#include "xwalk/application/common/application.h"
+#include "xwalk/application/common/application_manifest_constants.h"
 #include "xwalk/extensions/browser/xwalk_extension_service.h"
+#include "xwalk/extensions/common/xwalk_extension_switches.h"
 #include "xwalk/runtime/browser/xwalk_browser_main_parts.h"
 #include "xwalk/runtime/browser/geolocation/xwalk_access_token_store.h"
 #include "xwalk/runtime/browser/media/media_capture_devices_dispatcher.h"
@@ -81,6 +86,17 @@ content::BrowserMainParts* XWalkContentBrowserClient::CreateBrowserMainParts(
   return main_parts_;
 }
 
+void XWalkContentBrowserClient::AppendExtraCommandLineSwitches(
+    CommandLine* command_line, int child_process_id) {
+  // Renderers need to know the extension process is used, so they wait for
+  // its extensions.
+  static const char* const kSwitchNames[] = {
+    switches::kXWalkEnableExtensionProcess,
+  };
+  command_line->CopySwitchesFrom(*CommandLine::ForCurrentProcess(),
+                                 kSwitchNames, arraysize(kSwitchNames));
+}
+
 net::URLRequestContextGetter* XWalkContentBrowserClient::CreateRequestContext(
     content::BrowserContext* browser_context,
     content::ProtocolHandlerMap* protocol_handlers) {
@@ -118,7 +134,21 @@ XWalkContentBrowserClient::GetWebContentsViewDelegate(
 void XWalkContentBrowserClient::RenderProcessHostCreated(
     content::RenderProcessHost* host) {
 #if !defined(OS_ANDROID)
-  main_parts_->extension_service()->OnRenderProcessHostCreated(host);
+  extensions::XWalkExtensionService* extension_service =
+      main_parts_->extension_service();
+
+  // The running application is known before its first render process is
+  // created, and doesn't change afterwards.
+  const application::Application* application =
+      main_parts_->runtime_context()->GetApplicationSystem()->
+          application_service()->GetRunningApplication();
+  const base::DictionaryValue* frame_policy;
+  if (application && application->GetManifest()->GetDictionary(
+          application_manifest_keys::kXWalkExtensionsKey, &frame_policy)) {
+    extension_service->SetFramePolicy(*frame_policy);
+  }
+
+  extension_service->OnRenderProcessHostCreated(host);
 #else
   // Extension in Android is not supported currently.
   NOTIMPLEMENTED();
@@ -5,6 +5,7 @@
 #include "xwalk/runtime/common/xwalk_content_client.h"
 
 #include "base/command_line.h"
+#include "base/logging.h"
 #include "base/strings/string_piece.h"
 #include "base/strings/utf_string_conversions.h"
 #include "content/public/common/content_switches.h"
@@ -12,6 +13,7 @@
 #include "ui/base/resource/resource_bundle.h"
 #include "webkit/common/user_agent/user_agent_util.h"
 #include "xwalk/application/common/constants.h"
+#include "xwalk/extensions/common/xwalk_extension_process_type.h"
 
 namespace xwalk {
 
@@ -61,4 +63,14 @@ void XWalkContentClient::AddAdditionalSchemes(
   savable_schemes->push_back(application::kApplicationScheme);
 }
 
+std::string XWalkContentClient::GetProcessTypeNameInEnglish(int type) {
+  switch (type) {
+    case extensions::PROCESS_TYPE_EXTENSION:
+      return "Extension Process";
+  }
+
+  NOTREACHED() << "Unknown child process type!";
+  return "Unknown";
+}
+
 }  // namespace xwalk
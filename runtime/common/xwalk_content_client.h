@@ -30,6 +30,7 @@ class XWalkContentClient : public content::ContentClient {
   virtual void AddAdditionalSchemes(
       std::vector<std::string>* standard_schemes,
       std::vector<std::string>* saveable_shemes) OVERRIDE;
+  virtual std::string GetProcessTypeNameInEnglish(int type) OVERRIDE;
 
  private:
   DISALLOW_COPY_AND_ASSIGN(XWalkContentClient);
@@ -25,4 +25,8 @@ const char kXWalkExternalExtensionsPath[] = "external-extensions-path";
 const char kXWalkAllowExternalExtensionsForRemoteSources[] =
     "allow-external-extensions-for-remote-sources";
 
+// Lets pages read the extension message counters with
+// xwalk.runtime.getExtensionMetrics(), which otherwise returns no entries.
+const char kXWalkEnableExtensionMetrics[] = "enable-extension-metrics";
+
 }  // namespace switches
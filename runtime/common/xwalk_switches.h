@@ -20,6 +20,8 @@ extern const char kXWalkExternalExtensionsPath[];
 
 extern const char kXWalkAllowExternalExtensionsForRemoteSources[];
 
+extern const char kXWalkEnableExtensionMetrics[];
+
 }  // namespace switches
 
 #endif  // XWALK_RUNTIME_COMMON_XWALK_SWITCHES_H_
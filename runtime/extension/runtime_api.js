@@ -6,5 +6,9 @@ extension._setupExtensionInternal();
 var internal = extension._internal;
 
 exports.getAPIVersion = function(callback) {
-  internal.postMessage('getAPIVersion', [], callback);
+  internal.postMessage(functionIds.getAPIVersion, [], callback);
+}
+
+exports.getExtensionMetrics = function(callback) {
+  internal.postMessage(functionIds.getExtensionMetrics, [], callback);
 }
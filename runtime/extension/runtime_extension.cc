@@ -4,8 +4,14 @@
 
 #include "xwalk/runtime/extension/runtime_extension.h"
 
+#include <vector>
 #include "base/bind.h"
+#include "base/command_line.h"
+#include "base/memory/linked_ptr.h"
+#include "xwalk/extensions/common/xwalk_extension_metrics.h"
 #include "xwalk/jsapi/runtime.h"
+#include "xwalk/jsapi/runtime_functions.h"
+#include "xwalk/runtime/common/xwalk_switches.h"
 
 extern const char kSource_runtime_api[];
 
@@ -13,10 +19,7 @@ namespace xwalk {
 
 RuntimeExtension::RuntimeExtension() {
   set_name("xwalk.runtime");
-}
-
-const char* RuntimeExtension::GetJavaScriptAPI() {
-  return kSource_runtime_api;
+  SetJavaScriptAPI(jsapi::runtime::kFunctionIdsSource, kSource_runtime_api);
 }
 
 XWalkExtensionInstance* RuntimeExtension::CreateInstance(
@@ -27,13 +30,55 @@ XWalkExtensionInstance* RuntimeExtension::CreateInstance(
 RuntimeInstance::RuntimeInstance(
     const XWalkExtension::PostMessageCallback& post_message)
   : XWalkInternalExtensionInstance(post_message) {
-  RegisterFunction("getAPIVersion", &RuntimeInstance::OnGetAPIVersion);
+  RegisterFunction(jsapi::runtime::kGetAPIVersion,
+                   &RuntimeInstance::OnGetAPIVersion);
+  RegisterFunction(jsapi::runtime::kGetExtensionMetrics,
+                   &RuntimeInstance::OnGetExtensionMetrics);
 }
 
-void RuntimeInstance::OnGetAPIVersion(
-    const std::string&, const std::string& callback_id,
-    base::ListValue* args) {
+void RuntimeInstance::OnGetAPIVersion(int callback_id) {
   PostResult(callback_id, jsapi::runtime::GetAPIVersion::Results::Create(1));
 };
 
+void RuntimeInstance::OnGetExtensionMetrics(int callback_id) {
+  using extensions::XWalkExtensionMetrics;
+  using jsapi::runtime::ExtensionMetrics;
+
+  // The counters cover every extension of the process, used by all the
+  // pages it hosts, so they are only given out when asked for.
+  std::vector<linked_ptr<ExtensionMetrics> > metrics;
+  if (!CommandLine::ForCurrentProcess()->HasSwitch(
+          switches::kXWalkEnableExtensionMetrics)) {
+    PostResult(callback_id,
+               jsapi::runtime::GetExtensionMetrics::Results::Create(metrics));
+    return;
+  }
+
+  XWalkExtensionMetrics::CountersMap counters;
+  XWalkExtensionMetrics::GetInstance()->GetCounters(&counters);
+
+  XWalkExtensionMetrics::CountersMap::const_iterator it = counters.begin();
+  for (; it != counters.end(); ++it) {
+    const XWalkExtensionMetrics::Counters& c = it->second;
+    linked_ptr<ExtensionMetrics> m(new ExtensionMetrics);
+    m->name = it->first;
+    m->messages_in = c.messages_in;
+    m->bytes_in = c.bytes_in;
+    m->messages_out = c.messages_out;
+    m->bytes_out = c.bytes_out;
+    m->sync_messages = c.sync_messages;
+    m->dropped_messages = c.dropped_messages;
+    m->queue_depth = c.queue_depth;
+    m->max_queue_depth = c.max_queue_depth;
+    m->handler_time = c.handler_time.InMillisecondsF();
+    m->max_handler_time = c.max_handler_time.InMillisecondsF();
+    m->sync_reply_time = c.sync_reply_time.InMillisecondsF();
+    m->max_sync_reply_time = c.max_sync_reply_time.InMillisecondsF();
+    metrics.push_back(m);
+  }
+
+  PostResult(callback_id,
+             jsapi::runtime::GetExtensionMetrics::Results::Create(metrics));
+}
+
 }  // namespace xwalk
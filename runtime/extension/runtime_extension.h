@@ -19,8 +19,6 @@ class RuntimeExtension : public XWalkInternalExtension {
  public:
   RuntimeExtension();
 
-  virtual const char* GetJavaScriptAPI() OVERRIDE;
-
   virtual XWalkExtensionInstance* CreateInstance(
       const XWalkExtension::PostMessageCallback& post_message) OVERRIDE;
 };
@@ -31,8 +29,8 @@ class RuntimeInstance : public XWalkInternalExtensionInstance {
       const XWalkExtension::PostMessageCallback& post_message);
 
  private:
-  void OnGetAPIVersion(const std::string& function_name,
-                       const std::string& callback_id, base::ListValue* args);
+  void OnGetAPIVersion(int callback_id);
+  void OnGetExtensionMetrics(int callback_id);
 };
 
 }  // namespace xwalk
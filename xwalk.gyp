@@ -533,6 +533,7 @@
           'dependencies': [
             'xwalk',
             'xwalk_browsertest',
+            'xwalk_extensions_perftest',
             'xwalk_unittest',
           ],
         },